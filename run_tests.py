@@ -8,6 +8,13 @@ import sys
 import unittest
 import time
 import platform
+import json
+try:
+    from http.client import HTTPConnection
+    from urllib.parse import urlencode
+except ImportError:
+    from httplib import HTTPConnection
+    from urllib import urlencode
 
 def safe_remove(fname):
     try:
@@ -29,6 +36,8 @@ if not os.path.exists(files_dir):
 
 node_process=None
 ck_dir='tests-ck-master'
+node_host='localhost'
+node_port=3333
 
 def die(retcode):
     os.chdir(script_dir)
@@ -48,6 +57,17 @@ else:
     node_env['HOME'] = script_dir
     shutil.copyfile(config_file_sample_linux, config_file)
 
+# the tests cover the content store as well, and limits small enough to be reached
+with open(config_file) as f:
+    config = json.load(f)
+config['content_store'] = 1
+config['max_upload_size'] = 64
+config['keep_alive_timeout'] = 2
+config['keep_alive_max_requests'] = 4
+config['max_running_jobs'] = 2
+with open(config_file, 'w') as f:
+    json.dump(config, f)
+
 node_process = subprocess.Popen(['build/ck-crowdnode-server'], env=node_env)
 
 shutil.rmtree(ck_dir, ignore_errors=True)
@@ -63,7 +83,7 @@ import ck.kernel as ck
 test_repo_name = 'ck-crowdnode-auto-tests'
 test_repo_cid = test_repo_name + '::'
 r = ck.access({'module_uoa': 'repo', 'data_uoa': test_repo_name, 'action': 'remove', 'force': 'yes', 'all': 'yes'})
-r = ck.access({'remote': 'yes', 'module_uoa': 'repo', 'url': 'http://localhost:3333', 'quiet': 'yes', 'data_uoa': test_repo_name, 'action': 'add'})
+r = ck.access({'remote': 'yes', 'module_uoa': 'repo', 'url': 'http://%s:%d' % (node_host, node_port), 'quiet': 'yes', 'data_uoa': test_repo_name, 'action': 'add'})
 if r['return']>0:
     print('Unable to create test repo. ' + r.get('error', ''))
     die(1)
@@ -74,7 +94,13 @@ module_cfg = {
     'secret_key': 'c4e239b4-8471-11e6-b24d-cbfef11692ca',
     'platform': platform.system(),
     'repo_name': test_repo_name,
-    'cid': test_repo_cid
+    'cid': test_repo_cid,
+    'files_dir': files_dir,
+    'host': node_host,
+    'port': node_port,
+    'keep_alive_timeout': config['keep_alive_timeout'],
+    'keep_alive_max_requests': config['keep_alive_max_requests'],
+    'max_running_jobs': config['max_running_jobs']
 }
 
 def access_test_repo(param_dict):
@@ -85,11 +111,33 @@ def access_test_repo(param_dict):
         raise AssertionError('Failed to access test repo. Call parameters:\n ' + str(d) + '\nResult:\n ' + str(r))
     return r
 
+def send_request(method, path, body=None, headers={}):
+    # the body may be compressed, see Content-Encoding
+    conn = HTTPConnection(node_host, node_port, timeout=30)
+    try:
+        conn.request(method, path, body, headers)
+        response = conn.getresponse()
+        return response.status, dict((k.lower(), v) for k, v in response.getheaders()), response.read()
+    finally:
+        conn.close()
+
+def send_command(param_dict, headers={}, path='/'):
+    d = {'secretkey': module_cfg['secret_key']}
+    d.update(param_dict)
+    h = {'Content-Type': 'application/x-www-form-urlencoded'}
+    h.update(headers)
+    status, response_headers, body = send_request('POST', path, urlencode({'ck_json': json.dumps(d)}), h)
+    r = json.loads(body.decode('utf-8'))
+    r['http_status'] = status
+    return r
+
 class CkTestLoader(unittest.TestLoader):
     def loadTestsFromModule(self, module, pattern=None):
         module.ck = ck
         module.cfg = module_cfg
         module.access_test_repo = access_test_repo
+        module.send_request = send_request
+        module.send_command = send_command
         return unittest.TestLoader.loadTestsFromModule(self, module, pattern)
 
 suite = CkTestLoader().discover(tests_dir, pattern='test_*.py')
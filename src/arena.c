@@ -0,0 +1,162 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+#ifdef _MSC_VER
+#define ARENA_THREAD_LOCAL __declspec(thread)
+#else
+#define ARENA_THREAD_LOCAL __thread
+#endif
+
+#define ARENA_ALIGN 16
+#define ARENA_MAX_BLOCK_SIZE (8 * 1024 * 1024)  /* blocks grow geometrically up to this size */
+
+typedef struct arena_block {
+    struct arena_block *next;
+    char *ptr;          /* next free byte */
+    char *end;
+    int dedicated;      /* holds a single large allocation */
+} arena_block_t;
+
+#define BLOCK_HEADER ((sizeof(arena_block_t) + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1))
+#define BLOCK_DATA(block) ((char *) (block) + BLOCK_HEADER)
+
+struct arena {
+    arena_block_t *blocks;      /* the block allocations are taken from, followed by the older ones */
+    arena_block_t *first;       /* block kept by arena_reset() */
+    size_t blockSize;
+    size_t nextBlockSize;
+};
+
+static ARENA_THREAD_LOCAL arena_t *current = NULL;
+
+static arena_block_t *new_block(size_t size) {
+    arena_block_t *block = malloc(BLOCK_HEADER + size);
+    if (!block) {
+        return NULL;
+    }
+    block->next = NULL;
+    block->ptr = BLOCK_DATA(block);
+    block->end = block->ptr + size;
+    block->dedicated = 0;
+    return block;
+}
+
+arena_t *arena_create(size_t blockSize) {
+    arena_t *arena = malloc(sizeof(arena_t));
+    if (!arena) {
+        return NULL;
+    }
+    arena->first = arena->blocks = new_block(blockSize);
+    if (!arena->first) {
+        free(arena);
+        return NULL;
+    }
+    arena->blockSize = blockSize;
+    arena->nextBlockSize = blockSize * 2;
+    return arena;
+}
+
+void arena_destroy(arena_t *arena) {
+    if (!arena) {
+        return;
+    }
+    if (current == arena) {
+        current = NULL;
+    }
+    while (arena->blocks) {
+        arena_block_t *next = arena->blocks->next;
+        free(arena->blocks);
+        arena->blocks = next;
+    }
+    free(arena);
+}
+
+void *arena_alloc(arena_t *arena, size_t size) {
+    arena_block_t *block = arena->blocks;
+    if (size > SIZE_MAX - BLOCK_HEADER - ARENA_ALIGN) {
+        return NULL;
+    }
+    size = size ? (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1) : ARENA_ALIGN;
+
+    if ((size_t) (block->end - block->ptr) < size) {
+        if (size > arena->nextBlockSize / 4) {
+            // large allocations get a block of their own behind the current one, which stays in use
+            block = new_block(size);
+            if (!block) {
+                return NULL;
+            }
+            block->dedicated = 1;
+            block->ptr = block->end;
+            block->next = arena->blocks->next;
+            arena->blocks->next = block;
+            return BLOCK_DATA(block);
+        }
+        block = new_block(arena->nextBlockSize);
+        if (!block) {
+            return NULL;
+        }
+        if (arena->nextBlockSize < ARENA_MAX_BLOCK_SIZE) {
+            arena->nextBlockSize *= 2;
+        }
+        block->next = arena->blocks;
+        arena->blocks = block;
+    }
+
+    void *ptr = block->ptr;
+    block->ptr += size;
+    return ptr;
+}
+
+void arena_reset(arena_t *arena) {
+    arena_block_t *block = arena->blocks;
+    while (block) {
+        arena_block_t *next = block->next;
+        if (block != arena->first) {
+            free(block);
+        }
+        block = next;
+    }
+    arena->first->next = NULL;
+    arena->first->ptr = BLOCK_DATA(arena->first);
+    arena->blocks = arena->first;
+    arena->nextBlockSize = arena->blockSize * 2;
+}
+
+void arena_begin(arena_t *arena) {
+    current = arena;
+}
+
+void arena_end(void) {
+    if (current) {
+        arena_reset(current);
+    }
+    current = NULL;
+}
+
+void *arena_malloc(size_t size) {
+    return current ? arena_alloc(current, size) : malloc(size);
+}
+
+void arena_free(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+    if (current) {
+        arena_block_t **link = &current->blocks;
+        while (*link) {
+            arena_block_t *block = *link;
+            if ((char *) ptr >= BLOCK_DATA(block) && (char *) ptr < block->end) {
+                if (block->dedicated) {
+                    // large allocations are given back right away
+                    *link = block->next;
+                    free(block);
+                }
+                return;
+            }
+            link = &block->next;
+        }
+    }
+    free(ptr);
+}
@@ -0,0 +1,72 @@
+#ifndef CK_ARENA_H
+#define CK_ARENA_H
+
+#include <stddef.h>
+
+/**
+ * Region allocator for the short lived allocations of one request. Memory is taken from large blocks by moving a
+ * pointer and is released all at once by arena_reset(). An arena is not thread safe, every event loop has its own.
+ */
+typedef struct arena arena_t;
+
+/**
+ * create an arena
+ *
+ * @param blockSize size of the first block, which is kept by arena_reset()
+ * @return the arena or NULL if memory could not be allocated
+ */
+arena_t *arena_create(size_t blockSize);
+
+/**
+ * free the arena and all memory allocated from it
+ *
+ * @param arena the arena, may be NULL
+ */
+void arena_destroy(arena_t *arena);
+
+/**
+ * allocate memory from the arena, aligned for any type
+ *
+ * @param arena the arena
+ * @param size number of bytes
+ * @return the memory or NULL if it could not be allocated
+ */
+void *arena_alloc(arena_t *arena, size_t size);
+
+/**
+ * release all memory allocated from the arena, keeping the first block for reuse
+ *
+ * @param arena the arena
+ */
+void arena_reset(arena_t *arena);
+
+/**
+ * make the arena the current one of the calling thread, so that arena_malloc() allocates from it
+ *
+ * @param arena the arena, NULL means plain malloc
+ */
+void arena_begin(arena_t *arena);
+
+/**
+ * reset the current arena of the calling thread and go back to plain malloc
+ */
+void arena_end(void);
+
+/**
+ * allocate from the current arena of the calling thread or with malloc() if there is none
+ * (suitable for cJSON_InitHooks())
+ *
+ * @param size number of bytes
+ * @return the memory or NULL if it could not be allocated
+ */
+void *arena_malloc(size_t size);
+
+/**
+ * release memory from arena_malloc(): memory of the current arena is released by arena_end(), anything else is
+ * passed to free(). Memory of an arena must not be used or released after its arena_end().
+ *
+ * @param ptr the memory, may be NULL
+ */
+void arena_free(void *ptr);
+
+#endif
@@ -4,50 +4,331 @@
 
 #include "base64.h"
 
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define BASE64_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define BASE64_TARGET(isa)
+#else
+#include <cpuid.h>
+#define BASE64_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
 /**
  * characters used for Base64 encoding
  */
 const char *BASE64_CHARS = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
 /**
- * encode three bytes using base64 (RFC 3548)
- *
- * @param triple three bytes that should be encoded
- * @param result buffer of four characters where the result is stored
+ * values of the Base64 characters, -1 for characters outside the alphabet
+ * (both '+' '/' and the URL safe '-' '_' are accepted for 62 and 63)
  */
-void _base64_encode_triple(unsigned char triple[3], char result[4]) {
-    int tripleValue, i;
+static const signed char BASE64_VALUES[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, 62, -1, 63,
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+    -1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, 63,
+    -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+/**
+ * vectorized kernels: they process whole blocks only and return the number of source bytes consumed,
+ * leaving the rest to the scalar code
+ */
+typedef size_t (*base64_encode_kernel_t)(const unsigned char *source, size_t sourcelen, char *target);
+typedef size_t (*base64_decode_kernel_t)(const char *source, size_t sourcelen, unsigned char *target, size_t targetlen);
+typedef size_t (*base64_valid_kernel_t)(const char *source, size_t sourcelen);
 
-    tripleValue = triple[0];
-    tripleValue *= 256;
-    tripleValue += triple[1];
-    tripleValue *= 256;
-    tripleValue += triple[2];
+static base64_encode_kernel_t encode_kernel = NULL;
+static base64_decode_kernel_t decode_kernel = NULL;
+static base64_valid_kernel_t valid_kernel = NULL;
+static const char *implementation = "scalar";
+static volatile int initialized = 0;
 
-    for (i=0; i<4; i++) {
-        result[3-i] = BASE64_CHARS[tripleValue%64];
-        tripleValue /= 64;
+#ifdef BASE64_X86
+
+/**
+ * map 6 bit values to the characters of the standard alphabet (W. Mula's pshufb lookup)
+ */
+BASE64_TARGET("ssse3")
+static __m128i encode_lookup_ssse3(__m128i values) {
+    __m128i result = _mm_subs_epu8(values, _mm_set1_epi8(51));
+    __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), values);
+    result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+    const __m128i shift = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                        '/' - 63, 'A', 0, 0);
+    return _mm_add_epi8(_mm_shuffle_epi8(shift, result), values);
+}
+
+/**
+ * split the 12 bytes at the start of the register into 16 6 bit values, one per byte
+ */
+BASE64_TARGET("ssse3")
+static __m128i encode_unpack_ssse3(__m128i in) {
+    in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+    __m128i ac = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+    __m128i bd = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(ac, bd);
+}
+
+BASE64_TARGET("ssse3")
+static size_t encode_ssse3(const unsigned char *source, size_t sourcelen, char *target) {
+    size_t done = 0;
+    // 16 bytes are loaded for every 12 encoded
+    while (sourcelen - done >= 16) {
+        __m128i in = _mm_loadu_si128((const __m128i *) (source + done));
+        _mm_storeu_si128((__m128i *) target, encode_lookup_ssse3(encode_unpack_ssse3(in)));
+        done += 12;
+        target += 16;
     }
+    return done;
 }
 
 /**
- * encode an array of bytes using Base64 (RFC 3548)
+ * map characters of both alphabets to their 6 bit values, valid receives 0xff for every character in the alphabet
+ */
+BASE64_TARGET("ssse3")
+static __m128i decode_lookup_ssse3(__m128i in, __m128i *valid) {
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(in, _mm_set1_epi8('Z' + 1)));
+    __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(in, _mm_set1_epi8('z' + 1)));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(in, _mm_set1_epi8('9' + 1)));
+    __m128i v62 = _mm_or_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8('+')), _mm_cmpeq_epi8(in, _mm_set1_epi8('-')));
+    __m128i v63 = _mm_or_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8('/')), _mm_cmpeq_epi8(in, _mm_set1_epi8('_')));
+
+    __m128i shift = _mm_or_si128(_mm_and_si128(upper, _mm_set1_epi8(-'A')),
+                                 _mm_or_si128(_mm_and_si128(lower, _mm_set1_epi8(26 - 'a')),
+                                              _mm_and_si128(digit, _mm_set1_epi8(52 - '0'))));
+    __m128i values = _mm_and_si128(_mm_add_epi8(in, shift), _mm_or_si128(upper, _mm_or_si128(lower, digit)));
+    values = _mm_or_si128(values, _mm_or_si128(_mm_and_si128(v62, _mm_set1_epi8(62)), _mm_and_si128(v63, _mm_set1_epi8(63))));
+
+    *valid = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(digit, _mm_or_si128(v62, v63)));
+    return values;
+}
+
+/**
+ * join 16 6 bit values into 12 bytes at the start of the register
+ */
+BASE64_TARGET("ssse3")
+static __m128i decode_pack_ssse3(__m128i values) {
+    __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    __m128i quads = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+    return _mm_shuffle_epi8(quads, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+BASE64_TARGET("ssse3")
+static size_t decode_ssse3(const char *source, size_t sourcelen, unsigned char *target, size_t targetlen) {
+    size_t done = 0;
+    // 16 bytes are stored for every 12 decoded
+    while (sourcelen - done >= 16 && targetlen >= 16) {
+        __m128i valid;
+        __m128i values = decode_lookup_ssse3(_mm_loadu_si128((const __m128i *) (source + done)), &valid);
+        if (0xffff != _mm_movemask_epi8(valid)) {
+            break; // padding, line breaks or garbage are handled by the scalar code
+        }
+        _mm_storeu_si128((__m128i *) target, decode_pack_ssse3(values));
+        done += 16;
+        target += 12;
+        targetlen -= 12;
+    }
+    return done;
+}
+
+BASE64_TARGET("ssse3")
+static size_t valid_ssse3(const char *source, size_t sourcelen) {
+    size_t done = 0;
+    while (sourcelen - done >= 16) {
+        __m128i valid;
+        decode_lookup_ssse3(_mm_loadu_si128((const __m128i *) (source + done)), &valid);
+        if (0xffff != _mm_movemask_epi8(valid)) {
+            break;
+        }
+        done += 16;
+    }
+    return done;
+}
+
+BASE64_TARGET("avx2")
+static size_t encode_avx2(const unsigned char *source, size_t sourcelen, char *target) {
+    size_t done = 0;
+    const __m256i shuffle = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                             1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m256i shift = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                           '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                           '/' - 63, 'A', 0, 0,
+                                           'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                           '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                           '/' - 63, 'A', 0, 0);
+    // 12 bytes per 128 bit lane, the upper lane is loaded from source + 12
+    while (sourcelen - done >= 28) {
+        __m128i lo = _mm_loadu_si128((const __m128i *) (source + done));
+        __m128i hi = _mm_loadu_si128((const __m128i *) (source + done + 12));
+        __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+
+        in = _mm256_shuffle_epi8(in, shuffle);
+        __m256i ac = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+        __m256i bd = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+        __m256i values = _mm256_or_si256(ac, bd);
+
+        __m256i result = _mm256_subs_epu8(values, _mm256_set1_epi8(51));
+        __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), values);
+        result = _mm256_or_si256(result, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+        result = _mm256_add_epi8(_mm256_shuffle_epi8(shift, result), values);
+
+        _mm256_storeu_si256((__m256i *) target, result);
+        done += 24;
+        target += 32;
+    }
+    return done;
+}
+
+BASE64_TARGET("avx2")
+static size_t decode_avx2(const char *source, size_t sourcelen, unsigned char *target, size_t targetlen) {
+    size_t done = 0;
+    // 32 bytes are stored for every 24 decoded
+    while (sourcelen - done >= 32 && targetlen >= 32) {
+        __m256i in = _mm256_loadu_si256((const __m256i *) (source + done));
+        __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), in));
+        __m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), in));
+        __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), in));
+        __m256i v62 = _mm256_or_si256(_mm256_cmpeq_epi8(in, _mm256_set1_epi8('+')), _mm256_cmpeq_epi8(in, _mm256_set1_epi8('-')));
+        __m256i v63 = _mm256_or_si256(_mm256_cmpeq_epi8(in, _mm256_set1_epi8('/')), _mm256_cmpeq_epi8(in, _mm256_set1_epi8('_')));
+        __m256i valid = _mm256_or_si256(_mm256_or_si256(upper, lower), _mm256_or_si256(digit, _mm256_or_si256(v62, v63)));
+        if (-1 != _mm256_movemask_epi8(valid)) {
+            break; // padding, line breaks or garbage are handled by the scalar code
+        }
+
+        __m256i shift = _mm256_or_si256(_mm256_and_si256(upper, _mm256_set1_epi8(-'A')),
+                                        _mm256_or_si256(_mm256_and_si256(lower, _mm256_set1_epi8(26 - 'a')),
+                                                        _mm256_and_si256(digit, _mm256_set1_epi8(52 - '0'))));
+        __m256i values = _mm256_and_si256(_mm256_add_epi8(in, shift), _mm256_or_si256(upper, _mm256_or_si256(lower, digit)));
+        values = _mm256_or_si256(values, _mm256_or_si256(_mm256_and_si256(v62, _mm256_set1_epi8(62)),
+                                                         _mm256_and_si256(v63, _mm256_set1_epi8(63))));
+
+        __m256i pairs = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+        __m256i quads = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+        __m256i packed = _mm256_shuffle_epi8(quads, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                                                     2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        // move the 12 bytes of the upper lane right after the ones of the lower lane
+        packed = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+
+        _mm256_storeu_si256((__m256i *) target, packed);
+        done += 32;
+        target += 24;
+        targetlen -= 24;
+    }
+    return done;
+}
+
+static void cpuid(unsigned int leaf, unsigned int regs[4]) {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuidex(info, (int) leaf, 0);
+    regs[0] = info[0];
+    regs[1] = info[1];
+    regs[2] = info[2];
+    regs[3] = info[3];
+#else
+    __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+/**
+ * @return 1 if the operating system saves the YMM registers on context switches
+ */
+static int os_supports_avx(void) {
+#ifdef _MSC_VER
+    return 6 == (_xgetbv(0) & 6);
+#else
+    unsigned int eax, edx;
+    __asm__ volatile ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+    return 6 == (eax & 6);
+#endif
+}
+
+#endif
+
+void base64_init(void) {
+#ifdef BASE64_X86
+    unsigned int regs[4];
+    cpuid(0, regs);
+    unsigned int maxLeaf = regs[0];
+    if (maxLeaf >= 1) {
+        cpuid(1, regs);
+        int ssse3 = (regs[2] >> 9) & 1;
+        int avx = ((regs[2] >> 27) & 1) && ((regs[2] >> 28) & 1) && os_supports_avx(); /* OSXSAVE and AVX */
+        int avx2 = 0;
+        if (avx && maxLeaf >= 7) {
+            cpuid(7, regs);
+            avx2 = (regs[1] >> 5) & 1;
+        }
+
+        if (avx2) {
+            encode_kernel = encode_avx2;
+            decode_kernel = decode_avx2;
+            implementation = "avx2";
+        } else if (ssse3) {
+            encode_kernel = encode_ssse3;
+            decode_kernel = decode_ssse3;
+            implementation = "ssse3";
+        }
+        if (ssse3) {
+            valid_kernel = valid_ssse3;
+        }
+    }
+#endif
+    initialized = 1;
+}
+
+const char *base64_implementation(void) {
+    if (!initialized) {
+        base64_init();
+    }
+    return implementation;
+}
+
+/**
+ * encode three bytes using base64 (RFC 3548)
  *
- * @param source the source buffer
- * @param sourcelen the length of the source buffer
- * @param target the target buffer
- * @param targetlen the length of the target buffer
- * @return 1 on success, 0 otherwise
+ * @param triple three bytes that should be encoded
+ * @param result buffer of four characters where the result is stored
  */
-int base64_encode(unsigned char *source, size_t sourcelen, char *target, size_t targetlen) {
-    /* check if the result will fit in the target buffer */
+void _base64_encode_triple(unsigned char triple[3], char result[4]) {
+    result[0] = BASE64_CHARS[triple[0] >> 2];
+    result[1] = BASE64_CHARS[((triple[0] & 0x03) << 4) | (triple[1] >> 4)];
+    result[2] = BASE64_CHARS[((triple[1] & 0x0f) << 2) | (triple[2] >> 6)];
+    result[3] = BASE64_CHARS[triple[2] & 0x3f];
+}
 
-    if ((sourcelen+2)/3*4 > targetlen-1)
-        return 0;
+size_t base64_encode_n(const unsigned char *source, size_t sourcelen, char *target) {
+    char *start = target;
+
+    if (!initialized) {
+        base64_init();
+    }
+    if (encode_kernel) {
+        size_t done = encode_kernel(source, sourcelen, target);
+        source += done;
+        sourcelen -= done;
+        target += done / 3 * 4;
+    }
 
-    /* encode all full triples */
+    /* encode the remaining full triples */
     while (sourcelen >= 3) {
-        _base64_encode_triple(source, target);
+        _base64_encode_triple((unsigned char *) source, target);
         sourcelen -= 3;
         source += 3;
         target += 4;
@@ -66,8 +347,26 @@ int base64_encode(unsigned char *source, size_t sourcelen, char *target, size_t
         target += 4;
     }
 
+    return target - start;
+}
+
+/**
+ * encode an array of bytes using Base64 (RFC 3548)
+ *
+ * @param source the source buffer
+ * @param sourcelen the length of the source buffer
+ * @param target the target buffer
+ * @param targetlen the length of the target buffer
+ * @return 1 on success, 0 otherwise
+ */
+int base64_encode(unsigned char *source, size_t sourcelen, char *target, size_t targetlen) {
+    /* check if the result will fit in the target buffer */
+
+    if (BASE64_ENCODED_LEN(sourcelen) > targetlen-1)
+        return 0;
+
     /* terminate the string */
-    target[0] = 0;
+    target[base64_encode_n(source, sourcelen, target)] = 0;
 
     return 1;
 }
@@ -79,17 +378,7 @@ int base64_encode(unsigned char *source, size_t sourcelen, char *target, size_t
  * @return the value in case of success (0-63), -1 on failure
  */
 int _base64_char_value(char base64char) {
-    if (base64char >= 'A' && base64char <= 'Z')
-        return base64char-'A';
-    if (base64char >= 'a' && base64char <= 'z')
-        return base64char-'a'+26;
-    if (base64char >= '0' && base64char <= '9')
-        return base64char-'0'+2*26;
-    if (base64char == '-') //was + -> +
-        return 2*26+10;//return  43;//(int)('+');
-    if (base64char == '_') // was / -> /
-        return 2*26+11;//return  47;//(int)('/');
-    return -1;
+    return BASE64_VALUES[(unsigned char) base64char];
 }
 
 /**
@@ -127,76 +416,96 @@ int _base64_decode_triple(char quadruple[4], char result[3]) {
         bytes_to_decode = 0;
 
     /* make one big value out of the partial values */
-    triple_value = char_value[0];
-    triple_value *= 64;
-    triple_value += char_value[1];
-    triple_value *= 64;
-    triple_value += char_value[2];
-    triple_value *= 64;
-    triple_value += char_value[3];
+    triple_value = (char_value[0] << 18) | (char_value[1] << 12) | (char_value[2] << 6) | char_value[3];
 
     /* break the big value into bytes */
-    for (i=bytes_to_decode; i<3; i++)
-        triple_value /= 256;
-    for (i=bytes_to_decode-1; i>=0; i--) {
-        result[i] = triple_value%256;
-        triple_value /= 256;
-    }
+    for (i=0; i<bytes_to_decode; i++)
+        result[i] = (char) (triple_value >> (16 - 8 * i));
 
     return bytes_to_decode;
 }
 
-/**
- * decode base64 encoded data
- *
- * @param source the encoded data (zero terminated)
- * @param target pointer to the target buffer
- * @param targetlen length of the target buffer
- * @return length of converted data on success, -1 otherwise
- */
-size_t base64_decode(char *source, unsigned char *target, size_t targetlen) {
-    char *src, *tmpptr;
-    char quadruple[4];
-    unsigned  char tmpresult[3];
-    int i, tmplen = 3;
+size_t base64_decode_n(const char *source, size_t sourcelen, unsigned char *target, size_t targetlen) {
+    const char *end = source + sourcelen;
     size_t converted = 0;
 
-    /* concatinate '===' to the source to handle unpadded base64 data */
-    src = (char *)malloc(strlen(source)+5);
-    if (src == NULL)
-        return -1;
-    strcpy(src, source);
-    strcat(src, "====");
-    tmpptr = src;
-
-    unsigned char *startTarget = target;
-
-    /* convert as long as we get a full result */
-    while (tmplen == 3) {
-        /* get 4 characters to convert */
-        for (i=0; i<4; i++) {
-            /* skip invalid characters - we won't reach the end */
-            while (*tmpptr != '=' && _base64_char_value(*tmpptr)<0)
-                tmpptr++;
-            quadruple[i] = *(tmpptr++);
+    if (!initialized) {
+        base64_init();
+    }
+
+    while (1) {
+        if (decode_kernel) {
+            size_t done = decode_kernel(source, end - source, target, targetlen);
+            source += done;
+            target += done / 4 * 3;
+            targetlen -= done / 4 * 3;
+            converted += done / 4 * 3;
         }
 
-        /* convert the characters */
-        tmplen = _base64_decode_triple(quadruple, tmpresult);
+        /* whole quadruples of valid characters */
+        while (end - source >= 4 && targetlen >= 3) {
+            int a = BASE64_VALUES[(unsigned char) source[0]], b = BASE64_VALUES[(unsigned char) source[1]];
+            int c = BASE64_VALUES[(unsigned char) source[2]], d = BASE64_VALUES[(unsigned char) source[3]];
+            if ((a | b | c | d) < 0)
+                break;
+            int triple_value = (a << 18) | (b << 12) | (c << 6) | d;
+            target[0] = (unsigned char) (triple_value >> 16);
+            target[1] = (unsigned char) (triple_value >> 8);
+            target[2] = (unsigned char) triple_value;
+            source += 4;
+            target += 3;
+            targetlen -= 3;
+            converted += 3;
+        }
 
-        /* check if the fit in the result buffer */
-        if (targetlen < tmplen) {
-            free(src);
-            return -1;
+        /* get up to 4 characters to convert, skipping invalid ones, until '=' or the end */
+        int values[4], count = 0;
+        while (count < 4 && source < end && *source != '=') {
+            int value = BASE64_VALUES[(unsigned char) *(source++)];
+            if (value >= 0)
+                values[count++] = value;
         }
 
-        /* put the partial result in the result buffer */
-        memcpy(target, tmpresult, tmplen);
+        /* a full quadruple gives 3 bytes, a partial one (at the end of the data) 1 or 2 */
+        size_t tmplen = count > 1 ? count - 1 : 0;
+        if (targetlen < tmplen)
+            return -1;
+
+        int triple_value = 0, i;
+        for (i=0; i<count; i++)
+            triple_value |= values[i] << (18 - 6 * i);
+        for (i=0; i<(int) tmplen; i++)
+            target[i] = (unsigned char) (triple_value >> (16 - 8 * i));
         target += tmplen;
         targetlen -= tmplen;
         converted += tmplen;
+
+        if (count < 4)
+            return converted;
+    }
+}
+
+size_t base64_valid_prefix(const char *source, size_t sourcelen) {
+    size_t i = 0;
+
+    if (!initialized) {
+        base64_init();
     }
+    if (valid_kernel)
+        i = valid_kernel(source, sourcelen);
+    while (i < sourcelen && BASE64_VALUES[(unsigned char) source[i]] >= 0)
+        i++;
+    return i;
+}
 
-    free(src);
-    return converted;
-}
\ No newline at end of file
+/**
+ * decode base64 encoded data
+ *
+ * @param source the encoded data (zero terminated)
+ * @param target pointer to the target buffer
+ * @param targetlen length of the target buffer
+ * @return length of converted data on success, -1 otherwise
+ */
+size_t base64_decode(char *source, unsigned char *target, size_t targetlen) {
+    return base64_decode_n(source, strlen(source), target, targetlen);
+}
@@ -1,4 +1,24 @@
+#include <stddef.h>
 
+/**
+ * length of the Base64 encoding of n bytes (without the terminating zero)
+ */
+#define BASE64_ENCODED_LEN(n) (((n) + 2) / 3 * 4)
+
+/**
+ * maximum number of bytes n Base64 characters decode to
+ */
+#define BASE64_DECODED_MAX_LEN(n) ((n) / 4 * 3 + 2)
+
+/**
+ * select the fastest encoder and decoder the CPU supports, called automatically on first use
+ */
+void base64_init(void);
+
+/**
+ * @return name of the selected implementation ("avx2", "ssse3" or "scalar")
+ */
+const char *base64_implementation(void);
 
 /**
  * encode three bytes using base64 (RFC 3548)
@@ -19,6 +39,16 @@ void _base64_encode_triple(unsigned char triple[3], char result[4]);
  */
 int base64_encode(unsigned char *source, size_t sourcelen, char *target, size_t targetlen);
 
+/**
+ * encode an array of bytes using Base64 (RFC 3548) without terminating the result
+ *
+ * @param source the source buffer
+ * @param sourcelen the length of the source buffer
+ * @param target the target buffer, at least BASE64_ENCODED_LEN(sourcelen) characters
+ * @return number of characters written
+ */
+size_t base64_encode_n(const unsigned char *source, size_t sourcelen, char *target);
+
 /**
  * determine the value of a base64 encoding character
  *
@@ -45,3 +75,25 @@ int _base64_decode_triple(char quadruple[4], char result[3]) ;
  * @return length of converted data on success, -1 otherwise
  */
 size_t base64_decode(char *source, unsigned char *target, size_t targetlen);
+
+/**
+ * find the first character outside the Base64 alphabets (standard and URL safe, '=' is outside)
+ *
+ * @param source the characters
+ * @param sourcelen number of characters
+ * @return number of leading characters which are in the alphabet
+ */
+size_t base64_valid_prefix(const char *source, size_t sourcelen);
+
+/**
+ * decode base64 encoded data of the given length, which does not have to be zero terminated.
+ * Both the standard (+/) and the URL safe (-_) alphabet are accepted, other characters are skipped
+ * and decoding stops at the first '='.
+ *
+ * @param source the encoded data
+ * @param sourcelen number of characters in source
+ * @param target pointer to the target buffer
+ * @param targetlen length of the target buffer
+ * @return length of converted data on success, -1 if it does not fit in the target buffer
+ */
+size_t base64_decode_n(const char *source, size_t sourcelen, unsigned char *target, size_t targetlen);
@@ -0,0 +1,178 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "benchmark.h"
+
+/* two sided 95% quantiles of Student's t distribution for 1 to 30 degrees of freedom */
+static const double T_95[30] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+static double t_95(int degrees) {
+    return degrees <= 30 ? T_95[degrees - 1] : 1.960;
+}
+
+static double monotonic_time(void) {
+#ifdef _WIN32
+    return (double) GetTickCount64() / 1000;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * quantile of a sorted sample, interpolated linearly between the closest ranks
+ */
+static double quantile(const double *sorted, int count, double q) {
+    double position = q * (count - 1);
+    int below = (int) position;
+    if (below + 1 >= count) {
+        return sorted[count - 1];
+    }
+    return sorted[below] + (position - below) * (sorted[below + 1] - sorted[below]);
+}
+
+void bench_check_options(bench_options_t *options) {
+    if (options->repeat < 1) {
+        options->repeat = 1;
+    } else if (options->repeat > BENCH_MAX_REPEAT) {
+        options->repeat = BENCH_MAX_REPEAT;
+    }
+    if (options->warmup < 0) {
+        options->warmup = 0;
+    } else if (options->warmup > BENCH_MAX_REPEAT) {
+        options->warmup = BENCH_MAX_REPEAT;
+    }
+    if (options->minRepeat < 2) {
+        options->minRepeat = 2;     /* a confidence interval needs a deviation */
+    }
+    if (options->targetRci < 0) {
+        options->targetRci = 0;
+    }
+}
+
+int bench_compute_stats(const double *times, int count, bench_stats_t *stats) {
+    int i;
+    memset(stats, 0, sizeof(bench_stats_t));
+    stats->count = count;
+    if (count == 0) {
+        return 0;
+    }
+    double *sorted = malloc(sizeof(double) * count);
+    if (!sorted) {
+        return -1;
+    }
+    memcpy(sorted, times, sizeof(double) * count);
+    qsort(sorted, count, sizeof(double), compare_doubles);
+
+    double sum = 0;
+    for (i = 0; i < count; i++) {
+        sum += sorted[i];
+    }
+    stats->mean = sum / count;
+    double squares = 0;
+    for (i = 0; i < count; i++) {
+        squares += (sorted[i] - stats->mean) * (sorted[i] - stats->mean);
+    }
+    stats->stddev = count > 1 ? sqrt(squares / (count - 1)) : 0;
+    stats->min = sorted[0];
+    stats->max = sorted[count - 1];
+    stats->median = quantile(sorted, count, 0.5);
+
+    double q1 = quantile(sorted, count, 0.25);
+    double q3 = quantile(sorted, count, 0.75);
+    double low = q1 - 1.5 * (q3 - q1), high = q3 + 1.5 * (q3 - q1);
+    for (i = 0; i < count; i++) {
+        if (sorted[i] < low || sorted[i] > high) {
+            stats->outliers++;
+        }
+    }
+    if (count > 1 && stats->mean > 0) {
+        stats->rci = t_95(count - 1) * stats->stddev / sqrt((double) count) / stats->mean;
+    }
+    free(sorted);
+    return 0;
+}
+
+int bench_run(const char *command, const bench_options_t *options, bench_run_handler_t onRun,
+              shell_output_handler_t handler, void *ctx, bench_result_t *result) {
+    int run;
+    double mean = 0, squares = 0;   /* running mean and sum of squared deviations (Welford) */
+    memset(result, 0, sizeof(bench_result_t));
+    result->times = malloc(sizeof(double) * options->repeat);
+    if (!result->times) {
+        return -1;
+    }
+    if (options->measured) {
+        result->measurements = malloc(sizeof(shell_measurement_t) * options->repeat);
+        if (!result->measurements) {
+            bench_result_free(result);
+            return -1;
+        }
+    }
+
+    for (run = 0; run < options->warmup + options->repeat; run++) {
+        int warmup = run < options->warmup;
+        shell_measurement_t *measurement = options->measured && !warmup
+                                           ? &result->measurements[result->runs] : NULL;
+        if (onRun) {
+            onRun(ctx, run, warmup);
+        }
+        double started = monotonic_time();
+        if (shell_run(command, handler, ctx, &result->status, measurement) < 0) {
+            bench_result_free(result);
+            return -1;
+        }
+        double elapsed = measurement ? measurement->wallTime : monotonic_time() - started;
+        if (warmup) {
+            if (0 != result->status.exitCode) {
+                break;
+            }
+            continue;
+        }
+        result->times[result->runs++] = elapsed;
+        if (0 != result->status.exitCode) {
+            break;  /* the failed run is the last one */
+        }
+        double delta = elapsed - mean;
+        mean += delta / result->runs;
+        squares += delta * (elapsed - mean);
+
+        // stopping rule: the mean is known precisely enough
+        if (options->targetRci > 0 && result->runs >= options->minRepeat && result->runs < options->repeat
+            && mean > 0) {
+            double stddev = sqrt(squares / (result->runs - 1));
+            if (t_95(result->runs - 1) * stddev / sqrt((double) result->runs) / mean <= options->targetRci) {
+                result->converged = 1;
+                break;
+            }
+        }
+    }
+    if (bench_compute_stats(result->times, result->runs, &result->stats) < 0) {
+        bench_result_free(result);
+        return -1;
+    }
+    return 0;
+}
+
+void bench_result_free(bench_result_t *result) {
+    free(result->times);
+    free(result->measurements);
+    result->times = NULL;
+    result->measurements = NULL;
+}
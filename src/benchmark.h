@@ -0,0 +1,91 @@
+#ifndef CK_BENCHMARK_H
+#define CK_BENCHMARK_H
+
+#include "shell_runner.h"
+
+#define BENCH_MAX_REPEAT 100000
+
+/**
+ * How a command is repeated
+ */
+typedef struct bench_options {
+    int repeat;         /* maximum number of measured runs, at least 1 */
+    int warmup;         /* runs before the measured ones, which are not counted */
+    int minRepeat;      /* measured runs before the stopping rule is applied */
+    double targetRci;   /* stop once the relative 95% confidence interval of the mean is below this, 0 - never */
+    int measured;       /* resource usage of every run is collected */
+} bench_options_t;
+
+/**
+ * Summary of the wall times of the measured runs, in seconds
+ */
+typedef struct bench_stats {
+    int count;
+    double mean;
+    double median;
+    double stddev;      /* sample standard deviation */
+    double min;
+    double max;
+    int outliers;       /* runs outside the Tukey fences (1.5 interquartile ranges beyond the quartiles) */
+    double rci;         /* half width of the 95% confidence interval of the mean relative to the mean */
+} bench_stats_t;
+
+typedef struct bench_result {
+    shell_status_t status;              /* of the last run */
+    int runs;                           /* measured runs done */
+    double *times;                      /* wall time of every measured run */
+    shell_measurement_t *measurements;  /* resource usage of every measured run, NULL if not measured */
+    int converged;                      /* stopped by the target confidence interval */
+    bench_stats_t stats;
+} bench_result_t;
+
+/**
+ * Called before every run, for example to drop the output of the previous one.
+ *
+ * @param ctx context given to bench_run()
+ * @param run number of the run, the warmup runs come first
+ * @param warmup 1 for a warmup run
+ */
+typedef void (*bench_run_handler_t)(void *ctx, int run, int warmup);
+
+/**
+ * normalize options taken from a request: at least one run, at most BENCH_MAX_REPEAT runs
+ *
+ * @param options the options
+ */
+void bench_check_options(bench_options_t *options);
+
+/**
+ * run a command back to back, the warmup runs first, until it fails, the maximum number of runs is reached or
+ * the stopping rule is met. A failed measured run is kept as the last one, with its time.
+ *
+ * @param command the command
+ * @param options how it is repeated
+ * @param onRun called before every run, may be NULL
+ * @param handler receives the output of all runs
+ * @param ctx passed to both handlers
+ * @param result receives the times and their statistics, to be released with bench_result_free()
+ * @return 0 on success (even if the command failed), -1 if the command could not be started or memory could not
+ *         be allocated
+ */
+int bench_run(const char *command, const bench_options_t *options, bench_run_handler_t onRun,
+              shell_output_handler_t handler, void *ctx, bench_result_t *result);
+
+/**
+ * compute the statistics of a sample
+ *
+ * @param times the sample, not modified
+ * @param count its size
+ * @param stats receives the statistics
+ * @return 0 on success, -1 if memory could not be allocated
+ */
+int bench_compute_stats(const double *times, int count, bench_stats_t *stats);
+
+/**
+ * release the memory of a result
+ *
+ * @param result the result
+ */
+void bench_result_free(bench_result_t *result);
+
+#endif
@@ -0,0 +1,114 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "buffer_pool.h"
+
+#define BUFFER_POOL_CLASSES (BUFFER_POOL_MAX_SHIFT - BUFFER_POOL_MIN_SHIFT + 1)
+
+struct buffer_pool {
+    void *idle[BUFFER_POOL_CLASSES];    /* lists of idle buffers, linked through their first bytes */
+    size_t pooledBytes;
+    size_t maxPooledBytes;
+};
+
+/**
+ * @return the size class fitting the given size or -1 if such buffers are not pooled
+ */
+static int size_class(size_t size) {
+    int shift = BUFFER_POOL_MIN_SHIFT;
+    while (((size_t) 1 << shift) < size) {
+        if (++shift > BUFFER_POOL_MAX_SHIFT) {
+            return -1;
+        }
+    }
+    return shift - BUFFER_POOL_MIN_SHIFT;
+}
+
+buffer_pool_t *buffer_pool_create(size_t maxPooledBytes) {
+    buffer_pool_t *pool = malloc(sizeof(buffer_pool_t));
+    if (pool) {
+        memset(pool, 0, sizeof(buffer_pool_t));
+        pool->maxPooledBytes = maxPooledBytes;
+    }
+    return pool;
+}
+
+void buffer_pool_destroy(buffer_pool_t *pool) {
+    int i;
+    if (!pool) {
+        return;
+    }
+    for (i = 0; i < BUFFER_POOL_CLASSES; i++) {
+        while (pool->idle[i]) {
+            void *next = *(void **) pool->idle[i];
+            free(pool->idle[i]);
+            pool->idle[i] = next;
+        }
+    }
+    free(pool);
+}
+
+char *buffer_pool_get(buffer_pool_t *pool, size_t minCapacity, size_t *capacity) {
+    int c = size_class(minCapacity);
+    if (c < 0) {
+        *capacity = minCapacity;
+        return malloc(minCapacity);
+    }
+
+    size_t size = (size_t) 1 << (c + BUFFER_POOL_MIN_SHIFT);
+    *capacity = size;
+    if (pool && pool->idle[c]) {
+        char *buf = pool->idle[c];
+        pool->idle[c] = *(void **) buf;
+        pool->pooledBytes -= size;
+        return buf;
+    }
+    return malloc(size);
+}
+
+void buffer_pool_put(buffer_pool_t *pool, char *buf, size_t capacity) {
+    if (!buf) {
+        return;
+    }
+    int c = size_class(capacity);
+    if (!pool || c < 0 || ((size_t) 1 << (c + BUFFER_POOL_MIN_SHIFT)) != capacity
+        || pool->pooledBytes + capacity > pool->maxPooledBytes) {
+        free(buf);
+        return;
+    }
+    *(void **) buf = pool->idle[c];
+    pool->idle[c] = buf;
+    pool->pooledBytes += capacity;
+}
+
+char *buffer_pool_grow(buffer_pool_t *pool, char *buf, size_t used, size_t *capacity, size_t minCapacity) {
+    if (buf && minCapacity <= *capacity) {
+        return buf;
+    }
+
+    size_t newCapacity = buf ? *capacity * 2 : 0;
+    if (newCapacity < minCapacity) {
+        newCapacity = minCapacity;
+    }
+
+    if (buf && size_class(*capacity) < 0) {
+        // both sizes are beyond the pooled classes, realloc may avoid the copy
+        char *grown = realloc(buf, newCapacity);
+        if (grown) {
+            *capacity = newCapacity;
+        }
+        return grown;
+    }
+
+    size_t grownCapacity;
+    char *grown = buffer_pool_get(pool, newCapacity, &grownCapacity);
+    if (!grown) {
+        return NULL;
+    }
+    if (buf) {
+        memcpy(grown, buf, used);
+        buffer_pool_put(pool, buf, *capacity);
+    }
+    *capacity = grownCapacity;
+    return grown;
+}
@@ -0,0 +1,63 @@
+#ifndef CK_BUFFER_POOL_H
+#define CK_BUFFER_POOL_H
+
+#include <stddef.h>
+
+/**
+ * Buffers are pooled in power of two size classes between these sizes, larger ones are allocated and freed directly
+ */
+#define BUFFER_POOL_MIN_SHIFT 12    /* 4 KB */
+#define BUFFER_POOL_MAX_SHIFT 26    /* 64 MB */
+
+/**
+ * Pool of reusable I/O buffers. A pool is not thread safe, every event loop has its own.
+ */
+typedef struct buffer_pool buffer_pool_t;
+
+/**
+ * create a buffer pool
+ *
+ * @param maxPooledBytes maximum total size of the idle buffers kept in the pool
+ * @return the pool or NULL if memory could not be allocated
+ */
+buffer_pool_t *buffer_pool_create(size_t maxPooledBytes);
+
+/**
+ * free the pool and all idle buffers in it
+ *
+ * @param pool the pool
+ */
+void buffer_pool_destroy(buffer_pool_t *pool);
+
+/**
+ * get a buffer of at least the given size
+ *
+ * @param pool the pool, NULL means plain malloc
+ * @param minCapacity required size
+ * @param capacity receives the actual size of the buffer
+ * @return the buffer or NULL if memory could not be allocated
+ */
+char *buffer_pool_get(buffer_pool_t *pool, size_t minCapacity, size_t *capacity);
+
+/**
+ * return a buffer to the pool (or free it if the pool is full)
+ *
+ * @param pool the pool the buffer was taken from, NULL means plain free
+ * @param buf the buffer, may be NULL
+ * @param capacity size of the buffer as returned by buffer_pool_get()
+ */
+void buffer_pool_put(buffer_pool_t *pool, char *buf, size_t capacity);
+
+/**
+ * make sure a buffer has at least the given size, growing it geometrically and keeping its content
+ *
+ * @param pool the pool the buffer was taken from
+ * @param buf the buffer, may be NULL
+ * @param used number of bytes to keep
+ * @param capacity size of the buffer, updated with the new size
+ * @param minCapacity required size
+ * @return the (possibly moved) buffer or NULL if memory could not be allocated, in which case buf is still valid
+ */
+char *buffer_pool_grow(buffer_pool_t *pool, char *buf, size_t used, size_t *capacity, size_t minCapacity);
+
+#endif
@@ -39,6 +39,8 @@
 
 static const char *ep;
 
+static void drop_index(cJSON *object);
+
 const char *cJSON_GetErrorPtr() {return ep;}
 
 static int cJSON_strcasecmp(const char *s1,const char *s2)
@@ -90,8 +92,9 @@ void cJSON_Delete(cJSON *c)
 	{
 		next=c->next;
 		if (!(c->type&cJSON_IsReference) && c->child) cJSON_Delete(c->child);
-		if (!(c->type&cJSON_IsReference) && c->valuestring) cJSON_free(c->valuestring);
-		if (c->string) cJSON_free(c->string);
+		drop_index(c);
+		if (!(c->type&(cJSON_IsReference|cJSON_StringIsInSitu)) && c->valuestring) cJSON_free(c->valuestring);
+		if (!(c->type&cJSON_NameIsInSitu) && c->string) cJSON_free(c->string);
 		cJSON_free(c);
 		c=next;
 	}
@@ -116,7 +119,7 @@ static const char *parse_number(cJSON *item,const char *num)
 	
 	item->valuedouble=n;
 	item->valueint=(int)n;
-	item->type=cJSON_Number;
+	item->type|=cJSON_Number;
 	return num;
 }
 
@@ -143,19 +146,11 @@ static char *print_number(cJSON *item)
 	return str;
 }
 
-/* Parse the input text into an unescaped cstring, and populate item. */
+/* Unescape the string text at ptr into ptr2, which may be ptr itself (the output is never longer). Returns the end of the text. */
 static const unsigned char firstByteMark[7] = { 0x00, 0x00, 0xC0, 0xE0, 0xF0, 0xF8, 0xFC };
-static const char *parse_string(cJSON *item,const char *str)
+static const char *unescape_string(const char *ptr,char *ptr2,size_t *outlen)
 {
-	const char *ptr=str+1;char *ptr2;char *out;int len=0;unsigned uc,uc2;
-	if (*str!='\"') {ep=str;return 0;}	/* not a string! */
-	
-	while (*ptr!='\"' && *ptr && ++len) if (*ptr++ == '\\') ptr++;	/* Skip escaped quotes. */
-	
-	out=(char*)cJSON_malloc(len+1);	/* This is how long we need for the string, roughly. */
-	if (!out) return 0;
-	
-	ptr=str+1;ptr2=out;
+	char *out=ptr2;int len;unsigned uc,uc2;
 	while (*ptr!='\"' && *ptr)
 	{
 		if (*ptr!='\\') *ptr2++=*ptr++;
@@ -197,10 +192,38 @@ static const char *parse_string(cJSON *item,const char *str)
 			ptr++;
 		}
 	}
-	*ptr2=0;
-	if (*ptr=='\"') ptr++;
+	*outlen=ptr2-out;
+	return ptr;
+}
+
+/* Parse the input text into an unescaped cstring, and populate item. */
+static const char *parse_string(cJSON *item,const char *str,int insitu)
+{
+	const char *ptr=str+1;char *out;size_t len=0,rest;int closed;
+	if (*str!='\"') {ep=str;return 0;}	/* not a string! */
+
+	if (insitu)
+	{
+		/* The text is unescaped where it is, the closing quote becomes the terminator. */
+		while (*ptr!='\"' && *ptr!='\\' && *ptr) ptr++;
+		out=(char*)str+1;len=ptr-out;
+		if (*ptr=='\\') {ptr=unescape_string(ptr,out+len,&rest);len+=rest;}
+		item->type|=cJSON_String|cJSON_StringIsInSitu;
+	}
+	else
+	{
+		while (*ptr!='\"' && *ptr && ++len) if (*ptr++ == '\\') ptr++;	/* Skip escaped quotes. */
+
+		out=(char*)cJSON_malloc(len+1);	/* This is how long we need for the string, roughly. */
+		if (!out) return 0;
+		ptr=unescape_string(str+1,out,&len);
+		item->type|=cJSON_String;
+	}
+	closed=(*ptr=='\"');
+	out[len]=0;
+	if (closed) ptr++;
 	item->valuestring=out;
-	item->type=cJSON_String;
+	item->valuelength=len;
 	return ptr;
 }
 
@@ -243,42 +266,45 @@ static char *print_string_ptr(const char *str)
 static char *print_string(cJSON *item)	{return print_string_ptr(item->valuestring);}
 
 /* Predeclare these prototypes. */
-static const char *parse_value(cJSON *item,const char *value);
+static const char *parse_value(cJSON *item,const char *value,int insitu);
 static char *print_value(cJSON *item,int depth,int fmt);
-static const char *parse_array(cJSON *item,const char *value);
+static const char *parse_array(cJSON *item,const char *value,int insitu);
 static char *print_array(cJSON *item,int depth,int fmt);
-static const char *parse_object(cJSON *item,const char *value);
+static const char *parse_object(cJSON *item,const char *value,int insitu);
 static char *print_object(cJSON *item,int depth,int fmt);
 
 /* Utility to jump whitespace and cr/lf */
 static const char *skip(const char *in) {while (in && *in && (unsigned char)*in<=32) in++; return in;}
 
 /* Parse an object - create a new root, and populate. */
-cJSON *cJSON_Parse(const char *value)
+static cJSON *parse_root(const char *value,int insitu)
 {
 	cJSON *c=cJSON_New_Item();
 	ep=0;
 	if (!c) return 0;       /* memory fail */
 
-	if (!parse_value(c,skip(value))) {cJSON_Delete(c);return 0;}
+	if (!parse_value(c,skip(value),insitu)) {cJSON_Delete(c);return 0;}
 	return c;
 }
+cJSON *cJSON_Parse(const char *value)		{return parse_root(value,0);}
+cJSON *cJSON_ParseInSitu(char *value)		{return parse_root(value,1);}
 
 /* Render a cJSON item/entity/structure to text. */
 char *cJSON_Print(cJSON *item)				{return print_value(item,0,1);}
 char *cJSON_PrintUnformatted(cJSON *item)	{return print_value(item,0,0);}
 
 /* Parser core - when encountering text, process appropriately. */
-static const char *parse_value(cJSON *item,const char *value)
+/* The type is or-ed in, so that cJSON_NameIsInSitu set by parse_object survives. */
+static const char *parse_value(cJSON *item,const char *value,int insitu)
 {
 	if (!value)						return 0;	/* Fail on null. */
-	if (!strncmp(value,"null",4))	{ item->type=cJSON_NULL;  return value+4; }
-	if (!strncmp(value,"false",5))	{ item->type=cJSON_False; return value+5; }
-	if (!strncmp(value,"true",4))	{ item->type=cJSON_True; item->valueint=1;	return value+4; }
-	if (*value=='\"')				{ return parse_string(item,value); }
+	if (!strncmp(value,"null",4))	{ item->type|=cJSON_NULL;  return value+4; }
+	if (!strncmp(value,"false",5))	{ item->type|=cJSON_False; return value+5; }
+	if (!strncmp(value,"true",4))	{ item->type|=cJSON_True; item->valueint=1;	return value+4; }
+	if (*value=='\"')				{ return parse_string(item,value,insitu); }
 	if (*value=='-' || (*value>='0' && *value<='9'))	{ return parse_number(item,value); }
-	if (*value=='[')				{ return parse_array(item,value); }
-	if (*value=='{')				{ return parse_object(item,value); }
+	if (*value=='[')				{ return parse_array(item,value,insitu); }
+	if (*value=='{')				{ return parse_object(item,value,insitu); }
 
 	ep=value;return 0;	/* failure. */
 }
@@ -302,18 +328,19 @@ static char *print_value(cJSON *item,int depth,int fmt)
 }
 
 /* Build an array from input text. */
-static const char *parse_array(cJSON *item,const char *value)
+static const char *parse_array(cJSON *item,const char *value,int insitu)
 {
 	cJSON *child;
 	if (*value!='[')	{ep=value;return 0;}	/* not an array! */
 
-	item->type=cJSON_Array;
+	item->type|=cJSON_Array;
 	value=skip(value+1);
 	if (*value==']') return value+1;	/* empty array. */
 
-	item->child=child=cJSON_New_Item();
+	item->child=item->last=child=cJSON_New_Item();
 	if (!item->child) return 0;		 /* memory fail */
-	value=skip(parse_value(child,skip(value)));	/* skip any spacing, get the value. */
+	item->childcount=1;
+	value=skip(parse_value(child,skip(value),insitu));	/* skip any spacing, get the value. */
 	if (!value) return 0;
 
 	while (*value==',')
@@ -321,7 +348,8 @@ static const char *parse_array(cJSON *item,const char *value)
 		cJSON *new_item;
 		if (!(new_item=cJSON_New_Item())) return 0; 	/* memory fail */
 		child->next=new_item;new_item->prev=child;child=new_item;
-		value=skip(parse_value(child,skip(value+1)));
+		item->last=child;item->childcount++;
+		value=skip(parse_value(child,skip(value+1),insitu));
 		if (!value) return 0;	/* memory fail */
 	}
 
@@ -381,22 +409,23 @@ static char *print_array(cJSON *item,int depth,int fmt)
 }
 
 /* Build an object from the text. */
-static const char *parse_object(cJSON *item,const char *value)
+static const char *parse_object(cJSON *item,const char *value,int insitu)
 {
 	cJSON *child;
 	if (*value!='{')	{ep=value;return 0;}	/* not an object! */
 	
-	item->type=cJSON_Object;
+	item->type|=cJSON_Object;
 	value=skip(value+1);
 	if (*value=='}') return value+1;	/* empty array. */
 	
-	item->child=child=cJSON_New_Item();
+	item->child=item->last=child=cJSON_New_Item();
 	if (!item->child) return 0;
-	value=skip(parse_string(child,skip(value)));
+	item->childcount=1;
+	value=skip(parse_string(child,skip(value),insitu));
 	if (!value) return 0;
-	child->string=child->valuestring;child->valuestring=0;
+	child->string=child->valuestring;child->valuestring=0;child->type=insitu?cJSON_NameIsInSitu:0;
 	if (*value!=':') {ep=value;return 0;}	/* fail! */
-	value=skip(parse_value(child,skip(value+1)));	/* skip any spacing, get the value. */
+	value=skip(parse_value(child,skip(value+1),insitu));	/* skip any spacing, get the value. */
 	if (!value) return 0;
 	
 	while (*value==',')
@@ -404,11 +433,12 @@ static const char *parse_object(cJSON *item,const char *value)
 		cJSON *new_item;
 		if (!(new_item=cJSON_New_Item()))	return 0; /* memory fail */
 		child->next=new_item;new_item->prev=child;child=new_item;
-		value=skip(parse_string(child,skip(value+1)));
+		item->last=child;item->childcount++;
+		value=skip(parse_string(child,skip(value+1),insitu));
 		if (!value) return 0;
-		child->string=child->valuestring;child->valuestring=0;
+		child->string=child->valuestring;child->valuestring=0;child->type=insitu?cJSON_NameIsInSitu:0;
 		if (*value!=':') {ep=value;return 0;}	/* fail! */
-		value=skip(parse_value(child,skip(value+1)));	/* skip any spacing, get the value. */
+		value=skip(parse_value(child,skip(value+1),insitu));	/* skip any spacing, get the value. */
 		if (!value) return 0;
 	}
 	
@@ -477,35 +507,114 @@ static char *print_object(cJSON *item,int depth,int fmt)
 	return out;	
 }
 
+/* Objects with at least this many items get a hash index over their names on the first lookup. */
+#define INDEX_MIN_ITEMS 16
+
+/* Open addressing table of the named items of an object, in item order so the first of equal names is found first. */
+struct cJSON_Index {
+	size_t mask;
+	size_t used;
+	cJSON *slots[1];
+};
+
+/* Case insensitive FNV-1a, matching cJSON_strcasecmp. */
+static size_t hash_name(const char *str)
+{
+	size_t h=2166136261u;
+	while (*str) h=(h^(unsigned char)tolower(*(const unsigned char *)str++))*16777619u;
+	return h;
+}
+
+static void drop_index(cJSON *object)	{if (object->index) {cJSON_free(object->index);object->index=0;}}
+
+/* Add a named item to the index, dropping the index when it gets too full; it is rebuilt by the next lookup. */
+static void index_item(cJSON *object,cJSON *item)
+{
+	struct cJSON_Index *index=object->index;size_t i;
+	if (!index || !item->string) return;
+	if ((index->used+1)*2>index->mask+1) {drop_index(object);return;}
+	for (i=hash_name(item->string)&index->mask;index->slots[i];i=(i+1)&index->mask);
+	index->slots[i]=item;index->used++;
+}
+
+static void build_index(cJSON *object)
+{
+	size_t slots=32;cJSON *c;
+	while (slots<(size_t)object->childcount*2) slots*=2;
+	object->index=(struct cJSON_Index*)cJSON_malloc(sizeof(struct cJSON_Index)+(slots-1)*sizeof(cJSON*));
+	if (!object->index) return;
+	memset(object->index,0,sizeof(struct cJSON_Index)+(slots-1)*sizeof(cJSON*));
+	object->index->mask=slots-1;
+	for (c=object->child;c && object->index;c=c->next) index_item(object,c);
+}
+
 /* Get Array size/item / object item. */
-int    cJSON_GetArraySize(cJSON *array)							{cJSON *c=array->child;int i=0;while(c)i++,c=c->next;return i;}
+int    cJSON_GetArraySize(cJSON *array)							{return array->childcount;}
 cJSON *cJSON_GetArrayItem(cJSON *array,int item)				{cJSON *c=array->child;  while (c && item>0) item--,c=c->next; return c;}
 /* FGG update to support update of json objects with other json objects */
 char *cJSON_GetArrayItemName(cJSON *array,int item)				{cJSON *c=array->child;  while (c && item>0) item--,c=c->next; return c->string;}
-cJSON *cJSON_GetObjectItem(cJSON *object,const char *string)	{cJSON *c=object->child; while (c && cJSON_strcasecmp(c->string,string)) c=c->next; return c;}
+cJSON *cJSON_GetObjectItem(cJSON *object,const char *string)
+{
+	cJSON *c;size_t i;
+	if (string && !object->index && object->childcount>=INDEX_MIN_ITEMS && !(object->type&cJSON_IsReference)) build_index(object);
+	if (!string || !object->index)
+	{
+		c=object->child; while (c && cJSON_strcasecmp(c->string,string)) c=c->next; return c;
+	}
+	for (i=hash_name(string)&object->index->mask;(c=object->index->slots[i]);i=(i+1)&object->index->mask)
+		if (!cJSON_strcasecmp(c->string,string)) return c;
+	return 0;
+}
 
 /* Utility for array list handling. */
 static void suffix_object(cJSON *prev,cJSON *item) {prev->next=item;item->prev=prev;}
 /* Utility for handling references. */
-static cJSON *create_reference(cJSON *item) {cJSON *ref=cJSON_New_Item();if (!ref) return 0;memcpy(ref,item,sizeof(cJSON));ref->string=0;ref->type|=cJSON_IsReference;ref->next=ref->prev=0;return ref;}
+static cJSON *create_reference(cJSON *item) {cJSON *ref=cJSON_New_Item();if (!ref) return 0;memcpy(ref,item,sizeof(cJSON));ref->string=0;ref->type|=cJSON_IsReference;ref->next=ref->prev=0;ref->index=0;return ref;}
 
 /* Add item to array/object. */
-void   cJSON_AddItemToArray(cJSON *array, cJSON *item)						{cJSON *c=array->child;if (!item) return; if (!c) {array->child=item;} else {while (c && c->next) c=c->next; suffix_object(c,item);}}
-void   cJSON_AddItemToObject(cJSON *object,const char *string,cJSON *item)	{if (!item) return; if (item->string) cJSON_free(item->string);item->string=cJSON_strdup(string);cJSON_AddItemToArray(object,item);}
+void   cJSON_AddItemToArray(cJSON *array, cJSON *item)
+{
+	cJSON *c=array->last;
+	if (!item) return;
+	if (!array->child) array->child=item;
+	else
+	{
+		if (!c || c->next) {c=array->child;while (c->next) c=c->next;}	/* no valid tail, e.g. of a reference */
+		suffix_object(c,item);
+	}
+	array->last=item;array->childcount++;
+	index_item(array,item);
+}
+void   cJSON_AddItemToObject(cJSON *object,const char *string,cJSON *item)	{if (!item) return; if (item->string && !(item->type&cJSON_NameIsInSitu)) cJSON_free(item->string);item->type&=~cJSON_NameIsInSitu;item->string=cJSON_strdup(string);cJSON_AddItemToArray(object,item);}
 void	cJSON_AddItemReferenceToArray(cJSON *array, cJSON *item)						{cJSON_AddItemToArray(array,create_reference(item));}
 void	cJSON_AddItemReferenceToObject(cJSON *object,const char *string,cJSON *item)	{cJSON_AddItemToObject(object,string,create_reference(item));}
 
-cJSON *cJSON_DetachItemFromArray(cJSON *array,int which)			{cJSON *c=array->child;while (c && which>0) c=c->next,which--;if (!c) return 0;
-	if (c->prev) c->prev->next=c->next;if (c->next) c->next->prev=c->prev;if (c==array->child) array->child=c->next;c->prev=c->next=0;return c;}
+/* Unlink an item from its array/object. */
+static cJSON *detach_item(cJSON *array,cJSON *c)
+{
+	if (c->prev) c->prev->next=c->next;
+	if (c->next) c->next->prev=c->prev;
+	if (c==array->child) array->child=c->next;
+	if (c==array->last) array->last=c->prev;
+	array->childcount--;drop_index(array);
+	c->prev=c->next=0;return c;
+}
+cJSON *cJSON_DetachItemFromArray(cJSON *array,int which)			{cJSON *c=array->child;while (c && which>0) c=c->next,which--;if (!c) return 0;return detach_item(array,c);}
 void   cJSON_DeleteItemFromArray(cJSON *array,int which)			{cJSON_Delete(cJSON_DetachItemFromArray(array,which));}
-cJSON *cJSON_DetachItemFromObject(cJSON *object,const char *string) {int i=0;cJSON *c=object->child;while (c && cJSON_strcasecmp(c->string,string)) i++,c=c->next;if (c) return cJSON_DetachItemFromArray(object,i);return 0;}
+cJSON *cJSON_DetachItemFromObject(cJSON *object,const char *string) {cJSON *c=cJSON_GetObjectItem(object,string);if (c) return detach_item(object,c);return 0;}
 void   cJSON_DeleteItemFromObject(cJSON *object,const char *string) {cJSON_Delete(cJSON_DetachItemFromObject(object,string));}
 
 /* Replace array/object items with new ones. */
-void   cJSON_ReplaceItemInArray(cJSON *array,int which,cJSON *newitem)		{cJSON *c=array->child;while (c && which>0) c=c->next,which--;if (!c) return;
+static void replace_item(cJSON *array,cJSON *c,cJSON *newitem)
+{
 	newitem->next=c->next;newitem->prev=c->prev;if (newitem->next) newitem->next->prev=newitem;
-	if (c==array->child) array->child=newitem; else newitem->prev->next=newitem;c->next=c->prev=0;cJSON_Delete(c);}
-void   cJSON_ReplaceItemInObject(cJSON *object,const char *string,cJSON *newitem){int i=0;cJSON *c=object->child;while(c && cJSON_strcasecmp(c->string,string))i++,c=c->next;if(c){newitem->string=cJSON_strdup(string);cJSON_ReplaceItemInArray(object,i,newitem);}}
+	if (c==array->child) array->child=newitem; else newitem->prev->next=newitem;
+	if (c==array->last) array->last=newitem;
+	drop_index(array);
+	c->next=c->prev=0;cJSON_Delete(c);
+}
+void   cJSON_ReplaceItemInArray(cJSON *array,int which,cJSON *newitem)		{cJSON *c=array->child;while (c && which>0) c=c->next,which--;if (!c) return;replace_item(array,c,newitem);}
+void   cJSON_ReplaceItemInObject(cJSON *object,const char *string,cJSON *newitem){cJSON *c=cJSON_GetObjectItem(object,string);if(c){newitem->type&=~cJSON_NameIsInSitu;newitem->string=cJSON_strdup(string);replace_item(object,c,newitem);}}
 
 /* Create basic types: */
 cJSON *cJSON_CreateNull()						{cJSON *item=cJSON_New_Item();if(item)item->type=cJSON_NULL;return item;}
@@ -513,12 +622,12 @@ cJSON *cJSON_CreateTrue()						{cJSON *item=cJSON_New_Item();if(item)item->type=
 cJSON *cJSON_CreateFalse()						{cJSON *item=cJSON_New_Item();if(item)item->type=cJSON_False;return item;}
 cJSON *cJSON_CreateBool(int b)					{cJSON *item=cJSON_New_Item();if(item)item->type=b?cJSON_True:cJSON_False;return item;}
 cJSON *cJSON_CreateNumber(double num)			{cJSON *item=cJSON_New_Item();if(item){item->type=cJSON_Number;item->valuedouble=num;item->valueint=(int)num;}return item;}
-cJSON *cJSON_CreateString(const char *string)	{cJSON *item=cJSON_New_Item();if(item){item->type=cJSON_String;item->valuestring=cJSON_strdup(string);}return item;}
+cJSON *cJSON_CreateString(const char *string)	{cJSON *item=cJSON_New_Item();if(item){item->type=cJSON_String;item->valuestring=cJSON_strdup(string);item->valuelength=item->valuestring?strlen(item->valuestring):0;}return item;}
 cJSON *cJSON_CreateArray()						{cJSON *item=cJSON_New_Item();if(item)item->type=cJSON_Array;return item;}
 cJSON *cJSON_CreateObject()						{cJSON *item=cJSON_New_Item();if(item)item->type=cJSON_Object;return item;}
 
 /* Create Arrays: */
-cJSON *cJSON_CreateIntArray(int *numbers,int count)				{int i;cJSON *n=0,*p=0,*a=cJSON_CreateArray();for(i=0;a && i<count;i++){n=cJSON_CreateNumber(numbers[i]);if(!i)a->child=n;else suffix_object(p,n);p=n;}return a;}
-cJSON *cJSON_CreateFloatArray(float *numbers,int count)			{int i;cJSON *n=0,*p=0,*a=cJSON_CreateArray();for(i=0;a && i<count;i++){n=cJSON_CreateNumber(numbers[i]);if(!i)a->child=n;else suffix_object(p,n);p=n;}return a;}
-cJSON *cJSON_CreateDoubleArray(double *numbers,int count)		{int i;cJSON *n=0,*p=0,*a=cJSON_CreateArray();for(i=0;a && i<count;i++){n=cJSON_CreateNumber(numbers[i]);if(!i)a->child=n;else suffix_object(p,n);p=n;}return a;}
-cJSON *cJSON_CreateStringArray(const char **strings,int count)	{int i;cJSON *n=0,*p=0,*a=cJSON_CreateArray();for(i=0;a && i<count;i++){n=cJSON_CreateString(strings[i]);if(!i)a->child=n;else suffix_object(p,n);p=n;}return a;}
+cJSON *cJSON_CreateIntArray(int *numbers,int count)				{int i;cJSON *a=cJSON_CreateArray();for(i=0;a && i<count;i++)cJSON_AddItemToArray(a,cJSON_CreateNumber(numbers[i]));return a;}
+cJSON *cJSON_CreateFloatArray(float *numbers,int count)			{int i;cJSON *a=cJSON_CreateArray();for(i=0;a && i<count;i++)cJSON_AddItemToArray(a,cJSON_CreateNumber(numbers[i]));return a;}
+cJSON *cJSON_CreateDoubleArray(double *numbers,int count)		{int i;cJSON *a=cJSON_CreateArray();for(i=0;a && i<count;i++)cJSON_AddItemToArray(a,cJSON_CreateNumber(numbers[i]));return a;}
+cJSON *cJSON_CreateStringArray(const char **strings,int count)	{int i;cJSON *a=cJSON_CreateArray();for(i=0;a && i<count;i++)cJSON_AddItemToArray(a,cJSON_CreateString(strings[i]));return a;}
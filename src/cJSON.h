@@ -38,15 +38,21 @@ extern "C"
 #define cJSON_Object 6
 	
 #define cJSON_IsReference 256
+#define cJSON_StringIsInSitu 512	/* valuestring points into the text given to cJSON_ParseInSitu() */
+#define cJSON_NameIsInSitu 1024		/* string points into the text given to cJSON_ParseInSitu() */
 
 /* The cJSON structure: */
 typedef struct cJSON {
 	struct cJSON *next,*prev;	/* next/prev allow you to walk array/object chains. Alternatively, use GetArraySize/GetArrayItem/GetObjectItem */
 	struct cJSON *child;		/* An array or object item will have a child pointer pointing to a chain of the items in the array/object. */
+	struct cJSON *last;			/* Last item of the chain, so that appending does not walk it. */
+	int childcount;				/* Number of items in the chain. */
+	struct cJSON_Index *index;	/* Hash index over the names of the items of a large object, built by cJSON_GetObjectItem. */
 
 	int type;					/* The type of the item, as above. */
 
 	char *valuestring;			/* The item's string, if type==cJSON_String */
+	size_t valuelength;			/* Length of valuestring, if type==cJSON_String */
 	int valueint;				/* The item's number, if type==cJSON_Number */
 	double valuedouble;			/* The item's number, if type==cJSON_Number */
 
@@ -64,6 +70,9 @@ extern void cJSON_InitHooks(cJSON_Hooks* hooks);
 
 /* Supply a block of JSON, and this returns a cJSON object you can interrogate. Call cJSON_Delete when finished. */
 extern cJSON *cJSON_Parse(const char *value);
+/* Like cJSON_Parse, but strings are unescaped inside value itself and point into it instead of being copied.
+   value must stay alive until cJSON_Delete, strings without escapes need no allocation at all. */
+extern cJSON *cJSON_ParseInSitu(char *value);
 /* Render a cJSON entity to text for transfer/storage. Free the char* when finished. */
 extern char  *cJSON_Print(cJSON *item);
 /* Render a cJSON entity to text for transfer/storage without any formatting. Free the char* when finished. */
@@ -71,7 +80,8 @@ extern char  *cJSON_PrintUnformatted(cJSON *item);
 /* Delete a cJSON entity and all subentities. */
 extern void   cJSON_Delete(cJSON *c);
 
-/* Returns the number of items in an array (or object). */
+/* Returns the number of items in an array (or object). Items must only be added and removed by the calls below, which
+   keep the cached size, the tail and the name index up to date. */
 extern int	  cJSON_GetArraySize(cJSON *array);
 /* FGG update to support update of json objects with other json objects */
 extern char *cJSON_GetArrayItemName(cJSON *array,int item);
@@ -8,9 +8,14 @@
 #
 # Developer: Daniil Efremov
  */
+#ifdef __linux__
+    #define _GNU_SOURCE /* accept4, pthread_setaffinity_np */
+#endif
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
 
 #if defined(__linux__) || defined(__APPLE__)
     #include <unistd.h>
@@ -19,13 +24,19 @@
     #include <netdb.h> /* struct hostent, gethostbyname */
     #include <netinet/in.h> /* struct sockaddr_in, struct sockaddr */
     #include <ctype.h>
+    #include <fcntl.h>
+    #include <signal.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/uio.h>
+#include <dirent.h>
 
 #elif _WIN32
 #include <winsock2.h>
 #include <ws2tcpip.h>
 #include <windows.h>
 #include <io.h>
+#include <sys/stat.h>
 
     struct thread_win_params {
       int sock;
@@ -40,12 +51,37 @@
 #else
 #endif
 
+#ifdef __linux__
+    #include <time.h>
+    #include <stdint.h>
+    #include <pthread.h>
+    #include <sched.h>
+    #include <sys/epoll.h>
+    #include <sys/eventfd.h>
+    #include <sys/sendfile.h>
+#endif
+
 #include "cJSON.h"
 #include "base64.h"
 #include "urldecoder.h"
 #include "net_uuid.h"
-
-static char *const CK_JSON_KEY = "ck_json=";
+#include "http_parser.h"
+#include "buffer_pool.h"
+#include "arena.h"
+#include "push_stream.h"
+#include "json_writer.h"
+#include "shell_runner.h"
+#include "job_engine.h"
+#include "benchmark.h"
+#include "content_store.h"
+#include "upload_session.h"
+#include "compressor.h"
+#include "tar_stream.h"
+
+static char *const CK_JSON_FIELD = "ck_json";
+static char *const RAW_FILES_PATH = "/files/";     /* raw file transfers: PUT|GET /files/<name>?secretkey=... */
+static char *const RAW_PARAM_ARCHIVE = "archive";  /* ?archive=tar - a directory tree as a tar stream */
+static char *const SECRET_KEY_HEADER = "X-CK-Secret-Key";  /* lets a large push with a wrong key be refused before its body */
 
 static char *const JSON_PARAM_NAME_COMMAND = "action";
 static char *const JSON_PARAM_PARAMS = "parameters";
@@ -53,17 +89,77 @@ static char *const JSCON_PARAM_VALUE_PUSH = "push";
 static char *const JSON_PARAM_FILE_NAME = "filename";
 static char *const JSON_PARAM_FILE_CONTENT = "file_content_base64";
 static char *const JSON_PARAM_SHELL_COMMAND = "cmd";
+static char *const JSON_PARAM_ASYNC = "async";
+static char *const JSON_PARAM_STREAM = "stream";
+static char *const JSON_PARAM_MEASURE = "measure";
+static char *const JSON_PARAM_REPEAT = "repeat";
+static char *const JSON_PARAM_WARMUP = "warmup";
+static char *const JSON_PARAM_MIN_REPEAT = "min_repeat";
+static char *const JSON_PARAM_TARGET_RCI = "target_rci";
+static char *const JSON_PARAM_EXCLUSIVE = "exclusive";
+static char *const JSON_PARAM_HASH = "hash";
+static char *const JSON_PARAM_HASHES = "hashes";
+static char *const JSON_PARAM_UPLOAD_ID = "upload_id";
+static char *const JSON_PARAM_OFFSET = "offset";
+static char *const JSON_PARAM_TOTAL_SIZE = "total_size";
+static char *const JSON_PARAM_LENGTH = "length";
+static char *const JSON_PARAM_COMPRESSION = "compression";
+static char *const JSON_PARAM_FILES = "files";
+static char *const JSON_PARAM_FILE_NAMES = "filenames";
+static char *const JSON_PARAM_RUN_UUID = "runUUID";
 
 /**
  * todo move out to config /etc/ck-crowdnode/ck-crowdnode.properties
  */
 #define MAX_BUFFER_SIZE 1024
+#define MAX_REQUEST_BODY_SIZE (1L << 30)  /* requests which are buffered in memory */
+#define MAX_UPLOAD_SIZE (LONG_MAX / 16)   /* raw uploads streamed to disk */
+#define FILE_BUFFER_SIZE (64 * 1024)      /* raw file transfers are streamed through a buffer of this size */
+#define READ_AHEAD_SIZE (4 * 1024 * 1024) /* of the next file of a batch, read while the current one is sent */
+#define STREAM_PULL_THRESHOLD (1024 * 1024) /* larger pulls are encoded while they are sent */
+#define STREAM_BODY_THRESHOLD (64 * 1024) /* larger JSON commands are decoded while they are received */
+#define REQUEST_ARENA_SIZE (64 * 1024)    /* first block of the per request arena, kept between requests */
+#define REQUEST_PRESIZE_LIMIT (1024 * 1024) /* larger bodies are buffered as they arrive, not allocated up front */
+#define RESPONSE_HEADER_SIZE 512
+#define COMPRESS_MIN_SIZE 1024         /* smaller response bodies are not worth compressing */
 #define DEFAULT_SERVER_PORT 3333
+#ifdef _WIN32
 static const int MAXPENDING = 5;    /* Maximum outstanding connection requests */
+#endif
 
 static char *const JSON_CONFIG_PARAM_PORT = "port";
 static char *const JSON_CONFIG_PARAM_PATH_TO_FILES = "path_to_files";
 static char *const JSON_CONFIG_PARAM_SECRET_KEY = "secret_key";
+static char *const JSON_CONFIG_PARAM_WORKER_THREADS = "worker_threads";   /* 0 or missing - number of online CPUs */
+static char *const JSON_CONFIG_PARAM_KEEP_ALIVE_TIMEOUT = "keep_alive_timeout";   /* seconds */
+static char *const JSON_CONFIG_PARAM_KEEP_ALIVE_MAX_REQUESTS = "keep_alive_max_requests";
+static char *const JSON_CONFIG_PARAM_BUFFER_POOL_SIZE = "buffer_pool_size";   /* megabytes of idle buffers kept per worker */
+static char *const JSON_CONFIG_PARAM_MAX_RUNNING_JOBS = "max_running_jobs";   /* asynchronous shell commands run at once */
+static char *const JSON_CONFIG_PARAM_MAX_QUEUED_JOBS = "max_queued_jobs";
+static char *const JSON_CONFIG_PARAM_MAX_FINISHED_JOBS = "max_finished_jobs";   /* finished jobs kept for state */
+static char *const JSON_CONFIG_PARAM_JOB_RETENTION = "job_retention";   /* seconds, 0 - keep until evicted by max_finished_jobs */
+static char *const JSON_CONFIG_PARAM_JOB_CORES = "job_cores";   /* like "2-5,7", shell commands are bound to them, empty - not bound */
+static char *const JSON_CONFIG_PARAM_JOB_CORES_PER_JOB = "job_cores_per_job";
+static char *const JSON_CONFIG_PARAM_CONTENT_STORE = "content_store";   /* 1 - pushed content is kept once, see handleHas() */
+
+static char *const JSON_CONFIG_PARAM_UPLOAD_TIMEOUT = "upload_timeout";   /* seconds a resumable upload may be idle */
+static char *const JSON_CONFIG_PARAM_MAX_UPLOAD_SIZE = "max_upload_size";   /* megabytes of a resumable upload or a decompressed
+                                                                              push, 0 - up to the free space */
+
+static char *const CONTENT_STORE_DIR = ".objects/";    /* in the files directory */
+
+#define DEFAULT_KEEP_ALIVE_TIMEOUT 15
+#define DEFAULT_KEEP_ALIVE_MAX_REQUESTS 100
+#define DEFAULT_BUFFER_POOL_SIZE 64
+#define DEFAULT_MAX_RUNNING_JOBS 1
+#define DEFAULT_MAX_QUEUED_JOBS 1000
+#define DEFAULT_MAX_FINISHED_JOBS 100
+#define DEFAULT_JOB_RETENTION 3600
+#define DEFAULT_JOB_CORES_PER_JOB 1
+#define DEFAULT_UPLOAD_TIMEOUT 3600
+#define DEFAULT_MAX_UPLOAD_SIZE 16384
+
+#define MAX_MISSING_RANGES 64      /* reported in the response to a chunk of a resumable push */
 
 #ifdef _WIN32
 static char *const DEFAULT_BASE_DIR = "%LOCALAPPDATA%/ck-crowdnode-files/";
@@ -95,6 +191,49 @@ int WSAGetLastError() {
  *   output result JSON:
  *     {"state":"finished", "compileUUID":"567567567567567"}
  *
+ *   with "content_store" configured the result has the SHA-256 of the content, "hash":"<64 hex digits>". A push with
+ *   a "hash" is rejected if the content does not match it; without content it gives stored content a file name:
+ *     {"action":"push", "filename":"file1", "hash":"<64 hex digits>"}
+ *
+ *   a push is decoded to disk while it is received, instead of being buffered, if it is POSTed with the secret key
+ *   in the query string (?secretkey=...) or in an X-CK-Secret-Key header as well.
+ *
+ *   a large file can be pushed in chunks, in any order and over several connections, and a dropped chunk is pushed
+ *   again. The chunks of one file share an upload id chosen by the client; the chunk which completes the file
+ *   saves it:
+ *     {"action":"push", "filename":"file1", "upload_id":"<letters, digits, - or _>", "total_size":1000000,
+ *      "offset":65536, "file_content_base64":"<base64 encoded chunk>"}
+ *   total_size may not exceed "max_upload_size" megabytes of the configuration nor the free space.
+ *
+ *   output result JSON, the ranges still missing are [offset, length] pairs (the first MAX_MISSING_RANGES), a chunk
+ *   without content just asks for them:
+ *     {"return":"0", "upload_id":"...", "total_size":1000000, "received":65536, "complete":false,
+ *      "missing":[[0, 65536], [131072, 868928]]}
+ *
+ *   with "compression":"gzip" (or "zstd" if built WITH_ZSTD) the content, or each chunk, is compressed; sizes,
+ *   offsets and the hash are those of the decompressed file. A pull with "compression" returns the content compressed
+ *   and names it in the result, "compression":"gzip". Any JSON result is compressed by the Accept-Encoding of the
+ *   request.
+ *
+ * has command
+ *   input JSON:
+ *     {"action":"has", "hashes":["<64 hex digits>", ...]}
+ *
+ *   output result JSON, the hashes of the content which is not stored and has to be pushed:
+ *     {"return":"0", "missing":["<64 hex digits>", ...]}
+ *
+ * push_batch and pull_batch commands move many files in one round trip, with the outcome of each file:
+ *   input JSON:
+ *     {"action":"push_batch", "files":[{"filename":"a", "file_content_base64":"..."}, {"filename":"b", "hash":"..."}]}
+ *     {"action":"pull_batch", "filenames":["a", "b"]}
+ *
+ *   output result JSON, a pull with the content and "size" of each file that could be read:
+ *     {"return":"0", "files":[{"filename":"a", "return":"0"}, {"filename":"b", "return":"1", "error":"..."}],
+ *      "count":2, "failed":1}
+ *
+ *   a directory tree is transferred as a tar stream with PUT|GET /files/<dir>?archive=tar&secretkey=..., an upload
+ *   is extracted while it is received and answered like push_batch.
+ *
  * run command
  *   input JSON:
  *     {"command":"run", "parameters":{"compileUUID":"567567567567567"} }
@@ -104,14 +243,41 @@ int WSAGetLastError() {
  *     {"state":"finished ok"}
  *     {"state":"finished error", "errorMessage":"File not found"}
  *
+ * shell command
+ *   input JSON:
+ *     {"action":"shell", "cmd":"ls -l", "async":"yes"}
+ *
+ *   output result JSON (without async the result of the state command for the finished job):
+ *     {"return":"0", "runUUID":"12312312323213", "state":"queued"}
+ *
+ *   with "stream":"yes" instead of async the output is sent as it is produced, one JSON document per line:
+ *     {"stream":"stdout", "data":"..."}
+ *     {"stream":"stderr", "data":"..."}
+ *     {"return":"0", "stream":"exit", "return_code":0, "signal":0}
+ *
+ *   with "measure":"yes" the final result also has the resource usage of the command (see writeMeasurement())
+ *
+ *   with "repeat":N and/or "warmup":M the command is run M times, then up to N times while it succeeds; "target_rci"
+ *   stops earlier once the 95% confidence interval of the mean wall time is narrower than this fraction of the mean
+ *   (checked from "min_repeat" runs on, 5 by default). stdout and stderr are those of the last run, streamed output
+ *   carries the number of its run ("run":0 is the first warmup run), and the result has the statistics:
+ *     "benchmark":{"warmup":2, "runs":10, "converged":false, "times":[0.0102, ...], "median":0.0101, "mean":0.0102,
+ *                  "stddev":0.0001, "min":0.0100, "max":0.0105, "outliers":1, "rci":0.007}
+ *   measured, it holds the resource usage of every run as "measurements":[...] instead of the result.
+ *
+ *   with "job_cores" configured every command waits for a slot of "job_cores_per_job" cores and is bound to them,
+ *   first come first served; without it only the asynchronous ones wait, for one of "max_running_jobs" slots.
+ *   "exclusive":"yes" waits until no other command runs and holds the following ones back until it is finished.
+ *
  * state command
  *   input JSON:
  *     {"command":"state", "parameters":{"runUUID":"12312312323213"} }
  *
  *   output result JSON:
- *     {"state":"in progress"}
- *     {"state":"finished ok"}
- *     {"state":"finished error", "errorMessage":"File not found"}
+ *     {"return":"0", "runUUID":"12312312323213", "state":"queued"}
+ *     {"return":"0", "runUUID":"12312312323213", "state":"running", "stdout":"<so far>", "stderr":"<so far>"}
+ *     {"return":"0", "runUUID":"12312312323213", "state":"finished", "return_code":0, "signal":0, "stdout":"...", "stderr":"..."}
+ *     {"return":"0", "runUUID":"12312312323213", "state":"failed", "stdout":"", "stderr":""}
  *
  * pull command
  *   input JSON:
@@ -120,13 +286,79 @@ int WSAGetLastError() {
  *   output result JSON:
  *     {"state":"finished", "parameters": {"filename":"file1", "data":"<base64 encoded binary file data >"} }
  *
- *
- * todo list:
- * 2) Check/Implement concurrent execution - looks like thread fors well at linus and windows as well
- * 3) Implement "shell' commnad
  */
 
-void doProcessing(int sock, char *baseDir);
+typedef struct ArchiveUpload ArchiveUpload;
+typedef struct ArchiveDownload ArchiveDownload;
+typedef struct PullDownload PullDownload;
+typedef struct EventLoop EventLoop;
+typedef struct ShellTask ShellTask;
+
+/**
+ * Per-connection state. The request is accumulated in 'message' and the serialized HTTP response is queued
+ * in 'response' until it is fully written to the socket, so that a connection can be served either by a blocking
+ * loop or by the event loop without a process per client.
+ */
+typedef struct Connection {
+    int sock;
+
+    buffer_pool_t *pool;        /* pool of the event loop the message and response buffers come from, may be NULL */
+    arena_t *arena;             /* arena of the event loop for the allocations made while a request is processed, may be NULL */
+
+    char *message;       /* request bytes received so far, zero terminated */
+    int messageSize;     /* number of bytes in message */
+    size_t messageCapacity;
+    http_request_t request;     /* parser state of the first request in message */
+    int peerClosed;      /* client shut down its side of the connection */
+    int eventLoop;       /* served by the event loop, so processing must not block */
+    EventLoop *loop;     /* the event loop, NULL if served by a blocking loop */
+    int waitingRequestLen;  /* bytes of the request answered by a shell task, removed once the task is done */
+    int keepAlive;       /* keep the connection open after the current response */
+    int requestCount;    /* requests served on this connection */
+    int requestRouted;   /* routeRequest() has seen the headers of the current request */
+    long lastActive;     /* monotonic time of the last activity, seconds */
+
+    FILE *uploadFile;    /* raw upload being streamed to disk */
+    char *uploadPath;    /* destination of the upload */
+    char *uploadTempPath;    /* the upload is written here and renamed to uploadPath once complete */
+    long uploadRemaining;    /* body bytes still to be received */
+    push_stream_t *pushStream;  /* JSON command streamed through a filter instead of being buffered */
+    sha256_t uploadDigest;      /* of the received content, if the content store is enabled */
+    long long pushSize;         /* content bytes of a streamed push, after decompression */
+    ArchiveUpload *archiveUpload;   /* tar body being extracted while it is received */
+
+    char responseHeader[RESPONSE_HEADER_SIZE];  /* HTTP headers of the queued response */
+    int responseHeaderSize;
+    char *response;      /* queued HTTP response body */
+    int responseSize;
+    size_t responseCapacity;
+    int responseSent;    /* bytes of headers and body sent so far */
+    FILE *sendFile;      /* file sent as the response body after the queued response headers */
+    long long sendFileOffset;
+    long long sendFileEnd;
+    ArchiveDownload *sendArchive;   /* directory tree sent as a tar body, part by part */
+    PullDownload *sendPull;         /* large pull encoded part by part while it is sent */
+
+    int state;
+
+    struct Connection *prev, *next;     /* connections of the same event loop */
+} Connection;
+
+/* connection states */
+#define CONN_READING  0     /* waiting for the rest of the request */
+#define CONN_WRITING  1     /* response is queued and being sent */
+#define CONN_CLOSING  2     /* nothing left to do, the connection can be closed */
+#define CONN_WAITING 3      /* a job engine thread runs a shell command and hands the connection back */
+#define CONN_UPLOADING 4    /* request body is being streamed to a file */
+
+void doProcessing(Connection *conn, char *baseDir);
+void processCommand(Connection *conn, cJSON *commandJSON, char *baseDir);
+void handleFileDownload(Connection *conn, char *baseDir);
+void serveConnection(int sock, char *baseDir);
+#ifdef __linux__
+void runEventLoop(int listenSock, char *baseDir);
+void runWorkers(int port, int workerCount, char *baseDir);
+#endif
 
 int sockSend(int sock, const void* buf, size_t len) {
 #ifdef _WIN32
@@ -136,6 +368,31 @@ int sockSend(int sock, const void* buf, size_t len) {
 #endif
 }
 
+/**
+ * Sends two buffers with a single system call, so that response headers and body leave in the same packet.
+ */
+int sockSendv(int sock, const void *buf1, size_t len1, const void *buf2, size_t len2) {
+#ifdef _WIN32
+    WSABUF bufs[2];
+    DWORD sent;
+    bufs[0].buf = (char *) buf1;
+    bufs[0].len = (ULONG) len1;
+    bufs[1].buf = (char *) buf2;
+    bufs[1].len = (ULONG) len2;
+    if (0 != WSASend(sock, bufs, 2, &sent, 0, NULL, NULL)) {
+        return -1;
+    }
+    return (int) sent;
+#else
+    struct iovec iov[2];
+    iov[0].iov_base = (void *) buf1;
+    iov[0].iov_len = len1;
+    iov[1].iov_base = (void *) buf2;
+    iov[1].iov_len = len2;
+    return writev(sock, iov, 2);
+#endif
+}
+
 int sockSendAll(int sock, const void* buf, size_t len) {
     const char* p = buf;
     while (0 < len) {
@@ -149,60 +406,221 @@ int sockSendAll(int sock, const void* buf, size_t len) {
     return 0;
 }
 
-int sendHttpResponse(int sock, int httpStatus, char* payload, int size) {
-    // send HTTP headers
-    char buf[300];
-    int n = sprintf(buf, "HTTP/1.1 %d OK\r\nContent-Type: text/html; charset=UTF-8\r\nContent-Length: %d\r\n\r\n", httpStatus, size);
-    if (0 >= n) {
+const char *httpStatusText(int httpStatus) {
+    switch (httpStatus) {
+        case 200: return "OK";
+        case 206: return "Partial Content";
+        case 400: return "Bad Request";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Payload Too Large";
+        case 416: return "Range Not Satisfiable";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 505: return "HTTP Version Not Supported";
+        default: return "Unknown";
+    }
+}
+
+/**
+ * Appends bytes to the queued response body.
+ */
+static int queueResponse(Connection *conn, const char *buf, int size) {
+    char *response = buffer_pool_grow(conn->pool, conn->response, conn->responseSize, &conn->responseCapacity,
+                                      conn->responseSize + size);
+    if (!response) {
+        perror("[ERROR]: Memory not allocated for HTTP response");
+        return -1;
+    }
+    memcpy(response + conn->responseSize, buf, size);
+    conn->response = response;
+    conn->responseSize += size;
+    conn->state = CONN_WRITING;
+    return 0;
+}
+
+/**
+ * Queues HTTP response headers for a body of the given type and length, followed by extraHeaders (complete
+ * header lines) unless it is NULL. A body of unknown length (-1) is sent chunked to HTTP/1.1 clients and delimited
+ * by closing the connection for HTTP/1.0 ones.
+ */
+static int sendHttpHeaders(Connection *conn, int httpStatus, const char *contentType, long long contentLength,
+                           const char *extraHeaders) {
+    char lengthHeader[48] = "Transfer-Encoding: chunked\r\n";
+    if (contentLength >= 0) {
+        snprintf(lengthHeader, sizeof(lengthHeader), "Content-Length: %lld\r\n", contentLength);
+    } else if (conn->request.versionMinor < 1) {
+        conn->keepAlive = 0;
+        lengthHeader[0] = '\0';
+    }
+    int n = snprintf(conn->responseHeader, sizeof(conn->responseHeader),
+                     "HTTP/1.1 %d %s\r\nContent-Type: %s\r\n%sConnection: %s\r\n%s\r\n",
+                     httpStatus, httpStatusText(httpStatus), contentType, lengthHeader,
+                     conn->keepAlive ? "keep-alive" : "close", extraHeaders ? extraHeaders : "");
+    if (0 >= n || n >= (int) sizeof(conn->responseHeader)) {
         perror("sprintf failed");
         return -1;
     }
-    if (0 > sockSendAll(sock, buf, n)) {
-        perror("Failed to send HTTP response headers");
+    conn->responseHeaderSize = n;
+    conn->state = CONN_WRITING;
+    return 0;
+}
+
+/**
+ * Queues HTTP response headers and payload in the connection, so that they are sent in one go.
+ */
+int sendHttpResponse(Connection *conn, int httpStatus, char* payload, int size) {
+    if (sendHttpHeaders(conn, httpStatus, "text/html; charset=UTF-8", size, NULL) < 0) {
         return -1;
     }
+    return queueResponse(conn, payload, size);
+}
+
+/**
+ * Starts a JSON response body, which is written straight into a buffer of the connection pool.
+ */
+static void beginJSONResponse(Connection *conn, json_writer_t *writer) {
+    json_writer_init(writer, conn->pool);
+}
+
+/**
+ * A response body being compressed into a buffer of the connection pool.
+ */
+typedef struct {
+    buffer_pool_t *pool;
+    char *buf;
+    size_t size;
+    size_t capacity;
+} ResponseBuffer;
 
-    // send payload
-    if (0 > sockSendAll(sock, payload, size)) {
-        perror("Failed to send HTTP response body");
+/**
+ * compressor_sink_t appending to a ResponseBuffer.
+ */
+static int appendResponse(void *ctx, const void *data, size_t len) {
+    ResponseBuffer *out = ctx;
+    char *buf = buffer_pool_grow(out->pool, out->buf, out->size, &out->capacity, out->size + len);
+    if (!buf) {
         return -1;
     }
+    memcpy(buf + out->size, data, len);
+    out->buf = buf;
+    out->size += len;
+    return 0;
 }
 
-void sendErrorMessage(int sock, char * errorMessage, const char *errorCode) {
-	perror(errorMessage);
+/**
+ * Returns the content coding of a response, chosen by the Accept-Encoding of the request.
+ */
+static compression_t getResponseEncoding(Connection *conn) {
+    int acceptLen = 0;
+    const char *accept = conn->message ? http_get_header(&conn->request, conn->message, "Accept-Encoding", &acceptLen)
+                                       : NULL;
+    return compression_negotiate(accept, acceptLen);
+}
 
-	cJSON *resultJSON = cJSON_CreateObject();
-    if (!resultJSON) {
-        perror("[ERROR]: resultJSON cannot be created");
-        return;
+/**
+ * Returns the headers describing the content coding of a response.
+ */
+static const char *getEncodingHeaders(compression_t encoding) {
+    return COMPRESSION_ZSTD == encoding ? "Content-Encoding: zstd\r\nVary: Accept-Encoding\r\n"
+                                        : "Content-Encoding: gzip\r\nVary: Accept-Encoding\r\n";
+}
+
+/**
+ * Compresses the queued response body if the client accepts one of the supported content codings (Accept-Encoding)
+ * and the body is large enough to gain from it.
+ *
+ * Returns the headers describing the coding, NULL if the body is sent as it is.
+ */
+static const char *compressResponse(Connection *conn) {
+    if (conn->responseSize < COMPRESS_MIN_SIZE || !conn->message) {
+        return NULL;
+    }
+    compression_t encoding = getResponseEncoding(conn);
+    if (COMPRESSION_NONE == encoding) {
+        return NULL;
     }
 
-    cJSON_AddItemToObject(resultJSON, "return", cJSON_CreateString(errorCode));
-	cJSON_AddItemToObject(resultJSON, "error", cJSON_CreateString(errorMessage));
-	char *resultJSONtext = cJSON_PrintUnformatted(resultJSON);
-    if (!resultJSONtext) {
-        perror("[ERROR]: resultJSONtext cannot be created");
-        return;
+    ResponseBuffer out = {conn->pool, NULL, 0, 0};
+    compressor_t *compressor = compressor_create(encoding, 0);
+    int failed = !compressor || compressor_write(compressor, conn->response, conn->responseSize, appendResponse, &out) < 0
+                 || compressor_finish(compressor, appendResponse, &out) < 0;
+    compressor_free(compressor);
+    if (failed || out.size >= (size_t) conn->responseSize) {
+        if (out.buf) {
+            buffer_pool_put(conn->pool, out.buf, out.capacity);
+        }
+        return NULL;
     }
-    int n = sendHttpResponse(sock, 500, resultJSONtext, strlen(resultJSONtext));
-    if (n < 0) {
+    buffer_pool_put(conn->pool, conn->response, conn->responseCapacity);
+    conn->response = out.buf;
+    conn->responseSize = (int) out.size;
+    conn->responseCapacity = out.capacity;
+    return getEncodingHeaders(encoding);
+}
+
+/**
+ * Queues the JSON written since beginJSONResponse() as the response body, with its headers.
+ */
+static int sendJSONWriterResponse(Connection *conn, json_writer_t *writer, int httpStatus) {
+    if (json_writer_error(writer) || writer->len > INT_MAX) {
+        json_writer_free(writer);
+        perror("[ERROR]: JSON response cannot be created");
+        return -1;
+    }
+    buffer_pool_put(conn->pool, conn->response, conn->responseCapacity);
+    conn->response = writer->buf;
+    conn->responseSize = (int) writer->len;
+    conn->responseCapacity = writer->capacity;
+    const char *encodingHeaders = compressResponse(conn);
+    return sendHttpHeaders(conn, httpStatus, "text/html; charset=UTF-8", (long long) conn->responseSize,
+                           encodingHeaders);
+}
+
+/**
+ * Queues the result JSON as a successful HTTP response.
+ */
+int sendJSONResponse(Connection *conn, cJSON *resultJSON) {
+    json_writer_t writer;
+    beginJSONResponse(conn, &writer);
+    json_writer_cjson(&writer, resultJSON);
+    return sendJSONWriterResponse(conn, &writer, 200);
+}
+
+void sendErrorResponse(Connection *conn, int httpStatus, const char *errorMessage, const char *errorCode) {
+	perror(errorMessage);
+
+    json_writer_t writer;
+    beginJSONResponse(conn, &writer);
+    json_writer_begin_object(&writer);
+    json_writer_key(&writer, "return");
+    json_writer_string(&writer, errorCode);
+    json_writer_key(&writer, "error");
+    json_writer_string(&writer, errorMessage);
+    json_writer_end_object(&writer);
+    if (sendJSONWriterResponse(conn, &writer, httpStatus) < 0) {
 		perror("ERROR writing to socket");
-		return ;
 	}
-    free(resultJSONtext);
-    cJSON_Delete(resultJSON);
 }
 
+void sendErrorMessage(Connection *conn, char * errorMessage, const char *errorCode) {
+    sendErrorResponse(conn, 500, errorMessage, errorCode);
+}
+
+/**
+ * Returns str1 followed by str2, allocated with arena_malloc() (release it with arena_free()).
+ */
 char* concat(const char *str1, const char *str2) {
     size_t totalSize = strlen(str1) + strlen(str2) + sizeof(char);
-    char *message = malloc(totalSize);
-    memset(message, 0, totalSize);
+    char *message = arena_malloc(totalSize);
 
     if(!message){
         printf("[ERROR]: Memory not allocated for concat\n");
         exit(-1);
     }
+    memset(message, 0, totalSize);
 
     strcat(message, str1);
     strcat(message + strlen(str1), str2);
@@ -218,11 +636,44 @@ typedef struct {
     int	port;
     char *pathToFiles;
     char *secretKey;
+    int workerThreads;
+    int keepAliveTimeout;       /* idle connections are closed after this number of seconds */
+    int keepAliveMaxRequests;   /* connection is closed after serving this number of requests */
+    int bufferPoolSize;         /* megabytes of idle I/O buffers each worker keeps for reuse */
+    int maxRunningJobs;
+    int maxQueuedJobs;
+    int maxFinishedJobs;
+    int jobRetention;
+    char *jobCores;             /* cores the shell commands are bound to, "" - not bound */
+    int jobCoresPerJob;
+    int contentStore;           /* pushed content is deduplicated */
+    int uploadTimeout;
+    int maxUploadSize;          /* megabytes */
 
 } CKCrowdnodeServerConfig;
 
 CKCrowdnodeServerConfig *ckCrowdnodeServerConfig;
 char *serverSecretKey;
+static content_store_t *contentStore;   /* NULL if it is disabled */
+static upload_sessions_t *uploadSessions;   /* resumable pushes, NULL if they are not supported */
+
+#ifdef __linux__
+static pthread_mutex_t uuidMutex = PTHREAD_MUTEX_INITIALIZER;
+static job_engine_t *jobEngine;    /* shell commands of the event loops, shared by all of them */
+#endif
+
+/**
+ * Thread safe wrapper for get_uuid_string(), which keeps its clock state in static variables.
+ */
+void generateUUID(char *uuid_str, size_t size) {
+#ifdef __linux__
+    pthread_mutex_lock(&uuidMutex);
+    get_uuid_string(uuid_str, size);
+    pthread_mutex_unlock(&uuidMutex);
+#else
+    get_uuid_string(uuid_str, size);
+#endif
+}
 
 
 static char *const JSON_PARAM_NAME_SECRETKEY = "secretkey";
@@ -260,7 +711,7 @@ char *str_replace(char *orig, char *rep, char *with) {
     //    tmp points to the end of the result string
     //    ins points to the next occurrence of rep in orig
     //    orig points to the remainder of orig after "end of rep"
-    tmp = result = malloc(strlen(orig) + (len_with - len_rep) * count + 1);
+    tmp = result = arena_malloc(strlen(orig) + (len_with - len_rep) * count + 1);
 
     if (!result)
         return NULL;
@@ -341,6 +792,57 @@ int loadConfigFromFile(CKCrowdnodeServerConfig *ckCrowdnodeServerConfig, char**
     int port = portJSON->valueint;
     ckCrowdnodeServerConfig->port =port;
 
+    cJSON *workerThreadsJSON = cJSON_GetObjectItem(configSON, JSON_CONFIG_PARAM_WORKER_THREADS);
+    ckCrowdnodeServerConfig->workerThreads = workerThreadsJSON ? workerThreadsJSON->valueint : 0;
+
+    cJSON *keepAliveTimeoutJSON = cJSON_GetObjectItem(configSON, JSON_CONFIG_PARAM_KEEP_ALIVE_TIMEOUT);
+    ckCrowdnodeServerConfig->keepAliveTimeout = keepAliveTimeoutJSON && keepAliveTimeoutJSON->valueint > 0 ?
+                                                keepAliveTimeoutJSON->valueint : DEFAULT_KEEP_ALIVE_TIMEOUT;
+
+    cJSON *keepAliveMaxRequestsJSON = cJSON_GetObjectItem(configSON, JSON_CONFIG_PARAM_KEEP_ALIVE_MAX_REQUESTS);
+    ckCrowdnodeServerConfig->keepAliveMaxRequests = keepAliveMaxRequestsJSON && keepAliveMaxRequestsJSON->valueint > 0 ?
+                                                    keepAliveMaxRequestsJSON->valueint : DEFAULT_KEEP_ALIVE_MAX_REQUESTS;
+
+    cJSON *bufferPoolSizeJSON = cJSON_GetObjectItem(configSON, JSON_CONFIG_PARAM_BUFFER_POOL_SIZE);
+    ckCrowdnodeServerConfig->bufferPoolSize = bufferPoolSizeJSON && bufferPoolSizeJSON->valueint >= 0 ?
+                                              bufferPoolSizeJSON->valueint : DEFAULT_BUFFER_POOL_SIZE;
+
+    cJSON *maxRunningJobsJSON = cJSON_GetObjectItem(configSON, JSON_CONFIG_PARAM_MAX_RUNNING_JOBS);
+    ckCrowdnodeServerConfig->maxRunningJobs = maxRunningJobsJSON && maxRunningJobsJSON->valueint > 0 ?
+                                              maxRunningJobsJSON->valueint : DEFAULT_MAX_RUNNING_JOBS;
+
+    cJSON *maxQueuedJobsJSON = cJSON_GetObjectItem(configSON, JSON_CONFIG_PARAM_MAX_QUEUED_JOBS);
+    ckCrowdnodeServerConfig->maxQueuedJobs = maxQueuedJobsJSON && maxQueuedJobsJSON->valueint > 0 ?
+                                             maxQueuedJobsJSON->valueint : DEFAULT_MAX_QUEUED_JOBS;
+
+    cJSON *maxFinishedJobsJSON = cJSON_GetObjectItem(configSON, JSON_CONFIG_PARAM_MAX_FINISHED_JOBS);
+    ckCrowdnodeServerConfig->maxFinishedJobs = maxFinishedJobsJSON && maxFinishedJobsJSON->valueint > 0 ?
+                                               maxFinishedJobsJSON->valueint : DEFAULT_MAX_FINISHED_JOBS;
+
+    cJSON *jobRetentionJSON = cJSON_GetObjectItem(configSON, JSON_CONFIG_PARAM_JOB_RETENTION);
+    ckCrowdnodeServerConfig->jobRetention = jobRetentionJSON && jobRetentionJSON->valueint >= 0 ?
+                                            jobRetentionJSON->valueint : DEFAULT_JOB_RETENTION;
+
+    cJSON *jobCoresJSON = cJSON_GetObjectItem(configSON, JSON_CONFIG_PARAM_JOB_CORES);
+    ckCrowdnodeServerConfig->jobCores = concat(jobCoresJSON && jobCoresJSON->valuestring ?
+                                               jobCoresJSON->valuestring : "", "");
+
+    cJSON *jobCoresPerJobJSON = cJSON_GetObjectItem(configSON, JSON_CONFIG_PARAM_JOB_CORES_PER_JOB);
+    ckCrowdnodeServerConfig->jobCoresPerJob = jobCoresPerJobJSON && jobCoresPerJobJSON->valueint > 0 ?
+                                              jobCoresPerJobJSON->valueint : DEFAULT_JOB_CORES_PER_JOB;
+
+    cJSON *contentStoreJSON = cJSON_GetObjectItem(configSON, JSON_CONFIG_PARAM_CONTENT_STORE);
+    ckCrowdnodeServerConfig->contentStore = contentStoreJSON && (cJSON_True == (contentStoreJSON->type & 255)
+                                                                 || contentStoreJSON->valueint > 0);
+
+    cJSON *uploadTimeoutJSON = cJSON_GetObjectItem(configSON, JSON_CONFIG_PARAM_UPLOAD_TIMEOUT);
+    ckCrowdnodeServerConfig->uploadTimeout = uploadTimeoutJSON && uploadTimeoutJSON->valueint > 0 ?
+                                             uploadTimeoutJSON->valueint : DEFAULT_UPLOAD_TIMEOUT;
+
+    cJSON *maxUploadSizeJSON = cJSON_GetObjectItem(configSON, JSON_CONFIG_PARAM_MAX_UPLOAD_SIZE);
+    ckCrowdnodeServerConfig->maxUploadSize = maxUploadSizeJSON && maxUploadSizeJSON->valueint >= 0 ?
+                                             maxUploadSizeJSON->valueint : DEFAULT_MAX_UPLOAD_SIZE;
+
     cJSON *pathSON = cJSON_GetObjectItem(configSON, JSON_CONFIG_PARAM_PATH_TO_FILES);
     if (!pathSON) {
         printf("[ERROR]: Invalid JSON format for provided message, attribute %s not found\n", JSON_CONFIG_PARAM_PATH_TO_FILES);
@@ -386,6 +888,19 @@ int createCKFilesDirectoryIfDoesnotExist(char * ckFilesDirectory, char** envp) {
 
 int loadDefaultConfig(CKCrowdnodeServerConfig *ckCrowdnodeServerConfig, char** envp) {
     ckCrowdnodeServerConfig->port = DEFAULT_SERVER_PORT;
+    ckCrowdnodeServerConfig->workerThreads = 0;
+    ckCrowdnodeServerConfig->keepAliveTimeout = DEFAULT_KEEP_ALIVE_TIMEOUT;
+    ckCrowdnodeServerConfig->keepAliveMaxRequests = DEFAULT_KEEP_ALIVE_MAX_REQUESTS;
+    ckCrowdnodeServerConfig->bufferPoolSize = DEFAULT_BUFFER_POOL_SIZE;
+    ckCrowdnodeServerConfig->maxRunningJobs = DEFAULT_MAX_RUNNING_JOBS;
+    ckCrowdnodeServerConfig->maxQueuedJobs = DEFAULT_MAX_QUEUED_JOBS;
+    ckCrowdnodeServerConfig->maxFinishedJobs = DEFAULT_MAX_FINISHED_JOBS;
+    ckCrowdnodeServerConfig->jobRetention = DEFAULT_JOB_RETENTION;
+    ckCrowdnodeServerConfig->jobCores = "";
+    ckCrowdnodeServerConfig->jobCoresPerJob = DEFAULT_JOB_CORES_PER_JOB;
+    ckCrowdnodeServerConfig->contentStore = 0;
+    ckCrowdnodeServerConfig->uploadTimeout = DEFAULT_UPLOAD_TIMEOUT;
+    ckCrowdnodeServerConfig->maxUploadSize = DEFAULT_MAX_UPLOAD_SIZE;
     ckCrowdnodeServerConfig->pathToFiles = getAbsolutePath(DEFAULT_BASE_DIR, envp);
     char generatedSecretKey[38];
     get_uuid_string(generatedSecretKey, sizeof(generatedSecretKey));
@@ -420,6 +935,19 @@ int loadDefaultConfig(CKCrowdnodeServerConfig *ckCrowdnodeServerConfig, char** e
     memset(defaultCrowdnodeServerConfig, 0, generatedSecretKeySize);
     strcpy(defaultCrowdnodeServerConfig, generatedSecretKey);
     cJSON_AddNumberToObject(defaultConfigJSON, JSON_CONFIG_PARAM_PORT, DEFAULT_SERVER_PORT);
+    cJSON_AddNumberToObject(defaultConfigJSON, JSON_CONFIG_PARAM_WORKER_THREADS, 0);
+    cJSON_AddNumberToObject(defaultConfigJSON, JSON_CONFIG_PARAM_KEEP_ALIVE_TIMEOUT, DEFAULT_KEEP_ALIVE_TIMEOUT);
+    cJSON_AddNumberToObject(defaultConfigJSON, JSON_CONFIG_PARAM_KEEP_ALIVE_MAX_REQUESTS, DEFAULT_KEEP_ALIVE_MAX_REQUESTS);
+    cJSON_AddNumberToObject(defaultConfigJSON, JSON_CONFIG_PARAM_BUFFER_POOL_SIZE, DEFAULT_BUFFER_POOL_SIZE);
+    cJSON_AddNumberToObject(defaultConfigJSON, JSON_CONFIG_PARAM_MAX_RUNNING_JOBS, DEFAULT_MAX_RUNNING_JOBS);
+    cJSON_AddNumberToObject(defaultConfigJSON, JSON_CONFIG_PARAM_MAX_QUEUED_JOBS, DEFAULT_MAX_QUEUED_JOBS);
+    cJSON_AddNumberToObject(defaultConfigJSON, JSON_CONFIG_PARAM_MAX_FINISHED_JOBS, DEFAULT_MAX_FINISHED_JOBS);
+    cJSON_AddNumberToObject(defaultConfigJSON, JSON_CONFIG_PARAM_JOB_RETENTION, DEFAULT_JOB_RETENTION);
+    cJSON_AddItemToObject(defaultConfigJSON, JSON_CONFIG_PARAM_JOB_CORES, cJSON_CreateString(""));
+    cJSON_AddNumberToObject(defaultConfigJSON, JSON_CONFIG_PARAM_JOB_CORES_PER_JOB, DEFAULT_JOB_CORES_PER_JOB);
+    cJSON_AddNumberToObject(defaultConfigJSON, JSON_CONFIG_PARAM_CONTENT_STORE, 0);
+    cJSON_AddNumberToObject(defaultConfigJSON, JSON_CONFIG_PARAM_UPLOAD_TIMEOUT, DEFAULT_UPLOAD_TIMEOUT);
+    cJSON_AddNumberToObject(defaultConfigJSON, JSON_CONFIG_PARAM_MAX_UPLOAD_SIZE, DEFAULT_MAX_UPLOAD_SIZE);
     cJSON_AddItemToObject(defaultConfigJSON, JSON_CONFIG_PARAM_PATH_TO_FILES, cJSON_CreateString(getAbsolutePath(DEFAULT_BASE_DIR, envp)));
     cJSON_AddItemToObject(defaultConfigJSON, JSON_CONFIG_PARAM_SECRET_KEY, cJSON_CreateString(defaultCrowdnodeServerConfig));
     char *file_content = cJSON_PrintUnformatted(defaultConfigJSON);
@@ -432,12 +960,72 @@ int loadDefaultConfig(CKCrowdnodeServerConfig *ckCrowdnodeServerConfig, char** e
 
     }
     fclose(file);
-    free(file_content);
+    arena_free(file_content);
     cJSON_Delete(defaultConfigJSON);
 }
 
+#ifndef _WIN32
+/**
+ * Creates a socket listening on all interfaces at the given port.
+ * With reusePort set several sockets can listen on the same port and the kernel spreads connections between them.
+ *
+ * Returns the socket or -1 if SO_REUSEPORT is not supported, exits on other errors.
+ */
+int openServerSocket(int portno, int reusePort) {
+    struct sockaddr_in serv_addr;
+#ifdef __linux__
+    /* shell commands are started from threads of this process, they must not inherit the port */
+    int sockfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+#else
+    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+#endif
+
+	if (sockfd < 0) {
+		perror("ERROR opening socket");
+		exit(1);
+	}
+
+	/* the server is a single long running process now, allow restarting it while old connections are in TIME_WAIT */
+	int reuseAddr = 1;
+	setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuseAddr, sizeof(reuseAddr));
+#ifdef SO_REUSEPORT
+	if (reusePort && setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &reusePort, sizeof(reusePort)) < 0) {
+		perror("[WARN]: SO_REUSEPORT is not supported");
+		close(sockfd);
+		return -1;
+	}
+#else
+	if (reusePort) {
+		close(sockfd);
+		return -1;
+	}
+#endif
+
+	memset((char *) &serv_addr, 0, sizeof(serv_addr));
+
+	serv_addr.sin_family = AF_INET;
+	serv_addr.sin_addr.s_addr = INADDR_ANY;
+	serv_addr.sin_port = htons(portno);
+
+	if (bind(sockfd, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0) {
+		perror("ERROR on binding");
+		exit(1);
+	}
+
+	if (listen(sockfd, SOMAXCONN) < 0) {
+		perror("ERROR on listen");
+		exit(1);
+	}
+	return sockfd;
+}
+#endif
+
 int main( int argc, char *argv[] , char** envp) {
 
+    // cJSON allocates from the arena of the request being processed, if there is one
+    cJSON_Hooks hooks = {arena_malloc, arena_free};
+    cJSON_InitHooks(&hooks);
+
     printf("[INFO]: CK-crowdnode-server starting ...\n");
     printf("[INFO]: %s env value: %s\n", HOME_DIR_TEMPLATE, getEnvValue(HOME_DIR_ENV_KEY, envp));
     printf("[INFO]: Configuration file absolute path: %s\n", getAbsolutePath(DEFAULT_CONFIG_FILE_PATH, envp));
@@ -449,40 +1037,49 @@ int main( int argc, char *argv[] , char** envp) {
 
     if (!loadConfigFromFile(ckCrowdnodeServerConfig, envp)) {
         loadDefaultConfig(ckCrowdnodeServerConfig, envp);
-        printf("[WARN]: CK-crowdnode-server configuration file problem. Server will be started with default configuration, port: %i, pathToFiles: %s, secret_key: %s\n",
+        printf("[WARN]: CK-crowdnode-server configuration file problem. Server will be started with default configuration, port: %i, pathToFiles: %s, secret_key: %s, worker_threads: %i\n",
                ckCrowdnodeServerConfig->port,
                ckCrowdnodeServerConfig->pathToFiles,
-               ckCrowdnodeServerConfig->secretKey
+               ckCrowdnodeServerConfig->secretKey,
+               ckCrowdnodeServerConfig->workerThreads
         );
     } else {
-        printf("[INFO]: CK-crowdnode-server configuration file loaded successfully with configuration, port: %i, pathToFiles: %s, secret_key: %s\n",
+        printf("[INFO]: CK-crowdnode-server configuration file loaded successfully with configuration, port: %i, pathToFiles: %s, secret_key: %s, worker_threads: %i\n",
                ckCrowdnodeServerConfig->port,
                ckCrowdnodeServerConfig->pathToFiles,
-               ckCrowdnodeServerConfig->secretKey
+               ckCrowdnodeServerConfig->secretKey,
+               ckCrowdnodeServerConfig->workerThreads
         );
     }
 
     createCKFilesDirectoryIfDoesnotExist(ckCrowdnodeServerConfig->pathToFiles, envp);
 
+    base64_init();
+    printf("[INFO]: Base64 implementation: %s\n", base64_implementation());
+
     serverSecretKey = ckCrowdnodeServerConfig->secretKey;
-    int sockfd, newsockfd;
-	socklen_t clilen;
     int portno = ckCrowdnodeServerConfig->port;
 	char *baseDir = malloc(strlen(ckCrowdnodeServerConfig->pathToFiles) * sizeof(char) + 1);
     if (!baseDir) {
         perror("Could not allocate memory for baseDir");
     }
     strcpy(baseDir, ckCrowdnodeServerConfig->pathToFiles);
-	unsigned long win_thread_id;
-
+    if (ckCrowdnodeServerConfig->contentStore) {
+        char *storeDir = concat(baseDir, CONTENT_STORE_DIR);
+        contentStore = content_store_create(storeDir);
+        if (contentStore) {
+            printf("[INFO]: Content store: %s (SHA-256 implementation: %s)\n", storeDir, sha256_implementation());
+        } else {
+            printf("[WARN]: Content store could not be opened at %s, pushed files are not deduplicated\n", storeDir);
+        }
+    }
+    uploadSessions = upload_sessions_create(baseDir, ckCrowdnodeServerConfig->uploadTimeout,
+                                            (long long) ckCrowdnodeServerConfig->maxUploadSize * 1024 * 1024);
 #ifdef _WIN32
+	unsigned long win_thread_id;
 	struct thread_win_params twp;
 	struct thread_win_params* ptwp=&twp;
-#endif
 
-	struct sockaddr_in serv_addr, cli_addr;
-
-#ifdef _WIN32
     int servSock;                    /* Socket descriptor for server */
     int clntSock;                    /* Socket descriptor for client */
     struct sockaddr_in echoServAddr; /* Local address */
@@ -520,32 +1117,48 @@ int main( int argc, char *argv[] , char** envp) {
         dieWithError("listen() failed");
     }
 
-#else
-    sockfd = socket(AF_INET, SOCK_STREAM, 0);
-
-	if (sockfd < 0) {
-		perror("ERROR opening socket");
-        printf("WSAGetLastError() %i\n", WSAGetLastError()); //win
-		exit(1);
-	}
-
-	memset((char *) &serv_addr, 0, sizeof(serv_addr));
-
-	serv_addr.sin_family = AF_INET;
-	serv_addr.sin_addr.s_addr = INADDR_ANY;
-	serv_addr.sin_port = htons(portno);
+#elif !defined(__linux__)
+    int sockfd, newsockfd;
+	socklen_t clilen;
+	struct sockaddr_in cli_addr;
 
-	if (bind(sockfd, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0) {
-		perror("ERROR on binding");
-		exit(1);
-	}
+    sockfd = openServerSocket(portno, 0);
 	printf("[INFO]: Server started at port  %i\n", portno);
-
-	listen(sockfd,5);
 	clilen = sizeof(cli_addr);
 #endif
 
+#if !defined(_WIN32)
+    /* a client going away must not kill the server */
+    signal(SIGPIPE, SIG_IGN);
+#endif
+#if !defined(_WIN32) && !defined(__linux__)
+    /* finished connection processes are reaped automatically */
+    signal(SIGCHLD, SIG_IGN);
+#endif
 
+#ifdef __linux__
+	/**
+     * Main server loop: all connections are served by one process, with an event loop per worker thread
+     */
+	job_core_set_t jobCores;
+	if (job_core_set_parse(ckCrowdnodeServerConfig->jobCores, ckCrowdnodeServerConfig->jobCoresPerJob, &jobCores) < 0) {
+		printf("[ERROR]: Invalid %s: %s\n", JSON_CONFIG_PARAM_JOB_CORES, ckCrowdnodeServerConfig->jobCores);
+		exit(1);
+	}
+	jobEngine = job_engine_create(ckCrowdnodeServerConfig->maxRunningJobs, ckCrowdnodeServerConfig->maxQueuedJobs,
+								  ckCrowdnodeServerConfig->maxFinishedJobs, ckCrowdnodeServerConfig->jobRetention,
+								  &jobCores);
+	job_core_set_free(&jobCores);
+	if (!jobEngine) {
+		printf("[ERROR]: Failed to start job threads\n");
+		exit(1);
+	}
+	int workerCount = ckCrowdnodeServerConfig->workerThreads;
+	if (workerCount <= 0) {
+		workerCount = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	runWorkers(portno, workerCount > 0 ? workerCount : 1, baseDir);
+#else
 	/**
      * Main server loop
      */
@@ -594,13 +1207,15 @@ int main( int argc, char *argv[] , char** envp) {
 
         if (pid == 0) {
             close(sockfd);
-            doProcessing(newsockfd, baseDir);
+            signal(SIGCHLD, SIG_DFL);
+            serveConnection(newsockfd, baseDir);
             exit(0);
         } else {
             close(newsockfd);
         }
 #endif
 	}
+#endif
 }
 
 #ifdef _WIN32
@@ -611,7 +1226,7 @@ void doProcessingWin (struct thread_win_params* ptwp)
 	char *baseDir = ptwp->baseDir;
 
 	// Child process - talk with connected client
-	doProcessing (newsockfd, baseDir);
+	serveConnection (newsockfd, baseDir);
 
 	if (shutdown (newsockfd, 2)!=0)
 	{
@@ -625,409 +1240,3866 @@ void doProcessingWin (struct thread_win_params* ptwp)
 }
 #endif
 
-/**
- * Tries to detect message length by the given buffer, which contains the beginning of the message.
- * The buffer passed must be of at least (size+1) length.
- * 
- * Returns -1, if the length is still unknown (in this case the caller must provide a bigger part of the message).
- * 
- * Returns -2, if the length can never be determined, i.e. HTTP headers don't contain 'Content-Length'.
- *
- * If 0 or more is returned, it is the total size of the message (size of the headers + size of the body).
- */
-int detectMessageLength(char* buf, int size) {
-    buf[size] = 0;
-    
-    // trying to find where headers end
-    char* s = strstr(buf, "\r\n\r\n");
-    int header_stop_len = 4;
-    if (NULL == s) {
-        s = strstr(buf, "\n\n");
-        header_stop_len = 2;
-    }
-    if (NULL == s) {
-        return -1;
-    }
-    const long header_len = (s - buf) + header_stop_len;
-
-    const char* content_len_key = "Content-Length:";
-    // trying to find Content-Length
-    char* content_len_header = strstr(buf, content_len_key);
-    if (NULL == content_len_header || (content_len_header - buf) >= header_len) {
-        return -2;
+Connection *newConnection(int sock, buffer_pool_t *pool, arena_t *arena) {
+    Connection *conn = malloc(sizeof(Connection));
+    if (!conn) {
+        perror("[ERROR]: Memory not allocated for connection");
+        return NULL;
     }
-
-    long l = strtol(content_len_header + strlen(content_len_key), NULL, 10);
-    return header_len + l;
+    memset(conn, 0, sizeof(Connection));
+    conn->sock = sock;
+    conn->pool = pool;
+    conn->arena = arena;
+    http_request_init(&conn->request, MAX_UPLOAD_SIZE);
+    conn->state = CONN_READING;
+    return conn;
 }
 
-void doProcessing(int sock, char *baseDir) {
-    char *client_message = malloc(MAX_BUFFER_SIZE + 1);
-    if (client_message == NULL) {
-        perror("[ERROR]: Memory not allocated for client_message first time");
-        exit(1);
-    }
+/**
+ * Returns the message buffer to the pool once it holds no unprocessed bytes, so that idle keep-alive
+ * connections do not keep buffers sized for their largest request.
+ */
+static void releaseMessage(Connection *conn) {
+    buffer_pool_put(conn->pool, conn->message, conn->messageCapacity);
+    conn->message = NULL;
+    conn->messageSize = 0;
+    conn->messageCapacity = 0;
+}
 
-    char *buffer = malloc(MAX_BUFFER_SIZE + 1);
-    if (buffer == NULL) {
-        perror("[ERROR]: Memory not allocated buffer");
-        exit(1);
+static void abortUpload(Connection *conn);
+static void freeArchiveUpload(ArchiveUpload *upload);
+static int startArchiveUpload(Connection *conn, const char *dirName, char *baseDir);
+static int queueArchivePart(Connection *conn);
+static void freeArchiveDownload(ArchiveDownload *download);
+static int queuePullPart(Connection *conn);
+static void freePullDownload(PullDownload *download);
+
+void freeConnection(Connection *conn) {
+    abortUpload(conn);
+    if (conn->sendFile) {
+        fclose(conn->sendFile);
     }
+    freeArchiveDownload(conn->sendArchive);
+    freePullDownload(conn->sendPull);
+    releaseMessage(conn);
+    buffer_pool_put(conn->pool, conn->response, conn->responseCapacity);
+    free(conn);
+}
 
-    memset(buffer, 0, MAX_BUFFER_SIZE);
-    int buffer_read = 0;
-    int total_read = 0;
-    int message_len = -1;
-
-    //buffered read from socket
-    int i = 0;
-    while(1) {
-        buffer_read = recv(sock, buffer, MAX_BUFFER_SIZE, 0);
-        if (buffer_read > 0) {
-            client_message = realloc(client_message, total_read + buffer_read + 1);
-            if (client_message == NULL) {
-                perror("Error ! Memory not allocated client_message");
-                exit(1);
-            }
-            buffer[buffer_read] = '\0';
-            memcpy(client_message + total_read, buffer, buffer_read);
-            total_read = total_read + buffer_read;
-            printf("Next %i part of buffer\n", i);
-            i++;
-            if (-1 == message_len) {
-                message_len = detectMessageLength(buffer, total_read);
-            }
-        } else if (buffer_read < 0) {
-            perror("[ERROR]: reading from socket");
-            printf("WSAGetLastError() %i\n", WSAGetLastError()); //win
-            exit(1);
-        }
-        if (buffer_read == 0 || total_read >= message_len || -2 == message_len) {
-            /* message received successfully */
-            break;
+/**
+ * Receives the next part of the request directly into the connection message buffer.
+ *
+ * Once the headers are parsed the buffer is sized for the whole request if it is up to REQUEST_PRESIZE_LIMIT, so the
+ * body is received with a single allocation. Otherwise, and before that, it grows geometrically as bytes actually
+ * arrive, always leaving at least MAX_BUFFER_SIZE bytes for recv(): a Content-Length alone reserves no more memory.
+ *
+ * Returns the number of bytes received, 0 if the client closed the connection and -1 on error (see errno).
+ */
+int receiveMessagePart(Connection *conn) {
+    size_t needed = conn->messageSize + MAX_BUFFER_SIZE + 1;
+    if (http_headers_complete(&conn->request)) {
+        size_t requestEnd = (size_t) http_request_length(&conn->request) + 1;
+        if (requestEnd <= REQUEST_PRESIZE_LIMIT) {
+            needed = requestEnd;
+        } else if (needed < REQUEST_PRESIZE_LIMIT) {
+            needed = REQUEST_PRESIZE_LIMIT;
         }
     }
-    if (buffer == NULL) {
-        perror("Error ! Try to free not allocated memory buffer");
-        exit(1);
+    if (needed > conn->messageCapacity) {
+        char *message = buffer_pool_grow(conn->pool, conn->message, conn->messageSize, &conn->messageCapacity, needed);
+        if (!message) {
+            perror("[ERROR]: Memory not allocated for client_message");
+            errno = ENOMEM;
+            return -1;
+        }
+        conn->message = message;
     }
-    free(buffer);
-    client_message[total_read] = '\0';
-    printf("[DEBUG]: Post request length: %lu\n", (unsigned long) strlen(client_message));
 
-	char *decodedJSON;
-	char *encodedJSONPostData = strstr(client_message, CK_JSON_KEY);
-	if (encodedJSONPostData != NULL) {
-		char *encodedJSON = encodedJSONPostData + strlen(CK_JSON_KEY);
-		decodedJSON = url_decode(encodedJSON, total_read - (encodedJSON - client_message));
-	} else {
-		decodedJSON = client_message;
-	}
+    int n = recv(conn->sock, conn->message + conn->messageSize, conn->messageCapacity - conn->messageSize - 1, 0);
+    if (n > 0) {
+        conn->messageSize += n;
+    }
+    conn->message[conn->messageSize] = '\0';
+    return n;
+}
 
-	cJSON *commandJSON = cJSON_Parse(decodedJSON);
-	if (!commandJSON) {
-		sendErrorMessage(sock, "Invalid action JSON format for message", ERROR_CODE);
-		return;
-	}
+/**
+ * Continues parsing the request with the newly received bytes.
+ *
+ * Returns HTTP_PARSE_COMPLETE, HTTP_PARSE_INCOMPLETE or HTTP_PARSE_ERROR.
+ */
+int parseMessage(Connection *conn) {
+    return http_parse(&conn->request, conn->message ? conn->message : "", conn->messageSize);
+}
 
+/**
+ * Returns a zero terminated, url-decoded copy of a part of the request path.
+ */
+static char *decodePathPart(const char *part, size_t len) {
+    return url_decode(part, len);
+}
 
-    cJSON *secretkeyJSON = cJSON_GetObjectItem(commandJSON, JSON_PARAM_NAME_SECRETKEY);
-    if (!secretkeyJSON) {
-        if (commandJSON != NULL) {
-            cJSON_Delete(commandJSON);
-        }
-        sendErrorMessage(sock, ERROR_MESSAGE_SECRET_KEY_MISSMATCH, ERROR_CODE_SECRET_KEY_MISMATCH);
-        return;
+/**
+ * Returns the decoded value of a query string parameter or NULL if the request path has no such parameter.
+ */
+static char *getQueryParam(Connection *conn, const char *name) {
+    const char *path = conn->message + conn->request.path;
+    const char *pathEnd = path + conn->request.pathLen;
+    const char *query = memchr(path, '?', conn->request.pathLen);
+    if (!query) {
+        return NULL;
+    }
+    size_t valueLen;
+    const char *value = http_get_form_field(query + 1, pathEnd - query - 1, name, &valueLen);
+    return value ? decodePathPart(value, valueLen) : NULL;
+}
+
+/**
+ * Returns 1 if the request path addresses a raw file (RAW_FILES_PATH followed by the file name).
+ */
+static int isRawFileRequest(Connection *conn) {
+    size_t prefixLen = strlen(RAW_FILES_PATH);
+    return (size_t) conn->request.pathLen > prefixLen
+           && 0 == strncmp(conn->message + conn->request.path, RAW_FILES_PATH, prefixLen);
+}
+
+/**
+ * Returns 1 if a file name is a relative path which stays inside the base directory.
+ */
+static int isSafeFileName(const char *fileName) {
+    const char *component = fileName;
+    int safe = '\0' != *fileName && '/' != *fileName && '\\' != *fileName;
+    while (safe && component) {
+        size_t len = strcspn(component, "/\\");
+        if (2 == len && 0 == strncmp(component, "..", 2)) {
+            safe = 0;
+        }
+        component = '\0' == component[len] ? NULL : component + len + 1;
+    }
+    return safe;
+}
+
+/**
+ * Returns the decoded name of the file addressed by a raw file request or NULL if it is not a safe relative path.
+ */
+static char *getRawFileName(Connection *conn) {
+    const char *path = conn->message + conn->request.path;
+    const char *name = path + strlen(RAW_FILES_PATH);
+    const char *nameEnd = memchr(name, '?', path + conn->request.pathLen - name);
+    if (!nameEnd) {
+        nameEnd = path + conn->request.pathLen;
+    }
+    char *fileName = decodePathPart(name, nameEnd - name);
+    if (!fileName) {
+        return NULL;
+    }
+
+    if (!isSafeFileName(fileName)) {
+        arena_free(fileName);
+        return NULL;
+    }
+    return fileName;
+}
+
+/**
+ * Returns 1 if a raw file request transfers a directory tree as a tar archive (archive=tar).
+ */
+static int isArchiveRequest(Connection *conn) {
+    char *archive = getQueryParam(conn, RAW_PARAM_ARCHIVE);
+    int tar = archive && 0 == strcmp(archive, "tar");
+    arena_free(archive);
+    return tar;
+}
+
+/**
+ * Returns 1 if the secretkey query parameter of a raw file request matches the server secret key.
+ */
+static int checkRawSecretKey(Connection *conn) {
+    if (!serverSecretKey) {
+        return 1;
+    }
+    char *clientSecretKey = getQueryParam(conn, JSON_PARAM_NAME_SECRETKEY);
+    int matches = clientSecretKey && 0 == strcmp(clientSecretKey, serverSecretKey);
+    arena_free(clientSecretKey);
+    return matches;
+}
+
+/**
+ * Decides whether a large JSON command is decoded to disk while it is received (see startPushStream()). POST requests
+ * are, their secret key is checked in the JSON once the body is complete (see finishPushStream()). A key in the
+ * secretkey query parameter or the SECRET_KEY_HEADER is optional and only lets a wrong one be refused before the
+ * body is received.
+ *
+ * Returns 1 to stream the body, 0 to buffer it, -1 if the given secret key does not match.
+ */
+static int checkStreamSecretKey(Connection *conn) {
+    const char *method = conn->message + conn->request.method;
+    if (4 != conn->request.methodLen || 0 != strncmp(method, "POST", 4)) {
+        return 0;
+    }
+    int keyLen;
+    const char *key = http_get_header(&conn->request, conn->message, SECRET_KEY_HEADER, &keyLen);
+    char *queryKey = key ? NULL : getQueryParam(conn, JSON_PARAM_NAME_SECRETKEY);
+    if (queryKey) {
+        key = queryKey;
+        keyLen = (int) strlen(queryKey);
+    }
+    int rc = 1;
+    if (key) {
+        rc = !serverSecretKey || ((size_t) keyLen == strlen(serverSecretKey)
+                                  && 0 == strncmp(key, serverSecretKey, keyLen)) ? 1 : -1;
+    }
+    arena_free(queryKey);
+    return rc;
+}
+
+/**
+ * Returns 1 if the secretkey of a parsed command matches the one of the server, 0 otherwise.
+ */
+static int checkCommandSecretKey(cJSON *commandJSON) {
+    cJSON *secretkeyJSON = cJSON_GetObjectItem(commandJSON, JSON_PARAM_NAME_SECRETKEY);
+    if (!secretkeyJSON || !secretkeyJSON->valuestring) {
+        return 0;
     }
     char *clientSecretKey = secretkeyJSON->valuestring;
     printf("[DEBUG]: Got secretkey: %s from client\n", clientSecretKey);
-    if (!serverSecretKey || strncmp(clientSecretKey, serverSecretKey, strlen(serverSecretKey)) == 0 ) {
-        cJSON *actionJSON = cJSON_GetObjectItem(commandJSON, JSON_PARAM_NAME_COMMAND);
-        if (!actionJSON) {
-            printf("[ERROR]: Invalid action JSON format for message: \n");
-            if (commandJSON != NULL) {
-                cJSON_Delete(commandJSON);
+    return !serverSecretKey || 0 == strncmp(clientSecretKey, serverSecretKey, strlen(serverSecretKey));
+}
+
+/**
+ * Counts the request which is about to be answered and decides whether the connection stays open after it.
+ */
+static void beginResponse(Connection *conn) {
+    conn->requestCount++;
+    conn->keepAlive = !conn->peerClosed
+                      && conn->requestCount < ckCrowdnodeServerConfig->keepAliveMaxRequests
+                      && conn->request.keepAlive;
+}
+
+/**
+ * Removes the answered request from the message buffer, leaving the following (pipelined) requests in place.
+ */
+static void consumeRequest(Connection *conn, int requestLen) {
+    conn->messageSize -= requestLen;
+    if (0 == conn->messageSize) {
+        releaseMessage(conn);
+    } else {
+        memmove(conn->message, conn->message + requestLen, conn->messageSize + 1);
+    }
+    http_request_init(&conn->request, MAX_UPLOAD_SIZE);
+    conn->requestRouted = 0;
+}
+
+/**
+ * Processes the first request in the message buffer and removes it from there, leaving the following
+ * (pipelined) requests in place. The response is queued in the connection.
+ */
+void processRequest(Connection *conn, char *baseDir) {
+    if (HTTP_PARSE_COMPLETE != parseMessage(conn)) {
+        conn->keepAlive = 0;
+        sendErrorResponse(conn, conn->request.status, conn->request.error, ERROR_CODE);
+        return;
+    }
+    int requestLen = (int) http_request_length(&conn->request);
+
+    beginResponse(conn);
+
+    // let doProcessing see only this request
+    int messageSize = conn->messageSize;
+    char next = conn->message[requestLen];
+    conn->message[requestLen] = '\0';
+    conn->messageSize = requestLen;
+
+    // everything allocated by the handlers is released at once when the request is answered
+    arena_begin(conn->arena);
+    if (isRawFileRequest(conn)) {
+        handleFileDownload(conn, baseDir);
+    } else {
+        doProcessing(conn, baseDir);
+    }
+    arena_end();
+
+    conn->message[requestLen] = next;
+    conn->messageSize = messageSize;
+    if (CONN_WAITING == conn->state) {
+        // the response needs the request, see finishShellTask()
+        conn->waitingRequestLen = requestLen;
+        return;
+    }
+    consumeRequest(conn, requestLen);
+}
+
+/**
+ * Drops the sent response, so that the connection is ready for the next request.
+ */
+void resetResponse(Connection *conn) {
+    buffer_pool_put(conn->pool, conn->response, conn->responseCapacity);
+    conn->response = NULL;
+    conn->responseCapacity = 0;
+    conn->responseSize = 0;
+    conn->responseHeaderSize = 0;
+    conn->responseSent = 0;
+    conn->state = CONN_READING;
+}
+
+/**
+ * Sends as much of the response body file as the socket accepts, with sendfile() where it is available.
+ *
+ * Returns 1 if the file has been sent completely, 0 if the socket would block and -1 on error.
+ */
+static int flushSendFile(Connection *conn) {
+    while (conn->sendFileOffset < conn->sendFileEnd) {
+        long long remaining = conn->sendFileEnd - conn->sendFileOffset;
+#ifdef __linux__
+        off_t offset = (off_t) conn->sendFileOffset;
+        ssize_t n = sendfile(conn->sock, fileno(conn->sendFile), &offset, remaining < (1L << 30) ? (size_t) remaining : (1L << 30));
+        if (n < 0) {
+            if (EINTR == errno) {
+                continue;
             }
-            sendErrorMessage(sock, "Invalid action JSON format for message: no action found", ERROR_CODE);
-            return;
+            if (EAGAIN == errno || EWOULDBLOCK == errno) {
+                return 0;
+            }
+            perror("[ERROR]: Failed to send file");
+            return -1;
+        }
+        conn->sendFileOffset = offset;
+#else
+        // only the blocking driver runs here, so a partially sent buffer is never left behind
+        char buf[FILE_BUFFER_SIZE];
+        size_t n = fread(buf, 1, remaining < FILE_BUFFER_SIZE ? (size_t) remaining : FILE_BUFFER_SIZE, conn->sendFile);
+        if (0 < n && sockSendAll(conn->sock, buf, n) < 0) {
+            perror("[ERROR]: Failed to send file");
+            return -1;
+        }
+        conn->sendFileOffset += n;
+#endif
+        if (0 == n) {
+            printf("[ERROR]: File was truncated while being sent\n");
+            return -1;
+        }
+    }
+    fclose(conn->sendFile);
+    conn->sendFile = NULL;
+    return 1;
+}
+
+/**
+ * Sends as much of the queued response as the socket accepts, the headers together with the body.
+ *
+ * Returns 1 if the response has been sent completely, 0 if the socket would block and -1 on error.
+ */
+int flushResponse(Connection *conn) {
+    while (1) {
+        int headerSize = conn->responseHeaderSize;
+        while (conn->responseSent < headerSize + conn->responseSize) {
+            int sent = conn->responseSent;
+            int n = sent < headerSize
+                    ? sockSendv(conn->sock, conn->responseHeader + sent, headerSize - sent, conn->response, conn->responseSize)
+                    : sockSend(conn->sock, conn->response + sent - headerSize, headerSize + conn->responseSize - sent);
+            if (n < 0) {
+                if (EINTR == errno) {
+                    continue;
+                }
+                if (EAGAIN == errno || EWOULDBLOCK == errno) {
+                    return 0;
+                }
+                perror("[ERROR]: Failed to send HTTP response");
+                return -1;
+            }
+            conn->responseSent += n;
+        }
+        int sent = conn->sendFile ? flushSendFile(conn) : 1;
+        if (1 != sent || (!conn->sendArchive && !conn->sendPull)) {
+            return sent;
+        }
+        // the next part of an archive or a pull replaces the sent one
+        if ((conn->sendArchive ? queueArchivePart(conn) : queuePullPart(conn)) < 0) {
+            return -1;
+        }
+    }
+}
+
+static void setReceiveTimeout(int sock, int seconds) {
+#ifdef _WIN32
+    DWORD timeout = seconds * 1000;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char *) &timeout, sizeof(timeout));
+#else
+    struct timeval timeout;
+    timeout.tv_sec = seconds;
+    timeout.tv_usec = 0;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+#endif
+}
+
+/**
+ * Closes and removes the partially received upload, if there is one.
+ */
+static void abortUpload(Connection *conn) {
+    if (conn->uploadFile) {
+        fclose(conn->uploadFile);
+        conn->uploadFile = NULL;
+    }
+    if (conn->uploadTempPath) {
+        remove(conn->uploadTempPath);
+    }
+    push_stream_free(conn->pushStream);
+    conn->pushStream = NULL;
+    freeArchiveUpload(conn->archiveUpload);
+    conn->archiveUpload = NULL;
+    arena_free(conn->uploadPath);
+    free(conn->uploadTempPath);
+    conn->uploadPath = NULL;
+    conn->uploadTempPath = NULL;
+}
+
+/**
+ * Lets receiveUpload() take the body of the request, after a 100 Continue if the client waits for it.
+ */
+static void receiveUploadBody(Connection *conn) {
+    conn->uploadRemaining = conn->request.contentLength;
+    conn->state = CONN_UPLOADING;
+
+    int expectLen;
+    const char *expect = http_get_header(&conn->request, conn->message, "Expect", &expectLen);
+    if (expect && 12 == expectLen && 0 == strncmp(expect, "100-continue", 12)
+        && conn->messageSize == conn->request.headerLen) {
+        // best effort: a client which does not get it sends the body after a timeout anyway
+        static const char continueResponse[] = "HTTP/1.1 100 Continue\r\n\r\n";
+        sockSendAll(conn->sock, continueResponse, sizeof(continueResponse) - 1);
+    }
+}
+
+/**
+ * Starts streaming the body of a raw upload (PUT /files/<name>?secretkey=...) to a temporary file next to
+ * the destination, or extracting it into the directory of that name if it is a tar archive (archive=tar).
+ * If the upload cannot be accepted an error response is queued and the connection is closed after it, as the
+ * body is left unread.
+ */
+static void startUpload(Connection *conn, char *baseDir) {
+    conn->keepAlive = 0;
+    if (!checkRawSecretKey(conn)) {
+        sendErrorResponse(conn, 403, ERROR_MESSAGE_SECRET_KEY_MISSMATCH, ERROR_CODE_SECRET_KEY_MISMATCH);
+        return;
+    }
+    char *fileName = getRawFileName(conn);
+    if (!fileName) {
+        sendErrorResponse(conn, 400, "Invalid file name", ERROR_CODE);
+        return;
+    }
+    if (isArchiveRequest(conn)) {
+        int rc = startArchiveUpload(conn, fileName, baseDir);
+        arena_free(fileName);
+        if (0 == rc) {
+            receiveUploadBody(conn);
+        }
+        return;
+    }
+
+    conn->uploadPath = concat(baseDir, fileName);
+    arena_free(fileName);
+    conn->uploadTempPath = malloc(strlen(conn->uploadPath) + 32);
+    if (!conn->uploadTempPath) {
+        abortUpload(conn);
+        sendErrorMessage(conn, "Memory not allocated for upload", ERROR_CODE);
+        return;
+    }
+    sprintf(conn->uploadTempPath, "%s.%d.part", conn->uploadPath, (int) conn->sock);
+
+    conn->uploadFile = fopen(conn->uploadTempPath, "wb");
+    if (!conn->uploadFile) {
+        perror("[ERROR]: Could not open upload file");
+        char *message = concat("Could not write file at path: ", conn->uploadPath);
+        abortUpload(conn);
+        sendErrorMessage(conn, message, ERROR_CODE);
+        arena_free(message);
+        return;
+    }
+    if (contentStore) {
+        sha256_init(&conn->uploadDigest);
+    }
+    printf("[DEBUG]: Receiving %ld bytes to %s\n", conn->request.contentLength, conn->uploadPath);
+    receiveUploadBody(conn);
+}
+
+/**
+ * Starts passing the body of a large JSON command through a push_stream filter as it is received: the Base64
+ * content of a push is decoded chunk by chunk into a temporary file in the base directory, which handlePush()
+ * renames to the requested file name. Only the rest of the JSON is kept in memory.
+ */
+static void startPushStream(Connection *conn, char *baseDir) {
+    char uuid[38];
+    generateUUID(uuid, sizeof(uuid));
+    conn->uploadTempPath = malloc(strlen(baseDir) + strlen(uuid) + 16);
+    if (!conn->uploadTempPath) {
+        conn->keepAlive = 0;
+        sendErrorMessage(conn, "Memory not allocated for push", ERROR_CODE);
+        return;
+    }
+    sprintf(conn->uploadTempPath, "%s.push-%s.part", baseDir, uuid);
+
+    conn->uploadFile = fopen(conn->uploadTempPath, "wb");
+    if (!conn->uploadFile) {
+        perror("[ERROR]: Could not open push file");
+        free(conn->uploadTempPath);
+        conn->uploadTempPath = NULL;
+        conn->keepAlive = 0;
+        sendErrorMessage(conn, "Could not write file in files directory", ERROR_CODE);
+        return;
+    }
+    conn->pushStream = push_stream_create(JSON_PARAM_FILE_CONTENT, CK_JSON_FIELD, conn->uploadFile, MAX_REQUEST_BODY_SIZE);
+    if (!conn->pushStream) {
+        abortUpload(conn);
+        conn->keepAlive = 0;
+        sendErrorMessage(conn, "Memory not allocated for push", ERROR_CODE);
+        return;
+    }
+    if (contentStore) {
+        sha256_init(&conn->uploadDigest);
+        push_stream_set_digest(conn->pushStream, &conn->uploadDigest);
+    }
+    printf("[DEBUG]: Decoding %ld bytes of request body while it is received\n", conn->request.contentLength);
+    conn->uploadRemaining = conn->request.contentLength;
+    conn->state = CONN_UPLOADING;
+}
+
+/**
+ * Processes the JSON command left over by the push_stream filter once the whole body is received. The decoded file
+ * is removed without a trace if the secret key in the JSON does not match.
+ */
+static void finishPushStream(Connection *conn, char *baseDir) {
+    int failed = push_stream_finish(conn->pushStream) < 0;
+    if (0 != fclose(conn->uploadFile) && !failed) {
+        failed = 1;
+        perror("[ERROR]: Failed to write pushed file");
+    }
+    conn->uploadFile = NULL;
+    conn->pushSize = push_stream_written(conn->pushStream);
+    if (failed) {
+        printf("[ERROR]: %s\n", push_stream_error(conn->pushStream));
+        char *message = concat("Failed to decode request body: ", push_stream_error(conn->pushStream));
+        abortUpload(conn);
+        conn->keepAlive = 0;
+        sendErrorMessage(conn, message, ERROR_CODE);
+        arena_free(message);
+        return;
+    }
+
+    beginResponse(conn);
+    conn->state = CONN_READING;
+    arena_begin(conn->arena);
+    cJSON *commandJSON = cJSON_ParseInSitu(push_stream_json(conn->pushStream));
+    if (!commandJSON) {
+        sendErrorMessage(conn, "Invalid action JSON format for message", ERROR_CODE);
+    } else if (!checkCommandSecretKey(commandJSON)) {
+        abortUpload(conn);
+        sendErrorMessage(conn, ERROR_MESSAGE_SECRET_KEY_MISSMATCH, ERROR_CODE_SECRET_KEY_MISMATCH);
+        cJSON_Delete(commandJSON);
+    } else {
+        processCommand(conn, commandJSON, baseDir);
+        cJSON_Delete(commandJSON);
+    }
+    arena_end();
+    abortUpload(conn); // removes the temporary file unless handlePush() has taken it
+    if (CONN_WAITING == conn->state) {
+        conn->waitingRequestLen = conn->request.headerLen;
+    } else {
+        consumeRequest(conn, conn->request.headerLen);
+    }
+}
+
+/**
+ * Moves a completely written file to its name, through the content store if the hash of the content is given.
+ */
+static int saveReceivedFile(const char *tempPath, const char *path, const char *hash) {
+    if (hash) {
+        return content_store_add(contentStore, tempPath, hash, path);
+    }
+#ifdef _WIN32
+    // rename() does not replace existing files on Windows
+    remove(path);
+#endif
+    return rename(tempPath, path);
+}
+
+/**
+ * Returns 0 if the client sent a hash which does not match the received content, 1 otherwise.
+ */
+static int checkContentHash(const char *expected, const char *hash) {
+    if (expected && 0 != strcmp(expected, hash)) {
+        printf("[ERROR]: Content hash %s does not match the expected %s\n", hash, expected);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * A tar body being extracted into a directory while it is received: every file is written to a temporary file next
+ * to its destination and renamed (or handed to the content store) once its content is complete, so the archive is
+ * written to disk as it arrives and never held in memory. The outcome of every entry is kept for the response.
+ */
+struct ArchiveUpload {
+    tar_reader_t *reader;
+    char *dir;                  /* the destination, with a trailing slash */
+    size_t dirLen;
+    int sock;                   /* makes the names of the temporary files unique */
+    char *name;                 /* of the current entry, NULL if it is not reported */
+    tar_type_t type;
+    int mode;
+    char *path;                 /* destination of the current entry */
+    char *tempPath;
+    FILE *file;                 /* the current file, NULL once it has failed */
+    sha256_t digest;            /* of its content, if the content store is enabled */
+    long long size;
+    const char *error;          /* why the current entry failed */
+    cJSON *results;             /* outcome of the entries, see sendArchiveResult() */
+    int count;
+    int failed;
+};
+
+/**
+ * Drops the file being extracted.
+ */
+static void closeArchiveFile(ArchiveUpload *upload) {
+    if (upload->file) {
+        fclose(upload->file);
+        upload->file = NULL;
+        remove(upload->tempPath);
+    }
+}
+
+static void freeArchiveUpload(ArchiveUpload *upload) {
+    if (!upload) {
+        return;
+    }
+    closeArchiveFile(upload);
+    tar_reader_free(upload->reader);
+    cJSON_Delete(upload->results);
+    free(upload->dir);
+    free(upload->name);
+    free(upload->path);
+    free(upload->tempPath);
+    free(upload);
+}
+
+/**
+ * Adds the outcome of the current entry to the results.
+ */
+static void reportArchiveEntry(ArchiveUpload *upload, const char *hash) {
+    cJSON *entryJSON = cJSON_CreateObject();
+    if (!entryJSON) {
+        perror("[ERROR]: Memory not allocated for entryJSON");
+        exit(1);
+    }
+    cJSON_AddItemToObject(entryJSON, JSON_PARAM_FILE_NAME, cJSON_CreateString(upload->name));
+    cJSON_AddItemToObject(entryJSON, "return", cJSON_CreateString(upload->error ? "1" : "0"));
+    if (upload->error) {
+        printf("[ERROR]: %s: %s\n", upload->name, upload->error);
+        cJSON_AddItemToObject(entryJSON, "error", cJSON_CreateString(upload->error));
+        upload->failed++;
+    } else if (TAR_FILE == upload->type) {
+        cJSON_AddNumberToObject(entryJSON, "size", (double) upload->size);
+    }
+    if (hash[0]) {
+        cJSON_AddItemToObject(entryJSON, JSON_PARAM_HASH, cJSON_CreateString(hash));
+    }
+    cJSON_AddItemToArray(upload->results, entryJSON);
+    upload->count++;
+}
+
+#ifndef _WIN32
+/**
+ * Creates the missing directories of a path from the given position on, the last one only if the path ends with
+ * a slash.
+ *
+ * Returns 0 on success, -1 otherwise (see errno).
+ */
+static int makeDirectories(char *path, size_t from) {
+    char *slash = path + from;
+    while ((slash = strchr(slash, '/')) != NULL) {
+        *slash = '\0';
+        int rc = mkdir(path, 0755);
+        *slash = '/';
+        if (0 != rc && EEXIST != errno) {
+            return -1;
+        }
+        slash++;
+    }
+    return 0;
+}
+
+/**
+ * tar_handler_t: creates a directory or opens the temporary file of a file. An entry which can not be extracted
+ * fails on its own, its content is skipped.
+ */
+static int beginArchiveEntry(void *ctx, const tar_entry_t *entry) {
+    ArchiveUpload *upload = ctx;
+    free(upload->name);
+    free(upload->path);
+    free(upload->tempPath);
+    upload->name = upload->path = upload->tempPath = NULL;
+    upload->type = entry->type;
+    upload->mode = entry->mode;
+    upload->size = 0;
+    upload->error = NULL;
+    if (TAR_DIRECTORY == entry->type && 0 == strcmp(entry->name, ".")) {
+        return 0; // the destination itself
+    }
+
+    size_t nameLen = strlen(entry->name);
+    upload->name = malloc(nameLen + 1);
+    upload->path = malloc(upload->dirLen + nameLen + 2);
+    upload->tempPath = malloc(upload->dirLen + nameLen + 32);
+    if (!upload->name || !upload->path || !upload->tempPath) {
+        perror("[ERROR]: Memory not allocated for archive entry");
+        return -1;
+    }
+    strcpy(upload->name, entry->name);
+    sprintf(upload->path, "%s%s%s", upload->dir, entry->name, TAR_DIRECTORY == entry->type ? "/" : "");
+    if (!isSafeFileName(entry->name)) {
+        upload->error = "Invalid file name";
+    } else if (TAR_OTHER == entry->type) {
+        upload->error = "Unsupported entry type";
+    } else if (0 != makeDirectories(upload->path, upload->dirLen)) {
+        perror("[ERROR]: Could not create directory");
+        upload->error = "Could not create directory";
+    } else if (TAR_FILE == entry->type) {
+        sprintf(upload->tempPath, "%s.%d.part", upload->path, upload->sock);
+        upload->file = fopen(upload->tempPath, "wb");
+        if (!upload->file) {
+            perror("[ERROR]: Could not open extracted file");
+            upload->error = "Could not write file";
+        } else if (contentStore) {
+            sha256_init(&upload->digest);
+        }
+    }
+    return 0;
+}
+
+/**
+ * tar_handler_t: writes the next piece of the current file.
+ */
+static int writeArchiveData(void *ctx, const void *data, size_t len) {
+    ArchiveUpload *upload = ctx;
+    if (!upload->file) {
+        return 0;
+    }
+    if (fwrite(data, 1, len, upload->file) != len) {
+        perror("[ERROR]: Failed to write extracted file");
+        closeArchiveFile(upload);
+        upload->error = "Failed to write file";
+        return 0;
+    }
+    if (contentStore) {
+        sha256_update(&upload->digest, data, len);
+    }
+    upload->size += len;
+    return 0;
+}
+
+/**
+ * tar_handler_t: saves the complete file under its name, executable if it was in the archive, and reports the
+ * entry.
+ */
+static int endArchiveEntry(void *ctx) {
+    ArchiveUpload *upload = ctx;
+    char hash[CONTENT_HASH_SIZE] = "";
+    if (!upload->name) {
+        return 0;
+    }
+    if (upload->file) {
+        FILE *file = upload->file;
+        upload->file = NULL;
+        // the file keeps its own inode in the content store as well, so the mode is that of this name only
+        if ((upload->mode & 0100) && 0 != fchmod(fileno(file), 0755)) {
+            perror("[WARN]: Could not make extracted file executable");
+        }
+        int failed = 0 != fclose(file);
+        if (contentStore) {
+            sha256_final_hex(&upload->digest, hash);
+        }
+        if (failed || 0 != saveReceivedFile(upload->tempPath, upload->path, contentStore ? hash : NULL)) {
+            perror("[ERROR]: Failed to save extracted file");
+            remove(upload->tempPath);
+            upload->error = "Failed to write file";
+            hash[0] = '\0';
+        }
+    }
+    reportArchiveEntry(upload, hash);
+    return 0;
+}
+#endif
+
+/**
+ * Starts extracting the tar body of a raw upload (PUT /files/<dir>?archive=tar&secretkey=...) into the directory,
+ * which is created if it is missing. Entries with a name leading out of it, links and devices are not extracted.
+ *
+ * Returns 0 on success, -1 if an error response has been queued.
+ */
+static int startArchiveUpload(Connection *conn, const char *dirName, char *baseDir) {
+#ifdef _WIN32
+    (void) dirName;
+    (void) baseDir;
+    sendErrorResponse(conn, 501, "Archives are not supported on this platform", ERROR_CODE);
+    return -1;
+#else
+    static const tar_handler_t handler = {beginArchiveEntry, writeArchiveData, endArchiveEntry};
+    ArchiveUpload *upload = calloc(1, sizeof(ArchiveUpload));
+    if (upload) {
+        upload->dir = malloc(strlen(baseDir) + strlen(dirName) + 2);
+        upload->reader = tar_reader_create(&handler, upload);
+        upload->results = cJSON_CreateArray();
+    }
+    if (!upload || !upload->dir || !upload->reader || !upload->results) {
+        freeArchiveUpload(upload);
+        sendErrorMessage(conn, "Memory not allocated for upload", ERROR_CODE);
+        return -1;
+    }
+    sprintf(upload->dir, "%s%s/", baseDir, dirName);
+    upload->dirLen = strlen(upload->dir);
+    upload->sock = (int) conn->sock;
+    if (0 != makeDirectories(upload->dir, strlen(baseDir))) {
+        perror("[ERROR]: Could not create directory");
+        char *message = concat("Could not create directory at path: ", upload->dir);
+        freeArchiveUpload(upload);
+        sendErrorMessage(conn, message, ERROR_CODE);
+        arena_free(message);
+        return -1;
+    }
+    printf("[DEBUG]: Extracting %ld bytes of archive to %s\n", conn->request.contentLength, upload->dir);
+    conn->archiveUpload = upload;
+    return 0;
+#endif
+}
+
+/**
+ * Queues the response to an archive upload, example:
+ *   {"return":"0", "count":2, "failed":1, "files":[{"filename":"bin/run.sh", "return":"0", "size":120},
+ *                                                {"filename":"../x", "return":"1", "error":"Invalid file name"}]}
+ * An archive which can not be read to its end is answered with "return":"1", the error and the entries before it.
+ */
+static void sendArchiveResult(Connection *conn, const char *error) {
+    ArchiveUpload *upload = conn->archiveUpload;
+    printf("[INFO]: Extracted %d entries to %s, %d failed\n", upload->count - upload->failed, upload->dir,
+           upload->failed);
+    json_writer_t writer;
+    beginJSONResponse(conn, &writer);
+    json_writer_begin_object(&writer);
+    json_writer_key(&writer, "return");
+    json_writer_string(&writer, error ? "1" : "0");
+    if (error) {
+        json_writer_key(&writer, "error");
+        json_writer_string(&writer, error);
+    }
+    json_writer_key(&writer, "count");
+    json_writer_number(&writer, upload->count);
+    json_writer_key(&writer, "failed");
+    json_writer_number(&writer, upload->failed);
+    json_writer_key(&writer, JSON_PARAM_FILES);
+    json_writer_cjson(&writer, upload->results);
+    json_writer_end_object(&writer);
+    if (sendJSONWriterResponse(conn, &writer, error ? 400 : 200) < 0) {
+        sendErrorMessage(conn, "Memory not allocated for response", ERROR_CODE);
+    }
+}
+
+/**
+ * Reports the entry an unreadable archive has cut off.
+ */
+static void failArchiveEntry(ArchiveUpload *upload, const char *error) {
+    if (tar_reader_in_entry(upload->reader) && upload->name) {
+        closeArchiveFile(upload);
+        if (!upload->error) {
+            upload->error = error;
+        }
+        reportArchiveEntry(upload, "");
+    }
+}
+
+/**
+ * Answers an archive upload which can not be read any further, the rest of the body is left unread.
+ */
+static void failArchiveUpload(Connection *conn) {
+    const char *error = tar_reader_error(conn->archiveUpload->reader);
+    printf("[ERROR]: %s\n", error);
+    failArchiveEntry(conn->archiveUpload, error);
+    conn->keepAlive = 0;
+    sendArchiveResult(conn, error);
+    abortUpload(conn);
+}
+
+/**
+ * Ends the archive once the whole body is received and queues the response.
+ */
+static void finishArchiveUpload(Connection *conn) {
+    ArchiveUpload *upload = conn->archiveUpload;
+    const char *error = NULL;
+    if (0 != tar_reader_finish(upload->reader)) {
+        error = tar_reader_error(upload->reader);
+        failArchiveEntry(upload, error);
+    }
+    beginResponse(conn);
+    sendArchiveResult(conn, error);
+    abortUpload(conn);
+    consumeRequest(conn, conn->request.headerLen);
+}
+
+/**
+ * Renames the completely received upload to its destination, or hands it to the content store, and queues the
+ * response.
+ */
+static void finishUpload(Connection *conn) {
+    FILE *file = conn->uploadFile;
+    conn->uploadFile = NULL;
+    int failed = 0 != fclose(file);
+    char hash[CONTENT_HASH_SIZE] = "";
+    if (contentStore) {
+        sha256_final_hex(&conn->uploadDigest, hash);
+        char *expected = getQueryParam(conn, JSON_PARAM_HASH);
+        int matches = checkContentHash(expected, hash);
+        arena_free(expected);
+        if (!matches) {
+            abortUpload(conn);
+            conn->keepAlive = 0;
+            sendErrorResponse(conn, 400, "Content does not match hash", ERROR_CODE);
+            return;
+        }
+    }
+    if (failed || 0 != saveReceivedFile(conn->uploadTempPath, conn->uploadPath, contentStore ? hash : NULL)) {
+        perror("[ERROR]: Failed to save uploaded file");
+        abortUpload(conn);
+        conn->keepAlive = 0;
+        sendErrorMessage(conn, "Failed to write file ", ERROR_CODE);
+        return;
+    }
+    printf("[INFO]: File saved to: %s\n", conn->uploadPath);
+    free(conn->uploadTempPath);
+    conn->uploadTempPath = NULL;
+    abortUpload(conn); // nothing left to remove, just releases the path
+
+    beginResponse(conn);
+    cJSON *resultJSON = cJSON_CreateObject();
+    if (!resultJSON) {
+        perror("[ERROR]: Memory not allocated for resultJSON");
+        exit(1);
+    }
+    cJSON_AddItemToObject(resultJSON, "return", cJSON_CreateString("0"));
+    cJSON_AddNumberToObject(resultJSON, "size", (double) conn->request.contentLength);
+    if (hash[0]) {
+        cJSON_AddItemToObject(resultJSON, JSON_PARAM_HASH, cJSON_CreateString(hash));
+    }
+    sendJSONResponse(conn, resultJSON);
+    cJSON_Delete(resultJSON);
+    consumeRequest(conn, conn->request.headerLen);
+}
+
+/**
+ * Streams the request body from the socket to the upload file or the push_stream filter through a buffer of
+ * FILE_BUFFER_SIZE bytes placed after the request headers, so memory use does not depend on the body size.
+ * Bytes following the body are left in the socket (or in the message buffer, if they came with the headers)
+ * for the next request.
+ *
+ * Returns 1 once the request is processed, 0 if the socket would block and -1 if the connection has to be closed.
+ */
+static int receiveUpload(Connection *conn, char *baseDir) {
+    int headerLen = conn->request.headerLen;
+    while (conn->uploadRemaining > 0) {
+        long buffered = conn->messageSize - headerLen;
+        if (0 == buffered) {
+            size_t needed = headerLen + FILE_BUFFER_SIZE + 1;
+            if (needed > conn->messageCapacity) {
+                char *message = buffer_pool_grow(conn->pool, conn->message, conn->messageSize, &conn->messageCapacity, needed);
+                if (!message) {
+                    perror("[ERROR]: Memory not allocated for upload buffer");
+                    abortUpload(conn);
+                    return -1;
+                }
+                conn->message = message;
+            }
+
+            size_t space = conn->messageCapacity - conn->messageSize - 1;
+            if ((unsigned long) conn->uploadRemaining < space) {
+                space = (size_t) conn->uploadRemaining;
+            }
+            int n = recv(conn->sock, conn->message + conn->messageSize, space, 0);
+            if (n < 0) {
+                if (EINTR == errno) {
+                    continue;
+                }
+                if (EAGAIN == errno || EWOULDBLOCK == errno) {
+                    return 0;
+                }
+                perror("[ERROR]: reading upload from socket");
+                abortUpload(conn);
+                return -1;
+            }
+            if (0 == n) {
+                printf("[WARN]: Connection closed during upload of %s\n", conn->uploadTempPath);
+                abortUpload(conn);
+                return -1;
+            }
+            conn->messageSize += n;
+            buffered = n;
+        }
+
+        long chunk = buffered < conn->uploadRemaining ? buffered : conn->uploadRemaining;
+        if (conn->pushStream) {
+            if (push_stream_write(conn->pushStream, conn->message + headerLen, chunk) < 0) {
+                printf("[ERROR]: %s\n", push_stream_error(conn->pushStream));
+                char *message = concat("Failed to decode request body: ", push_stream_error(conn->pushStream));
+                abortUpload(conn);
+                conn->keepAlive = 0;
+                sendErrorMessage(conn, message, ERROR_CODE);
+                arena_free(message);
+                return 1;
+            }
+        } else if (conn->archiveUpload) {
+            if (tar_reader_write(conn->archiveUpload->reader, conn->message + headerLen, chunk) < 0) {
+                failArchiveUpload(conn);
+                return 1;
+            }
+        } else if (fwrite(conn->message + headerLen, 1, chunk, conn->uploadFile) != (size_t) chunk) {
+            perror("[ERROR]: Failed to write uploaded file");
+            abortUpload(conn);
+            conn->keepAlive = 0;
+            sendErrorMessage(conn, "Failed to write file ", ERROR_CODE);
+            return 1;
+        } else if (contentStore) {
+            sha256_update(&conn->uploadDigest, conn->message + headerLen, chunk);
+        }
+        conn->uploadRemaining -= chunk;
+        conn->messageSize -= chunk;
+        memmove(conn->message + headerLen, conn->message + headerLen + chunk, conn->messageSize - headerLen + 1);
+    }
+    if (conn->pushStream) {
+        finishPushStream(conn, baseDir);
+    } else if (conn->archiveUpload) {
+        finishArchiveUpload(conn);
+    } else {
+        finishUpload(conn);
+    }
+    return 1;
+}
+
+/**
+ * Looks at a request as soon as its headers are parsed, before the body is received: raw file requests and large
+ * JSON commands are taken over here, other requests are buffered completely for doProcessing().
+ *
+ * Returns 1 if the request is no longer read by the caller (an upload has started or an error response is queued).
+ */
+static int routeRequest(Connection *conn, char *baseDir) {
+    if (!http_headers_complete(&conn->request) || conn->requestRouted) {
+        return CONN_READING != conn->state;
+    }
+    conn->requestRouted = 1;
+
+    if (isRawFileRequest(conn)) {
+        const char *method = conn->message + conn->request.method;
+        if (3 == conn->request.methodLen && 0 == strncmp(method, "PUT", 3)) {
+            startUpload(conn, baseDir);
+            return CONN_READING != conn->state;
+        }
+        if (3 != conn->request.methodLen || 0 != strncmp(method, "GET", 3)) {
+            conn->keepAlive = 0;
+            sendErrorResponse(conn, 405, "Method not allowed for files", ERROR_CODE);
+            return 1;
+        }
+        // downloads are handled by processRequest() once the whole request is received
+    }
+    // only raw uploads may be larger, other bodies end up in memory
+    if (conn->request.contentLength > MAX_REQUEST_BODY_SIZE) {
+        conn->keepAlive = 0;
+        sendErrorResponse(conn, 413, "Request body is too large", ERROR_CODE);
+        return 1;
+    }
+    if (conn->request.contentLength > STREAM_BODY_THRESHOLD) {
+        int stream = checkStreamSecretKey(conn);
+        if (stream < 0) {
+            conn->keepAlive = 0;
+            sendErrorResponse(conn, 403, ERROR_MESSAGE_SECRET_KEY_MISSMATCH, ERROR_CODE_SECRET_KEY_MISMATCH);
+            return 1;
+        }
+        if (stream > 0) {
+            startPushStream(conn, baseDir);
+        }
+    }
+    return CONN_READING != conn->state;
+}
+
+/**
+ * Serves one connection with blocking socket calls (used where there is no event loop).
+ */
+void serveConnection(int sock, char *baseDir) {
+    arena_t *arena = arena_create(REQUEST_ARENA_SIZE);
+    Connection *conn = newConnection(sock, NULL, arena);
+    if (!conn) {
+        arena_destroy(arena);
+        return;
+    }
+    setReceiveTimeout(sock, ckCrowdnodeServerConfig->keepAliveTimeout);
+
+    while (1) {
+        //buffered read from socket
+        int parsed;
+        while (HTTP_PARSE_INCOMPLETE == (parsed = parseMessage(conn)) && !routeRequest(conn, baseDir)) {
+            int n = receiveMessagePart(conn);
+            if (n < 0) {
+                if (EAGAIN != errno && EWOULDBLOCK != errno) {
+                    perror("[ERROR]: reading from socket");
+                    printf("WSAGetLastError() %i\n", WSAGetLastError()); //win
+                }
+                freeConnection(conn);
+                arena_destroy(arena);
+                return;
+            }
+            if (0 == n) {
+                conn->peerClosed = 1;
+                break;
+            }
+        }
+
+        if (HTTP_PARSE_ERROR != parsed) {
+            routeRequest(conn, baseDir);
+        }
+        if (CONN_UPLOADING == conn->state) {
+            if (receiveUpload(conn, baseDir) <= 0) {
+                break; // a receive timeout ends the upload as well
+            }
+        } else if (CONN_READING == conn->state) {
+            if (HTTP_PARSE_INCOMPLETE == parsed) {
+                break; // connection closed in the middle of a request
+            }
+            processRequest(conn, baseDir);
+        }
+        if (CONN_WRITING != conn->state) {
+            break;
+        }
+        if (flushResponse(conn) < 0) {
+            perror("ERROR writing to socket");
+            break;
+        }
+        if (!conn->keepAlive) {
+            break;
+        }
+        resetResponse(conn);
+    }
+    freeConnection(conn);
+    arena_destroy(arena);
+}
+
+#ifdef __linux__
+
+#define MAX_EVENTS 64
+
+static int setNonBlocking(int sock, int nonBlocking) {
+    int flags = fcntl(sock, F_GETFL, 0);
+    if (flags < 0) {
+        return -1;
+    }
+    flags = nonBlocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    return fcntl(sock, F_SETFL, flags);
+}
+
+static long monotonicSeconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+/**
+ * An event loop and the shell tasks the job engine threads have finished for its connections.
+ */
+struct EventLoop {
+    int epfd;
+    int wakeFd;                 /* eventfd, readable once a task is handed back */
+    pthread_mutex_t mutex;
+    ShellTask *finished;
+};
+
+static void resumeWaitingConnections(EventLoop *loop, Connection **connections, char *baseDir);
+
+/**
+ * Accepts all pending connections and registers them in the event loop.
+ */
+static void acceptConnections(EventLoop *loop, int listenSock, Connection **connections, buffer_pool_t *pool,
+                              arena_t *arena) {
+    while (1) {
+        int sock = accept4(listenSock, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (sock < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            if (EAGAIN != errno && EWOULDBLOCK != errno) {
+                perror("ERROR on accept");
+            }
+            return;
+        }
+
+        Connection *conn = newConnection(sock, pool, arena);
+        if (!conn) {
+            close(sock);
+            continue;
+        }
+        conn->eventLoop = 1;
+        conn->loop = loop;
+        conn->lastActive = monotonicSeconds();
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = conn;
+        if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, sock, &ev) < 0) {
+            perror("[ERROR]: Failed to register connection in epoll");
+            close(sock);
+            freeConnection(conn);
+            continue;
+        }
+
+        conn->next = *connections;
+        if (*connections) {
+            (*connections)->prev = conn;
+        }
+        *connections = conn;
+    }
+}
+
+static void closeConnection(int epfd, Connection *conn, Connection **connections) {
+    if (conn->prev) {
+        conn->prev->next = conn->next;
+    } else {
+        *connections = conn->next;
+    }
+    if (conn->next) {
+        conn->next->prev = conn->prev;
+    }
+    epoll_ctl(epfd, EPOLL_CTL_DEL, conn->sock, NULL);
+    close(conn->sock);
+    freeConnection(conn);
+}
+
+/**
+ * Closes connections which have been idle for longer than the keep-alive timeout. One waiting for its shell command
+ * is not idle.
+ */
+static void closeIdleConnections(int epfd, Connection **connections, long now) {
+    Connection *conn = *connections;
+    while (conn) {
+        Connection *next = conn->next;
+        if (CONN_WAITING != conn->state && now - conn->lastActive >= ckCrowdnodeServerConfig->keepAliveTimeout) {
+            closeConnection(epfd, conn, connections);
+        }
+        conn = next;
+    }
+}
+
+/**
+ * Advances the connection state machine as far as the socket allows without blocking.
+ */
+static void handleConnection(Connection *conn, char *baseDir) {
+    while (1) {
+        if (CONN_READING == conn->state) {
+            int parsed;
+            while (HTTP_PARSE_INCOMPLETE == (parsed = parseMessage(conn)) && !conn->peerClosed
+                   && !routeRequest(conn, baseDir)) {
+                int n = receiveMessagePart(conn);
+                if (0 == n) {
+                    conn->peerClosed = 1;
+                    break;
+                }
+                if (n < 0) {
+                    if (EINTR == errno) {
+                        continue;
+                    }
+                    if (EAGAIN == errno || EWOULDBLOCK == errno) {
+                        return; // wait for the rest of the request
+                    }
+                    perror("[ERROR]: reading from socket");
+                    conn->state = CONN_CLOSING;
+                    return;
+                }
+            }
+
+            if (HTTP_PARSE_ERROR != parsed) {
+                routeRequest(conn, baseDir);
+            }
+            if (CONN_READING == conn->state) {
+                if (HTTP_PARSE_INCOMPLETE == parsed) {
+                    // connection closed in the middle of a request
+                    conn->state = CONN_CLOSING;
+                    return;
+                }
+                processRequest(conn, baseDir);
+                if (CONN_WAITING == conn->state) {
+                    return;
+                }
+                if (CONN_READING == conn->state) {
+                    // no response for this action
+                    conn->state = CONN_CLOSING;
+                    return;
+                }
+            }
+        }
+
+        if (CONN_UPLOADING == conn->state) {
+            int received = receiveUpload(conn, baseDir);
+            if (0 == received) {
+                return; // wait for the rest of the body
+            }
+            if (0 > received || CONN_READING == conn->state) {
+                // failed or no response for this action
+                conn->state = CONN_CLOSING;
+                return;
+            }
+            if (CONN_WAITING == conn->state) {
+                return;
+            }
+        }
+
+        if (CONN_WRITING == conn->state) {
+            int sent = flushResponse(conn);
+            if (0 == sent) {
+                return; // wait until the socket is writable again
+            }
+            if (0 > sent || !conn->keepAlive) {
+                conn->state = CONN_CLOSING;
+                return;
+            }
+            // next request: either already received (pipelined) or still to be read
+            resetResponse(conn);
+        }
+    }
+}
+
+/**
+ * Edge-triggered epoll loop serving all connections with non-blocking sockets. Never returns.
+ */
+void runEventLoop(int listenSock, char *baseDir) {
+    EventLoop loop;
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        perror("[ERROR]: epoll_create1 failed");
+        exit(1);
+    }
+    loop.epfd = epfd;
+    loop.finished = NULL;
+    pthread_mutex_init(&loop.mutex, NULL);
+    loop.wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (loop.wakeFd < 0) {
+        perror("[ERROR]: eventfd failed");
+        exit(1);
+    }
+
+    if (setNonBlocking(listenSock, 1) < 0) {
+        perror("[ERROR]: Failed to make listening socket non-blocking");
+        exit(1);
+    }
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = NULL; // NULL marks the listening socket
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, listenSock, &ev) < 0) {
+        perror("[ERROR]: Failed to register listening socket in epoll");
+        exit(1);
+    }
+    ev.data.ptr = &loop; // marks the finished shell tasks
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, loop.wakeFd, &ev) < 0) {
+        perror("[ERROR]: Failed to register eventfd in epoll");
+        exit(1);
+    }
+
+    buffer_pool_t *pool = buffer_pool_create((size_t) ckCrowdnodeServerConfig->bufferPoolSize << 20);
+    if (!pool) {
+        perror("[ERROR]: Memory not allocated for buffer pool");
+        exit(1);
+    }
+    arena_t *arena = arena_create(REQUEST_ARENA_SIZE);
+    if (!arena) {
+        perror("[ERROR]: Memory not allocated for request arena");
+        exit(1);
+    }
+
+    struct epoll_event events[MAX_EVENTS];
+    Connection *connections = NULL;
+    long lastIdleCheck = monotonicSeconds();
+    while (1) {
+        int n = epoll_wait(epfd, events, MAX_EVENTS, connections ? 1000 : -1);
+        if (n < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            perror("[ERROR]: epoll_wait failed");
+            exit(1);
+        }
+
+        int i;
+        for (i = 0; i < n; i++) {
+            Connection *conn = events[i].data.ptr;
+            if (!conn) {
+                acceptConnections(&loop, listenSock, &connections, pool, arena);
+                continue;
+            }
+            if (events[i].data.ptr == &loop) {
+                resumeWaitingConnections(&loop, &connections, baseDir);
+                continue;
+            }
+            if (CONN_WAITING == conn->state) {
+                // the task owns the connection, it is served again once the task is handed back
+                continue;
+            }
+
+            conn->lastActive = monotonicSeconds();
+            if (events[i].events & EPOLLERR) {
+                conn->state = CONN_CLOSING;
+            } else {
+                handleConnection(conn, baseDir);
+            }
+
+            if (CONN_CLOSING == conn->state) {
+                closeConnection(epfd, conn, &connections);
+            }
+        }
+
+        long now = monotonicSeconds();
+        if (now != lastIdleCheck) {
+            closeIdleConnections(epfd, &connections, now);
+            lastIdleCheck = now;
+        }
+    }
+}
+
+typedef struct {
+    int id;
+    int cpu;            /* CPU the worker is pinned to, -1 if it is not pinned */
+    int listenSock;
+    char *baseDir;
+    pthread_t thread;
+} Worker;
+
+static void *workerMain(void *arg) {
+    Worker *worker = arg;
+    if (0 <= worker->cpu) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(worker->cpu, &cpus);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (err) {
+            printf("[WARN]: Failed to pin worker %i to CPU %i: %s\n", worker->id, worker->cpu, strerror(err));
+        }
+    }
+    printf("[INFO]: Worker %i started on CPU %i\n", worker->id, worker->cpu);
+    runEventLoop(worker->listenSock, worker->baseDir);
+    return NULL;
+}
+
+/**
+ * Starts workerCount threads, each with its own SO_REUSEPORT listening socket and event loop, pinned round robin
+ * to the CPUs the process is allowed to run on. Never returns.
+ */
+void runWorkers(int port, int workerCount, char *baseDir) {
+    Worker *workers = calloc(workerCount, sizeof(Worker));
+    if (!workers) {
+        perror("[ERROR]: Memory not allocated for workers");
+        exit(1);
+    }
+
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+        CPU_ZERO(&allowed);
+    }
+
+    int cpu = -1;
+    int i;
+    for (i = 0; i < workerCount; i++) {
+        workers[i].id = i;
+        workers[i].baseDir = baseDir;
+        workers[i].listenSock = openServerSocket(port, 1);
+        if (workers[i].listenSock < 0) {
+            if (0 == i) {
+                // no SO_REUSEPORT - single worker with an ordinary listening socket
+                workers[i].listenSock = openServerSocket(port, 0);
+            }
+            if (workers[i].listenSock < 0) {
+                break;
+            }
+        }
+
+        workers[i].cpu = -1;
+        if (0 < CPU_COUNT(&allowed)) {
+            do {
+                cpu = (cpu + 1) % CPU_SETSIZE;
+            } while (!CPU_ISSET(cpu, &allowed));
+            workers[i].cpu = cpu;
+        }
+    }
+    workerCount = i;
+    printf("[INFO]: Server started at port  %i with %i worker threads\n", port, workerCount);
+
+    for (i = 0; i < workerCount; i++) {
+        int err = pthread_create(&workers[i].thread, NULL, workerMain, &workers[i]);
+        if (err) {
+            printf("[ERROR]: Failed to start worker %i: %s\n", i, strerror(err));
+            exit(1);
+        }
+    }
+    for (i = 0; i < workerCount; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    free(workers);
+}
+
+#endif
+
+/**
+ * Queues the successful push response, example:
+ *   {"return":0, "compileUUID": <generated UID>}
+ * with the hash of the content if it is in the content store.
+ */
+static void sendPushResult(Connection *conn, const char *hash) {
+    char compileUUID[38];
+    generateUUID(compileUUID, sizeof(compileUUID));
+
+    cJSON *resultJSON = cJSON_CreateObject();
+    if (!resultJSON) {
+        perror("[ERROR]: Memory not allocated for resultJSON");
+        exit(1);
+    }
+    cJSON_AddItemToObject(resultJSON, "return", cJSON_CreateString("0"));
+    cJSON_AddItemToObject(resultJSON, "compileUUID", cJSON_CreateString(compileUUID));
+    if (hash && hash[0]) {
+        cJSON_AddItemToObject(resultJSON, JSON_PARAM_HASH, cJSON_CreateString(hash));
+    }
+    sendJSONResponse(conn, resultJSON);
+    cJSON_Delete(resultJSON);
+}
+
+/**
+ * Returns the hash a push is checked against, NULL if there is none.
+ */
+static char *getExpectedHash(cJSON *commandJSON) {
+    cJSON *hashJSON = cJSON_GetObjectItem(commandJSON, JSON_PARAM_HASH);
+    return hashJSON ? hashJSON->valuestring : NULL;
+}
+
+/**
+ * Moves the content the push_stream filter has decoded while the request was received to the pushed file.
+ *
+ * Returns 0 on success, -1 if an error response has been queued.
+ */
+static int savePushStream(Connection *conn, cJSON *commandJSON, char *fileName, char *baseDir,
+                          char hash[CONTENT_HASH_SIZE]) {
+    if (!push_stream_found(conn->pushStream)) {
+        printf("[ERROR]: Invalid action JSON format for message: \n");
+        sendErrorMessage(conn, "Invalid action JSON format for message: no fileContentJSON found", ERROR_CODE);
+        return -1;
+    }
+    if (contentStore) {
+        sha256_final_hex(&conn->uploadDigest, hash);
+        if (!checkContentHash(getExpectedHash(commandJSON), hash)) {
+            sendErrorMessage(conn, "Content does not match hash", ERROR_CODE);
+            return -1;
+        }
+    }
+
+    char *filePath = concat(baseDir, fileName);
+    if (0 != saveReceivedFile(conn->uploadTempPath, filePath, contentStore ? hash : NULL)) {
+        perror("[ERROR]: Failed to save pushed file");
+        char *message = concat("Could not write file at path: ", filePath);
+        sendErrorMessage(conn, message, ERROR_CODE);
+        arena_free(message);
+        arena_free(filePath);
+        return -1;
+    }
+    printf("[INFO]: File saved to: %s (%lld bytes)\n", filePath, conn->pushSize);
+    arena_free(filePath);
+    free(conn->uploadTempPath);
+    conn->uploadTempPath = NULL; // nothing left to remove
+    return 0;
+}
+
+/**
+ * Gives content of the content store a file name, without it being pushed again.
+ *
+ * Returns NULL on success, the description of the failure otherwise, to be released with arena_free().
+ */
+static char *linkStoredContent(const char *hash, char *fileName, char *baseDir) {
+    if (!content_store_valid_hash(hash)) {
+        return concat("Invalid content hash", "");
+    }
+    char *filePath = concat(baseDir, fileName);
+    if (0 != content_store_link(contentStore, hash, filePath)) {
+        int notStored = ENOENT == errno;
+        perror("[ERROR]: Failed to link stored content");
+        char *message = concat(notStored ? "Content not stored: " : "Could not write file at path: ",
+                               notStored ? hash : filePath);
+        arena_free(filePath);
+        return message;
+    }
+    printf("[INFO]: Stored content %s linked to: %s\n", hash, filePath);
+    arena_free(filePath);
+    return NULL;
+}
+
+/**
+ * Answers a push naming content of the content store.
+ */
+static void pushStoredContent(Connection *conn, const char *hash, char *fileName, char *baseDir) {
+    char *error = linkStoredContent(hash, fileName, baseDir);
+    if (error) {
+        sendErrorMessage(conn, error, ERROR_CODE);
+        arena_free(error);
+        return;
+    }
+    sendPushResult(conn, hash);
+}
+
+/**
+ * Reads the "compression" of a push or pull, COMPRESSION_NONE if there is none.
+ *
+ * Returns 0 on success, -1 if an error response has been queued.
+ */
+static int getCompression(Connection *conn, cJSON *commandJSON, compression_t *compression) {
+    cJSON *compressionJSON = cJSON_GetObjectItem(commandJSON, JSON_PARAM_COMPRESSION);
+    *compression = COMPRESSION_NONE;
+    if (compressionJSON
+        && (!compressionJSON->valuestring || 0 != compression_parse(compressionJSON->valuestring, compression))) {
+        char *message = concat("Unsupported compression: ", compressionJSON->valuestring ? compressionJSON->valuestring : "");
+        sendErrorMessage(conn, message, ERROR_CODE);
+        arena_free(message);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Destination of pushed content: a file, hashed for the content store if digest is set.
+ */
+typedef struct {
+    FILE *file;
+    sha256_t *digest;
+    long long size;
+    long long limit;            /* the content may not grow larger, so a small compressed push cannot fill the disk */
+    const char *error;          /* why the sink failed, NULL if it did not */
+} PushedContent;
+
+/**
+ * Returns the largest content a push may have once it is decompressed.
+ */
+static long long maxPushedSize() {
+    int megabytes = ckCrowdnodeServerConfig->maxUploadSize;
+    return megabytes > 0 ? (long long) megabytes * 1024 * 1024 : LLONG_MAX;
+}
+
+/**
+ * compressor_sink_t writing PushedContent.
+ */
+static int writePushedContent(void *ctx, const void *data, size_t len) {
+    PushedContent *pushed = ctx;
+    if ((long long) len > pushed->limit - pushed->size) {
+        pushed->error = "Decompressed content is larger than the maximum upload size";
+        return -1;
+    }
+    if (fwrite(data, 1, len, pushed->file) != len) {
+        return -1;
+    }
+    if (pushed->digest) {
+        sha256_update(pushed->digest, data, len);
+    }
+    pushed->size += len;
+    return 0;
+}
+
+/**
+ * Passes pushed content to a sink, decompressing it on the way if it is compressed.
+ *
+ * Returns NULL on success, a description of the failure otherwise.
+ */
+static const char *passContent(compression_t compression, const void *data, size_t len, compressor_sink_t sink,
+                               void *ctx) {
+    if (COMPRESSION_NONE == compression) {
+        return sink(ctx, data, len) < 0 ? "Failed to write file " : NULL;
+    }
+    compressor_t *compressor = compressor_create(compression, 1);
+    if (!compressor) {
+        return "Memory not allocated for decompression";
+    }
+    const char *error = NULL;
+    if (compressor_write(compressor, data, len, sink, ctx) < 0 || compressor_finish(compressor, sink, ctx) < 0) {
+        // static strings of zlib or zstd, valid after the compressor is freed
+        error = compressor_error(compressor);
+    }
+    compressor_free(compressor);
+    return error;
+}
+
+/**
+ * Decompresses the content the push_stream filter has decoded into the temporary file, through a fixed window, and
+ * hashes the decompressed content for the content store instead.
+ *
+ * Returns 0 on success, -1 if an error response has been queued.
+ */
+static int inflatePushStream(Connection *conn, compression_t compression) {
+    if (!push_stream_found(conn->pushStream)) {
+        return 0; // reported by the caller
+    }
+    char *inflatedPath = concat(conn->uploadTempPath, ".inflated");
+    FILE *in = fopen(conn->uploadTempPath, "rb");
+    FILE *out = in ? fopen(inflatedPath, "wb") : NULL;
+    compressor_t *compressor = out ? compressor_create(compression, 1) : NULL;
+    const char *error = compressor ? NULL : "Could not write file in files directory";
+    if (contentStore) {
+        sha256_init(&conn->uploadDigest);
+    }
+    PushedContent pushed = {out, contentStore ? &conn->uploadDigest : NULL, 0, maxPushedSize(), NULL};
+    char buf[FILE_BUFFER_SIZE];
+    size_t n;
+    while (!error && (n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        if (compressor_write(compressor, buf, n, writePushedContent, &pushed) < 0) {
+            error = pushed.error ? pushed.error : compressor_error(compressor);
+        }
+    }
+    if (!error && ferror(in)) {
+        error = "Failed to read pushed file";
+    } else if (!error && compressor_finish(compressor, writePushedContent, &pushed) < 0) {
+        error = pushed.error ? pushed.error : compressor_error(compressor);
+    }
+    if (out && 0 != fclose(out) && !error) {
+        error = "Failed to write file ";
+    }
+    if (in) {
+        fclose(in);
+    }
+#ifdef _WIN32
+    // rename() does not replace existing files on Windows
+    if (!error) {
+        remove(conn->uploadTempPath);
+    }
+#endif
+    if (!error && 0 != rename(inflatedPath, conn->uploadTempPath)) {
+        error = "Failed to write file ";
+    }
+    if (error) {
+        remove(inflatedPath);
+        char *message = concat("Failed to decompress pushed file: ", error);
+        printf("[ERROR]: %s\n", message);
+        sendErrorMessage(conn, message, ERROR_CODE);
+        arena_free(message);
+    } else {
+        printf("[DEBUG]: Decompressed %lld bytes to %lld\n", push_stream_written(conn->pushStream), pushed.size);
+        conn->pushSize = pushed.size;
+    }
+    compressor_free(compressor);
+    arena_free(inflatedPath);
+    return error ? -1 : 0;
+}
+
+/**
+ * Decodes the Base64 content of a push into a buffer to be freed by the caller.
+ *
+ * Returns NULL with error set on failure.
+ */
+static unsigned char *decodePushContent(cJSON *fileContentJSON, size_t *bytesDecoded, const char **error) {
+    char *file_content_base64 = fileContentJSON->valuestring;
+    size_t encodedLen = fileContentJSON->valuelength;
+    printf("[DEBUG]: File content base64 length: %lu\n", (unsigned long) encodedLen);
+
+    size_t targetSize = BASE64_DECODED_MAX_LEN(encodedLen) + 1;
+    unsigned char *file_content = malloc(targetSize);
+    if (!file_content) {
+        *error = "Memory not allocated for file content";
+        return NULL;
+    }
+
+    *bytesDecoded = 0;
+    if (encodedLen != 0) {
+        // an empty file is valid content, only a result which does not fit is a failure
+        *bytesDecoded = base64_decode_n(file_content_base64, encodedLen, file_content, targetSize);
+        if (*bytesDecoded == (size_t) -1) {
+            free(file_content);
+            *error = "Failed to Base64 decode file";
+            return NULL;
+        }
+        file_content[*bytesDecoded] = '\0';
+        printf("[INFO]: Bytes decoded: %lu\n", (unsigned long) *bytesDecoded);
+    } else {
+        printf("[WARNING]: file content is empty nothing to decode\n");
+    }
+    return file_content;
+}
+
+static double numberValue(cJSON *item, double defaultValue);
+static long long regularFileSize(FILE *file);
+
+/**
+ * Computes the content hash of a file.
+ */
+static int hashFile(const char *path, char hash[CONTENT_HASH_SIZE]) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return -1;
+    }
+    char buf[FILE_BUFFER_SIZE];
+    size_t n;
+    sha256_t digest;
+    sha256_init(&digest);
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+        sha256_update(&digest, buf, n);
+    }
+    int failed = ferror(file);
+    fclose(file);
+    sha256_final_hex(&digest, hash);
+    return failed ? -1 : 0;
+}
+
+/**
+ * Destination of a decoded chunk: its upload session, from the offset of the chunk on.
+ */
+typedef struct {
+    upload_session_t *session;
+    long long offset;
+    long long size;
+    int error;          /* errno of the failed write */
+} PushedChunk;
+
+/**
+ * compressor_sink_t writing a PushedChunk.
+ */
+static int writePushedChunk(void *ctx, const void *data, size_t len) {
+    PushedChunk *chunk = ctx;
+    if (0 != upload_session_write(chunk->session, data, len, chunk->offset + chunk->size)) {
+        chunk->error = errno;
+        return -1;
+    }
+    chunk->size += len;
+    return 0;
+}
+
+/**
+ * Writes the content of a chunk into the file of its upload session, from the temporary file of the push_stream
+ * filter or decoded (and decompressed) from the JSON. A chunk without content writes nothing.
+ *
+ * Returns the number of bytes written, -1 if an error response has been queued.
+ */
+static long long writePushChunk(Connection *conn, cJSON *commandJSON, compression_t compression,
+                                upload_session_t *session, long long offset) {
+    long long len = 0;
+    int rc = 0;
+    if (conn->pushStream) {
+        len = push_stream_found(conn->pushStream) ? conn->pushSize : 0;
+        FILE *chunk = fopen(conn->uploadTempPath, "rb");
+        rc = chunk ? upload_session_copy(session, fileno(chunk), len, offset) : -1;
+        if (chunk) {
+            fclose(chunk);
+        }
+    } else {
+        cJSON *fileContentJSON = cJSON_GetObjectItem(commandJSON, JSON_PARAM_FILE_CONTENT);
+        if (fileContentJSON && fileContentJSON->valuestring && fileContentJSON->valuestring[0]) {
+            size_t bytesDecoded;
+            const char *error = NULL;
+            unsigned char *file_content = decodePushContent(fileContentJSON, &bytesDecoded, &error);
+            if (!file_content) {
+                sendErrorMessage(conn, (char *) error, ERROR_CODE);
+                return -1;
+            }
+            PushedChunk chunk = {session, offset, 0, 0};
+            error = passContent(compression, file_content, bytesDecoded, writePushedChunk, &chunk);
+            free(file_content);
+            if (error && !chunk.error) {
+                char *message = concat("Failed to decompress chunk: ", error);
+                sendErrorMessage(conn, message, ERROR_CODE);
+                arena_free(message);
+                return -1;
+            }
+            len = chunk.size;
+            rc = error ? -1 : 0;
+            errno = chunk.error;
+        }
+    }
+    if (rc < 0 && EALREADY == errno) {
+        // a chunk sent again after the file was saved
+        return 0;
+    }
+    if (rc < 0) {
+        perror("[ERROR]: Failed to write chunk");
+        sendErrorMessage(conn, EINVAL == errno ? "Chunk is outside the file" : "Failed to write file ", ERROR_CODE);
+        return -1;
+    }
+    return len;
+}
+
+/**
+ * Saves the file of an upload session, which the last chunk has completed, under its name.
+ *
+ * Returns 0 on success, -1 if an error response has been queued.
+ */
+static int commitUpload(Connection *conn, cJSON *commandJSON, upload_session_t *session, char *fileName,
+                        char *baseDir, char hash[CONTENT_HASH_SIZE]) {
+    const char *path = upload_session_path(session);
+    if (contentStore) {
+        if (0 != hashFile(path, hash)) {
+            perror("[ERROR]: Failed to read uploaded file");
+            upload_session_finish(session, 0);
+            sendErrorMessage(conn, "Failed to write file ", ERROR_CODE);
+            return -1;
+        }
+        if (!checkContentHash(getExpectedHash(commandJSON), hash)) {
+            upload_session_finish(session, 0);
+            sendErrorMessage(conn, "Content does not match hash", ERROR_CODE);
+            return -1;
+        }
+    }
+    char *filePath = concat(baseDir, fileName);
+    int rc = saveReceivedFile(path, filePath, contentStore ? hash : NULL);
+    upload_session_finish(session, 0 == rc);
+    if (0 != rc) {
+        perror("[ERROR]: Failed to save uploaded file");
+        char *message = concat("Could not write file at path: ", filePath);
+        sendErrorMessage(conn, message, ERROR_CODE);
+        arena_free(message);
+        arena_free(filePath);
+        return -1;
+    }
+    printf("[INFO]: File saved to: %s\n", filePath);
+    arena_free(filePath);
+    return 0;
+}
+
+/**
+ * Queues the response to a chunk of a resumable push, see the header comment.
+ */
+static void sendChunkResult(Connection *conn, const char *uploadId, long long total, upload_session_t *session,
+                            const char *hash) {
+    upload_range_t missing[MAX_MISSING_RANGES];
+    int complete = upload_session_committed(session);
+    int count = complete ? 0 : upload_session_missing(session, missing, MAX_MISSING_RANGES);
+    int i;
+
+    json_writer_t writer;
+    beginJSONResponse(conn, &writer);
+    json_writer_begin_object(&writer);
+    json_writer_key(&writer, "return");
+    json_writer_string(&writer, "0");
+    json_writer_key(&writer, JSON_PARAM_UPLOAD_ID);
+    json_writer_string(&writer, uploadId);
+    json_writer_key(&writer, JSON_PARAM_TOTAL_SIZE);
+    json_writer_number(&writer, (double) total);
+    json_writer_key(&writer, "received");
+    json_writer_number(&writer, (double) (complete ? total : upload_session_received(session)));
+    json_writer_key(&writer, "complete");
+    json_writer_bool(&writer, complete);
+    if (hash[0]) {
+        json_writer_key(&writer, JSON_PARAM_HASH);
+        json_writer_string(&writer, hash);
+    }
+    json_writer_key(&writer, "missing");
+    json_writer_begin_array(&writer);
+    for (i = 0; i < count; i++) {
+        json_writer_begin_array(&writer);
+        json_writer_number(&writer, (double) missing[i].offset);
+        json_writer_number(&writer, (double) missing[i].length);
+        json_writer_end_array(&writer);
+    }
+    json_writer_end_array(&writer);
+    json_writer_end_object(&writer);
+    if (sendJSONWriterResponse(conn, &writer, 200) < 0) {
+        sendErrorMessage(conn, "Memory not allocated for response", ERROR_CODE);
+    }
+}
+
+/**
+ * Writes one chunk of a resumable push at its offset (pwrite) into the preallocated file of its upload session and
+ * saves the file once all of it has been received.
+ */
+static void handlePushChunk(Connection *conn, cJSON *commandJSON, compression_t compression, char *fileName,
+                            char *baseDir) {
+    char *uploadId = cJSON_GetObjectItem(commandJSON, JSON_PARAM_UPLOAD_ID)->valuestring;
+    double total = numberValue(cJSON_GetObjectItem(commandJSON, JSON_PARAM_TOTAL_SIZE), -1);
+    double offset = numberValue(cJSON_GetObjectItem(commandJSON, JSON_PARAM_OFFSET), 0);
+    if (!uploadSessions) {
+        sendErrorMessage(conn, "Resumable uploads are not supported", ERROR_CODE);
+        return;
+    }
+    if (!uploadId || !upload_session_valid_id(uploadId)) {
+        sendErrorMessage(conn, "Invalid upload id", ERROR_CODE);
+        return;
+    }
+    if (total < 0 || offset < 0) {
+        sendErrorMessage(conn, "Invalid action JSON format for message: no total_size found", ERROR_CODE);
+        return;
+    }
+
+    upload_session_t *session = upload_session_open(uploadSessions, uploadId, fileName, (long long) total);
+    if (!session) {
+        perror("[ERROR]: Failed to open upload");
+        sendErrorMessage(conn, EINVAL == errno ? "Upload id is in use for another file"
+                               : EFBIG == errno ? "Upload is larger than the maximum upload size"
+                               : ENOSPC == errno ? "Not enough space for upload" : "Failed to write file ", ERROR_CODE);
+        return;
+    }
+    long long len = writePushChunk(conn, commandJSON, compression, session, (long long) offset);
+    char hash[CONTENT_HASH_SIZE] = "";
+    if (len >= 0 && (!upload_session_mark(session, (long long) offset, len)
+                     || 0 == commitUpload(conn, commandJSON, session, fileName, baseDir, hash))) {
+        printf("[DEBUG]: Upload %s: %lld bytes at %lld\n", uploadId, len, (long long) offset);
+        sendChunkResult(conn, uploadId, (long long) total, session, hash);
+    }
+    upload_session_release(uploadSessions, session);
+}
+
+/**
+ * Decodes the Base64 content of a push, decompresses it if it is compressed and saves it to the pushed file, through
+ * the content store if it is enabled, which sets the hash of the content.
+ *
+ * Returns NULL on success, the description of the failure otherwise, to be released with arena_free().
+ */
+static char *savePushedContent(cJSON *fileContentJSON, compression_t compression, const char *expectedHash,
+                               char *fileName, char *baseDir, char hash[CONTENT_HASH_SIZE]) {
+    const char *error = NULL;
+    size_t bytesDecoded;
+    unsigned char *file_content = decodePushContent(fileContentJSON, &bytesDecoded, &error);
+    if (!file_content) {
+        return concat(error, "");
+    }
+
+    // 2) save locally at tmp dir
+    printf("[DEBUG]: Build file path from base dir: %s and file name: %s\n", baseDir, fileName);
+    char *filePath = concat(baseDir, fileName);
+    char *writePath = filePath;
+    if (contentStore || COMPRESSION_NONE != compression) {
+        // written next to the pushed file and moved to it once complete, through the content store, which drops it
+        // if the content is there already
+        char uuid[38];
+        generateUUID(uuid, sizeof(uuid));
+        writePath = arena_malloc(strlen(baseDir) + strlen(uuid) + 16);
+        if (!writePath) {
+            free(file_content);
+            arena_free(filePath);
+            return concat("Memory not allocated for push", "");
+        }
+        sprintf(writePath, "%s.push-%s.part", baseDir, uuid);
+    }
+
+    FILE *file = fopen(writePath, "wb");
+    if (!file) {
+        char *message = concat("Could not write file at path: ", filePath);
+        printf("[ERROR]: %s", message);
+        if (writePath != filePath) {
+            arena_free(writePath);
+        }
+        arena_free(filePath);
+        free(file_content);
+        return message;
+    }
+
+    printf("[DEBUG]: Open file to write %s\n", writePath);
+    printf("[DEBUG]: Bytes to write %lu\n", (unsigned long) bytesDecoded);
+    sha256_t digest;
+    sha256_init(&digest);
+    PushedContent pushed = {file, contentStore ? &digest : NULL, 0, maxPushedSize(), NULL};
+    error = passContent(compression, file_content, bytesDecoded, writePushedContent, &pushed);
+    if (pushed.error) {
+        error = pushed.error;
+    }
+    const char *errorPrefix = error && COMPRESSION_NONE != compression ? "Failed to decompress file: " : "";
+    if (0 != fclose(file) && !error) {
+        error = "Failed to write file ";
+    }
+    free(file_content);
+    if (!error && contentStore) {
+        sha256_final_hex(&digest, hash);
+        if (!checkContentHash(expectedHash, hash)) {
+            error = "Content does not match hash";
+        }
+    }
+    if (!error && writePath != filePath && 0 != saveReceivedFile(writePath, filePath, contentStore ? hash : NULL)) {
+        perror("[ERROR]: Failed to save pushed file");
+        error = "Failed to write file ";
+    }
+    if (writePath != filePath) {
+        if (error) {
+            remove(writePath);
+        }
+        arena_free(writePath);
+    }
+    if (error) {
+        hash[0] = '\0';
+        arena_free(filePath);
+        return concat(errorPrefix, error);
+    }
+    printf("[INFO]: File saved to: %s\n", filePath);
+    arena_free(filePath);
+    return NULL;
+}
+
+void handlePush(Connection *conn, cJSON *commandJSON, char *baseDir) {
+    //  push file (to send file to CK Node )
+    cJSON *filenameJSON = cJSON_GetObjectItem(commandJSON, JSON_PARAM_FILE_NAME);
+    if (!filenameJSON || !filenameJSON->valuestring) {
+        printf("[ERROR]: Invalid action JSON format for provided message\n");
+        sendErrorMessage(conn, "Invalid action JSON format for message: no filenameJSON found", ERROR_CODE);
+        return;
+    }
+
+    char *fileName = filenameJSON->valuestring;
+    if (!isSafeFileName(fileName)) {
+        printf("[ERROR]: Invalid file name: %s\n", fileName);
+        sendErrorMessage(conn, "Invalid file name", ERROR_CODE);
+        return;
+    }
+    compression_t compression;
+    if (0 != getCompression(conn, commandJSON, &compression)
+        || (conn->pushStream && COMPRESSION_NONE != compression && 0 != inflatePushStream(conn, compression))) {
+        return;
+    }
+    if (cJSON_GetObjectItem(commandJSON, JSON_PARAM_UPLOAD_ID)) {
+        handlePushChunk(conn, commandJSON, compression, fileName, baseDir);
+        return;
+    }
+    char hash[CONTENT_HASH_SIZE] = "";
+    if (conn->pushStream) {
+        if (0 == savePushStream(conn, commandJSON, fileName, baseDir, hash)) {
+            sendPushResult(conn, hash);
+        }
+        return;
+    }
+
+    cJSON *fileContentJSON = cJSON_GetObjectItem(commandJSON, JSON_PARAM_FILE_CONTENT);
+    if (!fileContentJSON && contentStore && getExpectedHash(commandJSON)) {
+        pushStoredContent(conn, getExpectedHash(commandJSON), fileName, baseDir);
+        return;
+    }
+    if (!fileContentJSON || !fileContentJSON->valuestring) {
+        printf("[ERROR]: Invalid action JSON format for message: \n");
+        sendErrorMessage(conn, "Invalid action JSON format for message: no fileContentJSON found", ERROR_CODE);
+        return;
+    }
+
+    printf("[DEBUG]: File name: %s\n", fileName);
+    char *error = savePushedContent(fileContentJSON, compression, getExpectedHash(commandJSON), fileName, baseDir,
+                                    hash);
+    if (error) {
+        sendErrorMessage(conn, error, ERROR_CODE);
+        arena_free(error);
+        return;
+    }
+    sendPushResult(conn, hash);
+}
+
+/**
+ * Tells which of the given content hashes are not in the content store, so that a client pushes only those and
+ * names the others with a push of their hash.
+ */
+void handleHas(Connection *conn, cJSON *commandJSON) {
+    if (!contentStore) {
+        sendErrorMessage(conn, "Content store is disabled", ERROR_CODE);
+        return;
+    }
+    cJSON *hashesJSON = cJSON_GetObjectItem(commandJSON, JSON_PARAM_HASHES);
+    if (!hashesJSON || cJSON_Array != (hashesJSON->type & 255)) {
+        sendErrorMessage(conn, "Invalid action JSON format for message: no hashes found", ERROR_CODE);
+        return;
+    }
+
+    int count = 0, missing = 0;
+    json_writer_t writer;
+    beginJSONResponse(conn, &writer);
+    json_writer_begin_object(&writer);
+    json_writer_key(&writer, "return");
+    json_writer_string(&writer, "0");
+    json_writer_key(&writer, "missing");
+    json_writer_begin_array(&writer);
+    cJSON *hashJSON;
+    for (hashJSON = hashesJSON->child; hashJSON; hashJSON = hashJSON->next, count++) {
+        if (cJSON_String != (hashJSON->type & 255)) {
+            continue;
+        }
+        // malformed hashes are never stored
+        if (!content_store_valid_hash(hashJSON->valuestring) || !content_store_has(contentStore, hashJSON->valuestring)) {
+            json_writer_string(&writer, hashJSON->valuestring);
+            missing++;
+        }
+    }
+    json_writer_end_array(&writer);
+    json_writer_end_object(&writer);
+    printf("[INFO]: %d of %d hashes are missing\n", missing, count);
+    if (sendJSONWriterResponse(conn, &writer, 200) < 0) {
+        sendErrorMessage(conn, "Memory not allocated for response", ERROR_CODE);
+    }
+}
+
+/**
+ * The part of a file a pull sends, read from the current position of the file.
+ */
+typedef struct {
+    FILE *file;
+    long long remaining;
+} FileRange;
+
+static int seekFile(FILE *file, long long offset) {
+#ifdef _WIN32
+    return _fseeki64(file, offset, SEEK_SET);
+#else
+    return fseeko(file, (off_t) offset, SEEK_SET);
+#endif
+}
+
+/**
+ * Reads up to want bytes of a FileRange, fewer only at its end.
+ *
+ * Returns the number of bytes read, -1 on error.
+ */
+static long readFileRange(FileRange *range, unsigned char *buf, size_t want) {
+    if ((long long) want > range->remaining) {
+        want = (size_t) range->remaining;
+    }
+    size_t n = 0;
+    while (n < want) {
+        size_t read = fread(buf + n, 1, want - n, range->file);
+        if (0 == read) {
+            break;
+        }
+        n += read;
+    }
+    if (0 == n && ferror(range->file)) {
+        return -1;
+    }
+    range->remaining -= n;
+    return (long) n;
+}
+
+/**
+ * json_writer_generator_t encoding the next part of a FileRange with Base64.
+ */
+static long generateBase64FromFile(void *ctx, char *buf, size_t capacity) {
+    unsigned char chunk[JSON_WRITER_CHUNK_SIZE / 4 * 3];
+    size_t want = capacity / 4 * 3;
+    if (want > sizeof(chunk)) {
+        want = sizeof(chunk);
+    }
+    // whole triples only, padding may only come at the end
+    long n = readFileRange(ctx, chunk, want);
+    return n <= 0 ? n : (long) base64_encode_n(chunk, (size_t) n, buf);
+}
+
+/**
+ * A FileRange compressed as it is read, the compressed bytes not encoded yet are kept in pending.
+ */
+typedef struct {
+    FileRange *range;
+    compressor_t *compressor;
+    ResponseBuffer pending;
+    size_t pendingStart;
+    int finished;
+} CompressedFileRange;
+
+/**
+ * json_writer_generator_t compressing the next part of a FileRange and encoding it with Base64.
+ */
+static long generateCompressedBase64FromFile(void *ctx, char *buf, size_t capacity) {
+    CompressedFileRange *compressed = ctx;
+    ResponseBuffer *pending = &compressed->pending;
+    size_t want = capacity / 4 * 3;
+    if (want > JSON_WRITER_CHUNK_SIZE / 4 * 3) {
+        want = JSON_WRITER_CHUNK_SIZE / 4 * 3;
+    }
+    while (pending->size - compressed->pendingStart < want && !compressed->finished) {
+        if (compressed->pendingStart > 0) {
+            memmove(pending->buf, pending->buf + compressed->pendingStart, pending->size - compressed->pendingStart);
+            pending->size -= compressed->pendingStart;
+            compressed->pendingStart = 0;
+        }
+
+        unsigned char chunk[FILE_BUFFER_SIZE];
+        long n = readFileRange(compressed->range, chunk, sizeof(chunk));
+        if (n < 0) {
+            return -1;
+        }
+        int rc = n > 0 ? compressor_write(compressed->compressor, chunk, (size_t) n, appendResponse, pending)
+                       : compressor_finish(compressed->compressor, appendResponse, pending);
+        if (rc < 0) {
+            printf("[ERROR]: %s\n", compressor_error(compressed->compressor));
+            return -1;
+        }
+        compressed->finished = 0 == n;
+    }
+    // whole triples until the compressed data is complete
+    size_t n = pending->size - compressed->pendingStart;
+    if (n > want) {
+        n = want;
+    }
+    if (0 == n) {
+        return 0;
+    }
+    compressed->pendingStart += n;
+    return (long) base64_encode_n((unsigned char *) pending->buf + compressed->pendingStart - n, n, buf);
+}
+
+/**
+ * A pull too large to be answered from memory: the JSON is produced FILE_BUFFER_SIZE bytes of content at a time,
+ * compressed by the Accept-Encoding of the request and framed as HTTP chunks, each time the previous part has been
+ * sent (see flushResponse()).
+ */
+struct PullDownload {
+    FileRange range;
+    CompressedFileRange compressed;     /* the content is compressed if compressed.compressor is set */
+    compressor_t *encoder;              /* Content-Encoding of the response, NULL if none */
+    int chunked;
+    int finished;
+};
+
+static void freePullDownload(PullDownload *download) {
+    if (!download) {
+        return;
+    }
+    fclose(download->range.file);
+    compressor_free(download->compressed.compressor);
+    if (download->compressed.pending.buf) {
+        buffer_pool_put(download->compressed.pending.pool, download->compressed.pending.buf,
+                        download->compressed.pending.capacity);
+    }
+    compressor_free(download->encoder);
+    free(download);
+}
+
+/**
+ * compressor_sink_t queueing a part of the response body, as a chunk if the response is chunked.
+ */
+static int queuePullData(void *ctx, const void *data, size_t len) {
+    Connection *conn = ctx;
+    if (0 == len) {
+        return 0;
+    }
+    if (conn->sendPull->chunked) {
+        char sizeLine[24];
+        int n = snprintf(sizeLine, sizeof(sizeLine), "%lx\r\n", (unsigned long) len);
+        return queueResponse(conn, sizeLine, n) < 0 || queueResponse(conn, data, (int) len) < 0
+               || queueResponse(conn, "\r\n", 2) < 0 ? -1 : 0;
+    }
+    return queueResponse(conn, data, (int) len);
+}
+
+/**
+ * Passes JSON text of the response on, through the response compression if there is one.
+ */
+static int writePullText(Connection *conn, const char *text, size_t len) {
+    PullDownload *download = conn->sendPull;
+    if (download->encoder) {
+        return compressor_write(download->encoder, text, len, queuePullData, conn);
+    }
+    return queuePullData(conn, text, len);
+}
+
+/**
+ * Replaces the sent part of a pull with the next one: the next piece of the encoded content or, after the last one,
+ * the end of the JSON and of the body.
+ *
+ * Returns 0 on success, -1 on error (the response is cut off, the client sees an incomplete body).
+ */
+static int queuePullPart(Connection *conn) {
+    PullDownload *download = conn->sendPull;
+    conn->responseHeaderSize = 0;
+    conn->responseSize = 0;
+    conn->responseSent = 0;
+    char text[JSON_WRITER_CHUNK_SIZE];
+    long n = download->compressed.compressor
+             ? generateCompressedBase64FromFile(&download->compressed, text, sizeof(text))
+             : generateBase64FromFile(&download->range, text, sizeof(text));
+    if (n < 0) {
+        perror("[ERROR]: Failed to read pulled file");
+        return -1;
+    }
+    if (n > 0) {
+        return writePullText(conn, text, (size_t) n) < 0 ? -1 : 0;
+    }
+
+    int rc = writePullText(conn, "\"}", 2);
+    if (0 == rc && download->encoder) {
+        rc = compressor_finish(download->encoder, queuePullData, conn);
+    }
+    if (0 == rc && download->chunked) {
+        rc = queueResponse(conn, "0\r\n\r\n", 5);
+    }
+    freePullDownload(download);
+    conn->sendPull = NULL;
+    return rc;
+}
+
+/**
+ * Queues the headers and the start of the JSON of a pull whose content is encoded while it is sent, the JSON
+ * written so far (up to the content key) included. The download takes over the file and the compressor of the
+ * range, they are released on failure as well.
+ *
+ * Returns 0 on success, -1 if an error response has been queued.
+ */
+static int startPullDownload(Connection *conn, json_writer_t *writer, FileRange *range,
+                             CompressedFileRange *compressed) {
+    PullDownload *download = calloc(1, sizeof(PullDownload));
+    compression_t encoding = getResponseEncoding(conn);
+    if (download && COMPRESSION_NONE != encoding) {
+        download->encoder = compressor_create(encoding, 0);
+    }
+    json_writer_raw(writer, "\"", 1);
+    if (!download || (COMPRESSION_NONE != encoding && !download->encoder) || json_writer_error(writer)) {
+        fclose(range->file);
+        compressor_free(compressed->compressor);
+        if (download) {
+            compressor_free(download->encoder);
+            free(download);
+        }
+        json_writer_free(writer);
+        sendErrorMessage(conn, "Memory not allocated for file content", ERROR_CODE);
+        return -1;
+    }
+    download->range = *range;
+    download->compressed = *compressed;
+    download->compressed.range = &download->range;
+    download->chunked = conn->request.versionMinor >= 1;
+
+    printf("[DEBUG]: Sending %lld bytes of file content while they are encoded\n", range->remaining);
+    conn->sendPull = download;
+    int rc = sendHttpHeaders(conn, 200, "text/html; charset=UTF-8", -1, download->encoder
+                                                                         ? getEncodingHeaders(encoding) : NULL);
+    if (0 == rc) {
+        rc = writePullText(conn, writer->buf, writer->len);
+    }
+    json_writer_free(writer);
+    if (rc < 0) {
+        freePullDownload(download);
+        conn->sendPull = NULL;
+        conn->state = CONN_READING;
+        conn->responseHeaderSize = 0;
+        conn->responseSize = 0;
+        sendErrorMessage(conn, "Memory not allocated for file content", ERROR_CODE);
+        return -1;
+    }
+    return 0;
+}
+
+void handlePull(Connection *conn, cJSON *commandJSON, char *baseDir) {
+    //  pull file (to receive file from CK node)
+    cJSON *filenameJSON = cJSON_GetObjectItem(commandJSON, JSON_PARAM_FILE_NAME);
+    if (!filenameJSON || !filenameJSON->valuestring) {
+        printf("[ERROR]: Invalid action JSON format for provided message\n");
+        sendErrorMessage(conn, "Invalid action JSON format for message: no filenameJSON found", ERROR_CODE);
+        return;
+    }
+
+    char *fileName = filenameJSON->valuestring;
+    if (!isSafeFileName(fileName)) {
+        printf("[ERROR]: Invalid file name: %s\n", fileName);
+        sendErrorMessage(conn, "Invalid file name", ERROR_CODE);
+        return;
+    }
+    char *filePath = concat(baseDir, fileName);
+    printf("[DEBUG]: Reading file: %s\n", filePath);
+    FILE *file = fopen(filePath, "rb");
+    if (!file) {
+        char *message = concat("File not found at path:", filePath);
+        printf("[ERROR]: %s", message);
+        sendErrorMessage(conn, message, ERROR_CODE);
+        arena_free(message);
+        arena_free(filePath);
+        return;
+    }
+    arena_free(filePath);
+
+    fseek(file, 0, SEEK_END);
+    long fsize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    printf("[DEBUG]: File size: %lu\n", fsize);
+
+    // only the requested part is read, the whole file by default
+    cJSON *offsetJSON = cJSON_GetObjectItem(commandJSON, JSON_PARAM_OFFSET);
+    cJSON *lengthJSON = cJSON_GetObjectItem(commandJSON, JSON_PARAM_LENGTH);
+    long long offset = (long long) numberValue(offsetJSON, 0);
+    long long length = (long long) numberValue(lengthJSON, -1);
+    if (offset < 0 || offset > fsize || (offset > 0 && 0 != seekFile(file, offset))) {
+        fclose(file);
+        sendErrorMessage(conn, "Range not satisfiable", ERROR_CODE);
+        return;
+    }
+    FileRange range = {file, length < 0 || length > fsize - offset ? fsize - offset : length};
+    compression_t compression;
+    if (0 != getCompression(conn, commandJSON, &compression)) {
+        fclose(file);
+        return;
+    }
+    CompressedFileRange compressed = {&range, NULL, {conn->pool, NULL, 0, 0}, 0, 0};
+    if (COMPRESSION_NONE != compression && !(compressed.compressor = compressor_create(compression, 0))) {
+        fclose(file);
+        sendErrorMessage(conn, "Memory not allocated for compression", ERROR_CODE);
+        return;
+    }
+
+    /**
+     * return successful response message, example:
+     *   {"return":0, "filename": <file name from requies>, "file_content_base64":<base 64 encoded requested file content>}
+     * the file is encoded chunk by chunk straight into the response body; a part of it is described by
+     *   "offset":<first byte>, "length":<number of bytes>, "size":<file size>
+     * and compressed content by "compression":<gzip or zstd>
+     */
+    int streamed = range.remaining > STREAM_PULL_THRESHOLD;
+    json_writer_t writer;
+    beginJSONResponse(conn, &writer);
+    if (!compressed.compressor && !streamed) {
+        json_writer_reserve(&writer, BASE64_ENCODED_LEN((size_t) range.remaining) + strlen(fileName) * 6 + 192);
+    }
+    json_writer_begin_object(&writer);
+    json_writer_key(&writer, "return");
+    json_writer_string(&writer, "0");
+    json_writer_key(&writer, JSON_PARAM_FILE_NAME);
+    json_writer_string(&writer, fileName);
+    if (offsetJSON || lengthJSON) {
+        json_writer_key(&writer, JSON_PARAM_OFFSET);
+        json_writer_number(&writer, (double) offset);
+        json_writer_key(&writer, JSON_PARAM_LENGTH);
+        json_writer_number(&writer, (double) range.remaining);
+        json_writer_key(&writer, "size");
+        json_writer_number(&writer, (double) fsize);
+    }
+    if (compressed.compressor) {
+        json_writer_key(&writer, JSON_PARAM_COMPRESSION);
+        json_writer_string(&writer, compression_name(compression));
+    }
+    if (streamed) {
+        json_writer_key(&writer, JSON_PARAM_FILE_CONTENT);
+        startPullDownload(conn, &writer, &range, &compressed);
+        return;
+    }
+    if (compressed.compressor) {
+        json_writer_key(&writer, JSON_PARAM_FILE_CONTENT);
+        json_writer_generated_string(&writer, generateCompressedBase64FromFile, &compressed, 0);
+        compressor_free(compressed.compressor);
+        if (compressed.pending.buf) {
+            buffer_pool_put(conn->pool, compressed.pending.buf, compressed.pending.capacity);
+        }
+    } else {
+        json_writer_key(&writer, JSON_PARAM_FILE_CONTENT);
+        json_writer_generated_string(&writer, generateBase64FromFile, &range, 0);
+    }
+    json_writer_end_object(&writer);
+    fclose(file);
+    if (sendJSONWriterResponse(conn, &writer, 200) < 0) {
+        sendErrorMessage(conn, "Memory not allocated for file content", ERROR_CODE);
+    }
+}
+
+/**
+ * Pushes several files in one request:
+ *   {"action":"push_batch", "files":[{"filename":..., "file_content_base64":...}, {"filename":..., "hash":...}],
+ *    "compression":<gzip or zstd>}
+ * each file is saved on its own, one given by its hash only is linked from the content store, and the outcome of
+ * each is answered, example:
+ *   {"return":"0", "files":[{"filename":"a", "return":"0"}, {"filename":"../b", "return":"1",
+ *    "error":"Invalid file name"}], "count":2, "failed":1}
+ */
+void handlePushBatch(Connection *conn, cJSON *commandJSON, char *baseDir) {
+    cJSON *filesJSON = cJSON_GetObjectItem(commandJSON, JSON_PARAM_FILES);
+    if (!filesJSON || cJSON_Array != (filesJSON->type & 255)) {
+        printf("[ERROR]: Invalid action JSON format for provided message\n");
+        sendErrorMessage(conn, "Invalid action JSON format for message: no files found", ERROR_CODE);
+        return;
+    }
+    compression_t compression;
+    if (0 != getCompression(conn, commandJSON, &compression)) {
+        return;
+    }
+
+    int count = 0, failed = 0;
+    json_writer_t writer;
+    beginJSONResponse(conn, &writer);
+    json_writer_begin_object(&writer);
+    json_writer_key(&writer, "return");
+    json_writer_string(&writer, "0");
+    json_writer_key(&writer, JSON_PARAM_FILES);
+    json_writer_begin_array(&writer);
+    cJSON *fileJSON;
+    for (fileJSON = filesJSON->child; fileJSON; fileJSON = fileJSON->next, count++) {
+        cJSON *filenameJSON = cJSON_GetObjectItem(fileJSON, JSON_PARAM_FILE_NAME);
+        char *fileName = filenameJSON ? filenameJSON->valuestring : NULL;
+        cJSON *fileContentJSON = cJSON_GetObjectItem(fileJSON, JSON_PARAM_FILE_CONTENT);
+        char *expectedHash = getExpectedHash(fileJSON);
+        char hash[CONTENT_HASH_SIZE] = "";
+        char *error;
+        if (!fileName || !isSafeFileName(fileName)) {
+            error = concat("Invalid file name", "");
+        } else if (fileContentJSON && fileContentJSON->valuestring) {
+            error = savePushedContent(fileContentJSON, compression, expectedHash, fileName, baseDir, hash);
+        } else if (contentStore && expectedHash) {
+            error = linkStoredContent(expectedHash, fileName, baseDir);
+            if (!error) {
+                snprintf(hash, sizeof(hash), "%s", expectedHash);
+            }
+        } else {
+            error = concat("No file content found", "");
+        }
+
+        json_writer_begin_object(&writer);
+        json_writer_key(&writer, JSON_PARAM_FILE_NAME);
+        json_writer_string(&writer, fileName);
+        json_writer_key(&writer, "return");
+        json_writer_string(&writer, error ? "1" : "0");
+        if (error) {
+            printf("[ERROR]: %s: %s\n", fileName ? fileName : "", error);
+            json_writer_key(&writer, "error");
+            json_writer_string(&writer, error);
+            arena_free(error);
+            failed++;
+        } else if (hash[0]) {
+            json_writer_key(&writer, JSON_PARAM_HASH);
+            json_writer_string(&writer, hash);
+        }
+        json_writer_end_object(&writer);
+    }
+    json_writer_end_array(&writer);
+    json_writer_key(&writer, "count");
+    json_writer_number(&writer, count);
+    json_writer_key(&writer, "failed");
+    json_writer_number(&writer, failed);
+    json_writer_end_object(&writer);
+    printf("[INFO]: Pushed %d files, %d failed\n", count - failed, failed);
+    if (sendJSONWriterResponse(conn, &writer, 200) < 0) {
+        sendErrorMessage(conn, "Memory not allocated for response", ERROR_CODE);
+    }
+}
+
+/**
+ * Opens a file of a pull_batch and lets the kernel read its beginning while the file before it is encoded.
+ *
+ * Returns the file with its size set, NULL with error set if it can not be pulled.
+ */
+static FILE *openBatchFile(cJSON *filenameJSON, char *baseDir, long long *size, const char **error) {
+    if (cJSON_String != (filenameJSON->type & 255) || !isSafeFileName(filenameJSON->valuestring)) {
+        *error = "Invalid file name";
+        return NULL;
+    }
+    char *filePath = concat(baseDir, filenameJSON->valuestring);
+    FILE *file = fopen(filePath, "rb");
+    arena_free(filePath);
+    *size = file ? regularFileSize(file) : -1;
+    if (*size < 0) {
+        if (file) {
+            fclose(file);
+        }
+        *error = "File not found";
+        return NULL;
+    }
+#ifdef __linux__
+    posix_fadvise(fileno(file), 0, READ_AHEAD_SIZE, POSIX_FADV_WILLNEED);
+#endif
+    return file;
+}
+
+/**
+ * Pulls several files in one request:
+ *   {"action":"pull_batch", "filenames":["a", "b"], "compression":<gzip or zstd>}
+ * answered with the content of each file, or why it can not be pulled, example:
+ *   {"return":"0", "files":[{"filename":"a", "return":"0", "size":3, "file_content_base64":"YWJj"},
+ *    {"filename":"b", "return":"1", "error":"File not found"}], "count":2, "failed":1}
+ * the files are encoded one after the other straight into the response body, the next one read ahead meanwhile.
+ */
+void handlePullBatch(Connection *conn, cJSON *commandJSON, char *baseDir) {
+    cJSON *filenamesJSON = cJSON_GetObjectItem(commandJSON, JSON_PARAM_FILE_NAMES);
+    if (!filenamesJSON || cJSON_Array != (filenamesJSON->type & 255)) {
+        printf("[ERROR]: Invalid action JSON format for provided message\n");
+        sendErrorMessage(conn, "Invalid action JSON format for message: no filenames found", ERROR_CODE);
+        return;
+    }
+    compression_t compression;
+    if (0 != getCompression(conn, commandJSON, &compression)) {
+        return;
+    }
+
+    int count = 0, failed = 0;
+    json_writer_t writer;
+    beginJSONResponse(conn, &writer);
+    json_writer_begin_object(&writer);
+    json_writer_key(&writer, "return");
+    json_writer_string(&writer, "0");
+    json_writer_key(&writer, JSON_PARAM_FILES);
+    json_writer_begin_array(&writer);
+    const char *error = NULL;
+    long long size = 0;
+    cJSON *filenameJSON = filenamesJSON->child;
+    FILE *file = filenameJSON ? openBatchFile(filenameJSON, baseDir, &size, &error) : NULL;
+    for (; filenameJSON; filenameJSON = filenameJSON->next, count++) {
+        const char *nextError = NULL;
+        long long nextSize = 0;
+        FILE *next = filenameJSON->next ? openBatchFile(filenameJSON->next, baseDir, &nextSize, &nextError) : NULL;
+
+        FileRange range = {file, size};
+        CompressedFileRange compressed = {&range, NULL, {conn->pool, NULL, 0, 0}, 0, 0};
+        if (file && COMPRESSION_NONE != compression && !(compressed.compressor = compressor_create(compression, 0))) {
+            fclose(file);
+            file = NULL;
+            error = "Memory not allocated for compression";
+        }
+        json_writer_begin_object(&writer);
+        json_writer_key(&writer, JSON_PARAM_FILE_NAME);
+        json_writer_string(&writer, filenameJSON->valuestring);
+        json_writer_key(&writer, "return");
+        json_writer_string(&writer, file ? "0" : "1");
+        if (!file) {
+            printf("[ERROR]: %s: %s\n", filenameJSON->valuestring ? filenameJSON->valuestring : "", error);
+            json_writer_key(&writer, "error");
+            json_writer_string(&writer, error);
+            failed++;
+        } else if (compressed.compressor) {
+            json_writer_key(&writer, "size");
+            json_writer_number(&writer, (double) size);
+            json_writer_key(&writer, JSON_PARAM_COMPRESSION);
+            json_writer_string(&writer, compression_name(compression));
+            json_writer_key(&writer, JSON_PARAM_FILE_CONTENT);
+            json_writer_generated_string(&writer, generateCompressedBase64FromFile, &compressed, 0);
+            compressor_free(compressed.compressor);
+            if (compressed.pending.buf) {
+                buffer_pool_put(conn->pool, compressed.pending.buf, compressed.pending.capacity);
+            }
+        } else {
+            json_writer_reserve(&writer, BASE64_ENCODED_LEN((size_t) size) + 64);
+            json_writer_key(&writer, "size");
+            json_writer_number(&writer, (double) size);
+            json_writer_key(&writer, JSON_PARAM_FILE_CONTENT);
+            json_writer_generated_string(&writer, generateBase64FromFile, &range, 0);
+        }
+        json_writer_end_object(&writer);
+        if (file) {
+            fclose(file);
+        }
+        file = next;
+        size = nextSize;
+        error = nextError;
+    }
+    json_writer_end_array(&writer);
+    json_writer_key(&writer, "count");
+    json_writer_number(&writer, count);
+    json_writer_key(&writer, "failed");
+    json_writer_number(&writer, failed);
+    json_writer_end_object(&writer);
+    printf("[INFO]: Pulled %d files, %d failed\n", count - failed, failed);
+    if (sendJSONWriterResponse(conn, &writer, 200) < 0) {
+        sendErrorMessage(conn, "Memory not allocated for file content", ERROR_CODE);
+    }
+}
+
+/**
+ * Writes a measured value, unavailable ones (-1) as null.
+ */
+static void writeMeasuredValue(json_writer_t *writer, const char *name, double value) {
+    json_writer_key(writer, name);
+    if (value < 0) {
+        json_writer_null(writer);
+    } else {
+        json_writer_number(writer, value);
+    }
+}
+
+/**
+ * Writes the resource usage of a shell command, example:
+ *   {"wall_time":1.25, "user_time":1.1, "system_time":0.05, "max_rss_kb":10240,
+ *    "voluntary_context_switches":3, "involuntary_context_switches":12, "cycles":4000000000,
+ *    "instructions":9000000000, "cache_misses":120000, "branch_misses":80000, "task_clock_ns":1150000000}
+ */
+static void writeMeasurement(json_writer_t *writer, const shell_measurement_t *measurement) {
+    json_writer_begin_object(writer);
+    writeMeasuredValue(writer, "wall_time", measurement->wallTime);
+    writeMeasuredValue(writer, "user_time", measurement->userTime);
+    writeMeasuredValue(writer, "system_time", measurement->systemTime);
+    writeMeasuredValue(writer, "max_rss_kb", (double) measurement->maxRss);
+    writeMeasuredValue(writer, "voluntary_context_switches", (double) measurement->voluntaryContextSwitches);
+    writeMeasuredValue(writer, "involuntary_context_switches", (double) measurement->involuntaryContextSwitches);
+    writeMeasuredValue(writer, "cycles", (double) measurement->cycles);
+    writeMeasuredValue(writer, "instructions", (double) measurement->instructions);
+    writeMeasuredValue(writer, "cache_misses", (double) measurement->cacheMisses);
+    writeMeasuredValue(writer, "branch_misses", (double) measurement->branchMisses);
+    writeMeasuredValue(writer, "task_clock_ns", (double) measurement->taskClock);
+    json_writer_end_object(writer);
+}
+
+/**
+ * A repeat of more than one run or warmup runs make a benchmark.
+ */
+static int isBenchmark(const bench_options_t *options) {
+    return options->repeat > 1 || options->warmup > 0;
+}
+
+/**
+ * Writes the statistics of a repeated command, see the header comment.
+ */
+static void writeBenchmark(json_writer_t *writer, const bench_options_t *options, const bench_result_t *result) {
+    int i;
+    json_writer_key(writer, "benchmark");
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "warmup");
+    json_writer_number(writer, options->warmup);
+    json_writer_key(writer, "runs");
+    json_writer_number(writer, result->runs);
+    json_writer_key(writer, "converged");
+    json_writer_bool(writer, result->converged);
+    json_writer_key(writer, "times");
+    json_writer_begin_array(writer);
+    for (i = 0; i < result->runs; i++) {
+        json_writer_number(writer, result->times[i]);
+    }
+    json_writer_end_array(writer);
+    if (result->runs > 0) {
+        json_writer_key(writer, "median");
+        json_writer_number(writer, result->stats.median);
+        json_writer_key(writer, "mean");
+        json_writer_number(writer, result->stats.mean);
+        json_writer_key(writer, "stddev");
+        json_writer_number(writer, result->stats.stddev);
+        json_writer_key(writer, "min");
+        json_writer_number(writer, result->stats.min);
+        json_writer_key(writer, "max");
+        json_writer_number(writer, result->stats.max);
+        json_writer_key(writer, "outliers");
+        json_writer_number(writer, result->stats.outliers);
+        json_writer_key(writer, "rci");
+        json_writer_number(writer, result->stats.rci);
+    }
+    if (result->measurements) {
+        json_writer_key(writer, "measurements");
+        json_writer_begin_array(writer);
+        for (i = 0; i < result->runs; i++) {
+            writeMeasurement(writer, &result->measurements[i]);
+        }
+        json_writer_end_array(writer);
+    }
+    json_writer_end_object(writer);
+}
+
+/**
+ * Writes the exit status of the last run of a shell command, followed by its resource usage or, for a benchmark,
+ * the statistics of all runs.
+ */
+static void writeRunResult(json_writer_t *writer, const bench_options_t *options, const bench_result_t *result) {
+    json_writer_key(writer, "return_code");
+    json_writer_number(writer, result->status.exitCode);
+    json_writer_key(writer, "signal");
+    json_writer_number(writer, result->status.signal);
+    if (isBenchmark(options)) {
+        writeBenchmark(writer, options, result);
+    } else if (result->measurements && result->runs > 0) {
+        json_writer_key(writer, "measurements");
+        writeMeasurement(writer, &result->measurements[0]);
+    }
+}
+
+typedef struct {
+    shell_buffer_t out;
+    shell_buffer_t err;
+} ShellCapture;
+
+/**
+ * bench_run_handler_t keeping only the output of the last run.
+ */
+static void resetShellCapture(void *ctx, int run, int warmup) {
+    ShellCapture *capture = ctx;
+    (void) run;
+    (void) warmup;
+    shell_buffer_free(&capture->out);
+    shell_buffer_free(&capture->err);
+}
+
+static void captureShellOutput(void *ctx, int stream, const char *data, size_t len) {
+    ShellCapture *capture = ctx;
+    shell_buffer_append(SHELL_STDOUT == stream ? &capture->out : &capture->err, data, len);
+}
+
+/**
+ * Runs the shell command as often as requested, keeping the output of the last run. Returns -1 if the command could
+ * not be started.
+ */
+static int runShellCommand(char *shellCommand, const bench_options_t *options, ShellCapture *capture,
+                           bench_result_t *result) {
+    memset(capture, 0, sizeof(*capture));
+    if (bench_run(shellCommand, options, resetShellCapture, captureShellOutput, capture, result) < 0) {
+        printf("[ERROR]: Failed to run command: %s\n", shellCommand);
+        resetShellCapture(capture, 0, 0);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Writes the result JSON of runShellCommand() with the stdout, stderr and exit status of the last run, and its
+ * resource usage or the benchmark statistics, then frees the output and the result.
+ */
+static void writeShellResult(json_writer_t *writer, char *shellCommand, const bench_options_t *options,
+                             ShellCapture *capture, bench_result_t *result) {
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "return");
+    json_writer_string(writer, "0");
+    writeRunResult(writer, options, result);
+    json_writer_key(writer, "stdout");
+    json_writer_string_n(writer, capture->out.data ? capture->out.data : "", capture->out.len);
+    json_writer_key(writer, "stderr");
+    json_writer_string_n(writer, capture->err.data ? capture->err.data : "", capture->err.len);
+    json_writer_end_object(writer);
+
+    printf("[INFO]: exit code %d, signal %d, runs %d, stdout length: %lu, stderr length: %lu\n",
+           result->status.exitCode, result->status.signal, result->runs, (unsigned long) capture->out.len,
+           (unsigned long) capture->err.len);
+    if (capture->out.error || capture->err.error) {
+        printf("[ERROR]: Memory not allocated for the whole output of: %s\n", shellCommand);
+    }
+    resetShellCapture(capture, 0, 0);
+    bench_result_free(result);
+}
+
+/**
+ * Queues the result of runShellCommand() as the response, rc is what it returned.
+ */
+static void sendShellResult(Connection *conn, char *shellCommand, const bench_options_t *options, int rc,
+                            ShellCapture *capture, bench_result_t *result) {
+    if (rc < 0) {
+        sendErrorMessage(conn, "Failed to run shell command", ERROR_CODE);
+        return;
+    }
+    json_writer_t writer;
+    beginJSONResponse(conn, &writer);
+    writeShellResult(&writer, shellCommand, options, capture, result);
+    if (sendJSONWriterResponse(conn, &writer, 200) < 0) {
+        sendErrorMessage(conn, "Memory not allocated for stdout", ERROR_CODE);
+    }
+}
+
+/**
+ * Sends the headers of a response whose body is streamed while it is produced: chunked for HTTP/1.1 clients,
+ * delimited by closing the connection for HTTP/1.0 ones. The socket must be blocking.
+ */
+static int sendStreamHeaders(Connection *conn, const char *contentType) {
+    conn->keepAlive = 0;
+    int n = snprintf(conn->responseHeader, sizeof(conn->responseHeader),
+                     "HTTP/1.1 200 OK\r\nContent-Type: %s\r\n%sConnection: close\r\n\r\n", contentType,
+                     conn->request.versionMinor >= 1 ? "Transfer-Encoding: chunked\r\n" : "");
+    if (0 >= n || n >= (int) sizeof(conn->responseHeader)) {
+        perror("sprintf failed");
+        return -1;
+    }
+    return sockSendAll(conn->sock, conn->responseHeader, n);
+}
+
+/**
+ * Sends the JSON written since json_writer_init() as one line of a streamed NDJSON response.
+ */
+static int sendJSONFrame(Connection *conn, json_writer_t *writer) {
+    int chunked = conn->request.versionMinor >= 1;
+    json_writer_raw(writer, "\n\r\n", chunked ? 3 : 1);
+    if (json_writer_error(writer)) {
+        json_writer_free(writer);
+        return -1;
+    }
+    int rc = 0;
+    if (chunked) {
+        // size line and data leave in one packet, the data is followed by the CRLF ending the chunk
+        char sizeLine[24];
+        size_t dataLen = writer->len - 2;
+        int n = snprintf(sizeLine, sizeof(sizeLine), "%lx\r\n", (unsigned long) dataLen);
+        int sent = sockSendv(conn->sock, sizeLine, n, writer->buf, writer->len);
+        if (sent < 0) {
+            rc = -1;
+        } else if (sent < n) {
+            rc = sockSendAll(conn->sock, sizeLine + sent, n - sent) < 0
+                 || sockSendAll(conn->sock, writer->buf, writer->len) < 0 ? -1 : 0;
+        } else {
+            rc = sockSendAll(conn->sock, writer->buf + (sent - n), writer->len - (sent - n));
+        }
+    } else {
+        rc = sockSendAll(conn->sock, writer->buf, writer->len);
+    }
+    json_writer_free(writer);
+    return rc;
+}
+
+typedef struct {
+    Connection *conn;
+    int run;        /* the run the output belongs to, -1 if the command is run once */
+    int failed;     /* the client is gone, the rest of the output is discarded */
+} ShellStream;
+
+/**
+ * bench_run_handler_t numbering the frames of a benchmark.
+ */
+static void startShellStreamRun(void *ctx, int run, int warmup) {
+    ShellStream *shellStream = ctx;
+    (void) warmup;
+    if (shellStream->run >= 0) {
+        shellStream->run = run;
+    }
+}
+
+/**
+ * shell_output_handler_t sending every part of the output as soon as it is read, example:
+ *   {"stream":"stdout", "data":"..."}
+ * or, for a benchmark, {"stream":"stdout", "run":3, "data":"..."}
+ */
+static void sendShellOutputFrame(void *ctx, int stream, const char *data, size_t len) {
+    ShellStream *shellStream = ctx;
+    if (shellStream->failed) {
+        return;
+    }
+    json_writer_t writer;
+    json_writer_init(&writer, NULL); // the pool belongs to the event loop, this runs on a job engine thread
+    json_writer_begin_object(&writer);
+    json_writer_key(&writer, "stream");
+    json_writer_string(&writer, SHELL_STDOUT == stream ? "stdout" : "stderr");
+    if (shellStream->run >= 0) {
+        json_writer_key(&writer, "run");
+        json_writer_number(&writer, shellStream->run);
+    }
+    json_writer_key(&writer, "data");
+    json_writer_string_n(&writer, data, len);
+    json_writer_end_object(&writer);
+    if (sendJSONFrame(shellStream->conn, &writer) < 0) {
+        perror("[ERROR]: Failed to send shell output");
+        shellStream->failed = 1;
+    }
+}
+
+/**
+ * Runs the shell command and streams its output as NDJSON frames, so that neither the client waits for the end of
+ * a long command to see its progress nor the server keeps the output in memory. The last frame carries the exit
+ * status, example:
+ *   {"return":"0", "stream":"exit", "return_code":0, "signal":0}
+ * The connection is closed afterwards.
+ */
+static void streamShellResult(Connection *conn, char *shellCommand, const bench_options_t *options) {
+    if (sendStreamHeaders(conn, "application/x-ndjson") < 0) {
+        perror("[ERROR]: Failed to send HTTP response");
+        return;
+    }
+    ShellStream shellStream;
+    shellStream.conn = conn;
+    shellStream.run = isBenchmark(options) ? 0 : -1;
+    shellStream.failed = 0;
+    bench_result_t result;
+    int rc = bench_run(shellCommand, options, startShellStreamRun, sendShellOutputFrame, &shellStream, &result);
+    if (shellStream.failed) {
+        if (rc == 0) {
+            bench_result_free(&result);
+        }
+        return;
+    }
+
+    json_writer_t writer;
+    json_writer_init(&writer, NULL);
+    json_writer_begin_object(&writer);
+    json_writer_key(&writer, "return");
+    json_writer_string(&writer, rc < 0 ? "1" : "0");
+    json_writer_key(&writer, "stream");
+    json_writer_string(&writer, "exit");
+    if (rc < 0) {
+        printf("[ERROR]: Failed to run command: %s\n", shellCommand);
+        json_writer_key(&writer, "error");
+        json_writer_string(&writer, "Failed to run shell command");
+    } else {
+        printf("[INFO]: exit code %d, signal %d, runs %d\n", result.status.exitCode, result.status.signal, result.runs);
+        writeRunResult(&writer, options, &result);
+        bench_result_free(&result);
+    }
+    json_writer_end_object(&writer);
+    if (sendJSONFrame(conn, &writer) < 0
+        || (conn->request.versionMinor >= 1 && sockSendAll(conn->sock, "0\r\n\r\n", 5) < 0)) {
+        perror("[ERROR]: Failed to send shell output");
+    }
+}
+
+#ifdef __linux__
+/**
+ * A synchronous shell command of an event loop connection, run on a job engine thread. The connection waits
+ * meanwhile and the loop completes the response once the task is handed back.
+ */
+struct ShellTask {
+    Connection *conn;
+    char *command;
+    bench_options_t options;
+    int streamed;           /* the output has been streamed by the task, the connection is closed */
+    int rc;                 /* what runShellCommand() returned */
+    ShellCapture capture;
+    bench_result_t result;
+    ShellTask *next;
+};
+
+/**
+ * job_task_t running the shell command and handing the task back to the event loop of its connection.
+ */
+static void runShellTask(void *ctx) {
+    ShellTask *task = ctx;
+    if (task->streamed) {
+        streamShellResult(task->conn, task->command, &task->options);
+    } else {
+        task->rc = runShellCommand(task->command, &task->options, &task->capture, &task->result);
+    }
+
+    EventLoop *loop = task->conn->loop;
+    pthread_mutex_lock(&loop->mutex);
+    task->next = loop->finished;
+    loop->finished = task;
+    pthread_mutex_unlock(&loop->mutex);
+    uint64_t one = 1;
+    if (write(loop->wakeFd, &one, sizeof(one)) < 0 && EAGAIN != errno) {
+        perror("[ERROR]: Failed to wake up event loop");
+    }
+}
+
+/**
+ * Hands the shell command to a job engine thread, the connection waits until the task is finished. Returns -1 if the
+ * thread could not be started.
+ */
+static int startShellTask(Connection *conn, char *shellCommand, const bench_options_t *options, int streamed,
+                          int exclusive) {
+    ShellTask *task = calloc(1, sizeof(ShellTask));
+    if (!task || !(task->command = strdup(shellCommand))) {
+        free(task);
+        return -1;
+    }
+    task->conn = conn;
+    task->options = *options;
+    task->streamed = streamed;
+    if (streamed && setNonBlocking(conn->sock, 0) < 0) {
+        free(task->command);
+        free(task);
+        return -1;
+    }
+
+    conn->state = CONN_WAITING;
+    if (job_engine_run(jobEngine, exclusive || job_engine_bound(jobEngine), exclusive, runShellTask, task) < 0) {
+        conn->state = CONN_READING;
+        if (streamed) {
+            setNonBlocking(conn->sock, 1);
         }
-        char *action = actionJSON->valuestring;
-
-        printf("[INFO]: Get action: %s\n", action);
-        char *resultJSONtext;
-        if (strncmp(action, JSCON_PARAM_VALUE_PUSH, 4) == 0) {
-            //  push file (to send file to CK Node )
-            cJSON *filenameJSON = cJSON_GetObjectItem(commandJSON, JSON_PARAM_FILE_NAME);
-            if (!filenameJSON) {
-                printf("[ERROR]: Invalid action JSON format for provided message\n");
-                if (commandJSON != NULL) {
-                    cJSON_Delete(commandJSON);
-                }
-                sendErrorMessage(sock, "Invalid action JSON format for message: no filenameJSON found", ERROR_CODE);
-                return;
-            }
+        free(task->command);
+        free(task);
+        return -1;
+    }
+    return 0;
+}
 
-            char *fileName = filenameJSON->valuestring;
-            cJSON *fileContentJSON = cJSON_GetObjectItem(commandJSON, JSON_PARAM_FILE_CONTENT);
-            if (!fileContentJSON) {
-                printf("[ERROR]: Invalid action JSON format for message: \n");
-                if (commandJSON != NULL) {
-                    cJSON_Delete(commandJSON);
-                }
-                sendErrorMessage(sock, "Invalid action JSON format for message: no fileContentJSON found", ERROR_CODE);
-                return;
-            }
+/**
+ * Completes the response of a handed back shell task and drops the request it answers.
+ */
+static void finishShellTask(ShellTask *task) {
+    Connection *conn = task->conn;
+    if (task->streamed) {
+        setNonBlocking(conn->sock, 1);
+        conn->state = CONN_CLOSING;
+    } else {
+        conn->state = CONN_READING;
+        sendShellResult(conn, task->command, &task->options, task->rc, &task->capture, &task->result);
+    }
+    consumeRequest(conn, conn->waitingRequestLen);
+    free(task->command);
+    free(task);
+}
+
+/**
+ * Serves the connections whose shell tasks the job engine threads have handed back.
+ */
+static void resumeWaitingConnections(EventLoop *loop, Connection **connections, char *baseDir) {
+    uint64_t count;
+    if (read(loop->wakeFd, &count, sizeof(count)) < 0 && EAGAIN != errno) {
+        perror("[ERROR]: Failed to read eventfd");
+    }
+    pthread_mutex_lock(&loop->mutex);
+    ShellTask *task = loop->finished;
+    loop->finished = NULL;
+    pthread_mutex_unlock(&loop->mutex);
+
+    while (task) {
+        ShellTask *next = task->next;
+        Connection *conn = task->conn;
+        finishShellTask(task);
+        conn->lastActive = monotonicSeconds();
+        if (CONN_CLOSING != conn->state) {
+            handleConnection(conn, baseDir);
+        }
+        if (CONN_CLOSING == conn->state) {
+            closeConnection(loop->epfd, conn, connections);
+        }
+        task = next;
+    }
+}
+#endif
 
-            char *file_content_base64 = fileContentJSON->valuestring;
+/**
+ * Returns the size of a regular file or -1 if it is something else.
+ */
+static long long regularFileSize(FILE *file) {
+#ifdef _WIN32
+    struct _stat64 st;
+    if (0 != _fstat64(_fileno(file), &st) || !(st.st_mode & _S_IFREG)) {
+        return -1;
+    }
+#else
+    struct stat st;
+    if (0 != fstat(fileno(file), &st) || !S_ISREG(st.st_mode)) {
+        return -1;
+    }
+#endif
+    return (long long) st.st_size;
+}
 
-            printf("[DEBUG]: File name: %s\n", fileName);
-            printf("[DEBUG]: File content base64 length: %lu\n", (unsigned long) strlen(file_content_base64));
+/**
+ * Finds the part of a file a raw download asks for, with a Range header or the offset and length query parameters.
+ *
+ * Returns HTTP_RANGE_SATISFIABLE with first and last set, HTTP_RANGE_NONE for the whole file or
+ * HTTP_RANGE_UNSATISFIABLE.
+ */
+static int getRawRange(Connection *conn, long long size, long long *first, long long *last) {
+    int rangeLen;
+    const char *rangeHeader = http_get_header(&conn->request, conn->message, "Range", &rangeLen);
+    if (rangeHeader) {
+        return http_parse_range(rangeHeader, rangeLen, size, first, last);
+    }
+    char *offset = getQueryParam(conn, JSON_PARAM_OFFSET);
+    char *length = getQueryParam(conn, JSON_PARAM_LENGTH);
+    int result = HTTP_RANGE_NONE;
+    if (offset || length) {
+        char *end = NULL;
+        *first = offset ? strtoll(offset, &end, 10) : 0;
+        int valid = !offset || (offset[0] && !*end);
+        long long count = length ? strtoll(length, &end, 10) : size - *first;
+        valid = valid && (!length || (length[0] && !*end));
+        if (!valid || *first < 0 || count <= 0 || *first >= size) {
+            result = HTTP_RANGE_UNSATISFIABLE;
+        } else {
+            *last = *first + (count < size - *first ? count : size - *first) - 1;
+            result = HTTP_RANGE_SATISFIABLE;
+        }
+    }
+    arena_free(offset);
+    arena_free(length);
+    return result;
+}
 
-            int targetSize = ((unsigned long) strlen(file_content_base64) + 1) * 4 / 3;
-            unsigned char *file_content = malloc(targetSize);
+#ifndef _WIN32
+/**
+ * An entry of a directory tree sent as a tar archive.
+ */
+typedef struct {
+    char *name;                 /* relative to the directory */
+    tar_type_t type;
+    long long size;
+    int mode;
+    long long mtime;
+} ArchiveEntry;
 
-            int bytesDecoded = 0;
-            if (strlen(file_content_base64) != 0) {
-                bytesDecoded = base64_decode(file_content_base64, file_content, targetSize);
-                if (bytesDecoded == 0) {
-                    sendErrorMessage(sock, "Failed to Base64 decode file", ERROR_CODE);
-                }
-                file_content[bytesDecoded] = '\0';
-                printf("[INFO]: Bytes decoded: %i\n", bytesDecoded);
-            } else {
-                printf("[WARNING]: file content is empty nothing to decode\n");
+/**
+ * A directory tree sent as a tar body: the entries are listed up front, so the length of the body is known, and
+ * queueArchivePart() queues their headers while flushResponse() sends the contents of the files with sendfile().
+ */
+struct ArchiveDownload {
+    char *dir;                  /* with a trailing slash */
+    ArchiveEntry *entries;      /* sorted by name, a directory comes before its content */
+    int count;
+    int capacity;
+    int next;                   /* entry whose header is queued next */
+    long long zeros;            /* padding, or content which could not be read, owed before it */
+    FILE *ahead;                /* the next file with content, opened and read ahead */
+    int aheadIndex;
+    int skipStore;              /* the content store is inside the directory, it is not sent */
+    dev_t storeDev;
+    ino_t storeIno;
+};
+
+static void freeArchiveDownload(ArchiveDownload *download) {
+    if (!download) {
+        return;
+    }
+    int i;
+    for (i = 0; i < download->count; i++) {
+        free(download->entries[i].name);
+    }
+    if (download->ahead) {
+        fclose(download->ahead);
+    }
+    free(download->entries);
+    free(download->dir);
+    free(download);
+}
+
+static int compareArchiveEntries(const void *a, const void *b) {
+    return strcmp(((const ArchiveEntry *) a)->name, ((const ArchiveEntry *) b)->name);
+}
+
+/**
+ * Adds the regular files and directories below a directory of the archive (relative, "" for the top) to its
+ * entries, recursively. Links, devices and unreadable directories are left out.
+ *
+ * Returns 0 on success, -1 if memory could not be allocated.
+ */
+static int listArchiveEntries(ArchiveDownload *download, const char *relative) {
+    size_t dirLen = strlen(download->dir);
+    char *path = malloc(dirLen + strlen(relative) + 1);
+    if (!path) {
+        return -1;
+    }
+    sprintf(path, "%s%s", download->dir, relative);
+    DIR *dir = opendir(path);
+    free(path);
+    if (!dir) {
+        printf("[WARN]: Could not read directory %s%s: %s\n", download->dir, relative, strerror(errno));
+        return 0;
+    }
+    int rc = 0;
+    struct dirent *dirEntry;
+    while (0 == rc && (dirEntry = readdir(dir)) != NULL) {
+        if (0 == strcmp(dirEntry->d_name, ".") || 0 == strcmp(dirEntry->d_name, "..")) {
+            continue;
+        }
+        size_t nameLen = strlen(relative) + strlen(dirEntry->d_name) + 1;
+        if (nameLen >= TAR_NAME_MAX) {
+            printf("[WARN]: Name too long for an archive: %s/%s\n", relative, dirEntry->d_name);
+            continue;
+        }
+        char *name = malloc(nameLen + 1);
+        path = malloc(dirLen + nameLen + 1);
+        if (!name || !path) {
+            free(name);
+            free(path);
+            rc = -1;
+            break;
+        }
+        sprintf(name, "%s%s%s", relative, relative[0] ? "/" : "", dirEntry->d_name);
+        sprintf(path, "%s%s", download->dir, name);
+        struct stat st;
+        int listed = 0 == lstat(path, &st) && (S_ISREG(st.st_mode) || S_ISDIR(st.st_mode))
+                     && !(download->skipStore && st.st_dev == download->storeDev && st.st_ino == download->storeIno);
+        free(path);
+        if (!listed) {
+            free(name);
+            continue;
+        }
+        if (download->count == download->capacity) {
+            int capacity = download->capacity ? 2 * download->capacity : 64;
+            ArchiveEntry *entries = realloc(download->entries, capacity * sizeof(ArchiveEntry));
+            if (!entries) {
+                free(name);
+                rc = -1;
+                break;
             }
+            download->entries = entries;
+            download->capacity = capacity;
+        }
+        ArchiveEntry *entry = &download->entries[download->count++];
+        entry->name = name;
+        entry->type = S_ISDIR(st.st_mode) ? TAR_DIRECTORY : TAR_FILE;
+        entry->size = S_ISDIR(st.st_mode) ? 0 : (long long) st.st_size;
+        entry->mode = (int) (st.st_mode & 07777);
+        entry->mtime = (long long) st.st_mtime;
+        if (S_ISDIR(st.st_mode)) {
+            rc = listArchiveEntries(download, name);
+        }
+    }
+    closedir(dir);
+    return rc;
+}
 
-            // 2) save locally at tmp dir
-            printf("[DEBUG]: Build file path from base dir: %s and file name: %s\n", baseDir, fileName);
-            char *filePath = concat(baseDir, fileName);
+/**
+ * Opens the file of an entry, the one read ahead if it is that.
+ */
+static FILE *openArchiveFile(ArchiveDownload *download, int index) {
+    if (download->ahead && download->aheadIndex == index) {
+        FILE *file = download->ahead;
+        download->ahead = NULL;
+        return file;
+    }
+    char *path = malloc(strlen(download->dir) + strlen(download->entries[index].name) + 1);
+    if (!path) {
+        return NULL;
+    }
+    sprintf(path, "%s%s", download->dir, download->entries[index].name);
+    FILE *file = fopen(path, "rb");
+    free(path);
+    return file;
+}
+
+/**
+ * Opens the next file with content after the given entry and lets the kernel read its beginning while the current
+ * one is sent.
+ */
+static void readArchiveFileAhead(ArchiveDownload *download, int index) {
+    int next;
+    for (next = index + 1; next < download->count; next++) {
+        if (TAR_FILE == download->entries[next].type && download->entries[next].size > 0) {
+            break;
+        }
+    }
+    if (next == download->count || (download->ahead && download->aheadIndex == next)) {
+        return;
+    }
+    if (download->ahead) {
+        fclose(download->ahead);
+    }
+    download->ahead = openArchiveFile(download, next);
+    download->aheadIndex = next;
+#ifdef __linux__
+    if (download->ahead) {
+        posix_fadvise(fileno(download->ahead), 0, READ_AHEAD_SIZE, POSIX_FADV_WILLNEED);
+    }
+#endif
+}
 
-            FILE *file = fopen(filePath, "wb");
+/**
+ * Replaces the sent part of an archive with the next one: owed zeros, or the headers of the following entries up to
+ * the next file with content, which is left to flushResponse(), or the end of the archive. A file which can no
+ * longer be read is sent as zeros, so the length of the body stays as announced.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int queueArchivePart(Connection *conn) {
+    static const char zeros[FILE_BUFFER_SIZE];
+    ArchiveDownload *download = conn->sendArchive;
+    conn->responseHeaderSize = 0;
+    conn->responseSize = 0;
+    conn->responseSent = 0;
+    if (download->zeros > 0) {
+        int n = download->zeros < FILE_BUFFER_SIZE ? (int) download->zeros : FILE_BUFFER_SIZE;
+        download->zeros -= n;
+        if (queueResponse(conn, zeros, n) < 0) {
+            return -1;
+        }
+        if (download->zeros > 0) {
+            return 0;
+        }
+    }
+    while (download->next < download->count && conn->responseSize < FILE_BUFFER_SIZE) {
+        int index = download->next++;
+        ArchiveEntry *entry = &download->entries[index];
+        tar_entry_t tarEntry = {entry->name, entry->type, entry->size, entry->mode, entry->mtime};
+        char header[3 * TAR_BLOCK_SIZE + TAR_NAME_MAX];
+        if (queueResponse(conn, header, (int) tar_write_header(header, &tarEntry)) < 0) {
+            return -1;
+        }
+        if (entry->size > 0) {
+            download->zeros = tar_padding(entry->size);
+            FILE *file = openArchiveFile(download, index);
             if (!file) {
-                char *message = concat("Could not write file at path: ", filePath);
-                printf("[ERROR]: %s", message);
-                if (commandJSON != NULL) {
-                    cJSON_Delete(commandJSON);
-                }
-                sendErrorMessage(sock, message, ERROR_CODE);
-                return;
+                printf("[WARN]: Could not read %s%s, sent as zeros\n", download->dir, entry->name);
+                download->zeros += entry->size;
+                return 0;
             }
+            conn->sendFile = file;
+            conn->sendFileOffset = 0;
+            conn->sendFileEnd = entry->size;
+            readArchiveFileAhead(download, index);
+            return 0;
+        }
+    }
+    if (download->next == download->count) {
+        if (queueResponse(conn, zeros, TAR_END_SIZE) < 0) {
+            return -1;
+        }
+        printf("[INFO]: Archive of %s sent (%d entries)\n", download->dir, download->count);
+        freeArchiveDownload(download);
+        conn->sendArchive = NULL;
+    }
+    return 0;
+}
 
-            printf("[DEBUG]: Open file to write %s\n", filePath);
-            printf("[DEBUG]: Bytes to write %i\n", bytesDecoded);
-            int results = fwrite(file_content, 1, bytesDecoded, file);
-            if (results == EOF) {
-                sendErrorMessage(sock, "Failed to write file ", ERROR_CODE);
-            }
-            fclose(file);
-            free(file_content);
-            printf("[INFO]: File saved to: %s\n", filePath);
-
-            /**
-             * return successful response message, example:
-             *   {"return":0, "compileUUID": <generated UID>}
-             */
-            char compileUUID[38];
-            get_uuid_string(compileUUID, sizeof(compileUUID));
-
-            cJSON *resultJSON = cJSON_CreateObject();
-            if (!resultJSON) {
-                perror("[ERROR]: Memory not allocated for resultJSON");
-                exit(1);
-            }
-            printf("[INFO]: resultJSON created\n");
-            cJSON_AddItemToObject(resultJSON, "return", cJSON_CreateString("0"));
-            cJSON_AddItemToObject(resultJSON, "compileUUID", cJSON_CreateString(compileUUID));
-            resultJSONtext = cJSON_PrintUnformatted(resultJSON);
-            cJSON_Delete(resultJSON);
-        } else if (strncmp(action, "pull", 4) == 0) {
-            //  pull file (to receive file from CK node)
-            cJSON *filenameJSON = cJSON_GetObjectItem(commandJSON, JSON_PARAM_FILE_NAME);
-            if (!filenameJSON) {
-                printf("[ERROR]: Invalid action JSON format for provided message\n");
-                //todo check if need to cJSON_Delete(commandJSON) here as well
-                sendErrorMessage(sock, "Invalid action JSON format for message: no filenameJSON found", ERROR_CODE);
-                return;
-            }
+/**
+ * Raw download of a directory tree (GET /files/<dir>?archive=tar&secretkey=...): queues the response headers of
+ * a tar body with its regular files and directories, the content store left out, which flushResponse() sends.
+ */
+static void sendDirectoryArchive(Connection *conn, const char *dirPath, char *baseDir) {
+    struct stat st;
+    if (0 != stat(dirPath, &st) || !S_ISDIR(st.st_mode)) {
+        char *message = concat("Directory not found at path:", dirPath);
+        printf("[ERROR]: %s\n", message);
+        sendErrorResponse(conn, 404, message, ERROR_CODE);
+        arena_free(message);
+        return;
+    }
+    ArchiveDownload *download = calloc(1, sizeof(ArchiveDownload));
+    if (download) {
+        download->dir = malloc(strlen(dirPath) + 2);
+    }
+    if (!download || !download->dir) {
+        free(download);
+        sendErrorMessage(conn, "Memory not allocated for archive", ERROR_CODE);
+        return;
+    }
+    sprintf(download->dir, "%s/", dirPath);
+    char *storeDir = concat(baseDir, CONTENT_STORE_DIR);
+    if (0 == stat(storeDir, &st)) {
+        download->skipStore = 1;
+        download->storeDev = st.st_dev;
+        download->storeIno = st.st_ino;
+    }
+    arena_free(storeDir);
+    if (0 != listArchiveEntries(download, "")) {
+        freeArchiveDownload(download);
+        sendErrorMessage(conn, "Memory not allocated for archive", ERROR_CODE);
+        return;
+    }
+    if (download->count > 1) {
+        qsort(download->entries, download->count, sizeof(ArchiveEntry), compareArchiveEntries);
+    }
 
-            char *fileName = filenameJSON->valuestring;
-            char *filePath = concat(baseDir, fileName);
-            printf("[DEBUG]: Reading file: %s\n", filePath);
-            FILE *file = fopen(filePath, "rb");
-            if (!file) {
-                char *message = concat("File not found at path:", filePath);
-                printf("[ERROR]: %s", message);
+    long long size = TAR_END_SIZE;
+    int i;
+    for (i = 0; i < download->count; i++) {
+        ArchiveEntry *entry = &download->entries[i];
+        tar_entry_t tarEntry = {entry->name, entry->type, entry->size, entry->mode, entry->mtime};
+        size += (long long) tar_header_size(&tarEntry) + entry->size + (long long) tar_padding(entry->size);
+    }
+    printf("[DEBUG]: Sending %d entries of %s as a tar archive (%lld bytes)\n", download->count, download->dir, size);
+    if (sendHttpHeaders(conn, 200, "application/x-tar", size, NULL) < 0) {
+        freeArchiveDownload(download);
+        return;
+    }
+    readArchiveFileAhead(download, -1);
+    conn->sendArchive = download;
+}
+#else
+static void freeArchiveDownload(ArchiveDownload *download) {
+    (void) download;
+}
 
-                if (commandJSON != NULL) {
-                    cJSON_Delete(commandJSON);
-                }
+static int queueArchivePart(Connection *conn) {
+    (void) conn;
+    return -1;
+}
 
-                sendErrorMessage(sock, message, ERROR_CODE);
-                return;
-            }
+static void sendDirectoryArchive(Connection *conn, const char *dirPath, char *baseDir) {
+    (void) dirPath;
+    (void) baseDir;
+    sendErrorResponse(conn, 501, "Archives are not supported on this platform", ERROR_CODE);
+}
+#endif
 
-            fseek(file, 0, SEEK_END);
-            long fsize = ftell(file);
-            fseek(file, 0, SEEK_SET);
+/**
+ * Raw download (GET /files/<name>?secretkey=...): queues the response headers and lets flushResponse() send
+ * the file itself straight from the page cache, without reading it into memory. A single byte range (Range header,
+ * or offset and length query parameters) is sent as a 206 response, a directory with archive=tar as a tar body.
+ */
+void handleFileDownload(Connection *conn, char *baseDir) {
+    if (!checkRawSecretKey(conn)) {
+        sendErrorResponse(conn, 403, ERROR_MESSAGE_SECRET_KEY_MISSMATCH, ERROR_CODE_SECRET_KEY_MISMATCH);
+        return;
+    }
+    char *fileName = getRawFileName(conn);
+    if (!fileName) {
+        sendErrorResponse(conn, 400, "Invalid file name", ERROR_CODE);
+        return;
+    }
+    char *filePath = concat(baseDir, fileName);
+    arena_free(fileName);
+    if (isArchiveRequest(conn)) {
+        sendDirectoryArchive(conn, filePath, baseDir);
+        arena_free(filePath);
+        return;
+    }
 
-            char *fileContent = malloc(fsize + 1);
-            memset(fileContent, 0, fsize + 1);
-            fread(fileContent, fsize, 1, file);
+    FILE *file = fopen(filePath, "rb");
+    long long size = file ? regularFileSize(file) : -1;
+    if (size < 0) {
+        if (file) {
             fclose(file);
+        }
+        char *message = concat("File not found at path:", filePath);
+        printf("[ERROR]: %s\n", message);
+        sendErrorResponse(conn, 404, message, ERROR_CODE);
+        arena_free(message);
+        arena_free(filePath);
+        return;
+    }
+    printf("[DEBUG]: Sending file: %s (%lld bytes)\n", filePath, size);
+    arena_free(filePath);
+
+    long long first = 0, last = size - 1;
+    char extraHeaders[128];
+    int range = getRawRange(conn, size, &first, &last);
+    if (HTTP_RANGE_UNSATISFIABLE == range) {
+        fclose(file);
+        snprintf(extraHeaders, sizeof(extraHeaders), "Content-Range: bytes */%lld\r\n", size);
+        sendErrorResponse(conn, 416, "Range not satisfiable", ERROR_CODE);
+        // the same response, telling the size of the file
+        sendHttpHeaders(conn, 416, "text/html; charset=UTF-8", conn->responseSize, extraHeaders);
+        return;
+    }
+    if (HTTP_RANGE_SATISFIABLE == range) {
+        snprintf(extraHeaders, sizeof(extraHeaders), "Accept-Ranges: bytes\r\nContent-Range: bytes %lld-%lld/%lld\r\n",
+                 first, last, size);
+    } else {
+        snprintf(extraHeaders, sizeof(extraHeaders), "Accept-Ranges: bytes\r\n");
+    }
+    if (first > 0 && 0 != seekFile(file, first)) {
+        fclose(file);
+        sendErrorMessage(conn, "Failed to read file", ERROR_CODE);
+        return;
+    }
+    if (sendHttpHeaders(conn, HTTP_RANGE_SATISFIABLE == range ? 206 : 200, "application/octet-stream",
+                        last + 1 - first, extraHeaders) < 0) {
+        fclose(file);
+        return;
+    }
+    conn->sendFile = file;
+    conn->sendFileOffset = first;
+    conn->sendFileEnd = last + 1;
+}
 
-            fileContent[fsize] = 0;
-            printf("[DEBUG]: File size: %lu\n", fsize);
-
-            unsigned long targetSize = (unsigned long) ((fsize) * 4 / 3 + 5);
-            printf("[DEBUG]: Target encoded size: %lu\n", targetSize);
-            char *encodedContent = malloc(targetSize);
-            if (!encodedContent) {
-                perror("[ERROR]: Memory not allocated for encodedContent");
-                exit(1);
-            }
+/**
+ * Returns 1 for true, a non-zero number or one of the strings "yes", "true" and "1".
+ */
+static int isTrueValue(cJSON *item) {
+    if (!item) {
+        return 0;
+    }
+    switch (item->type & 255) {
+        case cJSON_True:
+            return 1;
+        case cJSON_Number:
+            return 0 != item->valuedouble;
+        case cJSON_String:
+            return 0 == strcmp(item->valuestring, "yes") || 0 == strcmp(item->valuestring, "true")
+                   || 0 == strcmp(item->valuestring, "1");
+        default:
+            return 0;
+    }
+}
 
-            if (fsize > 0) {
-                base64_encode(fileContent, fsize, encodedContent, targetSize);
-            }
+/**
+ * Returns the number given as a JSON number or a numeric string, the default value if there is none.
+ */
+static double numberValue(cJSON *item, double defaultValue) {
+    if (item && cJSON_Number == (item->type & 255)) {
+        return item->valuedouble;
+    }
+    if (item && cJSON_String == (item->type & 255) && item->valuestring[0]) {
+        char *end;
+        double value = strtod(item->valuestring, &end);
+        return *end ? defaultValue : value;
+    }
+    return defaultValue;
+}
 
-            /**
-             * return successful response message, example:
-             *   {"return":0, "filename": <file name from requies>, "file_content_base64":<base 64 encoded requested file content>}
-             */
-            cJSON *resultJSON = cJSON_CreateObject();
-            if (!resultJSON) {
-                perror("[ERROR]: Memory not allocated for resultJSON");
-                exit(1);
-            }
-            cJSON_AddItemToObject(resultJSON, "return", cJSON_CreateString("0"));
-            cJSON_AddItemToObject(resultJSON, JSON_PARAM_FILE_NAME, cJSON_CreateString(fileName));
-            cJSON_AddItemToObject(resultJSON, JSON_PARAM_FILE_CONTENT, cJSON_CreateString(encodedContent));
-            resultJSONtext = cJSON_PrintUnformatted(resultJSON);
-            cJSON_Delete(resultJSON);
-        } else if (strncmp(action, "shell", 4) == 0) {
-            //  shell (to execute a binary at CK node)
-            // todo implement:
-            // 1) find local file by provided name - send JSON error if not found
-            // 2) generate run ID
-            // 3) fork new process for async execute
-            // 3) return run UUID as JSON sync with run UID and send to client
-            // 4) in async process convert to JSON with ru UID and send to client
-            printf("[DEBUG]: Request for shell command %s\n", decodedJSON);
-
-            cJSON *shellCommandJSON = cJSON_GetObjectItem(commandJSON, JSON_PARAM_SHELL_COMMAND);
-            if (!shellCommandJSON) {
-                printf("[ERROR]: Invalid action JSON format for provided message\n");
-                //todo check if need to cJSON_Delete(commandJSON) here as well
-                sendErrorMessage(sock, "Invalid action JSON format for message: no filenameJSON found", ERROR_CODE);
-                return;
-            }
+/**
+ * Reads how the shell command is run from the action JSON.
+ */
+static void readBenchOptions(cJSON *commandJSON, bench_options_t *options) {
+    options->repeat = (int) numberValue(cJSON_GetObjectItem(commandJSON, JSON_PARAM_REPEAT), 1);
+    options->warmup = (int) numberValue(cJSON_GetObjectItem(commandJSON, JSON_PARAM_WARMUP), 0);
+    options->minRepeat = (int) numberValue(cJSON_GetObjectItem(commandJSON, JSON_PARAM_MIN_REPEAT), 5);
+    options->targetRci = numberValue(cJSON_GetObjectItem(commandJSON, JSON_PARAM_TARGET_RCI), 0);
+    options->measured = isTrueValue(cJSON_GetObjectItem(commandJSON, JSON_PARAM_MEASURE));
+    bench_check_options(options);
+}
 
-            char *shellCommand = shellCommandJSON->valuestring;
+/**
+ * Queues the shell command in the job engine and answers with its runUUID right away, example:
+ *   {"return":"0", "runUUID":"<generated UID>", "state":"queued"}
+ */
+static void submitShellJob(Connection *conn, char *shellCommand, const bench_options_t *options, int exclusive) {
+#ifdef __linux__
+    char runUUID[JOB_ID_SIZE];
+    generateUUID(runUUID, sizeof(runUUID));
+    int rc = job_engine_submit(jobEngine, runUUID, shellCommand, options, exclusive);
+    if (JOB_ENGINE_FULL == rc) {
+        sendErrorMessage(conn, "Too many queued jobs", ERROR_CODE);
+        return;
+    }
+    if (rc < 0) {
+        sendErrorMessage(conn, "Memory not allocated for job", ERROR_CODE);
+        return;
+    }
+    printf("[INFO]: Queued job %s: %s\n", runUUID, shellCommand);
+
+    json_writer_t writer;
+    beginJSONResponse(conn, &writer);
+    json_writer_begin_object(&writer);
+    json_writer_key(&writer, "return");
+    json_writer_string(&writer, "0");
+    json_writer_key(&writer, JSON_PARAM_RUN_UUID);
+    json_writer_string(&writer, runUUID);
+    json_writer_key(&writer, "state");
+    json_writer_string(&writer, job_state_name(JOB_QUEUED));
+    json_writer_end_object(&writer);
+    if (sendJSONWriterResponse(conn, &writer, 200) < 0) {
+        sendErrorMessage(conn, "Memory not allocated for response", ERROR_CODE);
+    }
+#else
+    (void) shellCommand;
+    (void) options;
+    (void) exclusive;
+    sendErrorMessage(conn, "Asynchronous shell commands are not supported on this platform", ERROR_CODE);
+#endif
+}
 
-            if (!shellCommand) {
-                printf("[ERROR]: Invalid action JSON format for provided message\n");
-                //todo check if need to cJSON_Delete(commandJSON) here as well
-                sendErrorMessage(sock, "Invalid action JSON format for message: no filenameJSON found", ERROR_CODE);
-                return;
-            }
+void handleShell(Connection *conn, cJSON *commandJSON) {
+    //  shell (to execute a binary at CK node)
+    cJSON *shellCommandJSON = cJSON_GetObjectItem(commandJSON, JSON_PARAM_SHELL_COMMAND);
+    if (!shellCommandJSON || !shellCommandJSON->valuestring) {
+        printf("[ERROR]: Invalid action JSON format for provided message\n");
+        sendErrorMessage(conn, "Invalid action JSON format for message: no cmd found", ERROR_CODE);
+        return;
+    }
 
-            int systemReturnCode = system(shellCommand);
+    char *shellCommand = shellCommandJSON->valuestring;
+    printf("[DEBUG]: Request for shell command %s\n", shellCommand);
 
-            char path[MAX_BUFFER_SIZE + 1];
-            char *stdoutText = malloc(MAX_BUFFER_SIZE + 1);
-            if (stdoutText == NULL) {
-                perror("[ERROR]: Memory not allocated for stdoutText first time");
-                exit(1);
-            }
-            memset(stdoutText, 0, MAX_BUFFER_SIZE + 1);
+    bench_options_t options;
+    readBenchOptions(commandJSON, &options);
+    int exclusive = isTrueValue(cJSON_GetObjectItem(commandJSON, JSON_PARAM_EXCLUSIVE));
+    if (isTrueValue(cJSON_GetObjectItem(commandJSON, JSON_PARAM_ASYNC))) {
+        submitShellJob(conn, shellCommand, &options, exclusive);
+        return;
+    }
+    int streamed = isTrueValue(cJSON_GetObjectItem(commandJSON, JSON_PARAM_STREAM));
 
-            /* Open the command for reading. */
-            FILE *fp;
-#ifdef _WIN32
-            fp = _popen(shellCommand, "r");
-#else
-            fp = popen(shellCommand, "r");
+#ifdef __linux__
+    if (conn->eventLoop) {
+        // the loop goes on serving its other connections meanwhile
+        if (startShellTask(conn, shellCommand, &options, streamed, exclusive) < 0) {
+            sendErrorMessage(conn, "Failed to start shell command", ERROR_CODE);
+        }
+        return;
+    }
 #endif
-            if (fp == NULL) {
-                printf("[ERROR]: Failed to run command: %s\n", shellCommand);
-                exit(1);
-            }
 
-            int buffer_read = 0;
-            int total_read = 0;
-            while (fgets(path, sizeof(path) - 1, fp) != NULL) {
-                buffer_read = sizeof(path) - 1;
-                printf("[INFO]: Next buffer_read: %i\n", buffer_read);
-                printf("[INFO]: Next stdout line length: %lu, line text: %s", (unsigned long)(strlen(path)), path);
-                stdoutText = realloc(stdoutText, total_read + buffer_read + 1);
-                if (stdoutText == NULL) {
-                    perror("[ERROR]: Memory not allocated stdout");
-                    exit(1);
-                }
-                strcat(stdoutText + strlen(stdoutText), path);
-                total_read = total_read + buffer_read;
-            }
+    if (streamed) {
+        streamShellResult(conn, shellCommand, &options);
+    } else {
+        ShellCapture capture;
+        bench_result_t result;
+        int rc = runShellCommand(shellCommand, &options, &capture, &result);
+        sendShellResult(conn, shellCommand, &options, rc, &capture, &result);
+    }
+}
 
-#ifdef _WIN32
-            _pclose(fp);
+#ifdef __linux__
+/**
+ * job_reporter_t writing the state of a job, the output of its current run so far and, once it is finished, its
+ * exit status.
+ */
+static void writeJobState(void *ctx, const job_t *job) {
+    json_writer_t *writer = ctx;
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "return");
+    json_writer_string(writer, "0");
+    json_writer_key(writer, JSON_PARAM_RUN_UUID);
+    json_writer_string(writer, job->id);
+    json_writer_key(writer, "state");
+    json_writer_string(writer, job_state_name(job->state));
+    if (JOB_FINISHED == job->state) {
+        writeRunResult(writer, &job->options, &job->result);
+    }
+    if (JOB_QUEUED != job->state) {
+        json_writer_key(writer, "stdout");
+        json_writer_string_n(writer, job->out.data ? job->out.data : "", job->out.len);
+        json_writer_key(writer, "stderr");
+        json_writer_string_n(writer, job->err.data ? job->err.data : "", job->err.len);
+    }
+    json_writer_end_object(writer);
+}
+#endif
+
+void handleState(Connection *conn, cJSON *commandJSON) {
+    printf("[DEBUG]: Check run state by runUUID ");
+    cJSON *params = cJSON_GetObjectItem(commandJSON, JSON_PARAM_PARAMS);
+    cJSON *runUUIDJSON = params ? cJSON_GetObjectItem(params, JSON_PARAM_RUN_UUID) : NULL;
+    if (!runUUIDJSON || !runUUIDJSON->valuestring) {
+        sendErrorMessage(conn, "Invalid action JSON format for message: no runUUID found", ERROR_CODE);
+        return;
+    }
+    printf("[DEBUG]: runUUID: %s\n", runUUIDJSON->valuestring);
+
+#ifdef __linux__
+    json_writer_t writer;
+    beginJSONResponse(conn, &writer);
+    if (job_engine_report(jobEngine, runUUIDJSON->valuestring, writeJobState, &writer) < 0) {
+        json_writer_free(&writer);
+        sendErrorMessage(conn, "Unknown runUUID", ERROR_CODE);
+        return;
+    }
+    if (sendJSONWriterResponse(conn, &writer, 200) < 0) {
+        sendErrorMessage(conn, "Memory not allocated for job output", ERROR_CODE);
+    }
 #else
-            pclose(fp);
+    sendErrorMessage(conn, "Unknown runUUID", ERROR_CODE);
 #endif
+}
 
-            printf("[INFO]: total stdout line length: %i\n", total_read);
-            printf("[DEBUG]: stdout: %s\n", stdoutText);
-
-            cJSON *resultJSON = cJSON_CreateObject();
-            cJSON_AddItemToObject(resultJSON, "return", cJSON_CreateString("0"));
-
-            cJSON_AddNumberToObject(resultJSON, "return_code", systemReturnCode);
-
-            cJSON_AddItemToObject(resultJSON, "stdout", cJSON_CreateString(stdoutText)); 
-            cJSON_AddItemToObject(resultJSON, "stderr", cJSON_CreateString("some program stderr"));   //todo get stderr
-            resultJSONtext = cJSON_PrintUnformatted(resultJSON);
-            cJSON_Delete(resultJSON);
-        } else if (strncmp(action, "state", 4) == 0) {
-            printf("[DEBUG]: Check run state by runUUID ");
-            cJSON *params = cJSON_GetObjectItem(commandJSON, JSON_PARAM_PARAMS);
-            char *runUUID = cJSON_GetObjectItem(params, "runUUID")->valuestring;
-            printf("[DEBUG]: runUUID: %s\n", runUUID);
-
-            //todo implement get actual runing state by runUUID
-
-            cJSON *resultJSON = cJSON_CreateObject();
-            cJSON_AddItemToObject(resultJSON, "return", cJSON_CreateString("0"));
-            resultJSONtext = cJSON_PrintUnformatted(resultJSON);
-            cJSON_Delete(resultJSON);
-        } else if (strncmp(action, "clear", 4) == 0) {
-            printf("[DEBUG]: Clearing tmp files ...");
-            // todo implement removing all temporary files saved localy but need check some process could be in running state
-            // so need to discus how it should work
-        } else if (strncmp(action, "shutdown", 4) == 0) {
-            printf("[DEBUG]: Start shutdown CK node");
-            cJSON_Delete(commandJSON);
-            return;
-        } else {
-            sendErrorMessage(sock, "unknown action", ERROR_CODE);
-        }
+void doProcessing(Connection *conn, char *baseDir) {
+    char *body = conn->message + conn->request.headerLen;
+    size_t bodyLen = (size_t) conn->request.contentLength;
+    printf("[DEBUG]: Post request length: %lu\n", (unsigned long) bodyLen);
+
+	// the command is either the urlencoded ck_json form field, which is decoded in the message buffer, or the whole body
+	char *commandText = body;
+	size_t encodedJSONLen;
+	char *encodedJSON = (char *) http_get_form_field(body, bodyLen, CK_JSON_FIELD, &encodedJSONLen);
+	char next = '\0';
+	if (encodedJSON != NULL) {
+		size_t errorOffset;
+		size_t decodedLen = url_decode_inplace(encodedJSON, encodedJSONLen, &errorOffset);
+		if (decodedLen == URL_DECODE_ERROR) {
+			char message[128];
+			snprintf(message, sizeof(message), "Malformed escape in %s at offset %lu", CK_JSON_FIELD,
+					 (unsigned long) errorOffset);
+			sendErrorMessage(conn, message, ERROR_CODE);
+			return;
+		}
+		// the byte after the field may already belong to the next pipelined request
+		next = encodedJSON[encodedJSONLen];
+		encodedJSON[decodedLen] = '\0';
+		commandText = encodedJSON;
+	}
 
-        int n1 = sendHttpResponse(sock, 200, resultJSONtext, strlen(resultJSONtext));
+	// strings of the command point into the message, large ones like the pushed file content are not copied
+	cJSON *commandJSON = cJSON_ParseInSitu(commandText);
+	if (!commandJSON) {
+		sendErrorMessage(conn, "Invalid action JSON format for message", ERROR_CODE);
+	} else {
+		processCommand(conn, commandJSON, baseDir);
+		cJSON_Delete(commandJSON);
+	}
+	if (encodedJSON != NULL) {
+		encodedJSON[encodedJSONLen] = next;
+	}
+}
 
-        free(resultJSONtext);
+/**
+ * Checks the secret key of a parsed command and runs its action.
+ */
+void processCommand(Connection *conn, cJSON *commandJSON, char *baseDir) {
+    if (!checkCommandSecretKey(commandJSON)) {
+        sendErrorMessage(conn, ERROR_MESSAGE_SECRET_KEY_MISSMATCH, ERROR_CODE_SECRET_KEY_MISMATCH);
+        return;
+    }
 
-        if (n1 < 0) {
-            perror("ERROR writing to socket");
-            return;
-        }
-    } else {
-        sendErrorMessage(sock, ERROR_MESSAGE_SECRET_KEY_MISSMATCH, ERROR_CODE_SECRET_KEY_MISMATCH);
+    cJSON *actionJSON = cJSON_GetObjectItem(commandJSON, JSON_PARAM_NAME_COMMAND);
+    if (!actionJSON || !actionJSON->valuestring) {
+        printf("[ERROR]: Invalid action JSON format for message: \n");
+        sendErrorMessage(conn, "Invalid action JSON format for message: no action found", ERROR_CODE);
         return;
     }
-	cJSON_Delete(commandJSON);
-    if (client_message == NULL) {
-        perror("Error ! Try to free not allocated memory client_message");
-        exit(1);
+    char *action = actionJSON->valuestring;
+
+    printf("[INFO]: Get action: %s\n", action);
+    if (strcmp(action, "push_batch") == 0) {
+        handlePushBatch(conn, commandJSON, baseDir);
+    } else if (strcmp(action, "pull_batch") == 0) {
+        handlePullBatch(conn, commandJSON, baseDir);
+    } else if (strncmp(action, JSCON_PARAM_VALUE_PUSH, 4) == 0) {
+        handlePush(conn, commandJSON, baseDir);
+    } else if (strncmp(action, "pull", 4) == 0) {
+        handlePull(conn, commandJSON, baseDir);
+    } else if (strncmp(action, "shell", 4) == 0) {
+        handleShell(conn, commandJSON);
+    } else if (strncmp(action, "state", 4) == 0) {
+        handleState(conn, commandJSON);
+    } else if (strcmp(action, "has") == 0) {
+        handleHas(conn, commandJSON);
+    } else if (strncmp(action, "clear", 4) == 0) {
+        printf("[DEBUG]: Clearing tmp files ...");
+        // todo implement removing all temporary files saved localy but need check some process could be in running state
+        // so need to discus how it should work
+    } else if (strncmp(action, "shutdown", 4) == 0) {
+        printf("[DEBUG]: Start shutdown CK node");
+    } else {
+        sendErrorMessage(conn, "unknown action", ERROR_CODE);
     }
-    free(client_message);
 
 	printf("[INFO]: Action completed successfuly\n");
 }
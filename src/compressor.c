@@ -0,0 +1,306 @@
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#ifdef CK_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#include "compressor.h"
+
+#define GZIP_LEVEL 1                /* compressed while the client waits: speed rather than ratio */
+#define GZIP_WINDOW_BITS (15 + 16)  /* largest window, gzip wrapper */
+#define ZSTD_LEVEL 3
+#define ZSTD_WINDOW_LOG_MAX 24      /* zstd streams needing more than a 16 MB window are rejected */
+
+#define ZLIB_MAX_INPUT (1U << 30)   /* avail_in is an unsigned int */
+
+struct compressor {
+    compression_t type;
+    int decompress;
+    int ended;                      /* decompression: the end of a stream has been seen */
+    const char *error;
+    z_stream zs;
+#ifdef CK_WITH_ZSTD
+    ZSTD_CCtx *cctx;
+    ZSTD_DCtx *dctx;
+#endif
+    unsigned char out[COMPRESSOR_WINDOW_SIZE];
+};
+
+static int fail(compressor_t *compressor, const char *error) {
+    compressor->error = error;
+    return -1;
+}
+
+int compression_parse(const char *name, compression_t *type) {
+    if (!name[0] || 0 == strcmp(name, "none") || 0 == strcmp(name, "identity")) {
+        *type = COMPRESSION_NONE;
+    } else if (0 == strcmp(name, "gzip")) {
+        *type = COMPRESSION_GZIP;
+#ifdef CK_WITH_ZSTD
+    } else if (0 == strcmp(name, "zstd")) {
+        *type = COMPRESSION_ZSTD;
+#endif
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+const char *compression_name(compression_t type) {
+    switch (type) {
+        case COMPRESSION_GZIP:
+            return "gzip";
+        case COMPRESSION_ZSTD:
+            return "zstd";
+        default:
+            return "identity";
+    }
+}
+
+static int token_equals(const char *token, size_t len, const char *name) {
+    size_t i;
+    if (len != strlen(name)) {
+        return 0;
+    }
+    for (i = 0; i < len; i++) {
+        char c = token[i] >= 'A' && token[i] <= 'Z' ? token[i] - 'A' + 'a' : token[i];
+        if (c != name[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * quality of one element of Accept-Encoding, like "gzip;q=0.5", 1 if none is given
+ */
+static double quality(const char *params, const char *end) {
+    const char *q = params;
+    while (q < end && (';' == *q || ' ' == *q || '\t' == *q)) {
+        q++;
+    }
+    if (end - q > 2 && ('q' == q[0] || 'Q' == q[0]) && '=' == q[1]) {
+        return atof(q + 2);
+    }
+    return 1;
+}
+
+compression_t compression_negotiate(const char *value, int len) {
+    double gzip = -1, zstd = -1, any = -1;
+    const char *end = value ? value + len : NULL;
+    const char *p = value;
+    while (p && p < end) {
+        const char *elementEnd = memchr(p, ',', end - p);
+        if (!elementEnd) {
+            elementEnd = end;
+        }
+        while (p < elementEnd && (' ' == *p || '\t' == *p)) {
+            p++;
+        }
+        const char *tokenEnd = p;
+        while (tokenEnd < elementEnd && ';' != *tokenEnd && ' ' != *tokenEnd && '\t' != *tokenEnd) {
+            tokenEnd++;
+        }
+        double q = quality(tokenEnd, elementEnd);
+        if (token_equals(p, tokenEnd - p, "gzip") || token_equals(p, tokenEnd - p, "x-gzip")) {
+            gzip = q;
+        } else if (token_equals(p, tokenEnd - p, "zstd")) {
+            zstd = q;
+        } else if (token_equals(p, tokenEnd - p, "*")) {
+            any = q;
+        }
+        p = elementEnd + 1;
+    }
+#ifdef CK_WITH_ZSTD
+    if ((zstd < 0 ? any : zstd) > 0) {
+        return COMPRESSION_ZSTD;
+    }
+#else
+    (void) zstd;
+#endif
+    return (gzip < 0 ? any : gzip) > 0 ? COMPRESSION_GZIP : COMPRESSION_NONE;
+}
+
+compressor_t *compressor_create(compression_t type, int decompress) {
+    compressor_t *compressor = calloc(1, sizeof(compressor_t));
+    if (!compressor) {
+        return NULL;
+    }
+    compressor->type = type;
+    compressor->decompress = decompress;
+    int rc = -1;
+    if (COMPRESSION_GZIP == type) {
+        rc = decompress ? inflateInit2(&compressor->zs, GZIP_WINDOW_BITS)
+                        : deflateInit2(&compressor->zs, GZIP_LEVEL, Z_DEFLATED, GZIP_WINDOW_BITS, 8, Z_DEFAULT_STRATEGY);
+        rc = Z_OK == rc ? 0 : -1;
+#ifdef CK_WITH_ZSTD
+    } else if (COMPRESSION_ZSTD == type && decompress) {
+        compressor->dctx = ZSTD_createDCtx();
+        rc = compressor->dctx && !ZSTD_isError(ZSTD_DCtx_setParameter(compressor->dctx, ZSTD_d_windowLogMax,
+                                                                       ZSTD_WINDOW_LOG_MAX)) ? 0 : -1;
+    } else if (COMPRESSION_ZSTD == type) {
+        compressor->cctx = ZSTD_createCCtx();
+        rc = compressor->cctx && !ZSTD_isError(ZSTD_CCtx_setParameter(compressor->cctx, ZSTD_c_compressionLevel,
+                                                                       ZSTD_LEVEL)) ? 0 : -1;
+#endif
+    }
+    if (rc < 0) {
+        if (COMPRESSION_GZIP != type) {
+            compressor->type = COMPRESSION_NONE; /* nothing for zlib to free */
+        }
+        compressor_free(compressor);
+        return NULL;
+    }
+    return compressor;
+}
+
+/**
+ * pass the output window to the sink
+ */
+static int emit(compressor_t *compressor, size_t len, compressor_sink_t sink, void *ctx) {
+    if (len > 0 && sink(ctx, compressor->out, len) < 0) {
+        return fail(compressor, "Failed to write output");
+    }
+    return 0;
+}
+
+static int gzip_write(compressor_t *compressor, const unsigned char *data, size_t len, int finish,
+                      compressor_sink_t sink, void *ctx) {
+    z_stream *zs = &compressor->zs;
+    do {
+        size_t piece = len < ZLIB_MAX_INPUT ? len : ZLIB_MAX_INPUT;
+        zs->next_in = (unsigned char *) data;
+        zs->avail_in = (unsigned int) piece;
+        data += piece;
+        len -= piece;
+        int flush = finish && 0 == len ? Z_FINISH : Z_NO_FLUSH;
+        while (1) {
+            zs->next_out = compressor->out;
+            zs->avail_out = sizeof(compressor->out);
+            int rc = deflate(zs, flush);
+            if (Z_STREAM_ERROR == rc) {
+                return fail(compressor, "Compression failed");
+            }
+            if (emit(compressor, sizeof(compressor->out) - zs->avail_out, sink, ctx) < 0) {
+                return -1;
+            }
+            if (Z_FINISH == flush ? Z_STREAM_END == rc : 0 == zs->avail_in && 0 != zs->avail_out) {
+                break;
+            }
+        }
+    } while (len > 0);
+    return 0;
+}
+
+static int gunzip_write(compressor_t *compressor, const unsigned char *data, size_t len,
+                        compressor_sink_t sink, void *ctx) {
+    z_stream *zs = &compressor->zs;
+    do {
+        size_t piece = len < ZLIB_MAX_INPUT ? len : ZLIB_MAX_INPUT;
+        zs->next_in = (unsigned char *) data;
+        zs->avail_in = (unsigned int) piece;
+        data += piece;
+        len -= piece;
+        while (1) {
+            if (compressor->ended) {
+                if (0 == zs->avail_in) {
+                    break;
+                }
+                // concatenated gzip members make one stream
+                inflateReset(zs);
+                compressor->ended = 0;
+            }
+            zs->next_out = compressor->out;
+            zs->avail_out = sizeof(compressor->out);
+            int rc = inflate(zs, Z_NO_FLUSH);
+            if (Z_STREAM_END == rc) {
+                compressor->ended = 1;
+            } else if (Z_OK != rc && Z_BUF_ERROR != rc) {
+                return fail(compressor, zs->msg ? zs->msg : "Invalid gzip data");
+            }
+            if (emit(compressor, sizeof(compressor->out) - zs->avail_out, sink, ctx) < 0) {
+                return -1;
+            }
+            if (!compressor->ended && 0 == zs->avail_in && 0 != zs->avail_out) {
+                break;
+            }
+        }
+    } while (len > 0);
+    return 0;
+}
+
+#ifdef CK_WITH_ZSTD
+
+static int zstd_write(compressor_t *compressor, const void *data, size_t len, int finish,
+                      compressor_sink_t sink, void *ctx) {
+    ZSTD_inBuffer in = {data, len, 0};
+    while (1) {
+        ZSTD_outBuffer out = {compressor->out, sizeof(compressor->out), 0};
+        size_t rc = compressor->decompress
+                    ? ZSTD_decompressStream(compressor->dctx, &out, &in)
+                    : ZSTD_compressStream2(compressor->cctx, &out, &in, finish ? ZSTD_e_end : ZSTD_e_continue);
+        if (ZSTD_isError(rc)) {
+            return fail(compressor, ZSTD_getErrorName(rc));
+        }
+        if (compressor->decompress) {
+            compressor->ended = 0 == rc; /* a frame is complete */
+        }
+        if (emit(compressor, out.pos, sink, ctx) < 0) {
+            return -1;
+        }
+        int done = finish ? 0 == rc : in.pos == in.size && out.pos < out.size;
+        if (done) {
+            return 0;
+        }
+    }
+}
+
+#endif
+
+int compressor_write(compressor_t *compressor, const void *data, size_t len, compressor_sink_t sink, void *ctx) {
+    if (0 == len) {
+        return 0;
+    }
+#ifdef CK_WITH_ZSTD
+    if (COMPRESSION_ZSTD == compressor->type) {
+        return zstd_write(compressor, data, len, 0, sink, ctx);
+    }
+#endif
+    return compressor->decompress ? gunzip_write(compressor, data, len, sink, ctx)
+                                  : gzip_write(compressor, data, len, 0, sink, ctx);
+}
+
+int compressor_finish(compressor_t *compressor, compressor_sink_t sink, void *ctx) {
+    if (compressor->decompress) {
+        return compressor->ended ? 0 : fail(compressor, "Compressed data is truncated");
+    }
+#ifdef CK_WITH_ZSTD
+    if (COMPRESSION_ZSTD == compressor->type) {
+        return zstd_write(compressor, "", 0, 1, sink, ctx);
+    }
+#endif
+    return gzip_write(compressor, (const unsigned char *) "", 0, 1, sink, ctx);
+}
+
+const char *compressor_error(compressor_t *compressor) {
+    return compressor->error ? compressor->error : "";
+}
+
+void compressor_free(compressor_t *compressor) {
+    if (!compressor) {
+        return;
+    }
+    if (COMPRESSION_GZIP == compressor->type) {
+        if (compressor->decompress) {
+            inflateEnd(&compressor->zs);
+        } else {
+            deflateEnd(&compressor->zs);
+        }
+    }
+#ifdef CK_WITH_ZSTD
+    ZSTD_freeCCtx(compressor->cctx);
+    ZSTD_freeDCtx(compressor->dctx);
+#endif
+    free(compressor);
+}
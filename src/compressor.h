@@ -0,0 +1,95 @@
+#ifndef CK_COMPRESSOR_H
+#define CK_COMPRESSOR_H
+
+#include <stddef.h>
+
+/**
+ * Size of the output window, data is passed on in pieces of at most this size
+ */
+#define COMPRESSOR_WINDOW_SIZE (64 * 1024)
+
+typedef enum {
+    COMPRESSION_NONE,
+    COMPRESSION_GZIP,
+    COMPRESSION_ZSTD            /* only if built WITH_ZSTD */
+} compression_t;
+
+/**
+ * Streaming gzip (zlib) or zstd compression and decompression: input is passed through in parts and the output
+ * handed to a sink through a fixed window, so memory does not depend on the size of the data.
+ */
+typedef struct compressor compressor_t;
+
+/**
+ * Receives the next part of the output.
+ *
+ * @param ctx context passed along with the sink
+ * @param data the bytes
+ * @param len number of bytes, at most COMPRESSOR_WINDOW_SIZE
+ * @return 0 on success, -1 to stop with an error
+ */
+typedef int (*compressor_sink_t)(void *ctx, const void *data, size_t len);
+
+/**
+ * @param name "gzip", "zstd", "none" or "identity"
+ * @param type receives the compression
+ * @return 0 on success, -1 if the compression is unknown or not supported by this build
+ */
+int compression_parse(const char *name, compression_t *type);
+
+/**
+ * @param type a compression
+ * @return its name as used in HTTP Content-Encoding ("identity" for none)
+ */
+const char *compression_name(compression_t type);
+
+/**
+ * choose the compression for a response from the value of an Accept-Encoding header, zstd before gzip
+ *
+ * @param value the header value, may be NULL
+ * @param len length of the value
+ * @return the compression, COMPRESSION_NONE if the client accepts none of the supported ones
+ */
+compression_t compression_negotiate(const char *value, int len);
+
+/**
+ * @param type COMPRESSION_GZIP or COMPRESSION_ZSTD
+ * @param decompress 0 - compress the input, 1 - decompress it
+ * @return the compressor or NULL if memory could not be allocated or the type is not supported
+ */
+compressor_t *compressor_create(compression_t type, int decompress);
+
+/**
+ * pass the next part of the input through
+ *
+ * @param compressor the compressor
+ * @param data the bytes
+ * @param len number of bytes
+ * @param sink receives the output produced so far
+ * @param ctx passed to the sink
+ * @return 0 on success, -1 on failure (see compressor_error())
+ */
+int compressor_write(compressor_t *compressor, const void *data, size_t len, compressor_sink_t sink, void *ctx);
+
+/**
+ * end the input and pass on the rest of the output
+ *
+ * @param compressor the compressor
+ * @param sink receives the output
+ * @param ctx passed to the sink
+ * @return 0 on success, -1 on failure, such as truncated compressed input (see compressor_error())
+ */
+int compressor_finish(compressor_t *compressor, compressor_sink_t sink, void *ctx);
+
+/**
+ * @param compressor the compressor
+ * @return description of the failure
+ */
+const char *compressor_error(compressor_t *compressor);
+
+/**
+ * @param compressor the compressor, may be NULL
+ */
+void compressor_free(compressor_t *compressor);
+
+#endif
@@ -0,0 +1,266 @@
+#ifndef _WIN32
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+
+#include "content_store.h"
+
+#define COPY_BUFFER_SIZE (64 * 1024)
+
+struct content_store {
+    char *dir;
+    size_t dirLen;
+    pthread_mutex_t mutex;
+    unsigned long counter;      /* makes the names of temporary copies unique */
+};
+
+/**
+ * objects are spread over subdirectories named by the first two digits of their hash
+ */
+static char *object_path(content_store_t *store, const char *hash) {
+    char *path = malloc(store->dirLen + CONTENT_HASH_SIZE + 3);
+    if (path) {
+        sprintf(path, "%s%.2s/%s", store->dir, hash, hash);
+    }
+    return path;
+}
+
+/**
+ * copy a file to a new one with the given mode: a clone sharing the blocks where the file system can do that
+ */
+static int copy_file(const char *from, const char *to, mode_t mode) {
+    char buf[COPY_BUFFER_SIZE];
+    int in = open(from, O_RDONLY);
+    if (in < 0) {
+        return -1;
+    }
+    int out = open(to, O_WRONLY | O_CREAT | O_EXCL, mode);
+    if (out < 0) {
+        close(in);
+        return -1;
+    }
+    ssize_t n = 0;
+    int rc = 0;
+#ifdef FICLONE
+    if (0 == ioctl(out, FICLONE, in)) {
+        rc = 1;
+    }
+#endif
+    while (0 == rc && (n = read(in, buf, sizeof(buf))) != 0) {
+        if (n < 0) {
+            rc = EINTR == errno ? 0 : -1;
+            continue;
+        }
+        ssize_t written = 0;
+        while (written < n) {
+            ssize_t w = write(out, buf + written, n - written);
+            if (w < 0 && EINTR != errno) {
+                rc = -1;
+                break;
+            }
+            written += w > 0 ? w : 0;
+        }
+    }
+    close(in);
+    if (0 != close(out)) {
+        rc = -1;
+    }
+    if (rc < 0) {
+        int error = errno;
+        unlink(to);
+        errno = error;
+    }
+    return rc < 0 ? -1 : 0;
+}
+
+/**
+ * a unique temporary name next to a file
+ */
+static char *temp_path(content_store_t *store, const char *path) {
+    char *temp = malloc(strlen(path) + 48);
+    if (!temp) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    pthread_mutex_lock(&store->mutex);
+    unsigned long n = store->counter++;
+    pthread_mutex_unlock(&store->mutex);
+    sprintf(temp, "%s.%ld-%lu.copy", path, (long) getpid(), n);
+    return temp;
+}
+
+/**
+ * give an object a name: a copy is made next to it and renamed, so a file of that name is replaced at once
+ */
+static int place(content_store_t *store, const char *object, const char *path) {
+    char *temp = temp_path(store, path);
+    if (!temp) {
+        return -1;
+    }
+    int rc = copy_file(object, temp, 0644);
+    if (0 == rc && 0 != rename(temp, path)) {
+        int error = errno;
+        unlink(temp);
+        errno = error;
+        rc = -1;
+    }
+    free(temp);
+    return rc;
+}
+
+/**
+ * keep a read-only copy of a file as the object of its content, unless that is stored already
+ */
+static int store_object(content_store_t *store, const char *file, const char *object) {
+    struct stat st;
+    if (0 == stat(object, &st)) {
+        return 0;
+    }
+    char *temp = temp_path(store, object);
+    if (!temp) {
+        return -1;
+    }
+    // another thread may store the same content meanwhile, either copy is just as good
+    int rc = copy_file(file, temp, 0444);
+    if (0 == rc && 0 != rename(temp, object)) {
+        int error = errno;
+        unlink(temp);
+        errno = error;
+        rc = -1;
+    }
+    free(temp);
+    return rc;
+}
+
+content_store_t *content_store_create(const char *dir) {
+    struct stat st;
+    if (0 != mkdir(dir, 0700) && (EEXIST != errno || 0 != stat(dir, &st) || !S_ISDIR(st.st_mode))) {
+        return NULL;
+    }
+    content_store_t *store = malloc(sizeof(content_store_t));
+    if (!store) {
+        return NULL;
+    }
+    store->dirLen = strlen(dir);
+    store->dir = malloc(store->dirLen + 1);
+    if (!store->dir) {
+        free(store);
+        return NULL;
+    }
+    strcpy(store->dir, dir);
+    pthread_mutex_init(&store->mutex, NULL);
+    store->counter = 0;
+    return store;
+}
+
+void content_store_destroy(content_store_t *store) {
+    if (!store) {
+        return;
+    }
+    pthread_mutex_destroy(&store->mutex);
+    free(store->dir);
+    free(store);
+}
+
+int content_store_valid_hash(const char *hash) {
+    int i;
+    for (i = 0; i < CONTENT_HASH_SIZE - 1; i++) {
+        if (!((hash[i] >= '0' && hash[i] <= '9') || (hash[i] >= 'a' && hash[i] <= 'f'))) {
+            return 0;
+        }
+    }
+    return '\0' == hash[i];
+}
+
+int content_store_has(content_store_t *store, const char *hash) {
+    struct stat st;
+    char *object = object_path(store, hash);
+    int found = object && 0 == stat(object, &st) && S_ISREG(st.st_mode);
+    free(object);
+    return found;
+}
+
+int content_store_add(content_store_t *store, const char *tempPath, const char *hash, const char *path) {
+    char *object = object_path(store, hash);
+    if (!object) {
+        errno = ENOMEM;
+        return -1;
+    }
+    // the subdirectory of the object
+    object[store->dirLen + 2] = '\0';
+    if (0 != mkdir(object, 0700) && EEXIST != errno) {
+        free(object);
+        return -1;
+    }
+    object[store->dirLen + 2] = '/';
+
+    int rc = store_object(store, tempPath, object);
+    if (0 == rc) {
+        rc = rename(tempPath, path);
+    }
+    free(object);
+    return rc;
+}
+
+int content_store_link(content_store_t *store, const char *hash, const char *path) {
+    char *object = object_path(store, hash);
+    if (!object) {
+        errno = ENOMEM;
+        return -1;
+    }
+    int rc = place(store, object, path);
+    free(object);
+    return rc;
+}
+
+#else
+
+#include "content_store.h"
+
+/* there is no store on Windows */
+content_store_t *content_store_create(const char *dir) {
+    (void) dir;
+    return NULL;
+}
+
+void content_store_destroy(content_store_t *store) {
+    (void) store;
+}
+
+int content_store_valid_hash(const char *hash) {
+    (void) hash;
+    return 0;
+}
+
+int content_store_has(content_store_t *store, const char *hash) {
+    (void) store;
+    (void) hash;
+    return 0;
+}
+
+int content_store_add(content_store_t *store, const char *tempPath, const char *hash, const char *path) {
+    (void) store;
+    (void) tempPath;
+    (void) hash;
+    (void) path;
+    return -1;
+}
+
+int content_store_link(content_store_t *store, const char *hash, const char *path) {
+    (void) store;
+    (void) hash;
+    (void) path;
+    return -1;
+}
+
+#endif
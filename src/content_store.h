@@ -0,0 +1,67 @@
+#ifndef CK_CONTENT_STORE_H
+#define CK_CONTENT_STORE_H
+
+#include "sha256.h"
+
+/**
+ * length of a content hash (lower case hexadecimal SHA-256) with the terminating zero
+ */
+#define CONTENT_HASH_SIZE SHA256_HEX_SIZE
+
+/**
+ * Content addressed store: every distinct content is kept once, read-only and named by its hash, so it is not
+ * pushed again. The files named with it are copies of their own (clones sharing the blocks where the file system
+ * supports that), which can be modified or given another mode without touching the stored content.
+ * A store is thread safe.
+ */
+typedef struct content_store content_store_t;
+
+/**
+ * open a store, creating its directory if needed
+ *
+ * @param dir the directory, with a trailing slash
+ * @return the store or NULL if the directory could not be created or memory could not be allocated
+ */
+content_store_t *content_store_create(const char *dir);
+
+/**
+ * @param store the store, may be NULL
+ */
+void content_store_destroy(content_store_t *store);
+
+/**
+ * @param hash a string
+ * @return 1 if it is a content hash (64 lower case hexadecimal digits)
+ */
+int content_store_valid_hash(const char *hash);
+
+/**
+ * @param store the store
+ * @param hash a valid content hash
+ * @return 1 if the content is stored
+ */
+int content_store_has(content_store_t *store, const char *hash);
+
+/**
+ * store the content of a completely written file, unless it is stored already, and rename the file to a name
+ * (replacing a file of that name)
+ *
+ * @param store the store
+ * @param tempPath the file, it is gone afterwards on success
+ * @param hash the hash of its content
+ * @param path the name
+ * @return 0 on success, -1 otherwise (with errno set)
+ */
+int content_store_add(content_store_t *store, const char *tempPath, const char *hash, const char *path);
+
+/**
+ * make stored content available under a name (replacing a file of that name)
+ *
+ * @param store the store
+ * @param hash a valid content hash
+ * @param path the name
+ * @return 0 on success, -1 otherwise (errno is ENOENT if the content is not stored)
+ */
+int content_store_link(content_store_t *store, const char *hash, const char *path);
+
+#endif
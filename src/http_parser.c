@@ -0,0 +1,358 @@
+#include <limits.h>
+#include <string.h>
+
+#include "http_parser.h"
+
+/**
+ * parser states
+ */
+#define S_START 0               /* before the request line, empty lines are skipped */
+#define S_METHOD 1
+#define S_PATH 2
+#define S_VERSION 3
+#define S_REQUEST_LINE_LF 4     /* CR seen at the end of the request line */
+#define S_HEADER_START 5
+#define S_HEADER_NAME 6
+#define S_HEADER_VALUE_START 7  /* skipping whitespace before the value */
+#define S_HEADER_VALUE 8
+#define S_HEADER_LF 9           /* CR seen at the end of a header line */
+#define S_HEADERS_END_LF 10     /* CR seen on the empty line ending the headers */
+#define S_BODY 11
+
+static int fail(http_request_t *request, int status, const char *error) {
+    request->status = status;
+    request->error = error;
+    return HTTP_PARSE_ERROR;
+}
+
+static char lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+/**
+ * compare a buffer with a lower case string ignoring case
+ */
+static int equals_ignore_case(const char *s, int len, const char *lowerCase) {
+    int i;
+    for (i = 0; i < len; i++) {
+        if (!lowerCase[i] || lower(s[i]) != lowerCase[i]) {
+            return 0;
+        }
+    }
+    return !lowerCase[len];
+}
+
+/**
+ * check whether a comma separated header value contains the given token
+ */
+static int has_token(const char *value, int len, const char *lowerCaseToken) {
+    int start = 0, i;
+    for (i = 0; i <= len; i++) {
+        if (i == len || ',' == value[i]) {
+            int end = i;
+            while (start < end && (' ' == value[start] || '\t' == value[start])) {
+                start++;
+            }
+            while (end > start && (' ' == value[end - 1] || '\t' == value[end - 1])) {
+                end--;
+            }
+            if (equals_ignore_case(value + start, end - start, lowerCaseToken)) {
+                return 1;
+            }
+            start = i + 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * remember the header which has just been parsed and interpret the ones the parser itself needs
+ */
+static int end_header(http_request_t *request, const char *buf, int valueEnd) {
+    http_header_t *header = &request->headers[request->headerCount];
+    while (valueEnd > header->value && (' ' == buf[valueEnd - 1] || '\t' == buf[valueEnd - 1])) {
+        valueEnd--;
+    }
+    header->valueLen = valueEnd - header->value;
+
+    const char *name = buf + header->name;
+    const char *value = buf + header->value;
+    if (equals_ignore_case(name, header->nameLen, "content-length")) {
+        long length = 0;
+        int i;
+        if (0 == header->valueLen) {
+            return fail(request, 400, "Invalid Content-Length");
+        }
+        for (i = 0; i < header->valueLen; i++) {
+            if (value[i] < '0' || value[i] > '9') {
+                return fail(request, 400, "Invalid Content-Length");
+            }
+            length = length * 10 + (value[i] - '0');
+            if (length > request->maxBodySize) {
+                return fail(request, 413, "Request body is too large");
+            }
+        }
+        if (0 <= request->contentLength && length != request->contentLength) {
+            return fail(request, 400, "Conflicting Content-Length headers");
+        }
+        request->contentLength = length;
+    } else if (equals_ignore_case(name, header->nameLen, "connection")) {
+        if (has_token(value, header->valueLen, "close")) {
+            request->keepAlive = 0;
+        } else if (has_token(value, header->valueLen, "keep-alive")) {
+            request->keepAlive = 1;
+        }
+    } else if (equals_ignore_case(name, header->nameLen, "transfer-encoding")) {
+        return fail(request, 501, "Transfer-Encoding is not supported for requests");
+    }
+
+    request->headerCount++;
+    return HTTP_PARSE_INCOMPLETE;
+}
+
+static int end_request_line(http_request_t *request, const char *buf) {
+    int versionLen = request->pos - request->mark;
+    const char *version = buf + request->mark;
+    if (8 != versionLen || 0 != strncmp(version, "HTTP/1.", 7) || version[7] < '0' || version[7] > '9') {
+        return fail(request, 505, "Unsupported HTTP version");
+    }
+    request->versionMinor = version[7] - '0';
+    request->keepAlive = request->versionMinor >= 1;
+    return HTTP_PARSE_INCOMPLETE;
+}
+
+static void end_headers(http_request_t *request) {
+    request->headerLen = request->pos + 1;
+    if (request->contentLength < 0) {
+        // a request without Content-Length has no body
+        request->contentLength = 0;
+    }
+    request->state = S_BODY;
+}
+
+void http_request_init(http_request_t *request, long maxBodySize) {
+    memset(request, 0, sizeof(http_request_t));
+    request->state = S_START;
+    request->contentLength = -1;
+    request->maxBodySize = maxBodySize;
+}
+
+int http_parse(http_request_t *request, const char *buf, size_t size) {
+    while (S_BODY != request->state && (size_t) request->pos < size) {
+        char c = buf[request->pos];
+
+        if (request->pos >= HTTP_MAX_HEADER_SIZE) {
+            return fail(request, 431, "Request headers are too large");
+        }
+
+        switch (request->state) {
+            case S_START:
+                if ('\r' != c && '\n' != c) {
+                    request->method = request->pos;
+                    request->state = S_METHOD;
+                    continue; // parse this byte as part of the method
+                }
+                break;
+
+            case S_METHOD:
+                if (' ' == c) {
+                    request->methodLen = request->pos - request->method;
+                    if (0 == request->methodLen) {
+                        return fail(request, 400, "Empty request method");
+                    }
+                    request->path = request->pos + 1;
+                    request->state = S_PATH;
+                } else if (c < 'A' || c > 'Z') {
+                    return fail(request, 400, "Invalid request method");
+                }
+                break;
+
+            case S_PATH:
+                if (' ' == c) {
+                    request->pathLen = request->pos - request->path;
+                    if (0 == request->pathLen) {
+                        return fail(request, 400, "Empty request path");
+                    }
+                    request->mark = request->pos + 1;
+                    request->state = S_VERSION;
+                } else if ('\r' == c || '\n' == c) {
+                    return fail(request, 400, "Missing HTTP version");
+                }
+                break;
+
+            case S_VERSION:
+                if ('\r' == c || '\n' == c) {
+                    if (HTTP_PARSE_ERROR == end_request_line(request, buf)) {
+                        return HTTP_PARSE_ERROR;
+                    }
+                    request->state = '\r' == c ? S_REQUEST_LINE_LF : S_HEADER_START;
+                }
+                break;
+
+            case S_REQUEST_LINE_LF:
+            case S_HEADER_LF:
+                if ('\n' != c) {
+                    return fail(request, 400, "Expected LF after CR");
+                }
+                request->state = S_HEADER_START;
+                break;
+
+            case S_HEADER_START:
+                if ('\r' == c) {
+                    request->state = S_HEADERS_END_LF;
+                } else if ('\n' == c) {
+                    end_headers(request);
+                } else if (' ' == c || '\t' == c) {
+                    return fail(request, 400, "Folded header lines are not supported");
+                } else if (':' == c) {
+                    return fail(request, 400, "Empty header name");
+                } else {
+                    if (HTTP_MAX_HEADERS == request->headerCount) {
+                        return fail(request, 431, "Too many request headers");
+                    }
+                    request->headers[request->headerCount].name = request->pos;
+                    request->state = S_HEADER_NAME;
+                }
+                break;
+
+            case S_HEADER_NAME:
+                if (':' == c) {
+                    http_header_t *header = &request->headers[request->headerCount];
+                    header->nameLen = request->pos - header->name;
+                    request->state = S_HEADER_VALUE_START;
+                } else if ('\r' == c || '\n' == c || ' ' == c || '\t' == c) {
+                    return fail(request, 400, "Invalid header name");
+                }
+                break;
+
+            case S_HEADER_VALUE_START:
+                if (' ' == c || '\t' == c) {
+                    break;
+                }
+                request->headers[request->headerCount].value = request->pos;
+                request->state = S_HEADER_VALUE;
+                continue; // parse this byte as part of the value
+
+            case S_HEADER_VALUE:
+                if ('\r' == c || '\n' == c) {
+                    if (HTTP_PARSE_ERROR == end_header(request, buf, request->pos)) {
+                        return HTTP_PARSE_ERROR;
+                    }
+                    request->state = '\r' == c ? S_HEADER_LF : S_HEADER_START;
+                }
+                break;
+
+            case S_HEADERS_END_LF:
+                if ('\n' != c) {
+                    return fail(request, 400, "Expected LF after CR");
+                }
+                end_headers(request);
+                break;
+        }
+        request->pos++;
+    }
+
+    if (S_BODY == request->state && size >= (size_t) http_request_length(request)) {
+        return HTTP_PARSE_COMPLETE;
+    }
+    return HTTP_PARSE_INCOMPLETE;
+}
+
+int http_headers_complete(const http_request_t *request) {
+    return S_BODY == request->state;
+}
+
+long http_request_length(const http_request_t *request) {
+    return request->headerLen + request->contentLength;
+}
+
+const char *http_get_header(const http_request_t *request, const char *buf, const char *name, int *valueLen) {
+    size_t nameLen = strlen(name);
+    int i;
+    for (i = 0; i < request->headerCount; i++) {
+        const http_header_t *header = &request->headers[i];
+        if ((size_t) header->nameLen == nameLen) {
+            size_t j = 0;
+            while (j < nameLen && lower(buf[header->name + j]) == lower(name[j])) {
+                j++;
+            }
+            if (j == nameLen) {
+                *valueLen = header->valueLen;
+                return buf + header->value;
+            }
+        }
+    }
+    return NULL;
+}
+
+const char *http_get_form_field(const char *body, size_t bodyLen, const char *name, size_t *valueLen) {
+    size_t nameLen = strlen(name);
+    const char *field = body;
+    const char *end = body + bodyLen;
+    while (field < end) {
+        const char *fieldEnd = memchr(field, '&', end - field);
+        if (!fieldEnd) {
+            fieldEnd = end;
+        }
+        if ((size_t) (fieldEnd - field) > nameLen && '=' == field[nameLen] && 0 == memcmp(field, name, nameLen)) {
+            *valueLen = fieldEnd - field - nameLen - 1;
+            return field + nameLen + 1;
+        }
+        field = fieldEnd + 1;
+    }
+    return NULL;
+}
+
+/**
+ * parse the decimal digits at *pos, -1 if there are none (or too many)
+ */
+static long long parse_number(const char *value, int len, int *pos) {
+    long long n = -1;
+    while (*pos < len && value[*pos] >= '0' && value[*pos] <= '9') {
+        if (n > (LLONG_MAX - 9) / 10) {
+            return -1;
+        }
+        n = (n < 0 ? 0 : 10 * n) + (value[*pos] - '0');
+        (*pos)++;
+    }
+    return n;
+}
+
+int http_parse_range(const char *value, int len, long long size, long long *first, long long *last) {
+    int pos = 0;
+    while (pos < len && (' ' == value[pos] || '\t' == value[pos])) {
+        pos++;
+    }
+    if (len - pos < 6 || !equals_ignore_case(value + pos, 6, "bytes=")) {
+        return HTTP_RANGE_NONE;
+    }
+    pos += 6;
+    long long start = parse_number(value, len, &pos);
+    if (pos == len || '-' != value[pos]) {
+        return HTTP_RANGE_NONE;
+    }
+    pos++;
+    long long end = parse_number(value, len, &pos);
+    while (pos < len && (' ' == value[pos] || '\t' == value[pos])) {
+        pos++;
+    }
+    if (pos != len || (start < 0 && end < 0) || (start >= 0 && end >= 0 && end < start)) {
+        return HTTP_RANGE_NONE;
+    }
+
+    if (start < 0) {
+        // the last bytes
+        if (0 == end || 0 == size) {
+            return HTTP_RANGE_UNSATISFIABLE;
+        }
+        start = end < size ? size - end : 0;
+        end = size - 1;
+    } else if (start >= size) {
+        return HTTP_RANGE_UNSATISFIABLE;
+    } else if (end < 0 || end >= size) {
+        end = size - 1;
+    }
+    *first = start;
+    *last = end;
+    return HTTP_RANGE_SATISFIABLE;
+}
@@ -0,0 +1,131 @@
+#ifndef CK_HTTP_PARSER_H
+#define CK_HTTP_PARSER_H
+
+#include <stddef.h>
+
+/**
+ * Limits enforced by the parser
+ */
+#define HTTP_MAX_HEADER_SIZE 16384  /* request line and all headers */
+#define HTTP_MAX_HEADERS 64
+
+/**
+ * Results of http_parse()
+ */
+#define HTTP_PARSE_ERROR -1
+#define HTTP_PARSE_INCOMPLETE 0
+#define HTTP_PARSE_COMPLETE 1
+
+/**
+ * Results of http_parse_range()
+ */
+#define HTTP_RANGE_UNSATISFIABLE -1
+#define HTTP_RANGE_NONE 0
+#define HTTP_RANGE_SATISFIABLE 1
+
+/**
+ * Location of a header in the request buffer. Offsets are used instead of pointers,
+ * so that the buffer can be reallocated while the request is still being received.
+ */
+typedef struct {
+    int name;
+    int nameLen;
+    int value;
+    int valueLen;
+} http_header_t;
+
+/**
+ * Incremental HTTP/1.x request parser state. All offsets are relative to the start of the request.
+ */
+typedef struct {
+    int state;
+    int pos;                /* next byte to parse, bytes before it are never looked at again */
+    int mark;               /* start of the token being parsed */
+
+    int method;
+    int methodLen;
+    int path;
+    int pathLen;
+    int versionMinor;       /* x in HTTP/1.x */
+
+    http_header_t headers[HTTP_MAX_HEADERS];
+    int headerCount;
+
+    int headerLen;          /* size of the request line and headers, i.e. offset of the body */
+    long contentLength;     /* -1 until the Content-Length header is seen */
+    long maxBodySize;
+    int keepAlive;          /* connection should stay open after this request */
+
+    int status;             /* HTTP status to answer with if parsing failed */
+    const char *error;      /* description of the parse error */
+} http_request_t;
+
+/**
+ * prepare the parser for a new request
+ *
+ * @param request the parser state
+ * @param maxBodySize maximum accepted Content-Length
+ */
+void http_request_init(http_request_t *request, long maxBodySize);
+
+/**
+ * continue parsing a request from where the previous call stopped
+ *
+ * @param request the parser state
+ * @param buf the request bytes received so far (the same buffer, possibly reallocated, on every call)
+ * @param size number of bytes in buf
+ * @return HTTP_PARSE_COMPLETE when the whole request including its body is in buf,
+ *         HTTP_PARSE_INCOMPLETE if more bytes are needed, HTTP_PARSE_ERROR if the request is malformed
+ *         or exceeds the limits (see status and error)
+ */
+int http_parse(http_request_t *request, const char *buf, size_t size);
+
+/**
+ * @param request the parser state
+ * @return 1 if the request line and all headers have been parsed, 0 otherwise
+ */
+int http_headers_complete(const http_request_t *request);
+
+/**
+ * @param request the parser state
+ * @return total length of the request (headers and body), valid once the headers are complete
+ */
+long http_request_length(const http_request_t *request);
+
+/**
+ * find a header by its name, ignoring case
+ *
+ * @param request the parser state
+ * @param buf the request buffer
+ * @param name the header name
+ * @param valueLen receives the length of the value
+ * @return pointer to the header value in buf (not zero terminated) or NULL if there is no such header
+ */
+const char *http_get_header(const http_request_t *request, const char *buf, const char *name, int *valueLen);
+
+/**
+ * find a field of an application/x-www-form-urlencoded body
+ *
+ * @param body the body
+ * @param bodyLen length of the body
+ * @param name the field name
+ * @param valueLen receives the length of the (still encoded) value
+ * @return pointer to the value in body or NULL if there is no such field
+ */
+const char *http_get_form_field(const char *body, size_t bodyLen, const char *name, size_t *valueLen);
+
+/**
+ * parse the value of a Range header with a single byte range ("bytes=first-last", "bytes=first-" or
+ * "bytes=-suffixLength"); other ranges, such as several ones, are ignored as the whole content may be sent instead
+ *
+ * @param value the header value
+ * @param len length of the value
+ * @param size size of the content
+ * @param first receives the offset of the first byte
+ * @param last receives the offset of the last byte, at most size - 1
+ * @return HTTP_RANGE_SATISFIABLE, HTTP_RANGE_UNSATISFIABLE if the range is outside the content
+ *         or HTTP_RANGE_NONE if the header is to be ignored
+ */
+int http_parse_range(const char *value, int len, long long size, long long *first, long long *last);
+
+#endif
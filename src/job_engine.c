@@ -0,0 +1,497 @@
+#ifndef _WIN32
+
+#ifdef __linux__
+#define _GNU_SOURCE /* sched_setaffinity */
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "job_engine.h"
+
+struct job_engine {
+    pthread_mutex_t mutex;
+    pthread_cond_t wakeup;      /* broadcast when a job is queued, a slot is taken or freed, or the engine stops */
+    pthread_t *threads;
+    int threadCount;
+    job_core_set_t cores;       /* no cores - the commands are not bound */
+    int slotCount;
+    char *busy;                 /* per slot */
+    int busySlots;
+    unsigned long nextTicket;   /* the job or reservation dispatched next */
+    unsigned long lastTicket;
+    job_t *jobs;                /* all jobs in the order they were submitted */
+    job_t *lastJob;
+    int queued;
+    int finished;
+    int maxQueued;
+    int maxFinished;
+    int retention;
+    int stopping;
+#ifdef __linux__
+    cpu_set_t processCpus;      /* the CPUs of the process when the engine was created, none if unknown */
+#endif
+};
+
+typedef struct {
+    job_engine_t *engine;
+    job_t *job;
+} job_output_t;
+
+typedef struct {
+    job_engine_t *engine;
+    int scheduled;
+    int exclusive;
+    job_task_t task;
+    void *ctx;
+} job_run_t;
+
+static void free_job(job_t *job) {
+    free(job->command);
+    bench_result_free(&job->result);
+    shell_buffer_free(&job->out);
+    shell_buffer_free(&job->err);
+    free(job);
+}
+
+static int is_done(const job_t *job) {
+    return job->state == JOB_FINISHED || job->state == JOB_FAILED;
+}
+
+static void remove_job(job_engine_t *engine, job_t *job) {
+    job_t **link = &engine->jobs;
+    job_t *prev = NULL;
+    while (*link != job) {
+        prev = *link;
+        link = &(*link)->next;
+    }
+    *link = job->next;
+    if (engine->lastJob == job) {
+        engine->lastJob = prev;
+    }
+    if (is_done(job)) {
+        engine->finished--;
+    }
+    free_job(job);
+}
+
+/**
+ * drop finished jobs which are older than the retention time and, beyond maxFinished, the ones which finished first
+ */
+static void evict(job_engine_t *engine) {
+    time_t now = time(NULL);
+    job_t *job = engine->jobs;
+    while (job) {
+        job_t *next = job->next;
+        if (is_done(job) && engine->retention > 0 && now - job->finished >= engine->retention) {
+            remove_job(engine, job);
+        }
+        job = next;
+    }
+    while (engine->finished > engine->maxFinished) {
+        job_t *oldest = NULL;
+        for (job = engine->jobs; job; job = job->next) {
+            if (is_done(job) && (!oldest || job->finished < oldest->finished)) {
+                oldest = job;
+            }
+        }
+        remove_job(engine, oldest);
+    }
+}
+
+static void collect_output(void *ctx, int stream, const char *data, size_t len) {
+    job_output_t *output = ctx;
+    pthread_mutex_lock(&output->engine->mutex);
+    shell_buffer_append(stream == SHELL_STDOUT ? &output->job->out : &output->job->err, data, len);
+    pthread_mutex_unlock(&output->engine->mutex);
+}
+
+/**
+ * only the output of the current run is kept
+ */
+static void reset_output(void *ctx, int run, int warmup) {
+    job_output_t *output = ctx;
+    (void) warmup;
+    if (0 == run) {
+        return;
+    }
+    pthread_mutex_lock(&output->engine->mutex);
+    output->job->out.len = 0;
+    output->job->err.len = 0;
+    if (output->job->out.data) {
+        output->job->out.data[0] = '\0';
+    }
+    if (output->job->err.data) {
+        output->job->err.data[0] = '\0';
+    }
+    pthread_mutex_unlock(&output->engine->mutex);
+}
+
+static int can_start(job_engine_t *engine, int exclusive) {
+    return exclusive ? 0 == engine->busySlots : engine->busySlots < engine->slotCount;
+}
+
+/**
+ * give the slot to the ticket whose turn it is, with the engine locked
+ */
+static void take_slot(job_engine_t *engine, int exclusive, job_slot_t *slot) {
+    int i;
+    slot->exclusive = exclusive;
+    if (exclusive) {
+        memset(engine->busy, 1, engine->slotCount);
+        engine->busySlots = engine->slotCount;
+        slot->index = 0;
+    } else {
+        for (i = 0; engine->busy[i]; i++) {
+        }
+        engine->busy[i] = 1;
+        engine->busySlots++;
+        slot->index = i;
+    }
+    engine->nextTicket++;
+    // the next in line may fit into the slots left
+    pthread_cond_broadcast(&engine->wakeup);
+}
+
+static void release_slot(job_engine_t *engine, job_slot_t *slot) {
+    if (slot->exclusive) {
+        memset(engine->busy, 0, engine->slotCount);
+        engine->busySlots = 0;
+    } else if (slot->index >= 0) {
+        engine->busy[slot->index] = 0;
+        engine->busySlots--;
+    }
+    slot->index = -1;
+    pthread_cond_broadcast(&engine->wakeup);
+}
+
+static void *run_jobs(void *arg) {
+    job_engine_t *engine = arg;
+    pthread_mutex_lock(&engine->mutex);
+    while (1) {
+        job_t *job = NULL;
+        while (!engine->stopping) {
+            for (job = engine->jobs; job && (job->state != JOB_QUEUED || job->ticket != engine->nextTicket);
+                 job = job->next) {
+            }
+            if (job && can_start(engine, job->exclusive)) {
+                break;
+            }
+            pthread_cond_wait(&engine->wakeup, &engine->mutex);
+        }
+        if (engine->stopping) {
+            break;
+        }
+        job_slot_t slot;
+        take_slot(engine, job->exclusive, &slot);
+        job->state = JOB_RUNNING;
+        job->started = time(NULL);
+        engine->queued--;
+        pthread_mutex_unlock(&engine->mutex);
+
+        // the job stays in the table while it runs, only finished jobs are evicted
+        job_output_t output;
+        bench_result_t result;
+        output.engine = engine;
+        output.job = job;
+        if (job_engine_bind(engine, &slot, 0) < 0) {
+            printf("[WARN]: Failed to bind job %s to its cores: %s\n", job->id, strerror(errno));
+        }
+        int rc = bench_run(job->command, &job->options, reset_output, collect_output, &output, &result);
+
+        pthread_mutex_lock(&engine->mutex);
+        release_slot(engine, &slot);
+        job->state = rc < 0 ? JOB_FAILED : JOB_FINISHED;
+        if (rc == 0) {
+            job->result = result;
+        }
+        job->finished = time(NULL);
+        engine->finished++;
+        evict(engine);
+    }
+    pthread_mutex_unlock(&engine->mutex);
+    return NULL;
+}
+
+int job_core_set_parse(const char *list, int perJob, job_core_set_t *set) {
+    const char *p = list;
+    memset(set, 0, sizeof(job_core_set_t));
+    while (*p) {
+        char *end;
+        long first = strtol(p, &end, 10), last;
+        if (end == p || first < 0 || first > 65535) {
+            job_core_set_free(set);
+            return -1;
+        }
+        p = end;
+        last = first;
+        if ('-' == *p) {
+            last = strtol(++p, &end, 10);
+            if (end == p || last < first || last > 65535) {
+                job_core_set_free(set);
+                return -1;
+            }
+            p = end;
+        }
+        int *cores = realloc(set->cores, sizeof(int) * (set->count + (last - first + 1)));
+        if (!cores) {
+            job_core_set_free(set);
+            return -1;
+        }
+        set->cores = cores;
+        while (first <= last) {
+            set->cores[set->count++] = (int) first++;
+        }
+        if (',' == *p) {
+            p++;
+        } else if (*p) {
+            job_core_set_free(set);
+            return -1;
+        }
+    }
+    set->perJob = perJob < 1 ? 1 : perJob > set->count && set->count > 0 ? set->count : perJob;
+    return 0;
+}
+
+void job_core_set_free(job_core_set_t *set) {
+    free(set->cores);
+    set->cores = NULL;
+    set->count = 0;
+}
+
+job_engine_t *job_engine_create(int maxRunning, int maxQueued, int maxFinished, int retention,
+                                const job_core_set_t *cores) {
+    job_engine_t *engine = malloc(sizeof(job_engine_t));
+    if (!engine) {
+        return NULL;
+    }
+    memset(engine, 0, sizeof(job_engine_t));
+    engine->maxQueued = maxQueued;
+    engine->maxFinished = maxFinished;
+    engine->retention = retention;
+    engine->slotCount = maxRunning > 0 ? maxRunning : 1;
+#ifdef __linux__
+    // the threads of unscheduled tasks are started by pinned threads, they must not stay on their CPU
+    if (sched_getaffinity(0, sizeof(engine->processCpus), &engine->processCpus) < 0) {
+        CPU_ZERO(&engine->processCpus);
+    }
+#endif
+    if (cores && cores->count > 0) {
+        engine->cores.cores = malloc(sizeof(int) * cores->count);
+        if (!engine->cores.cores) {
+            free(engine);
+            return NULL;
+        }
+        memcpy(engine->cores.cores, cores->cores, sizeof(int) * cores->count);
+        engine->cores.count = cores->count;
+        engine->cores.perJob = cores->perJob;
+        engine->slotCount = cores->count / cores->perJob;
+    }
+    engine->threads = malloc(sizeof(pthread_t) * engine->slotCount);
+    engine->busy = calloc(engine->slotCount, 1);
+    if (!engine->threads || !engine->busy) {
+        free(engine->threads);
+        free(engine->busy);
+        job_core_set_free(&engine->cores);
+        free(engine);
+        return NULL;
+    }
+    pthread_mutex_init(&engine->mutex, NULL);
+    pthread_cond_init(&engine->wakeup, NULL);
+    // a thread per slot, so the queued jobs never wait for a thread while a slot is free
+    for (engine->threadCount = 0; engine->threadCount < engine->slotCount; engine->threadCount++) {
+        if (0 != pthread_create(&engine->threads[engine->threadCount], NULL, run_jobs, engine)) {
+            job_engine_destroy(engine);
+            return NULL;
+        }
+    }
+    return engine;
+}
+
+void job_engine_destroy(job_engine_t *engine) {
+    int i;
+    if (!engine) {
+        return;
+    }
+    pthread_mutex_lock(&engine->mutex);
+    engine->stopping = 1;
+    pthread_cond_broadcast(&engine->wakeup);
+    pthread_mutex_unlock(&engine->mutex);
+    for (i = 0; i < engine->threadCount; i++) {
+        pthread_join(engine->threads[i], NULL);
+    }
+    while (engine->jobs) {
+        job_t *next = engine->jobs->next;
+        free_job(engine->jobs);
+        engine->jobs = next;
+    }
+    pthread_cond_destroy(&engine->wakeup);
+    pthread_mutex_destroy(&engine->mutex);
+    free(engine->threads);
+    free(engine->busy);
+    job_core_set_free(&engine->cores);
+    free(engine);
+}
+
+int job_engine_submit(job_engine_t *engine, const char *id, const char *command, const bench_options_t *options,
+                      int exclusive) {
+    job_t *job = malloc(sizeof(job_t));
+    if (!job) {
+        return JOB_ENGINE_ERROR;
+    }
+    memset(job, 0, sizeof(job_t));
+    job->command = malloc(strlen(command) + 1);
+    if (!job->command) {
+        free(job);
+        return JOB_ENGINE_ERROR;
+    }
+    strcpy(job->command, command);
+    strncpy(job->id, id, JOB_ID_SIZE - 1);
+    job->state = JOB_QUEUED;
+    job->options = *options;
+    job->exclusive = exclusive;
+    job->submitted = time(NULL);
+
+    pthread_mutex_lock(&engine->mutex);
+    if (engine->queued >= engine->maxQueued) {
+        pthread_mutex_unlock(&engine->mutex);
+        free_job(job);
+        return JOB_ENGINE_FULL;
+    }
+    evict(engine);
+    job->ticket = engine->lastTicket++;
+    if (engine->lastJob) {
+        engine->lastJob->next = job;
+    } else {
+        engine->jobs = job;
+    }
+    engine->lastJob = job;
+    engine->queued++;
+    pthread_cond_broadcast(&engine->wakeup);
+    pthread_mutex_unlock(&engine->mutex);
+    return 0;
+}
+
+int job_engine_bound(job_engine_t *engine) {
+    return engine->cores.count > 0;
+}
+
+static void *run_task(void *arg) {
+    job_run_t *run = arg;
+    job_slot_t slot;
+    slot.index = -1;
+    slot.exclusive = 0;
+    if (run->scheduled) {
+        if (0 == job_engine_acquire(run->engine, run->exclusive, &slot)
+            && job_engine_bind(run->engine, &slot, 0) < 0) {
+            printf("[WARN]: Failed to bind shell command to its cores: %s\n", strerror(errno));
+        }
+    }
+#ifdef __linux__
+    else if (CPU_COUNT(&run->engine->processCpus) > 0
+             && sched_setaffinity(0, sizeof(run->engine->processCpus), &run->engine->processCpus) < 0) {
+        printf("[WARN]: Failed to unpin shell command: %s\n", strerror(errno));
+    }
+#endif
+    run->task(run->ctx);
+    if (slot.index >= 0) {
+        job_engine_release(run->engine, &slot);
+    }
+    free(run);
+    return NULL;
+}
+
+int job_engine_run(job_engine_t *engine, int scheduled, int exclusive, job_task_t task, void *ctx) {
+    job_run_t *run = malloc(sizeof(job_run_t));
+    pthread_t thread;
+    if (!run) {
+        return -1;
+    }
+    run->engine = engine;
+    run->scheduled = scheduled;
+    run->exclusive = exclusive;
+    run->task = task;
+    run->ctx = ctx;
+    if (0 != pthread_create(&thread, NULL, run_task, run)) {
+        free(run);
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
+
+int job_engine_acquire(job_engine_t *engine, int exclusive, job_slot_t *slot) {
+    pthread_mutex_lock(&engine->mutex);
+    unsigned long ticket = engine->lastTicket++;
+    while (!engine->stopping && (ticket != engine->nextTicket || !can_start(engine, exclusive))) {
+        pthread_cond_wait(&engine->wakeup, &engine->mutex);
+    }
+    if (engine->stopping) {
+        pthread_mutex_unlock(&engine->mutex);
+        slot->index = -1;
+        slot->exclusive = 0;
+        return -1;
+    }
+    take_slot(engine, exclusive, slot);
+    pthread_mutex_unlock(&engine->mutex);
+    return 0;
+}
+
+int job_engine_bind(job_engine_t *engine, const job_slot_t *slot, int pid) {
+#ifdef __linux__
+    int i;
+    if (0 == engine->cores.count || slot->index < 0) {
+        return 0;
+    }
+    int first = slot->exclusive ? 0 : slot->index * engine->cores.perJob;
+    int last = slot->exclusive ? engine->cores.count : first + engine->cores.perJob;
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (i = first; i < last; i++) {
+        if (engine->cores.cores[i] < CPU_SETSIZE) {
+            CPU_SET(engine->cores.cores[i], &cpus);
+        }
+    }
+    return sched_setaffinity(pid, sizeof(cpus), &cpus);
+#else
+    (void) engine;
+    (void) slot;
+    (void) pid;
+    return 0;
+#endif
+}
+
+void job_engine_release(job_engine_t *engine, job_slot_t *slot) {
+    pthread_mutex_lock(&engine->mutex);
+    release_slot(engine, slot);
+    pthread_mutex_unlock(&engine->mutex);
+}
+
+int job_engine_report(job_engine_t *engine, const char *id, job_reporter_t reporter, void *ctx) {
+    job_t *job;
+    pthread_mutex_lock(&engine->mutex);
+    evict(engine);
+    for (job = engine->jobs; job && 0 != strcmp(job->id, id); job = job->next) {
+    }
+    if (job) {
+        reporter(ctx, job);
+    }
+    pthread_mutex_unlock(&engine->mutex);
+    return job ? 0 : -1;
+}
+
+const char *job_state_name(int state) {
+    switch (state) {
+        case JOB_QUEUED: return "queued";
+        case JOB_RUNNING: return "running";
+        case JOB_FINISHED: return "finished";
+        default: return "failed";
+    }
+}
+
+#endif
@@ -0,0 +1,192 @@
+#ifndef CK_JOB_ENGINE_H
+#define CK_JOB_ENGINE_H
+
+#include <time.h>
+
+#include "shell_runner.h"
+#include "benchmark.h"
+
+#define JOB_ID_SIZE 40
+
+/* job states */
+#define JOB_QUEUED 0
+#define JOB_RUNNING 1
+#define JOB_FINISHED 2
+#define JOB_FAILED 3        /* the command could not be started */
+
+/* job_engine_submit() errors */
+#define JOB_ENGINE_ERROR -1 /* memory not allocated */
+#define JOB_ENGINE_FULL -2  /* too many queued jobs */
+
+/**
+ * CPU cores the commands are bound to. They are split into slots of perJob cores, every command gets a slot of its
+ * own, an exclusive one all of them.
+ */
+typedef struct job_core_set {
+    int *cores;
+    int count;
+    int perJob;
+} job_core_set_t;
+
+/**
+ * Cores granted to a job or to a command run outside of the engine
+ */
+typedef struct job_slot {
+    int index;
+    int exclusive;      /* all slots, nothing else runs */
+} job_slot_t;
+
+/**
+ * A shell command run in the background. The output of its current run is collected while it runs.
+ */
+typedef struct job {
+    char id[JOB_ID_SIZE];
+    char *command;
+    int state;
+    bench_options_t options;    /* how often the command is run */
+    int exclusive;              /* no other command runs at the same time */
+    unsigned long ticket;       /* jobs and reservations are dispatched in the order of their tickets */
+    bench_result_t result;      /* valid once the job is finished */
+    shell_buffer_t out;
+    shell_buffer_t err;
+    time_t submitted;
+    time_t started;
+    time_t finished;
+    struct job *next;
+} job_t;
+
+/**
+ * Runs jobs with a thread per slot and keeps finished jobs for a while, so that their state can be queried. Jobs and
+ * commands run outside of the engine (see job_engine_acquire()) are dispatched first come first served as slots
+ * become free, so an exclusive command waiting for the running ones holds back the ones behind it.
+ * An engine is thread safe and shared by all event loops.
+ */
+typedef struct job_engine job_engine_t;
+
+/**
+ * Receives a job found by job_engine_report(). It is called with the engine locked, so the job must not be
+ * kept and the engine must not be called from it.
+ *
+ * @param ctx context given to job_engine_report()
+ * @param job the job
+ */
+typedef void (*job_reporter_t)(void *ctx, const job_t *job);
+
+/**
+ * Work run by job_engine_run() on a thread of the engine.
+ *
+ * @param ctx context given to job_engine_run()
+ */
+typedef void (*job_task_t)(void *ctx);
+
+/**
+ * parse a list of cores like "0-3,6"
+ *
+ * @param list the list
+ * @param perJob cores of a slot, limited to the number of cores
+ * @param set receives the cores, to be released with job_core_set_free()
+ * @return 0 on success, -1 if the list is malformed or memory could not be allocated
+ */
+int job_core_set_parse(const char *list, int perJob, job_core_set_t *set);
+
+void job_core_set_free(job_core_set_t *set);
+
+/**
+ * create an engine and start its threads
+ *
+ * @param maxRunning number of jobs run at the same time if they are not bound to cores
+ * @param maxQueued number of jobs which may wait for a thread
+ * @param maxFinished number of finished jobs kept, older ones are evicted first
+ * @param retention seconds a finished job is kept, 0 means until it is evicted by maxFinished
+ * @param cores the cores the commands are bound to, one slot per perJob cores, NULL or none - not bound
+ * @return the engine or NULL if memory could not be allocated or the threads could not be started
+ */
+job_engine_t *job_engine_create(int maxRunning, int maxQueued, int maxFinished, int retention,
+                                const job_core_set_t *cores);
+
+/**
+ * wait for the running jobs, drop the queued ones and free the engine
+ *
+ * @param engine the engine, may be NULL
+ */
+void job_engine_destroy(job_engine_t *engine);
+
+/**
+ * queue a shell command
+ *
+ * @param engine the engine
+ * @param id identifier of the job, shorter than JOB_ID_SIZE
+ * @param command the command
+ * @param options how often the command is run and whether it is measured
+ * @param exclusive 1 if the job waits for all running commands and nothing else runs until it is finished
+ * @return 0 on success, JOB_ENGINE_FULL or JOB_ENGINE_ERROR otherwise
+ */
+int job_engine_submit(job_engine_t *engine, const char *id, const char *command, const bench_options_t *options,
+                      int exclusive);
+
+/**
+ * @param engine the engine
+ * @return 1 if the commands are bound to cores
+ */
+int job_engine_bound(job_engine_t *engine);
+
+/**
+ * run a command outside of the job table on a thread of its own, so that the caller does not wait for it. A scheduled
+ * task first waits for its turn like job_engine_acquire() and runs bound to the cores of its slot, the others start
+ * at once on all CPUs the process was allowed to run on when the engine was created.
+ *
+ * @param engine the engine
+ * @param scheduled 1 if the task waits for a slot
+ * @param exclusive 1 if all slots are needed
+ * @param task runs the command, also if the engine is stopping, then without a slot
+ * @param ctx passed to the task
+ * @return 0 on success, -1 if the thread could not be started
+ */
+int job_engine_run(job_engine_t *engine, int scheduled, int exclusive, job_task_t task, void *ctx);
+
+/**
+ * wait for the turn of a command run outside of the engine, in line with the queued jobs
+ *
+ * @param engine the engine
+ * @param exclusive 1 if all slots are needed
+ * @param slot receives the granted slot, to be given back with job_engine_release()
+ * @return 0 on success, -1 if the engine is stopping
+ */
+int job_engine_acquire(job_engine_t *engine, int exclusive, job_slot_t *slot);
+
+/**
+ * bind a process or thread to the cores of a slot, the processes it starts inherit them
+ *
+ * @param engine the engine
+ * @param slot the slot
+ * @param pid the process, 0 for the calling thread
+ * @return 0 on success or if the engine does not bind commands, -1 otherwise
+ */
+int job_engine_bind(job_engine_t *engine, const job_slot_t *slot, int pid);
+
+/**
+ * give a slot back
+ *
+ * @param engine the engine
+ * @param slot the slot
+ */
+void job_engine_release(job_engine_t *engine, job_slot_t *slot);
+
+/**
+ * pass a job to a reporter
+ *
+ * @param engine the engine
+ * @param id identifier of the job
+ * @param reporter receives the job
+ * @param ctx passed to the reporter
+ * @return 0 on success, -1 if there is no such job (any more)
+ */
+int job_engine_report(job_engine_t *engine, const char *id, job_reporter_t reporter, void *ctx);
+
+/**
+ * @param state a job state
+ * @return its name ("queued", "running", "finished" or "failed")
+ */
+const char *job_state_name(int state);
+
+#endif
@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <limits.h>
+
+#include "json_writer.h"
+
+#define MIN_GENERATED_CAPACITY 64
+
+/* characters which are written as they are inside a string, the others as in cJSON print_string_ptr() */
+static int plain_char(unsigned char c) {
+    return c > 31 && c != '"' && c != '\\';
+}
+
+/**
+ * make sure at least size characters can be appended
+ */
+static int ensure(json_writer_t *writer, size_t size) {
+    if (writer->error) {
+        return -1;
+    }
+    if (writer->capacity - writer->len >= size) {
+        return 0;
+    }
+    char *buf = buffer_pool_grow(writer->pool, writer->buf, writer->len, &writer->capacity, writer->len + size);
+    if (!buf) {
+        writer->error = 1;
+        return -1;
+    }
+    writer->buf = buf;
+    return 0;
+}
+
+static void append(json_writer_t *writer, const char *data, size_t len) {
+    if (0 == ensure(writer, len)) {
+        memcpy(writer->buf + writer->len, data, len);
+        writer->len += len;
+    }
+}
+
+static void append_char(json_writer_t *writer, char c) {
+    if (0 == ensure(writer, 1)) {
+        writer->buf[writer->len++] = c;
+    }
+}
+
+/**
+ * write the comma which separates the value from the previous one at the same level
+ */
+static void begin_value(json_writer_t *writer) {
+    if (writer->afterKey) {
+        writer->afterKey = 0;
+        return;
+    }
+    if (writer->count[writer->depth]++ > 0) {
+        append_char(writer, ',');
+    }
+}
+
+/**
+ * append characters of a string value, escaping them
+ */
+static void append_escaped(json_writer_t *writer, const char *value, size_t len) {
+    // worst case is \u00XX for every character
+    if (ensure(writer, len <= 1024 ? len * 6 : len + 1024) < 0) {
+        return;
+    }
+    size_t i = 0;
+    while (i < len) {
+        size_t run = i;
+        while (run < len && plain_char((unsigned char) value[run])) {
+            run++;
+        }
+        append(writer, value + i, run - i);
+        if (run == len) {
+            break;
+        }
+        char escaped[8];
+        unsigned char c = (unsigned char) value[run];
+        switch (c) {
+            case '\\': strcpy(escaped, "\\\\"); break;
+            case '"': strcpy(escaped, "\\\""); break;
+            case '\b': strcpy(escaped, "\\b"); break;
+            case '\f': strcpy(escaped, "\\f"); break;
+            case '\n': strcpy(escaped, "\\n"); break;
+            case '\r': strcpy(escaped, "\\r"); break;
+            case '\t': strcpy(escaped, "\\t"); break;
+            default: sprintf(escaped, "\\u%04x", c); break;
+        }
+        append(writer, escaped, strlen(escaped));
+        i = run + 1;
+    }
+}
+
+void json_writer_init(json_writer_t *writer, buffer_pool_t *pool) {
+    memset(writer, 0, sizeof(json_writer_t));
+    writer->pool = pool;
+}
+
+void json_writer_reserve(json_writer_t *writer, size_t size) {
+    ensure(writer, size);
+}
+
+static void begin_container(json_writer_t *writer, char c) {
+    begin_value(writer);
+    if (writer->depth + 1 >= JSON_WRITER_MAX_DEPTH) {
+        writer->error = 1;
+        return;
+    }
+    writer->count[++writer->depth] = 0;
+    append_char(writer, c);
+}
+
+static void end_container(json_writer_t *writer, char c) {
+    if (writer->depth > 0) {
+        writer->depth--;
+    }
+    append_char(writer, c);
+}
+
+void json_writer_begin_object(json_writer_t *writer) {
+    begin_container(writer, '{');
+}
+
+void json_writer_end_object(json_writer_t *writer) {
+    end_container(writer, '}');
+}
+
+void json_writer_begin_array(json_writer_t *writer) {
+    begin_container(writer, '[');
+}
+
+void json_writer_end_array(json_writer_t *writer) {
+    end_container(writer, ']');
+}
+
+void json_writer_key(json_writer_t *writer, const char *name) {
+    json_writer_string(writer, name);
+    append_char(writer, ':');
+    writer->afterKey = 1;
+}
+
+void json_writer_string(json_writer_t *writer, const char *value) {
+    json_writer_string_n(writer, value ? value : "", value ? strlen(value) : 0);
+}
+
+void json_writer_string_n(json_writer_t *writer, const char *value, size_t len) {
+    begin_value(writer);
+    append_char(writer, '"');
+    append_escaped(writer, value, len);
+    append_char(writer, '"');
+}
+
+void json_writer_generated_string(json_writer_t *writer, json_writer_generator_t generator, void *ctx, int escape) {
+    begin_value(writer);
+    append_char(writer, '"');
+    while (!writer->error) {
+        long n;
+        if (escape) {
+            char chunk[JSON_WRITER_CHUNK_SIZE];
+            n = generator(ctx, chunk, sizeof(chunk));
+            if (n > 0) {
+                append_escaped(writer, chunk, (size_t) n);
+            }
+        } else {
+            // the generator writes straight into the document
+            if (writer->capacity - writer->len < MIN_GENERATED_CAPACITY
+                && ensure(writer, JSON_WRITER_CHUNK_SIZE) < 0) {
+                break;
+            }
+            n = generator(ctx, writer->buf + writer->len, writer->capacity - writer->len);
+            if (n > 0) {
+                writer->len += (size_t) n;
+            }
+        }
+        if (n < 0) {
+            writer->error = 1;
+        }
+        if (n <= 0) {
+            break;
+        }
+    }
+    append_char(writer, '"');
+}
+
+void json_writer_number(json_writer_t *writer, double value) {
+    char buf[64];
+    if (value <= INT_MAX && value >= INT_MIN && fabs(((double) (int) value) - value) <= DBL_EPSILON) {
+        sprintf(buf, "%d", (int) value);
+    } else if (fabs(floor(value) - value) <= DBL_EPSILON) {
+        sprintf(buf, "%.0f", value);
+    } else if (fabs(value) < 1.0e-6 || fabs(value) > 1.0e9) {
+        sprintf(buf, "%e", value);
+    } else {
+        sprintf(buf, "%f", value);
+    }
+    begin_value(writer);
+    append(writer, buf, strlen(buf));
+}
+
+void json_writer_bool(json_writer_t *writer, int value) {
+    begin_value(writer);
+    append(writer, value ? "true" : "false", value ? 4 : 5);
+}
+
+void json_writer_null(json_writer_t *writer) {
+    begin_value(writer);
+    append(writer, "null", 4);
+}
+
+void json_writer_raw(json_writer_t *writer, const char *data, size_t len) {
+    append(writer, data, len);
+}
+
+void json_writer_cjson(json_writer_t *writer, cJSON *item) {
+    cJSON *child;
+    switch (item->type & 255) {
+        case cJSON_NULL: json_writer_null(writer); break;
+        case cJSON_False: json_writer_bool(writer, 0); break;
+        case cJSON_True: json_writer_bool(writer, 1); break;
+        case cJSON_Number: json_writer_number(writer, item->valuedouble); break;
+        case cJSON_String: json_writer_string(writer, item->valuestring); break;
+        case cJSON_Array:
+            json_writer_begin_array(writer);
+            for (child = item->child; child; child = child->next) {
+                json_writer_cjson(writer, child);
+            }
+            json_writer_end_array(writer);
+            break;
+        case cJSON_Object:
+            json_writer_begin_object(writer);
+            for (child = item->child; child; child = child->next) {
+                json_writer_key(writer, child->string);
+                json_writer_cjson(writer, child);
+            }
+            json_writer_end_object(writer);
+            break;
+    }
+}
+
+int json_writer_error(json_writer_t *writer) {
+    return writer->error;
+}
+
+void json_writer_free(json_writer_t *writer) {
+    buffer_pool_put(writer->pool, writer->buf, writer->capacity);
+    writer->buf = NULL;
+    writer->len = 0;
+    writer->capacity = 0;
+}
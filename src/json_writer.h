@@ -0,0 +1,126 @@
+#ifndef CK_JSON_WRITER_H
+#define CK_JSON_WRITER_H
+
+#include <stddef.h>
+
+#include "buffer_pool.h"
+#include "cJSON.h"
+
+/**
+ * Deepest nesting of objects and arrays
+ */
+#define JSON_WRITER_MAX_DEPTH 32
+
+/**
+ * Size of the chunks string generators are asked for
+ */
+#define JSON_WRITER_CHUNK_SIZE (64 * 1024)
+
+/**
+ * Streaming JSON emitter: values are escaped and appended straight to a buffer taken from a buffer pool, in the
+ * same format as cJSON_PrintUnformatted(), without building a cJSON tree first. Errors are sticky, so a whole
+ * document can be written and checked once at the end.
+ */
+typedef struct json_writer {
+    buffer_pool_t *pool;
+    char *buf;
+    size_t len;
+    size_t capacity;
+    int depth;
+    int count[JSON_WRITER_MAX_DEPTH];   /* values written at each level, to place the commas */
+    int afterKey;                       /* a member name has been written, its value follows */
+    int error;
+} json_writer_t;
+
+/**
+ * Produces the next part of a string value.
+ *
+ * @param ctx context given to json_writer_generated_string()
+ * @param buf where the characters are stored
+ * @param capacity size of buf, at least 64
+ * @return number of characters stored, 0 at the end of the string, -1 on failure
+ */
+typedef long (*json_writer_generator_t)(void *ctx, char *buf, size_t capacity);
+
+/**
+ * start an empty document
+ *
+ * @param writer the writer
+ * @param pool the pool the buffer is taken from, NULL means plain malloc
+ */
+void json_writer_init(json_writer_t *writer, buffer_pool_t *pool);
+
+/**
+ * make room for the given number of further characters, so that a large document is not grown step by step
+ *
+ * @param writer the writer
+ * @param size number of characters
+ */
+void json_writer_reserve(json_writer_t *writer, size_t size);
+
+void json_writer_begin_object(json_writer_t *writer);
+void json_writer_end_object(json_writer_t *writer);
+void json_writer_begin_array(json_writer_t *writer);
+void json_writer_end_array(json_writer_t *writer);
+
+/**
+ * write the name of the next member of an object
+ *
+ * @param writer the writer
+ * @param name the name
+ */
+void json_writer_key(json_writer_t *writer, const char *name);
+
+/**
+ * write a string value (NULL is written as "")
+ */
+void json_writer_string(json_writer_t *writer, const char *value);
+
+/**
+ * write a string value of the given length
+ */
+void json_writer_string_n(json_writer_t *writer, const char *value, size_t len);
+
+/**
+ * write a string value produced chunk by chunk, which is never held in memory as a whole
+ *
+ * @param writer the writer
+ * @param generator produces the characters
+ * @param ctx passed to the generator
+ * @param escape 0 if the generator only produces characters which need no escaping (like Base64), which are then
+ *               stored straight in the document, 1 if they must be escaped
+ */
+void json_writer_generated_string(json_writer_t *writer, json_writer_generator_t generator, void *ctx, int escape);
+
+/**
+ * write a number like cJSON does (integers without a fraction)
+ */
+void json_writer_number(json_writer_t *writer, double value);
+
+void json_writer_bool(json_writer_t *writer, int value);
+void json_writer_null(json_writer_t *writer);
+
+/**
+ * append characters as they are, outside of any value (like the line feeds between the documents of an NDJSON stream)
+ */
+void json_writer_raw(json_writer_t *writer, const char *data, size_t len);
+
+/**
+ * write a cJSON tree
+ */
+void json_writer_cjson(json_writer_t *writer, cJSON *item);
+
+/**
+ * @param writer the writer
+ * @return 1 if memory could not be allocated, the nesting was too deep or a generator failed, 0 otherwise
+ */
+int json_writer_error(json_writer_t *writer);
+
+/**
+ * give the buffer back to the pool
+ *
+ * @param writer the writer
+ */
+void json_writer_free(json_writer_t *writer);
+
+#endif
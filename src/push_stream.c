@@ -0,0 +1,358 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "push_stream.h"
+#include "base64.h"
+
+/* body formats, decided by the first non-whitespace byte */
+#define BODY_UNKNOWN 0
+#define BODY_JSON 1
+#define BODY_FORM 2
+
+/* form parser states */
+#define FORM_NAME 0
+#define FORM_VALUE 1    /* value of the form field holding the JSON */
+#define FORM_SKIP 2     /* value of another form field */
+
+/* position relative to the content field name in the JSON */
+#define KEY_NONE 0
+#define KEY_MATCHED 1   /* the field name has just been read */
+#define KEY_COLON 2     /* ... followed by a colon, a string value is streamed */
+
+#define MAX_FORM_NAME 64
+
+struct push_stream {
+    const char *field;
+    const char *formField;
+    FILE *out;
+    sha256_t *digest;       /* of the decoded content, may be NULL */
+
+    int body;
+    int formState;
+    char formName[MAX_FORM_NAME];
+    size_t formNameLen;
+    int formFieldSeen;
+    int hexDigits;          /* digits of a %XX escape still expected */
+    int hexValue;
+
+    int depth;              /* nesting of JSON objects and arrays */
+    int inString;
+    int escape;             /* previous character was a backslash */
+    size_t keyStart;        /* offset of the opening quote of the current string */
+    int keyState;
+    int streaming;          /* inside the content value */
+    int unicodeDigits;      /* digits of a \uXXXX escape still expected */
+    int unicodeValue;
+    int padded;             /* '=' seen, the rest of the content is ignored */
+    int found;
+
+    char *json;
+    size_t jsonLen;
+    size_t jsonCapacity;
+    size_t maxJsonSize;
+
+    char encoded[PUSH_STREAM_CHUNK_SIZE];
+    size_t encodedLen;
+    unsigned char decoded[PUSH_STREAM_CHUNK_SIZE / 4 * 3];
+    long long written;
+
+    const char *error;
+};
+
+static int fail(push_stream_t *stream, const char *error) {
+    stream->error = error;
+    return -1;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return 0;
+}
+
+/**
+ * decode the collected characters and write them to the file, keeping an incomplete quadruple unless this is the end
+ */
+static int flush_encoded(push_stream_t *stream, int final) {
+    size_t len = final ? stream->encodedLen : stream->encodedLen / 4 * 4;
+    size_t decodedLen = base64_decode_n(stream->encoded, len, stream->decoded, sizeof(stream->decoded));
+    if (decodedLen == (size_t) -1)
+        return fail(stream, "Failed to Base64 decode file");
+    if (decodedLen > 0 && fwrite(stream->decoded, 1, decodedLen, stream->out) != decodedLen)
+        return fail(stream, "Failed to write file");
+    if (stream->digest)
+        sha256_update(stream->digest, stream->decoded, decodedLen);
+    stream->written += decodedLen;
+    memmove(stream->encoded, stream->encoded + len, stream->encodedLen - len);
+    stream->encodedLen -= len;
+    return 0;
+}
+
+/**
+ * collect a character of the content, characters outside the Base64 alphabet are skipped like base64_decode() does
+ */
+static int content_char(push_stream_t *stream, char c) {
+    if (stream->padded)
+        return 0;
+    if (c == '=') {
+        stream->padded = 1;
+        return 0;
+    }
+    if (_base64_char_value(c) < 0)
+        return 0;
+    stream->encoded[stream->encodedLen++] = c;
+    if (stream->encodedLen == sizeof(stream->encoded))
+        return flush_encoded(stream, 0);
+    return 0;
+}
+
+/**
+ * collect a run of characters of the content which are all in the Base64 alphabet
+ */
+static int content_run(push_stream_t *stream, const char *data, size_t len) {
+    while (len > 0) {
+        size_t n = sizeof(stream->encoded) - stream->encodedLen;
+        if (n > len)
+            n = len;
+        memcpy(stream->encoded + stream->encodedLen, data, n);
+        stream->encodedLen += n;
+        data += n;
+        len -= n;
+        if (stream->encodedLen == sizeof(stream->encoded) && flush_encoded(stream, 0) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+static int append_json(push_stream_t *stream, char c) {
+    if (stream->jsonLen + 1 >= stream->jsonCapacity) {
+        size_t capacity = stream->jsonCapacity ? stream->jsonCapacity * 2 : 4096;
+        if (capacity > stream->maxJsonSize + 1)
+            capacity = stream->maxJsonSize + 1;
+        if (stream->jsonLen + 1 >= capacity)
+            return fail(stream, "Request JSON is too large");
+        char *json = realloc(stream->json, capacity);
+        if (!json)
+            return fail(stream, "Memory not allocated for request JSON");
+        stream->json = json;
+        stream->jsonCapacity = capacity;
+    }
+    stream->json[stream->jsonLen++] = c;
+    stream->json[stream->jsonLen] = '\0';
+    return 0;
+}
+
+/**
+ * pass one character of the JSON text through the scanner
+ */
+static int json_char(push_stream_t *stream, char c) {
+    if (stream->streaming) {
+        if (stream->unicodeDigits > 0) {
+            stream->unicodeValue = stream->unicodeValue * 16 + hex_value(c);
+            if (0 == --stream->unicodeDigits && stream->unicodeValue < 128)
+                return content_char(stream, (char) stream->unicodeValue);
+            return 0;
+        }
+        if (stream->escape) {
+            stream->escape = 0;
+            if (c == 'u') {
+                stream->unicodeDigits = 4;
+                stream->unicodeValue = 0;
+                return 0;
+            }
+            return c == '/' ? content_char(stream, c) : 0;
+        }
+        if (c == '\\') {
+            stream->escape = 1;
+            return 0;
+        }
+        if (c != '"')
+            return content_char(stream, c);
+        // end of the content, the JSON gets an empty string instead
+        stream->streaming = 0;
+        return append_json(stream, c);
+    }
+
+    if (append_json(stream, c) < 0)
+        return -1;
+
+    if (stream->inString) {
+        if (stream->escape) {
+            stream->escape = 0;
+        } else if (c == '\\') {
+            stream->escape = 1;
+        } else if (c == '"') {
+            size_t fieldLen = strlen(stream->field);
+            stream->inString = 0;
+            stream->keyState = KEY_NONE;
+            if (stream->depth == 1 && !stream->found && stream->jsonLen - stream->keyStart - 2 == fieldLen
+                && 0 == memcmp(stream->json + stream->keyStart + 1, stream->field, fieldLen))
+                stream->keyState = KEY_MATCHED;
+        }
+        return 0;
+    }
+
+    switch (c) {
+        case '"':
+            if (stream->keyState == KEY_COLON) {
+                stream->streaming = 1;
+                stream->found = 1;
+            } else {
+                stream->inString = 1;
+                stream->keyStart = stream->jsonLen - 1;
+            }
+            stream->keyState = KEY_NONE;
+            break;
+        case ':':
+            stream->keyState = stream->keyState == KEY_MATCHED ? KEY_COLON : KEY_NONE;
+            break;
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+            break;
+        case '{':
+        case '[':
+            stream->depth++;
+            stream->keyState = KEY_NONE;
+            break;
+        case '}':
+        case ']':
+            stream->depth--;
+            stream->keyState = KEY_NONE;
+            break;
+        default:
+            stream->keyState = KEY_NONE;
+    }
+    return 0;
+}
+
+/**
+ * pass one byte of a urlencoded form through the form parser, decoding the value of the JSON field
+ */
+static int form_char(push_stream_t *stream, char c) {
+    if (stream->formState == FORM_NAME) {
+        if (c == '=' || c == '&') {
+            stream->formName[stream->formNameLen] = '\0';
+            if (c == '=' && !stream->formFieldSeen && 0 == strcmp(stream->formName, stream->formField)) {
+                stream->formFieldSeen = 1;
+                stream->formState = FORM_VALUE;
+            } else if (c == '=') {
+                stream->formState = FORM_SKIP;
+            }
+            stream->formNameLen = 0;
+        } else if (stream->formNameLen + 1 < MAX_FORM_NAME) {
+            stream->formName[stream->formNameLen++] = c;
+        }
+        return 0;
+    }
+
+    if (c == '&') {
+        stream->formState = FORM_NAME;
+        stream->hexDigits = 0;
+        return 0;
+    }
+    if (stream->formState == FORM_SKIP)
+        return 0;
+
+    if (stream->hexDigits > 0) {
+        stream->hexValue = stream->hexValue * 16 + hex_value(c);
+        return 0 == --stream->hexDigits ? json_char(stream, (char) stream->hexValue) : 0;
+    }
+    if (c == '%') {
+        stream->hexDigits = 2;
+        stream->hexValue = 0;
+        return 0;
+    }
+    return json_char(stream, c == '+' ? ' ' : c);
+}
+
+push_stream_t *push_stream_create(const char *field, const char *formField, FILE *out, size_t maxJsonSize) {
+    push_stream_t *stream = malloc(sizeof(push_stream_t));
+    if (!stream)
+        return NULL;
+    memset(stream, 0, sizeof(push_stream_t));
+    stream->field = field;
+    stream->formField = formField;
+    stream->out = out;
+    stream->maxJsonSize = maxJsonSize;
+    stream->body = BODY_UNKNOWN;
+    stream->formState = FORM_NAME;
+    return stream;
+}
+
+void push_stream_set_digest(push_stream_t *stream, sha256_t *digest) {
+    stream->digest = digest;
+}
+
+int push_stream_write(push_stream_t *stream, const char *data, size_t len) {
+    size_t i;
+    if (stream->error)
+        return -1;
+    for (i = 0; i < len; i++) {
+        char c = data[i];
+
+        // plain Base64 characters of the content are collected in bulk
+        if (stream->streaming && !stream->escape && !stream->unicodeDigits && !stream->padded
+            && (stream->body == BODY_JSON || (stream->formState == FORM_VALUE && !stream->hexDigits))) {
+            size_t run = base64_valid_prefix(data + i, len - i);
+            if (stream->body == BODY_FORM) {
+                const char *space = memchr(data + i, '+', run); /* '+' is an encoded space in a form */
+                if (space)
+                    run = space - (data + i);
+            }
+            if (run > 0) {
+                if (content_run(stream, data + i, run) < 0)
+                    return -1;
+                i += run - 1;
+                continue;
+            }
+        }
+
+        if (stream->body == BODY_UNKNOWN) {
+            if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+                continue;
+            stream->body = c == '{' ? BODY_JSON : BODY_FORM;
+        }
+        if ((stream->body == BODY_JSON ? json_char(stream, c) : form_char(stream, c)) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+int push_stream_finish(push_stream_t *stream) {
+    if (stream->error)
+        return -1;
+    if (stream->encodedLen > 0)
+        return flush_encoded(stream, 1);
+    return 0;
+}
+
+char *push_stream_json(push_stream_t *stream) {
+    if (!stream->json)
+        stream->json = calloc(1, 1);
+    return stream->json;
+}
+
+int push_stream_found(push_stream_t *stream) {
+    return stream->found;
+}
+
+long long push_stream_written(push_stream_t *stream) {
+    return stream->written;
+}
+
+const char *push_stream_error(push_stream_t *stream) {
+    return stream->error ? stream->error : "";
+}
+
+void push_stream_free(push_stream_t *stream) {
+    if (stream) {
+        free(stream->json);
+        free(stream);
+    }
+}
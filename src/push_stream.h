@@ -0,0 +1,90 @@
+#ifndef CK_PUSH_STREAM_H
+#define CK_PUSH_STREAM_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "sha256.h"
+
+/**
+ * Number of Base64 characters decoded at once
+ */
+#define PUSH_STREAM_CHUNK_SIZE (64 * 1024)
+
+/**
+ * Incremental filter for the body of a JSON command, either raw JSON or a urlencoded form with the JSON in one
+ * field. The value of one string field of the top level JSON object is Base64 decoded chunk by chunk into a file
+ * as the body arrives; the rest of the JSON, with that value replaced by an empty string, is kept for cJSON_ParseInSitu().
+ */
+typedef struct push_stream push_stream_t;
+
+/**
+ * create a filter
+ *
+ * @param field name of the JSON field holding the Base64 encoded content
+ * @param formField name of the form field holding the JSON if the body is urlencoded
+ * @param out file the decoded content is written to
+ * @param maxJsonSize maximum size of the JSON kept in memory
+ * @return the filter or NULL if memory could not be allocated
+ */
+push_stream_t *push_stream_create(const char *field, const char *formField, FILE *out, size_t maxJsonSize);
+
+/**
+ * hash the decoded content as it is written
+ *
+ * @param stream the filter
+ * @param digest initialized hash the content is added to, NULL - not hashed
+ */
+void push_stream_set_digest(push_stream_t *stream, sha256_t *digest);
+
+/**
+ * pass the next part of the body through the filter
+ *
+ * @param stream the filter
+ * @param data body bytes
+ * @param len number of bytes
+ * @return 0 on success, -1 on failure (see push_stream_error())
+ */
+int push_stream_write(push_stream_t *stream, const char *data, size_t len);
+
+/**
+ * decode and write the last characters once the whole body has been passed through the filter
+ *
+ * @param stream the filter
+ * @return 0 on success, -1 on failure (see push_stream_error())
+ */
+int push_stream_finish(push_stream_t *stream);
+
+/**
+ * @param stream the filter
+ * @return the JSON without the streamed content (zero terminated), owned by the filter but may be modified,
+ *         NULL if memory could not be allocated
+ */
+char *push_stream_json(push_stream_t *stream);
+
+/**
+ * @param stream the filter
+ * @return 1 if the content field was found, 0 otherwise
+ */
+int push_stream_found(push_stream_t *stream);
+
+/**
+ * @param stream the filter
+ * @return number of decoded bytes written to the file
+ */
+long long push_stream_written(push_stream_t *stream);
+
+/**
+ * @param stream the filter
+ * @return description of the failure
+ */
+const char *push_stream_error(push_stream_t *stream);
+
+/**
+ * free the filter (the file is not closed)
+ *
+ * @param stream the filter, may be NULL
+ */
+void push_stream_free(push_stream_t *stream);
+
+#endif
@@ -0,0 +1,247 @@
+#include <string.h>
+
+#include "sha256.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SHA256_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SHA256_TARGET(isa)
+#else
+#include <cpuid.h>
+#define SHA256_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+/**
+ * hashes whole blocks of 64 bytes
+ */
+typedef void (*blocks_kernel_t)(uint32_t state[8], const unsigned char *data, size_t count);
+
+static void transform(uint32_t state[8], const unsigned char *block) {
+    uint32_t w[64];
+    int i;
+    for (i = 0; i < 16; i++) {
+        w[i] = (uint32_t) block[4 * i] << 24 | (uint32_t) block[4 * i + 1] << 16
+               | (uint32_t) block[4 * i + 2] << 8 | (uint32_t) block[4 * i + 3];
+    }
+    for (i = 16; i < 64; i++) {
+        uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (i = 0; i < 64; i++) {
+        uint32_t t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+        uint32_t t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+static void blocks_scalar(uint32_t state[8], const unsigned char *data, size_t count) {
+    while (count--) {
+        transform(state, data);
+        data += 64;
+    }
+}
+
+#ifdef SHA256_X86
+
+/**
+ * four rounds of group g: cur holds its message words, the schedule of the following groups is extended in next
+ * and prev (the group before, which becomes the one three groups ahead)
+ */
+#define SHA_ROUNDS4(g, cur, next, prev) do { \
+        __m128i msg = _mm_add_epi32(cur, _mm_loadu_si128((const __m128i *) &K[4 * (g)])); \
+        state1 = _mm_sha256rnds2_epu32(state1, state0, msg); \
+        if ((g) >= 3 && (g) < 15) { \
+            next = _mm_sha256msg2_epu32(_mm_add_epi32(next, _mm_alignr_epi8(cur, prev, 4)), cur); \
+        } \
+        state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0E)); \
+        if ((g) >= 1 && (g) < 13) { \
+            prev = _mm_sha256msg1_epu32(prev, cur); \
+        } \
+    } while (0)
+
+/**
+ * SHA extensions: two rounds per instruction, the message schedule four words at a time
+ */
+SHA256_TARGET("sha,sse4.1,ssse3")
+static void blocks_sha(uint32_t state[8], const unsigned char *data, size_t count) {
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) &state[0]), 0xB1);     /* CDAB */
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) &state[4]), 0x1B);  /* EFGH */
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);                                        /* ABEF */
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);                                             /* CDGH */
+
+    while (count--) {
+        __m128i abef = state0, cdgh = state1;
+        __m128i m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) data), byteSwap);
+        __m128i m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 16)), byteSwap);
+        __m128i m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 32)), byteSwap);
+        __m128i m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 48)), byteSwap);
+        int g;
+        for (g = 0; g < 16; g += 4) {
+            SHA_ROUNDS4(g, m0, m1, m3);
+            SHA_ROUNDS4(g + 1, m1, m2, m0);
+            SHA_ROUNDS4(g + 2, m2, m3, m1);
+            SHA_ROUNDS4(g + 3, m3, m0, m2);
+        }
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+        data += 64;
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);                  /* FEBA */
+    state1 = _mm_shuffle_epi32(state1, 0xB1);               /* DCHG */
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);            /* DCBA */
+    state1 = _mm_alignr_epi8(state1, tmp, 8);               /* ABEF */
+    _mm_storeu_si128((__m128i *) &state[0], state0);
+    _mm_storeu_si128((__m128i *) &state[4], state1);
+}
+
+static void cpuid(unsigned int leaf, unsigned int regs[4]) {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuidex(info, (int) leaf, 0);
+    regs[0] = info[0];
+    regs[1] = info[1];
+    regs[2] = info[2];
+    regs[3] = info[3];
+#else
+    __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+#endif
+
+static blocks_kernel_t blocks_kernel = blocks_scalar;
+static const char *implementation = "scalar";
+static int initialized = 0;
+
+void sha256_select(void) {
+#ifdef SHA256_X86
+    unsigned int regs[4];
+    cpuid(0, regs);
+    if (regs[0] >= 7) {
+        cpuid(1, regs);
+        int sse41 = (regs[2] >> 19) & 1;
+        int ssse3 = (regs[2] >> 9) & 1;
+        cpuid(7, regs);
+        if (sse41 && ssse3 && ((regs[1] >> 29) & 1)) {
+            blocks_kernel = blocks_sha;
+            implementation = "sha";
+        }
+    }
+#endif
+    initialized = 1;
+}
+
+const char *sha256_implementation(void) {
+    if (!initialized) {
+        sha256_select();
+    }
+    return implementation;
+}
+
+void sha256_init(sha256_t *ctx) {
+    if (!initialized) {
+        sha256_select();
+    }
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(ctx->state, initial, sizeof(initial));
+    ctx->length = 0;
+    ctx->blockLen = 0;
+}
+
+void sha256_update(sha256_t *ctx, const void *data, size_t len) {
+    const unsigned char *p = data;
+    ctx->length += len;
+    if (ctx->blockLen > 0) {
+        size_t n = 64 - ctx->blockLen < len ? 64 - ctx->blockLen : len;
+        memcpy(ctx->block + ctx->blockLen, p, n);
+        ctx->blockLen += n;
+        p += n;
+        len -= n;
+        if (ctx->blockLen < 64) {
+            return;
+        }
+        blocks_kernel(ctx->state, ctx->block, 1);
+        ctx->blockLen = 0;
+    }
+    // whole blocks are hashed where they are
+    if (len >= 64) {
+        blocks_kernel(ctx->state, p, len / 64);
+        p += len / 64 * 64;
+        len %= 64;
+    }
+    memcpy(ctx->block, p, len);
+    ctx->blockLen = len;
+}
+
+void sha256_final(sha256_t *ctx, unsigned char digest[SHA256_DIGEST_SIZE]) {
+    uint64_t bits = ctx->length * 8;
+    int i;
+    ctx->block[ctx->blockLen++] = 0x80;
+    if (ctx->blockLen > 56) {
+        memset(ctx->block + ctx->blockLen, 0, 64 - ctx->blockLen);
+        blocks_kernel(ctx->state, ctx->block, 1);
+        ctx->blockLen = 0;
+    }
+    memset(ctx->block + ctx->blockLen, 0, 56 - ctx->blockLen);
+    for (i = 0; i < 8; i++) {
+        ctx->block[63 - i] = (unsigned char) (bits >> (8 * i));
+    }
+    blocks_kernel(ctx->state, ctx->block, 1);
+    for (i = 0; i < 8; i++) {
+        digest[4 * i] = (unsigned char) (ctx->state[i] >> 24);
+        digest[4 * i + 1] = (unsigned char) (ctx->state[i] >> 16);
+        digest[4 * i + 2] = (unsigned char) (ctx->state[i] >> 8);
+        digest[4 * i + 3] = (unsigned char) ctx->state[i];
+    }
+}
+
+void sha256_final_hex(sha256_t *ctx, char hex[SHA256_HEX_SIZE]) {
+    static const char DIGITS[] = "0123456789abcdef";
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    int i;
+    sha256_final(ctx, digest);
+    for (i = 0; i < SHA256_DIGEST_SIZE; i++) {
+        hex[2 * i] = DIGITS[digest[i] >> 4];
+        hex[2 * i + 1] = DIGITS[digest[i] & 15];
+    }
+    hex[2 * SHA256_DIGEST_SIZE] = '\0';
+}
@@ -0,0 +1,61 @@
+#ifndef CK_SHA256_H
+#define CK_SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_DIGEST_SIZE 32
+
+/**
+ * length of the hexadecimal form of a digest, with the terminating zero
+ */
+#define SHA256_HEX_SIZE (2 * SHA256_DIGEST_SIZE + 1)
+
+/**
+ * SHA-256 (FIPS 180-4) of data passed in parts
+ */
+typedef struct sha256 {
+    uint32_t state[8];
+    uint64_t length;                /* bytes passed so far */
+    unsigned char block[64];        /* incomplete block */
+    size_t blockLen;
+} sha256_t;
+
+/**
+ * select the fastest implementation the CPU supports, called automatically on first use
+ */
+void sha256_select(void);
+
+/**
+ * @return name of the selected implementation ("sha" for the x86 SHA extensions or "scalar")
+ */
+const char *sha256_implementation(void);
+
+void sha256_init(sha256_t *ctx);
+
+/**
+ * hash the next part of the data
+ *
+ * @param ctx the context
+ * @param data the bytes
+ * @param len number of bytes
+ */
+void sha256_update(sha256_t *ctx, const void *data, size_t len);
+
+/**
+ * finish the hash, the context has to be initialized again before it is reused
+ *
+ * @param ctx the context
+ * @param digest receives the hash
+ */
+void sha256_final(sha256_t *ctx, unsigned char digest[SHA256_DIGEST_SIZE]);
+
+/**
+ * finish the hash and write it as lower case hexadecimal digits
+ *
+ * @param ctx the context
+ * @param hex receives the zero terminated digits
+ */
+void sha256_final_hex(sha256_t *ctx, char hex[SHA256_HEX_SIZE]);
+
+#endif
@@ -0,0 +1,369 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#endif
+
+#ifdef __linux__
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "shell_runner.h"
+
+#define SHELL_READ_SIZE (64 * 1024)
+#define SHELL_BUFFER_MIN_SIZE 4096
+
+#ifndef _WIN32
+extern char **environ;
+
+/**
+ * create a pipe whose ends are not inherited by other commands
+ */
+static int open_pipe(int fds[2]) {
+    if (pipe(fds) < 0) {
+        return -1;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return 0;
+}
+
+/**
+ * read from both pipes as data arrives, so that the command never blocks on a full pipe, until both are closed
+ */
+static void drain(int outFd, int errFd, shell_output_handler_t handler, void *ctx) {
+    char buf[SHELL_READ_SIZE];
+    struct pollfd fds[2];
+    int streams[2] = {SHELL_STDOUT, SHELL_STDERR};
+    int open = 2;
+    int i;
+    fds[0].fd = outFd;
+    fds[1].fd = errFd;
+    fds[0].events = fds[1].events = POLLIN;
+    while (open > 0) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (i = 0; i < 2; i++) {
+            if (fds[i].fd < 0 || !fds[i].revents) {
+                continue;
+            }
+            ssize_t n = read(fds[i].fd, buf, sizeof(buf));
+            if (n > 0) {
+                handler(ctx, streams[i], buf, (size_t) n);
+            } else if (n == 0 || errno != EINTR) {
+                // a negative descriptor is ignored by poll() from now on
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                open--;
+            }
+        }
+    }
+    for (i = 0; i < 2; i++) {
+        if (fds[i].fd >= 0) {
+            close(fds[i].fd);
+        }
+    }
+}
+
+static void reset_measurement(shell_measurement_t *measurement) {
+    memset(measurement, 0, sizeof(shell_measurement_t));
+    measurement->cycles = -1;
+    measurement->instructions = -1;
+    measurement->cacheMisses = -1;
+    measurement->branchMisses = -1;
+    measurement->taskClock = -1;
+}
+
+static double monotonic_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#ifdef __linux__
+#define COUNTER_COUNT 5
+
+/* counters in the order of the fields of shell_measurement_t */
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} COUNTERS[COUNTER_COUNT] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK}
+};
+
+/**
+ * open a counter of the process and the children it starts, which begins counting when the process executes
+ * the shell
+ *
+ * @return the descriptor or -1 if the kernel does not allow the counter
+ */
+static int open_counter(pid_t pid, int counter) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = COUNTERS[counter].type;
+    attr.config = COUNTERS[counter].config;
+    attr.disabled = 1;
+    attr.enable_on_exec = 1;
+    attr.inherit = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    int fd = (int) syscall(__NR_perf_event_open, &attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    if (fd < 0 && (EACCES == errno || EPERM == errno)) {
+        // perf_event_paranoid 2 still allows counting user space only
+        attr.exclude_kernel = 1;
+        fd = (int) syscall(__NR_perf_event_open, &attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    }
+    return fd;
+}
+
+/**
+ * @return the value of a counter, scaled up if it had to share the hardware with other counters, -1 if unknown
+ */
+static long long read_counter(int fd) {
+    uint64_t values[3];     /* value, time enabled, time running */
+    if (fd < 0 || read(fd, values, sizeof(values)) != (ssize_t) sizeof(values)) {
+        return -1;
+    }
+    if (values[2] == 0) {
+        return values[1] == 0 ? (long long) values[0] : -1;
+    }
+    if (values[2] < values[1]) {
+        return (long long) ((double) values[0] * values[1] / values[2]);
+    }
+    return (long long) values[0];
+}
+
+/**
+ * start the shell with fork(), holding it back until its counters are attached: posix_spawn() can not wait
+ */
+static pid_t spawn_counted(char *argv[], int outFd, int errFd, int counters[COUNTER_COUNT]) {
+    int goPipe[2];
+    int i;
+    if (open_pipe(goPipe) < 0) {
+        return -1;
+    }
+    pid_t pid = fork();
+    if (0 == pid) {
+        // only async signal safe calls from here on, the server has other threads
+        char go;
+        dup2(outFd, 1);
+        dup2(errFd, 2);
+        close(goPipe[1]);
+        while (read(goPipe[0], &go, 1) < 0 && EINTR == errno) {
+        }
+        execve("/bin/sh", argv, environ);
+        _exit(127);
+    }
+    close(goPipe[0]);
+    if (pid > 0) {
+        for (i = 0; i < COUNTER_COUNT; i++) {
+            counters[i] = open_counter(pid, i);
+        }
+    }
+    close(goPipe[1]);   /* lets the child go on */
+    return pid;
+}
+#endif
+
+int shell_run(const char *command, shell_output_handler_t handler, void *ctx, shell_status_t *status,
+              shell_measurement_t *measurement) {
+    int outPipe[2], errPipe[2];
+    if (open_pipe(outPipe) < 0) {
+        return -1;
+    }
+    if (open_pipe(errPipe) < 0) {
+        close(outPipe[0]);
+        close(outPipe[1]);
+        return -1;
+    }
+
+    char *argv[] = {"sh", "-c", (char *) command, NULL};
+    pid_t pid;
+    int rc;
+    double started = 0;
+#ifdef __linux__
+    int counters[COUNTER_COUNT];
+    int i;
+    for (i = 0; i < COUNTER_COUNT; i++) {
+        counters[i] = -1;
+    }
+#endif
+    if (measurement) {
+        reset_measurement(measurement);
+        started = monotonic_time();
+    }
+#ifdef __linux__
+    if (measurement) {
+        pid = spawn_counted(argv, outPipe[1], errPipe[1], counters);
+        rc = pid < 0 ? errno : 0;
+    } else
+#endif
+    {
+        // posix_spawn() starts the shell without copying the page tables of the server like fork() would
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, outPipe[1], 1);
+        posix_spawn_file_actions_adddup2(&actions, errPipe[1], 2);
+        rc = posix_spawn(&pid, "/bin/sh", &actions, NULL, argv, environ);
+        posix_spawn_file_actions_destroy(&actions);
+    }
+    close(outPipe[1]);
+    close(errPipe[1]);
+    if (rc != 0) {
+        close(outPipe[0]);
+        close(errPipe[0]);
+        errno = rc;
+        return -1;
+    }
+
+    drain(outPipe[0], errPipe[0], handler, ctx);
+
+    // wait4() also reports the resources used by the children the shell has waited for
+    int waitStatus;
+    struct rusage usage;
+    while (wait4(pid, &waitStatus, 0, &usage) < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    if (WIFSIGNALED(waitStatus)) {
+        status->exitCode = -1;
+        status->signal = WTERMSIG(waitStatus);
+    } else {
+        status->exitCode = WEXITSTATUS(waitStatus);
+        status->signal = 0;
+    }
+
+    if (measurement) {
+        measurement->wallTime = monotonic_time() - started;
+        measurement->userTime = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+        measurement->systemTime = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+#ifdef __APPLE__
+        measurement->maxRss = usage.ru_maxrss / 1024;   /* bytes there */
+#else
+        measurement->maxRss = usage.ru_maxrss;
+#endif
+        measurement->voluntaryContextSwitches = usage.ru_nvcsw;
+        measurement->involuntaryContextSwitches = usage.ru_nivcsw;
+#ifdef __linux__
+        measurement->cycles = read_counter(counters[0]);
+        measurement->instructions = read_counter(counters[1]);
+        measurement->cacheMisses = read_counter(counters[2]);
+        measurement->branchMisses = read_counter(counters[3]);
+        measurement->taskClock = read_counter(counters[4]);
+        for (i = 0; i < COUNTER_COUNT; i++) {
+            if (counters[i] >= 0) {
+                close(counters[i]);
+            }
+        }
+#endif
+    }
+    return 0;
+}
+#else
+int shell_run(const char *command, shell_output_handler_t handler, void *ctx, shell_status_t *status,
+              shell_measurement_t *measurement) {
+    char buf[SHELL_READ_SIZE];
+    ULONGLONG started = GetTickCount64();
+    FILE *fp = _popen(command, "r");
+    if (!fp) {
+        return -1;
+    }
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        handler(ctx, SHELL_STDOUT, buf, n);
+    }
+    status->exitCode = _pclose(fp);
+    status->signal = 0;
+    if (measurement) {
+        // only the wall time is measured here
+        measurement->wallTime = (double) (GetTickCount64() - started) / 1000;
+        measurement->userTime = -1;
+        measurement->systemTime = -1;
+        measurement->maxRss = -1;
+        measurement->voluntaryContextSwitches = -1;
+        measurement->involuntaryContextSwitches = -1;
+        measurement->cycles = -1;
+        measurement->instructions = -1;
+        measurement->cacheMisses = -1;
+        measurement->branchMisses = -1;
+        measurement->taskClock = -1;
+    }
+    return 0;
+}
+#endif
+
+void shell_buffer_append(shell_buffer_t *buffer, const char *data, size_t len) {
+    if (buffer->error) {
+        return;
+    }
+    if (buffer->capacity - buffer->len <= len) {
+        size_t capacity = buffer->capacity ? buffer->capacity : SHELL_BUFFER_MIN_SIZE;
+        while (capacity - buffer->len <= len) {
+            capacity *= 2;
+        }
+        char *grown = realloc(buffer->data, capacity);
+        if (!grown) {
+            buffer->error = 1;
+            return;
+        }
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->len, data, len);
+    buffer->len += len;
+    buffer->data[buffer->len] = '\0';
+}
+
+typedef struct {
+    shell_buffer_t *out;
+    shell_buffer_t *err;
+} capture_t;
+
+static void capture_output(void *ctx, int stream, const char *data, size_t len) {
+    capture_t *capture = ctx;
+    shell_buffer_append(stream == SHELL_STDOUT ? capture->out : capture->err, data, len);
+}
+
+int shell_capture(const char *command, shell_buffer_t *out, shell_buffer_t *err, shell_status_t *status,
+                  shell_measurement_t *measurement) {
+    capture_t capture;
+    memset(out, 0, sizeof(shell_buffer_t));
+    memset(err, 0, sizeof(shell_buffer_t));
+    capture.out = out;
+    capture.err = err;
+    if (shell_run(command, capture_output, &capture, status, measurement) < 0) {
+        shell_buffer_free(out);
+        shell_buffer_free(err);
+        return -1;
+    }
+    return 0;
+}
+
+void shell_buffer_free(shell_buffer_t *buffer) {
+    free(buffer->data);
+    memset(buffer, 0, sizeof(shell_buffer_t));
+}
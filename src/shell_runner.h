@@ -0,0 +1,102 @@
+#ifndef CK_SHELL_RUNNER_H
+#define CK_SHELL_RUNNER_H
+
+#include <stddef.h>
+
+/**
+ * Output streams of a command
+ */
+#define SHELL_STDOUT 1
+#define SHELL_STDERR 2
+
+/**
+ * How a command ended
+ */
+typedef struct shell_status {
+    int exitCode;   /* exit status of the command, -1 if it was killed by a signal */
+    int signal;     /* signal which killed the command, 0 if it exited */
+} shell_status_t;
+
+/**
+ * Resource usage of a command and its children, collected on request. Values which are not available
+ * (no hardware counters, perf_event_paranoid, counters outside of Linux, rusage on Windows) are -1.
+ */
+typedef struct shell_measurement {
+    double wallTime;                    /* seconds from start to exit, monotonic clock */
+    double userTime;                    /* seconds */
+    double systemTime;                  /* seconds */
+    long maxRss;                        /* kilobytes */
+    long voluntaryContextSwitches;
+    long involuntaryContextSwitches;
+    long long cycles;
+    long long instructions;
+    long long cacheMisses;
+    long long branchMisses;
+    long long taskClock;                /* nanoseconds */
+} shell_measurement_t;
+
+/**
+ * Receives the output of a command as it is read.
+ *
+ * @param ctx context given to shell_run()
+ * @param stream SHELL_STDOUT or SHELL_STDERR
+ * @param data the output
+ * @param len its length
+ */
+typedef void (*shell_output_handler_t)(void *ctx, int stream, const char *data, size_t len);
+
+/**
+ * Output of a command collected in memory
+ */
+typedef struct shell_buffer {
+    char *data;         /* zero terminated, NULL if there was no output */
+    size_t len;
+    size_t capacity;
+    int error;          /* memory could not be allocated, the rest of the output is missing */
+} shell_buffer_t;
+
+/**
+ * run a command once with the system shell, reading its stdout and stderr concurrently until both are closed
+ * (on Windows stderr is not captured and goes to the console of the server)
+ *
+ * @param command the command
+ * @param handler receives the output
+ * @param ctx passed to the handler
+ * @param status receives the exit status
+ * @param measurement receives the resource usage, NULL if it is not needed. Hardware counters are only enabled
+ *                    once the shell is executed, so the server itself is not counted.
+ * @return 0 on success, -1 if the command could not be started
+ */
+int shell_run(const char *command, shell_output_handler_t handler, void *ctx, shell_status_t *status,
+              shell_measurement_t *measurement);
+
+/**
+ * run a command like shell_run() and collect its output
+ *
+ * @param command the command
+ * @param out receives stdout, to be released with shell_buffer_free()
+ * @param err receives stderr, to be released with shell_buffer_free()
+ * @param status receives the exit status
+ * @param measurement receives the resource usage, NULL if it is not needed
+ * @return 0 on success, -1 if the command could not be started
+ */
+int shell_capture(const char *command, shell_buffer_t *out, shell_buffer_t *err, shell_status_t *status,
+                  shell_measurement_t *measurement);
+
+/**
+ * append output to a buffer, which grows by doubling so that collecting it takes linear time
+ *
+ * @param buffer the buffer, zeroed before first use
+ * @param data the output
+ * @param len its length
+ */
+void shell_buffer_append(shell_buffer_t *buffer, const char *data, size_t len);
+
+/**
+ * release collected output
+ *
+ * @param buffer the buffer
+ */
+void shell_buffer_free(shell_buffer_t *buffer);
+
+#endif
@@ -0,0 +1,543 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tar_stream.h"
+
+#define NAME_SIZE 100
+#define PREFIX_SIZE 155
+#define OCTAL_MAX 077777777777LL    /* largest number of a 12 byte octal field */
+#define META_MAX (64 * 1024)        /* largest pax extended header read */
+
+/* offsets of the ustar header fields */
+#define FIELD_NAME 0
+#define FIELD_MODE 100
+#define FIELD_UID 108
+#define FIELD_GID 116
+#define FIELD_SIZE 124
+#define FIELD_MTIME 136
+#define FIELD_CHECKSUM 148
+#define FIELD_TYPE 156
+#define FIELD_MAGIC 257
+#define FIELD_VERSION 263
+#define FIELD_PREFIX 345
+
+enum {
+    READ_HEADER,
+    READ_CONTENT,
+    READ_META,                  /* content of a pax extended header or a GNU long name */
+    READ_PADDING,
+    READ_END                    /* the zero blocks have been seen */
+};
+
+enum {
+    META_LONG_NAME,
+    META_PAX,
+    META_SKIP                   /* global pax headers and GNU long link names are not used */
+};
+
+struct tar_reader {
+    tar_handler_t handler;
+    void *ctx;
+    int state;
+    const char *error;
+    unsigned char block[TAR_BLOCK_SIZE];
+    size_t fill;                /* bytes of the header in block */
+    int zeroBlocks;
+    long long remaining;        /* bytes of content or meta data still to come */
+    size_t padding;             /* zero bytes still to skip after them */
+    int meta;
+    char *metaBuf;
+    size_t metaLen;
+    int hasLongName;            /* the next entry is named by longName */
+    long long paxSize;          /* size of the next entry from a pax header, -1 if none */
+    char longName[TAR_NAME_MAX + 1];
+    char name[TAR_NAME_MAX + 1];
+};
+
+static int fail(tar_reader_t *reader, const char *error) {
+    reader->error = error;
+    return -1;
+}
+
+size_t tar_padding(long long size) {
+    return (size_t) ((TAR_BLOCK_SIZE - size % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE);
+}
+
+/**
+ * the name as it is stored: directories end with '/'
+ */
+static size_t full_name(const tar_entry_t *entry, char name[TAR_NAME_MAX + 2]) {
+    size_t len = strlen(entry->name);
+    if (len > TAR_NAME_MAX) {
+        len = TAR_NAME_MAX;
+    }
+    memcpy(name, entry->name, len);
+    if (TAR_DIRECTORY == entry->type) {
+        name[len++] = '/';
+    }
+    name[len] = '\0';
+    return len;
+}
+
+/**
+ * position of the '/' which splits a name into the prefix and name fields, -1 if it does not fit them
+ */
+static long split_name(const char *name, size_t len) {
+    size_t i;
+    for (i = 0; i < len && i <= PREFIX_SIZE; i++) {
+        if ('/' == name[i] && len - i - 1 <= NAME_SIZE && len - i - 1 > 0) {
+            return (long) i;
+        }
+    }
+    return -1;
+}
+
+static size_t digits(size_t n) {
+    size_t count = 1;
+    while (n >= 10) {
+        n /= 10;
+        count++;
+    }
+    return count;
+}
+
+/**
+ * length of the pax record "<length> path=<name>\n", which counts its own digits
+ */
+static size_t path_record_size(size_t nameLen) {
+    size_t len = 1 + strlen("path=") + nameLen + 1;
+    size_t size = len + digits(len);
+    return len + digits(size);
+}
+
+size_t tar_header_size(const tar_entry_t *entry) {
+    char name[TAR_NAME_MAX + 2];
+    size_t len = full_name(entry, name);
+    if (len <= NAME_SIZE || split_name(name, len) >= 0) {
+        return TAR_BLOCK_SIZE;
+    }
+    size_t record = path_record_size(len);
+    return TAR_BLOCK_SIZE + record + tar_padding((long long) record) + TAR_BLOCK_SIZE;
+}
+
+static void put_octal(char *field, size_t size, long long value) {
+    // digits, then a terminating NUL
+    size_t i = size - 1;
+    field[i] = '\0';
+    while (i > 0) {
+        field[--i] = (char) ('0' + (value & 7));
+        value >>= 3;
+    }
+}
+
+static void put_size(char *field, long long value) {
+    if (value <= OCTAL_MAX) {
+        put_octal(field, 12, value);
+        return;
+    }
+    // GNU base-256: the high bit of the first byte is set, the number follows big endian
+    int i;
+    for (i = 11; i > 0; i--) {
+        field[i] = (char) (value & 0xff);
+        value >>= 8;
+    }
+    field[0] = (char) 0x80;
+}
+
+static void put_checksum(char *block) {
+    unsigned long sum = 0;
+    int i;
+    memset(block + FIELD_CHECKSUM, ' ', 8);
+    for (i = 0; i < TAR_BLOCK_SIZE; i++) {
+        sum += (unsigned char) block[i];
+    }
+    // six digits, NUL and space
+    put_octal(block + FIELD_CHECKSUM, 7, (long long) sum);
+}
+
+static void put_header(char *block, const char *name, size_t len, char type, long long size, int mode,
+                       long long mtime) {
+    memset(block, 0, TAR_BLOCK_SIZE);
+    long split = len > NAME_SIZE ? split_name(name, len) : -1;
+    if (split >= 0) {
+        memcpy(block + FIELD_PREFIX, name, (size_t) split);
+        memcpy(block + FIELD_NAME, name + split + 1, len - split - 1);
+    } else {
+        // names longer than the field are cut, the pax header before has them in full
+        memcpy(block + FIELD_NAME, name, len < NAME_SIZE ? len : NAME_SIZE);
+    }
+    put_octal(block + FIELD_MODE, 8, mode & 07777);
+    put_octal(block + FIELD_UID, 8, 0);
+    put_octal(block + FIELD_GID, 8, 0);
+    put_size(block + FIELD_SIZE, size);
+    put_octal(block + FIELD_MTIME, 12, mtime > 0 && mtime <= OCTAL_MAX ? mtime : 0);
+    block[FIELD_TYPE] = type;
+    memcpy(block + FIELD_MAGIC, "ustar", 6);
+    memcpy(block + FIELD_VERSION, "00", 2);
+    put_checksum(block);
+}
+
+size_t tar_write_header(char *buf, const tar_entry_t *entry) {
+    char name[TAR_NAME_MAX + 2];
+    size_t len = full_name(entry, name);
+    char type = TAR_DIRECTORY == entry->type ? '5' : '0';
+    long long size = TAR_DIRECTORY == entry->type ? 0 : entry->size;
+    size_t written = 0;
+    if (len > NAME_SIZE && split_name(name, len) < 0) {
+        size_t record = path_record_size(len);
+        size_t padding = tar_padding((long long) record);
+        put_header(buf, "PaxHeader", 9, 'x', (long long) record, 0644, entry->mtime);
+        sprintf(buf + TAR_BLOCK_SIZE, "%lu path=%s\n", (unsigned long) record, name);
+        memset(buf + TAR_BLOCK_SIZE + record, 0, padding);
+        written = TAR_BLOCK_SIZE + record + padding;
+    }
+    put_header(buf + written, name, len, type, size, entry->mode, entry->mtime);
+    return written + TAR_BLOCK_SIZE;
+}
+
+tar_reader_t *tar_reader_create(const tar_handler_t *handler, void *ctx) {
+    tar_reader_t *reader = calloc(1, sizeof(tar_reader_t));
+    if (!reader) {
+        return NULL;
+    }
+    reader->handler = *handler;
+    reader->ctx = ctx;
+    reader->state = READ_HEADER;
+    reader->paxSize = -1;
+    return reader;
+}
+
+/**
+ * a number field, octal or GNU base-256
+ */
+static long long parse_number(const unsigned char *field, size_t size) {
+    long long value = 0;
+    size_t i = 0;
+    if (field[0] & 0x80) {
+        if (0xff == field[0]) {
+            return -1; /* negative */
+        }
+        value = field[0] & 0x7f;
+        for (i = 1; i < size; i++) {
+            if (value > (1LL << 54)) {
+                return -1;
+            }
+            value = (value << 8) | field[i];
+        }
+        return value;
+    }
+    while (i < size && ' ' == field[i]) {
+        i++;
+    }
+    for (; i < size && field[i] >= '0' && field[i] <= '7'; i++) {
+        if (value > (1LL << 59)) {
+            return -1;
+        }
+        value = value * 8 + (field[i] - '0');
+    }
+    if (i < size && '\0' != field[i] && ' ' != field[i]) {
+        return -1;
+    }
+    return value;
+}
+
+static int valid_checksum(const unsigned char *block) {
+    long long stored = parse_number(block + FIELD_CHECKSUM, 8);
+    long unsignedSum = 0, signedSum = 0;
+    int i;
+    for (i = 0; i < TAR_BLOCK_SIZE; i++) {
+        int inField = i >= FIELD_CHECKSUM && i < FIELD_CHECKSUM + 8;
+        unsignedSum += inField ? ' ' : block[i];
+        signedSum += inField ? ' ' : (signed char) block[i];
+    }
+    // some old archivers summed signed bytes
+    return stored == unsignedSum || stored == signedSum;
+}
+
+static int is_zero_block(const unsigned char *block) {
+    int i;
+    for (i = 0; i < TAR_BLOCK_SIZE; i++) {
+        if (block[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * the name of the entry in the header block, unless a long name came before it
+ */
+static const char *entry_name(tar_reader_t *reader) {
+    const unsigned char *block = reader->block;
+    char *name = reader->name;
+    if (reader->hasLongName) {
+        strcpy(name, reader->longName);
+    } else {
+        size_t len = 0;
+        // the prefix field only in POSIX archives, GNU ones use the space for other things
+        if (0 == memcmp(block + FIELD_MAGIC, "ustar", 6) && block[FIELD_PREFIX]) {
+            const unsigned char *prefixEnd = memchr(block + FIELD_PREFIX, '\0', PREFIX_SIZE);
+            len = prefixEnd ? (size_t) (prefixEnd - block - FIELD_PREFIX) : PREFIX_SIZE;
+            memcpy(name, block + FIELD_PREFIX, len);
+            name[len++] = '/';
+        }
+        const unsigned char *nameEnd = memchr(block + FIELD_NAME, '\0', NAME_SIZE);
+        size_t nameLen = nameEnd ? (size_t) (nameEnd - block - FIELD_NAME) : NAME_SIZE;
+        memcpy(name + len, block + FIELD_NAME, nameLen);
+        name[len + nameLen] = '\0';
+    }
+    while ('.' == name[0] && '/' == name[1]) {
+        memmove(name, name + 2, strlen(name + 2) + 1);
+    }
+    return name;
+}
+
+static void start_meta(tar_reader_t *reader, int meta, long long size) {
+    reader->meta = meta;
+    reader->metaLen = 0;
+    reader->remaining = size;
+    reader->padding = tar_padding(size);
+    reader->state = READ_META;
+}
+
+/**
+ * the content of an entry is complete, its padding follows
+ */
+static int end_content(tar_reader_t *reader) {
+    reader->state = reader->padding > 0 ? READ_PADDING : READ_HEADER;
+    return reader->handler.end(reader->ctx) < 0 ? fail(reader, "Stopped by the handler") : 0;
+}
+
+static int parse_header(tar_reader_t *reader) {
+    const unsigned char *block = reader->block;
+    if (is_zero_block(block)) {
+        if (++reader->zeroBlocks == 2) {
+            reader->state = READ_END;
+        }
+        return 0;
+    }
+    reader->zeroBlocks = 0;
+    if (!valid_checksum(block)) {
+        return fail(reader, "Invalid tar header checksum");
+    }
+    long long size = parse_number(block + FIELD_SIZE, 12);
+    if (size < 0) {
+        return fail(reader, "Invalid size in tar header");
+    }
+
+    char type = (char) block[FIELD_TYPE];
+    switch (type) {
+        case 'L':
+            if (size > TAR_NAME_MAX + 1) {
+                return fail(reader, "Name in archive is too long");
+            }
+            start_meta(reader, META_LONG_NAME, size);
+            return 0;
+        case 'x':
+            if (size > META_MAX) {
+                return fail(reader, "Extended header in archive is too large");
+            }
+            start_meta(reader, META_PAX, size);
+            return 0;
+        case 'g':
+        case 'K':
+            start_meta(reader, META_SKIP, size);
+            return 0;
+        default:
+            break;
+    }
+
+    tar_entry_t entry;
+    entry.name = entry_name(reader);
+    size_t len = strlen(reader->name);
+    if ('5' == type || (('0' == type || '\0' == type) && len > 0 && '/' == reader->name[len - 1])) {
+        entry.type = TAR_DIRECTORY;
+    } else if ('0' == type || '\0' == type || '7' == type) {
+        entry.type = TAR_FILE;
+    } else {
+        entry.type = TAR_OTHER;
+    }
+    while (len > 1 && '/' == reader->name[len - 1]) {
+        reader->name[--len] = '\0';
+    }
+    if (0 == len) {
+        strcpy(reader->name, ".");
+    }
+    if (reader->paxSize >= 0 && TAR_FILE == entry.type) {
+        size = reader->paxSize;
+    }
+    entry.size = TAR_FILE == entry.type ? size : 0;
+    entry.mode = (int) parse_number(block + FIELD_MODE, 8);
+    entry.mtime = parse_number(block + FIELD_MTIME, 12);
+    reader->hasLongName = 0;
+    reader->paxSize = -1;
+
+    if (reader->handler.begin(reader->ctx, &entry) < 0) {
+        return fail(reader, "Stopped by the handler");
+    }
+    reader->remaining = size;
+    reader->padding = tar_padding(size);
+    if (0 == size) {
+        return end_content(reader);
+    }
+    reader->state = READ_CONTENT;
+    return 0;
+}
+
+/**
+ * the records of a pax extended header, like "30 path=some/long/name.txt\n"
+ */
+static int parse_pax(tar_reader_t *reader) {
+    const char *p = reader->metaBuf;
+    const char *end = p + reader->metaLen;
+    while (p < end && '\0' != *p) {
+        // the length is read by hand: the buffer is not terminated and strtoul() accepts signs and blanks
+        const char *space = p;
+        size_t len = 0;
+        while (space < end && *space >= '0' && *space <= '9' && len <= META_MAX) {
+            len = len * 10 + (size_t) (*space - '0');
+            space++;
+        }
+        // the shortest record is "<length> k=\n"
+        if (space == p || space == end || ' ' != *space || len > (size_t) (end - p)
+                || len < (size_t) (space - p) + strlen(" k=\n") || '\n' != p[len - 1]) {
+            return fail(reader, "Invalid extended header in archive");
+        }
+        const char *key = space + 1;
+        const char *recordEnd = p + len - 1;
+        const char *equals = memchr(key, '=', recordEnd - key);
+        if (!equals) {
+            return fail(reader, "Invalid extended header in archive");
+        }
+        const char *value = equals + 1;
+        size_t valueLen = recordEnd - value;
+        if (4 == equals - key && 0 == strncmp(key, "path", 4)) {
+            if (valueLen > TAR_NAME_MAX) {
+                return fail(reader, "Name in archive is too long");
+            }
+            memcpy(reader->longName, value, valueLen);
+            reader->longName[valueLen] = '\0';
+            reader->hasLongName = 1;
+        } else if (4 == equals - key && 0 == strncmp(key, "size", 4)) {
+            char *valueEnd;
+            reader->paxSize = strtoll(value, &valueEnd, 10);
+            if (valueEnd != recordEnd || reader->paxSize < 0) {
+                return fail(reader, "Invalid size in extended header");
+            }
+        }
+        p += len;
+    }
+    return 0;
+}
+
+static int end_meta(tar_reader_t *reader) {
+    reader->state = reader->padding > 0 ? READ_PADDING : READ_HEADER;
+    if (META_LONG_NAME == reader->meta) {
+        const char *nameEnd = reader->metaLen > 0 ? memchr(reader->metaBuf, '\0', reader->metaLen) : NULL;
+        size_t len = nameEnd ? (size_t) (nameEnd - reader->metaBuf) : reader->metaLen;
+        memcpy(reader->longName, reader->metaBuf, len);
+        reader->longName[len] = '\0';
+        reader->hasLongName = 1;
+    } else if (META_PAX == reader->meta) {
+        return parse_pax(reader);
+    }
+    return 0;
+}
+
+static int append_meta(tar_reader_t *reader, const unsigned char *data, size_t len) {
+    if (META_SKIP == reader->meta) {
+        return 0;
+    }
+    if (!reader->metaBuf) {
+        reader->metaBuf = malloc(META_MAX);
+        if (!reader->metaBuf) {
+            return fail(reader, "Memory not allocated for extended header");
+        }
+    }
+    memcpy(reader->metaBuf + reader->metaLen, data, len);
+    reader->metaLen += len;
+    return 0;
+}
+
+int tar_reader_write(tar_reader_t *reader, const void *data, size_t len) {
+    const unsigned char *p = data;
+    if (reader->error) {
+        return -1;
+    }
+    while (len > 0) {
+        size_t n;
+        switch (reader->state) {
+            case READ_END:
+                return 0;
+            case READ_HEADER:
+                n = TAR_BLOCK_SIZE - reader->fill < len ? TAR_BLOCK_SIZE - reader->fill : len;
+                memcpy(reader->block + reader->fill, p, n);
+                reader->fill += n;
+                if (TAR_BLOCK_SIZE == reader->fill) {
+                    reader->fill = 0;
+                    if (parse_header(reader) < 0) {
+                        return -1;
+                    }
+                }
+                break;
+            case READ_CONTENT:
+                n = (long long) len < reader->remaining ? len : (size_t) reader->remaining;
+                if (reader->handler.data(reader->ctx, p, n) < 0) {
+                    return fail(reader, "Stopped by the handler");
+                }
+                reader->remaining -= n;
+                if (0 == reader->remaining && end_content(reader) < 0) {
+                    return -1;
+                }
+                break;
+            case READ_META:
+                n = (long long) len < reader->remaining ? len : (size_t) reader->remaining;
+                if (append_meta(reader, p, n) < 0) {
+                    return -1;
+                }
+                reader->remaining -= n;
+                if (0 == reader->remaining && end_meta(reader) < 0) {
+                    return -1;
+                }
+                break;
+            default:
+                n = len < reader->padding ? len : reader->padding;
+                reader->padding -= n;
+                if (0 == reader->padding) {
+                    reader->state = READ_HEADER;
+                }
+                break;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int tar_reader_finish(tar_reader_t *reader) {
+    if (reader->error) {
+        return -1;
+    }
+    // the zero blocks are optional, an archive may end after any complete entry
+    if (READ_END == reader->state || (READ_HEADER == reader->state && 0 == reader->fill)) {
+        return 0;
+    }
+    return fail(reader, "Archive is truncated");
+}
+
+int tar_reader_in_entry(tar_reader_t *reader) {
+    return READ_CONTENT == reader->state;
+}
+
+const char *tar_reader_error(tar_reader_t *reader) {
+    return reader->error ? reader->error : "";
+}
+
+void tar_reader_free(tar_reader_t *reader) {
+    if (!reader) {
+        return;
+    }
+    free(reader->metaBuf);
+    free(reader);
+}
@@ -0,0 +1,125 @@
+#ifndef CK_TAR_STREAM_H
+#define CK_TAR_STREAM_H
+
+#include <stddef.h>
+
+/**
+ * Size of the blocks of a tar archive, headers take one (or more for long names), contents are padded to them
+ */
+#define TAR_BLOCK_SIZE 512
+
+/**
+ * The two zero blocks ending an archive
+ */
+#define TAR_END_SIZE (2 * TAR_BLOCK_SIZE)
+
+/**
+ * Longest entry name read from an archive
+ */
+#define TAR_NAME_MAX 4096
+
+typedef enum {
+    TAR_FILE,
+    TAR_DIRECTORY,
+    TAR_OTHER                   /* links, devices and the like: the content, if any, is passed on */
+} tar_type_t;
+
+typedef struct tar_entry {
+    const char *name;           /* relative path, without a leading "./" or a trailing '/' */
+    tar_type_t type;
+    long long size;             /* bytes of content */
+    int mode;                   /* permission bits */
+    long long mtime;            /* seconds since the epoch */
+} tar_entry_t;
+
+/**
+ * @param entry a file or directory, its size and mode are not used
+ * @return number of bytes the header of the entry takes: a block, or more if the name needs a pax extended header
+ */
+size_t tar_header_size(const tar_entry_t *entry);
+
+/**
+ * write the header of an entry (ustar, with a pax extended header for long names, base-256 sizes beyond 8 GB)
+ *
+ * @param buf receives tar_header_size() bytes
+ * @param entry a file or directory
+ * @return number of bytes written
+ */
+size_t tar_write_header(char *buf, const tar_entry_t *entry);
+
+/**
+ * @param size bytes of content
+ * @return number of zero bytes which follow the content up to the next block
+ */
+size_t tar_padding(long long size);
+
+/**
+ * Streaming reader of tar archives (ustar, pax path and size records, GNU long names): the archive is passed
+ * through in parts of any size and the entries are handed to a tar_handler_t as they come, their content in
+ * pieces, so an entry is never held in memory as a whole.
+ */
+typedef struct tar_reader tar_reader_t;
+
+typedef struct tar_handler {
+    /**
+     * an entry starts, its content follows
+     * @return 0 to go on, -1 to stop reading
+     */
+    int (*begin)(void *ctx, const tar_entry_t *entry);
+
+    /**
+     * the next piece of the content of the current entry
+     * @return 0 to go on, -1 to stop reading
+     */
+    int (*data)(void *ctx, const void *data, size_t len);
+
+    /**
+     * the content of the current entry is complete
+     * @return 0 to go on, -1 to stop reading
+     */
+    int (*end)(void *ctx);
+} tar_handler_t;
+
+/**
+ * @param handler receives the entries, kept by the reader
+ * @param ctx passed to the handler
+ * @return the reader or NULL if memory could not be allocated
+ */
+tar_reader_t *tar_reader_create(const tar_handler_t *handler, void *ctx);
+
+/**
+ * pass the next part of the archive through the reader, anything after the end of the archive is ignored
+ *
+ * @param reader the reader
+ * @param data the bytes
+ * @param len number of bytes
+ * @return 0 on success, -1 on failure (see tar_reader_error())
+ */
+int tar_reader_write(tar_reader_t *reader, const void *data, size_t len);
+
+/**
+ * end the archive
+ *
+ * @param reader the reader
+ * @return 0 if it ended after a complete entry, -1 if it is truncated (see tar_reader_error())
+ */
+int tar_reader_finish(tar_reader_t *reader);
+
+/**
+ * @param reader the reader
+ * @return 1 while the content of an entry is being read, so the handler has not seen its end
+ */
+int tar_reader_in_entry(tar_reader_t *reader);
+
+/**
+ * @param reader the reader
+ * @return description of the failure
+ */
+const char *tar_reader_error(tar_reader_t *reader);
+
+/**
+ * @param reader the reader, may be NULL
+ */
+void tar_reader_free(tar_reader_t *reader);
+
+#endif
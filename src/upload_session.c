@@ -0,0 +1,528 @@
+#ifndef _WIN32
+
+#ifdef __linux__
+#define _GNU_SOURCE /* fallocate, copy_file_range */
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/statvfs.h>
+
+#include "upload_session.h"
+
+#define COPY_BUFFER_SIZE (64 * 1024)
+
+enum {
+    SESSION_OPEN,
+    SESSION_COMMITTING,         /* completed, the file is being moved to its name */
+    SESSION_COMMITTED,
+    SESSION_FAILED              /* forgotten once it is released */
+};
+
+struct upload_session {
+    upload_sessions_t *sessions;
+    char id[UPLOAD_ID_MAX_LEN + 1];
+    char *name;
+    char *path;
+    int fd;                     /* closed once a finished session is released */
+    long long total;
+    upload_range_t *ranges;     /* received, in order, neither overlapping nor adjacent */
+    int rangeCount;
+    int rangeCapacity;
+    long long received;
+    int state;
+    int refs;
+    time_t used;
+    struct upload_session *next;
+};
+
+struct upload_sessions {
+    pthread_mutex_t mutex;
+    char *dir;
+    int timeout;
+    long long maxTotal;         /* largest file, 0 - no limit besides the free space */
+    upload_session_t *list;
+};
+
+static void free_session(upload_session_t *session) {
+    if (session->fd >= 0) {
+        close(session->fd);
+    }
+    if (SESSION_OPEN == session->state) {
+        unlink(session->path);
+    }
+    free(session->ranges);
+    free(session->name);
+    free(session->path);
+    free(session);
+}
+
+static void unlink_session(upload_sessions_t *sessions, upload_session_t *session) {
+    upload_session_t **link = &sessions->list;
+    while (*link != session) {
+        link = &(*link)->next;
+    }
+    *link = session->next;
+}
+
+/**
+ * drop the sessions nobody has used for the timeout
+ */
+static void expire(upload_sessions_t *sessions) {
+    time_t now = time(NULL);
+    upload_session_t **link = &sessions->list;
+    while (*link) {
+        upload_session_t *session = *link;
+        if (0 == session->refs && now - session->used >= sessions->timeout) {
+            *link = session->next;
+            if (SESSION_OPEN == session->state) {
+                printf("[INFO]: Upload %s expired with %lld of %lld bytes\n", session->id, session->received, session->total);
+            }
+            free_session(session);
+        } else {
+            link = &session->next;
+        }
+    }
+}
+
+/**
+ * make the file its full size up front, so chunks do not fail half way for lack of space
+ */
+static int preallocate(int fd, long long total) {
+    if (0 == total) {
+        return 0;
+    }
+#ifdef __linux__
+    if (0 == fallocate(fd, 0, 0, (off_t) total)) {
+        return 0;
+    }
+    if (EOPNOTSUPP != errno && ENOSYS != errno) {
+        return -1;
+    }
+#endif
+    return ftruncate(fd, (off_t) total);
+}
+
+/**
+ * a file which could not be preallocated (see preallocate()) would take the space only as chunks arrive
+ */
+static int check_space(upload_sessions_t *sessions, long long total) {
+    struct statvfs st;
+    if (sessions->maxTotal > 0 && total > sessions->maxTotal) {
+        errno = EFBIG;
+        return -1;
+    }
+    if (0 == statvfs(sessions->dir, &st) && (unsigned long long) total > (unsigned long long) st.f_bavail * st.f_frsize) {
+        errno = ENOSPC;
+        return -1;
+    }
+    return 0;
+}
+
+static upload_session_t *new_session(upload_sessions_t *sessions, const char *id, const char *name, long long total) {
+    if (0 != check_space(sessions, total)) {
+        return NULL;
+    }
+    upload_session_t *session = calloc(1, sizeof(upload_session_t));
+    if (!session) {
+        return NULL;
+    }
+    strcpy(session->id, id);
+    session->fd = -1;
+    session->state = SESSION_FAILED; /* nothing to remove until the file is created */
+    session->name = malloc(strlen(name) + 1);
+    session->path = malloc(strlen(sessions->dir) + strlen(id) + 16);
+    if (!session->name || !session->path) {
+        free_session(session);
+        errno = ENOMEM;
+        return NULL;
+    }
+    strcpy(session->name, name);
+    sprintf(session->path, "%s.upload-%s.part", sessions->dir, id);
+    session->fd = open(session->path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (session->fd < 0) {
+        int error = errno;
+        free_session(session);
+        errno = error;
+        return NULL;
+    }
+    session->state = SESSION_OPEN;
+    if (0 != preallocate(session->fd, total)) {
+        int error = errno;
+        free_session(session);
+        errno = error;
+        return NULL;
+    }
+    session->sessions = sessions;
+    session->total = total;
+    return session;
+}
+
+upload_sessions_t *upload_sessions_create(const char *dir, int timeout, long long maxTotal) {
+    upload_sessions_t *sessions = malloc(sizeof(upload_sessions_t));
+    if (!sessions) {
+        return NULL;
+    }
+    sessions->dir = malloc(strlen(dir) + 1);
+    if (!sessions->dir) {
+        free(sessions);
+        return NULL;
+    }
+    strcpy(sessions->dir, dir);
+    pthread_mutex_init(&sessions->mutex, NULL);
+    sessions->timeout = timeout;
+    sessions->maxTotal = maxTotal;
+    sessions->list = NULL;
+    return sessions;
+}
+
+void upload_sessions_destroy(upload_sessions_t *sessions) {
+    if (!sessions) {
+        return;
+    }
+    while (sessions->list) {
+        upload_session_t *session = sessions->list;
+        sessions->list = session->next;
+        free_session(session);
+    }
+    pthread_mutex_destroy(&sessions->mutex);
+    free(sessions->dir);
+    free(sessions);
+}
+
+int upload_session_valid_id(const char *id) {
+    size_t i;
+    for (i = 0; id[i]; i++) {
+        char c = id[i];
+        if (i == UPLOAD_ID_MAX_LEN
+            || !((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || '-' == c || '_' == c)) {
+            return 0;
+        }
+    }
+    return i > 0;
+}
+
+upload_session_t *upload_session_open(upload_sessions_t *sessions, const char *id, const char *name, long long total) {
+    pthread_mutex_lock(&sessions->mutex);
+    expire(sessions);
+    upload_session_t *session = sessions->list;
+    while (session && 0 != strcmp(session->id, id)) {
+        session = session->next;
+    }
+    if (session && (session->total != total || 0 != strcmp(session->name, name))) {
+        pthread_mutex_unlock(&sessions->mutex);
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!session) {
+        session = new_session(sessions, id, name, total);
+        if (!session) {
+            int error = errno;
+            pthread_mutex_unlock(&sessions->mutex);
+            errno = error;
+            return NULL;
+        }
+        session->next = sessions->list;
+        sessions->list = session;
+    }
+    session->refs++;
+    session->used = time(NULL);
+    pthread_mutex_unlock(&sessions->mutex);
+    return session;
+}
+
+void upload_session_release(upload_sessions_t *sessions, upload_session_t *session) {
+    pthread_mutex_lock(&sessions->mutex);
+    session->refs--;
+    session->used = time(NULL);
+    if (0 == session->refs && SESSION_FAILED == session->state) {
+        unlink_session(sessions, session);
+        free_session(session);
+    } else if (0 == session->refs && SESSION_COMMITTED == session->state && session->fd >= 0) {
+        close(session->fd);
+        session->fd = -1;
+    }
+    pthread_mutex_unlock(&sessions->mutex);
+}
+
+const char *upload_session_path(upload_session_t *session) {
+    return session->path;
+}
+
+/**
+ * check that a chunk may be written
+ */
+static int check_chunk(upload_session_t *session, long long len, long long offset) {
+    pthread_mutex_lock(&session->sessions->mutex);
+    int state = session->state;
+    pthread_mutex_unlock(&session->sessions->mutex);
+    if (SESSION_OPEN != state) {
+        errno = EALREADY;
+        return -1;
+    }
+    if (offset < 0 || len < 0 || len > session->total - offset) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+int upload_session_write(upload_session_t *session, const void *data, size_t len, long long offset) {
+    if (0 != check_chunk(session, (long long) len, offset)) {
+        return -1;
+    }
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = pwrite(session->fd, p, len, (off_t) offset);
+        if (n < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= (size_t) n;
+        offset += n;
+    }
+    return 0;
+}
+
+int upload_session_copy(upload_session_t *session, int fd, long long len, long long offset) {
+    if (0 != check_chunk(session, len, offset)) {
+        return -1;
+    }
+#ifdef __linux__
+    // in the kernel, without passing the data through user space
+    while (len > 0) {
+        off_t to = (off_t) offset;
+        ssize_t n = copy_file_range(fd, NULL, session->fd, &to, (size_t) len, 0);
+        if (n < 0 && EINTR == errno) {
+            continue;
+        }
+        if (n <= 0) {
+            if (0 == n) {
+                errno = EIO; /* the file is shorter than the chunk */
+                return -1;
+            }
+            if (EXDEV == errno || ENOSYS == errno || EINVAL == errno || EOPNOTSUPP == errno) {
+                break;
+            }
+            return -1;
+        }
+        len -= n;
+        offset += n;
+    }
+#endif
+    char buf[COPY_BUFFER_SIZE];
+    while (len > 0) {
+        ssize_t n = read(fd, buf, len < (long long) sizeof(buf) ? (size_t) len : sizeof(buf));
+        if (n < 0 && EINTR == errno) {
+            continue;
+        }
+        if (n <= 0) {
+            if (0 == n) {
+                errno = EIO;
+            }
+            return -1;
+        }
+        if (0 != upload_session_write(session, buf, (size_t) n, offset)) {
+            return -1;
+        }
+        len -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+/**
+ * add a range to the received ones, merging it with the ones it overlaps or touches
+ */
+static int add_range(upload_session_t *session, long long offset, long long len) {
+    long long end = offset + len;
+    int first = 0;
+    while (first < session->rangeCount && session->ranges[first].offset + session->ranges[first].length < offset) {
+        first++;
+    }
+    int last = first;
+    while (last < session->rangeCount && session->ranges[last].offset <= end) {
+        last++;
+    }
+    if (first == last) {
+        if (session->rangeCount == session->rangeCapacity) {
+            int capacity = session->rangeCapacity ? 2 * session->rangeCapacity : 8;
+            upload_range_t *ranges = realloc(session->ranges, capacity * sizeof(upload_range_t));
+            if (!ranges) {
+                return -1;
+            }
+            session->ranges = ranges;
+            session->rangeCapacity = capacity;
+        }
+        memmove(session->ranges + first + 1, session->ranges + first, (session->rangeCount - first) * sizeof(upload_range_t));
+        session->rangeCount++;
+    } else {
+        upload_range_t *lastRange = &session->ranges[last - 1];
+        if (session->ranges[first].offset < offset) {
+            offset = session->ranges[first].offset;
+        }
+        if (lastRange->offset + lastRange->length > end) {
+            end = lastRange->offset + lastRange->length;
+        }
+        memmove(session->ranges + first + 1, session->ranges + last, (session->rangeCount - last) * sizeof(upload_range_t));
+        session->rangeCount -= last - first - 1;
+    }
+    session->ranges[first].offset = offset;
+    session->ranges[first].length = end - offset;
+
+    session->received = 0;
+    int i;
+    for (i = 0; i < session->rangeCount; i++) {
+        session->received += session->ranges[i].length;
+    }
+    return 0;
+}
+
+int upload_session_mark(upload_session_t *session, long long offset, long long len) {
+    int complete = 0;
+    pthread_mutex_lock(&session->sessions->mutex);
+    if (SESSION_OPEN == session->state && (0 == len || 0 == add_range(session, offset, len))
+        && session->received == session->total) {
+        session->state = SESSION_COMMITTING;
+        complete = 1;
+    }
+    session->used = time(NULL);
+    pthread_mutex_unlock(&session->sessions->mutex);
+    return complete;
+}
+
+void upload_session_finish(upload_session_t *session, int committed) {
+    pthread_mutex_lock(&session->sessions->mutex);
+    session->state = committed ? SESSION_COMMITTED : SESSION_FAILED;
+    if (!committed) {
+        unlink(session->path);
+    }
+    pthread_mutex_unlock(&session->sessions->mutex);
+}
+
+int upload_session_committed(upload_session_t *session) {
+    pthread_mutex_lock(&session->sessions->mutex);
+    int committed = SESSION_COMMITTED == session->state;
+    pthread_mutex_unlock(&session->sessions->mutex);
+    return committed;
+}
+
+long long upload_session_received(upload_session_t *session) {
+    pthread_mutex_lock(&session->sessions->mutex);
+    long long received = session->received;
+    pthread_mutex_unlock(&session->sessions->mutex);
+    return received;
+}
+
+int upload_session_missing(upload_session_t *session, upload_range_t *ranges, int max) {
+    int count = 0, i;
+    long long offset = 0;
+    pthread_mutex_lock(&session->sessions->mutex);
+    for (i = 0; i <= session->rangeCount && count < max; i++) {
+        long long end = i < session->rangeCount ? session->ranges[i].offset : session->total;
+        if (end > offset) {
+            ranges[count].offset = offset;
+            ranges[count].length = end - offset;
+            count++;
+        }
+        if (i < session->rangeCount) {
+            offset = session->ranges[i].offset + session->ranges[i].length;
+        }
+    }
+    pthread_mutex_unlock(&session->sessions->mutex);
+    return count;
+}
+
+#else
+
+#include "upload_session.h"
+
+/* no pwrite: there are no resumable uploads on Windows */
+upload_sessions_t *upload_sessions_create(const char *dir, int timeout, long long maxTotal) {
+    (void) dir;
+    (void) timeout;
+    (void) maxTotal;
+    return NULL;
+}
+
+void upload_sessions_destroy(upload_sessions_t *sessions) {
+    (void) sessions;
+}
+
+int upload_session_valid_id(const char *id) {
+    (void) id;
+    return 0;
+}
+
+upload_session_t *upload_session_open(upload_sessions_t *sessions, const char *id, const char *name, long long total) {
+    (void) sessions;
+    (void) id;
+    (void) name;
+    (void) total;
+    return NULL;
+}
+
+void upload_session_release(upload_sessions_t *sessions, upload_session_t *session) {
+    (void) sessions;
+    (void) session;
+}
+
+const char *upload_session_path(upload_session_t *session) {
+    (void) session;
+    return NULL;
+}
+
+int upload_session_write(upload_session_t *session, const void *data, size_t len, long long offset) {
+    (void) session;
+    (void) data;
+    (void) len;
+    (void) offset;
+    return -1;
+}
+
+int upload_session_copy(upload_session_t *session, int fd, long long len, long long offset) {
+    (void) session;
+    (void) fd;
+    (void) len;
+    (void) offset;
+    return -1;
+}
+
+int upload_session_mark(upload_session_t *session, long long offset, long long len) {
+    (void) session;
+    (void) offset;
+    (void) len;
+    return 0;
+}
+
+void upload_session_finish(upload_session_t *session, int committed) {
+    (void) session;
+    (void) committed;
+}
+
+int upload_session_committed(upload_session_t *session) {
+    (void) session;
+    return 0;
+}
+
+long long upload_session_received(upload_session_t *session) {
+    (void) session;
+    return 0;
+}
+
+int upload_session_missing(upload_session_t *session, upload_range_t *ranges, int max) {
+    (void) session;
+    (void) ranges;
+    (void) max;
+    return 0;
+}
+
+#endif
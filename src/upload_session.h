@@ -0,0 +1,134 @@
+#ifndef CK_UPLOAD_SESSION_H
+#define CK_UPLOAD_SESSION_H
+
+#include <stddef.h>
+
+/**
+ * maximum length of an upload id
+ */
+#define UPLOAD_ID_MAX_LEN 64
+
+/**
+ * Resumable uploads: the chunks of a file are written at their offsets into a temporary file, preallocated to the
+ * total size, in any order and over any number of connections. The session knows which ranges have arrived; the
+ * chunk which completes them commits the file. Idle sessions expire and their temporary files are removed.
+ * The table of sessions is thread safe.
+ */
+typedef struct upload_sessions upload_sessions_t;
+typedef struct upload_session upload_session_t;
+
+typedef struct upload_range {
+    long long offset;
+    long long length;
+} upload_range_t;
+
+/**
+ * @param dir the directory of the temporary files, with a trailing slash
+ * @param timeout seconds a session may be idle, and a completed one is remembered
+ * @param maxTotal largest total size of a session, 0 - limited only by the free space of the directory
+ * @return the table or NULL if memory could not be allocated
+ */
+upload_sessions_t *upload_sessions_create(const char *dir, int timeout, long long maxTotal);
+
+/**
+ * free the table, the temporary files of incomplete sessions are removed
+ *
+ * @param sessions the table, may be NULL
+ */
+void upload_sessions_destroy(upload_sessions_t *sessions);
+
+/**
+ * @param id a string
+ * @return 1 if it can name a session (1 to UPLOAD_ID_MAX_LEN letters, digits, '-' or '_')
+ */
+int upload_session_valid_id(const char *id);
+
+/**
+ * find a session or start it, which creates its temporary file with the total size
+ *
+ * @param sessions the table
+ * @param id a valid upload id
+ * @param name name of the file being uploaded, has to be the same for all chunks
+ * @param total size of the file, has to be the same for all chunks
+ * @return the session, to be released with upload_session_release(), or NULL with errno set (EINVAL if name or
+ *         total differ from the ones the session was started with, EFBIG if total is above the maximum, ENOSPC if
+ *         it is more than the free space)
+ */
+upload_session_t *upload_session_open(upload_sessions_t *sessions, const char *id, const char *name, long long total);
+
+/**
+ * @param sessions the table
+ * @param session the session, not used afterwards
+ */
+void upload_session_release(upload_sessions_t *sessions, upload_session_t *session);
+
+/**
+ * @param session the session
+ * @return path of the temporary file
+ */
+const char *upload_session_path(upload_session_t *session);
+
+/**
+ * write a chunk (pwrite), which is not marked as received yet
+ *
+ * @param session the session
+ * @param data the bytes
+ * @param len number of bytes
+ * @param offset position of the chunk in the file
+ * @return 0 on success, -1 otherwise (errno EINVAL if the chunk is outside the file, EALREADY if it is committed)
+ */
+int upload_session_write(upload_session_t *session, const void *data, size_t len, long long offset);
+
+/**
+ * write a chunk read from a file (copy_file_range where it is available)
+ *
+ * @param session the session
+ * @param fd the file, read from its current position
+ * @param len number of bytes
+ * @param offset position of the chunk in the file
+ * @return 0 on success, -1 otherwise (errno as for upload_session_write())
+ */
+int upload_session_copy(upload_session_t *session, int fd, long long len, long long offset);
+
+/**
+ * mark a written chunk as received
+ *
+ * @param session the session
+ * @param offset position of the chunk
+ * @param len number of bytes
+ * @return 1 if it completes the file (exactly once per session, the caller commits it), 0 otherwise
+ */
+int upload_session_mark(upload_session_t *session, long long offset, long long len);
+
+/**
+ * end a session the caller got 1 from upload_session_mark() for, a completed session is remembered until it expires
+ *
+ * @param session the session
+ * @param committed 1 if the file has been moved to its name, 0 if it could not be, the file is removed then and
+ *        the session forgotten
+ */
+void upload_session_finish(upload_session_t *session, int committed);
+
+/**
+ * @param session the session
+ * @return 1 if the file is committed
+ */
+int upload_session_committed(upload_session_t *session);
+
+/**
+ * @param session the session
+ * @return number of bytes received
+ */
+long long upload_session_received(upload_session_t *session);
+
+/**
+ * ranges not received yet, in order
+ *
+ * @param session the session
+ * @param ranges receives the first max ranges
+ * @param max size of ranges
+ * @return number of ranges written
+ */
+int upload_session_missing(upload_session_t *session, upload_range_t *ranges, int max);
+
+#endif
@@ -1,57 +1,186 @@
-#include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
 #include "urldecoder.h"
+#include "arena.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define URL_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
 
-/* Converts a hex character to its integer value */
-char from_hex(char ch) {
-    return isdigit(ch) ? ch - '0' : tolower(ch) - 'a' + 10;
+/* Values of the hex digits, -1 for other characters */
+static const signed char HEX_VALUES[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+static const char HEX_CHARS[] = "0123456789abcdef";
+
+/* Characters which are not encoded: letters, digits and -_.~ */
+static int plain_char(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')
+           || c == '-' || c == '_' || c == '.' || c == '~';
 }
 
-/* Converts an integer value to its hex character*/
-char to_hex(char code) {
-    static char hex[] = "0123456789abcdef";
-    return hex[code & 15];
+#ifdef URL_SSE2
+static unsigned int first_bit(unsigned int mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (unsigned int) index;
+#else
+    return (unsigned int) __builtin_ctz(mask);
+#endif
 }
 
-/* Returns a url-encoded version of str */
-/* IMPORTANT: be sure to free() the returned string after use */
-char *url_encode(char *str) {
-    char *pstr = str, *buf = malloc(strlen(str) * 3 + 1), *pbuf = buf;
-    while (*pstr) {
-        if (isalnum(*pstr) || *pstr == '-' || *pstr == '_' || *pstr == '.' || *pstr == '~')
-            *pbuf++ = *pstr;
-        else if (*pstr == ' ')
-            *pbuf++ = '+';
-        else
-            *pbuf++ = '%', *pbuf++ = to_hex(*pstr >> 4), *pbuf++ = to_hex(*pstr & 15);
-        pstr++;
-    }
-    *pbuf = '\0';
-    return buf;
+/* Bytes of v between lo and hi, bytes above 127 compare as negative and are never in a range of ASCII characters */
+static __m128i in_range(__m128i v, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8((char) (lo - 1))),
+                         _mm_cmplt_epi8(v, _mm_set1_epi8((char) (hi + 1))));
 }
+#endif
 
-/* Returns a url-decoded version of str */
-/* IMPORTANT: be sure to free() the returned string after use */
-char *url_decode(char *str, size_t size) {
-//    size_t size = strlen(str) + 1;
-    char *pstr = str;
-    char *buf = malloc(size);
-    char *pbuf = buf;
-    while (*pstr) {
-        if (*pstr == '%') {
-            if (pstr[1] && pstr[2]) {
-                *pbuf++ = from_hex(pstr[1]) << 4 | from_hex(pstr[2]);
-                pstr += 2;
+/* Returns the length of the prefix of str without '%' and '+' */
+static size_t plain_run(const char *str, size_t len) {
+    size_t i = 0;
+#ifdef URL_SSE2
+    const __m128i percent = _mm_set1_epi8('%');
+    const __m128i plus = _mm_set1_epi8('+');
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (str + i));
+        unsigned int mask = (unsigned int) _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, percent),
+                                                                         _mm_cmpeq_epi8(v, plus)));
+        if (mask) {
+            return i + first_bit(mask);
+        }
+    }
+#endif
+    while (i < len && str[i] != '%' && str[i] != '+') {
+        i++;
+    }
+    return i;
+}
+
+/* Returns the length of the prefix of str which is not encoded */
+static size_t unreserved_run(const char *str, size_t len) {
+    size_t i = 0;
+#ifdef URL_SSE2
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (str + i));
+        __m128i plain = _mm_or_si128(_mm_or_si128(in_range(v, 'a', 'z'), in_range(v, 'A', 'Z')),
+                                     in_range(v, '0', '9'));
+        plain = _mm_or_si128(plain, _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('-')),
+                                                              _mm_cmpeq_epi8(v, _mm_set1_epi8('_'))),
+                                                 _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('.')),
+                                                              _mm_cmpeq_epi8(v, _mm_set1_epi8('~')))));
+        unsigned int mask = (unsigned int) _mm_movemask_epi8(plain) ^ 0xFFFFu;
+        if (mask) {
+            return i + first_bit(mask);
+        }
+    }
+#endif
+    while (i < len && plain_char((unsigned char) str[i])) {
+        i++;
+    }
+    return i;
+}
+
+size_t url_decode_inplace(char *str, size_t len, size_t *errorOffset) {
+    size_t in = 0, out = 0;
+    while (in < len) {
+        // characters which stay as they are only move once something before them got shorter
+        size_t run = plain_run(str + in, len - in);
+        if (out != in) {
+            memmove(str + out, str + in, run);
+        }
+        in += run;
+        out += run;
+        if (in == len) {
+            break;
+        }
+        if (str[in] == '+') {
+            str[out++] = ' ';
+            in++;
+            continue;
+        }
+        int high = in + 1 < len ? HEX_VALUES[(unsigned char) str[in + 1]] : -1;
+        int low = in + 2 < len ? HEX_VALUES[(unsigned char) str[in + 2]] : -1;
+        if (high < 0 || low < 0) {
+            if (errorOffset) {
+                *errorOffset = in;
             }
-        } else if (*pstr == '+') {
-            *pbuf++ = ' ';
+            return URL_DECODE_ERROR;
+        }
+        str[out++] = (char) (high << 4 | low);
+        in += 3;
+    }
+    return out;
+}
+
+/* Returns a url-decoded version of str */
+/* IMPORTANT: be sure to arena_free() the returned string after use */
+char *url_decode(const char *str, size_t len) {
+    char *buf = arena_malloc(len + 1);
+    if (!buf) {
+        return NULL;
+    }
+    memcpy(buf, str, len);
+    size_t decodedLen = url_decode_inplace(buf, len, NULL);
+    if (decodedLen == URL_DECODE_ERROR) {
+        arena_free(buf);
+        return NULL;
+    }
+    buf[decodedLen] = '\0';
+    return buf;
+}
+
+size_t url_encode_n(const char *str, size_t len, char *target) {
+    size_t in = 0, out = 0;
+    while (in < len) {
+        size_t run = unreserved_run(str + in, len - in);
+        memcpy(target + out, str + in, run);
+        in += run;
+        out += run;
+        if (in == len) {
+            break;
+        }
+        unsigned char c = (unsigned char) str[in++];
+        if (c == ' ') {
+            target[out++] = '+';
         } else {
-            *pbuf++ = *pstr;
+            target[out++] = '%';
+            target[out++] = HEX_CHARS[c >> 4];
+            target[out++] = HEX_CHARS[c & 15];
         }
-        pstr++;
     }
-    *pbuf = '\0';
+    return out;
+}
+
+/* Returns a url-encoded version of str */
+/* IMPORTANT: be sure to arena_free() the returned string after use */
+char *url_encode(const char *str) {
+    size_t len = strlen(str);
+    char *buf = arena_malloc(len * 3 + 1);
+    if (!buf) {
+        return NULL;
+    }
+    buf[url_encode_n(str, len, buf)] = '\0';
     return buf;
-}
\ No newline at end of file
+}
@@ -1,9 +1,21 @@
+#include <stddef.h>
 
+/* Returned by url_decode_inplace() for a '%' which is not followed by two hex digits */
+#define URL_DECODE_ERROR ((size_t) -1)
 
-/* Returns a url-decoded version of str */
-/* IMPORTANT: be sure to free() the returned string after use */
-char *url_decode(char *str, size_t size);
+/* Decodes len characters of str in place: '+' becomes a space and %XX the byte with the hex value XX */
+/* The result is never longer than the input and is not zero terminated */
+/* Returns its length or URL_DECODE_ERROR, the offset of the malformed escape is stored in errorOffset if not NULL */
+size_t url_decode_inplace(char *str, size_t len, size_t *errorOffset);
+
+/* Returns a zero terminated, url-decoded copy of len characters of str, NULL if an escape is malformed */
+/* IMPORTANT: be sure to arena_free() the returned string after use */
+char *url_decode(const char *str, size_t len);
+
+/* Url-encodes len characters of str into target, which must have room for 3 * len characters */
+/* Returns the length of the result, which is not zero terminated */
+size_t url_encode_n(const char *str, size_t len, char *target);
 
 /* Returns a url-encoded version of str */
-/* IMPORTANT: be sure to free() the returned string after use */
-char *url_encode(char *str);
\ No newline at end of file
+/* IMPORTANT: be sure to arena_free() the returned string after use */
+char *url_encode(const char *str);
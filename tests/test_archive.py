@@ -0,0 +1,97 @@
+import io
+import json
+import os
+import tarfile
+import unittest
+
+# The following variables are initialized by test runner
+ck=None                 # CK kernel
+cfg=None                # test config
+access_test_repo=None   # convenience function to call the test repo without the need to specify its UOA and secretkey.
+                        # You just need to provide 'action' and the action's arguments
+send_request=None       # sends a raw HTTP request to the node: send_request(method, path, body, headers)
+send_command=None       # sends a JSON command straight to the node and returns the parsed result
+
+def pax_archive(records):
+    # a pax extended header with the given records followed by a small file
+    pax = tarfile.TarInfo('PaxHeaders/a.txt')
+    pax.type = tarfile.XHDTYPE
+    pax.size = len(records)
+    data = b'content'
+    info = tarfile.TarInfo('a.txt')
+    info.size = len(data)
+    out = io.BytesIO()
+    for header, content in ((pax, records), (info, data)):
+        out.write(header.tobuf(tarfile.USTAR_FORMAT))
+        out.write(content + b'\0' * ((512 - len(content) % 512) % 512))
+    out.write(b'\0' * 1024)
+    return out.getvalue()
+
+class TestArchive(unittest.TestCase):
+
+    def put_archive(self, name, body):
+        status, headers, response = send_request('PUT', '/files/%s?archive=tar&secretkey=%s' % (name, cfg['secret_key']),
+                                                  body)
+        return status, json.loads(response.decode('utf-8'))
+
+    def test_invalid_pax_records(self):
+        for records in (b'9 a=bcde\n0 x=y\n', b'0 x=y\n', b'3 \n', b'12 path=a.txt', b'99999999999999999999 x=y\n'):
+            status, r = self.put_archive('ck-archive-bad-pax', pax_archive(records))
+            self.assertEqual(400, status)
+            self.assertEqual('1', r['return'])
+            self.assertIn('extended header', r['error'])
+
+    def test_valid_pax_records(self):
+        status, r = self.put_archive('ck-archive-pax', pax_archive(b'10 a=bcde\n'))
+        self.assertEqual(200, status)
+        self.assertEqual('0', r['return'])
+        self.assertEqual(1, r['count'])
+
+    def test_mode_per_name(self):
+        if 'Windows' == cfg['platform']:
+            return
+        data = b'#!/bin/sh\necho same content\n'
+        out = io.BytesIO()
+        archive = tarfile.open(fileobj=out, mode='w')
+        for name, mode in (('plain.sh', 0o644), ('run.sh', 0o755), ('again.sh', 0o644)):
+            info = tarfile.TarInfo(name)
+            info.size = len(data)
+            info.mode = mode
+            archive.addfile(info, io.BytesIO(data))
+        archive.close()
+        status, r = self.put_archive('ck-archive-modes', out.getvalue())
+        self.assertEqual(200, status)
+        self.assertEqual(3, r['count'])
+        self.assertEqual(0, r['failed'])
+
+        dir = os.path.join(cfg['files_dir'], 'ck-archive-modes')
+        self.assertFalse(os.stat(os.path.join(dir, 'plain.sh')).st_mode & 0o100)
+        self.assertTrue(os.stat(os.path.join(dir, 'run.sh')).st_mode & 0o100)
+        self.assertFalse(os.stat(os.path.join(dir, 'again.sh')).st_mode & 0o100)
+
+    def test_archive_round_trip(self):
+        files = {'top.txt': b'top', 'sub/inner.bin': os.urandom(3000), 'sub/deeper/empty.txt': b''}
+        out = io.BytesIO()
+        archive = tarfile.open(fileobj=out, mode='w')
+        for name in sorted(files):
+            info = tarfile.TarInfo(name)
+            info.size = len(files[name])
+            archive.addfile(info, io.BytesIO(files[name]))
+        archive.close()
+        status, r = self.put_archive('ck-archive-tree', out.getvalue())
+        self.assertEqual(200, status)
+        self.assertEqual((3, 0), (r['count'], r['failed']))
+        for name in files:
+            with open(os.path.join(cfg['files_dir'], 'ck-archive-tree', name), 'rb') as f:
+                self.assertEqual(files[name], f.read())
+
+        status, headers, body = send_request('GET', '/files/ck-archive-tree?archive=tar&secretkey=%s' % cfg['secret_key'])
+        self.assertEqual(200, status)
+        self.assertEqual(str(len(body)), headers['content-length'])
+        archive = tarfile.open(fileobj=io.BytesIO(body))
+        received = dict((member.name, archive.extractfile(member).read()) for member in archive.getmembers()
+                        if member.isfile())
+        self.assertEqual(files, received)
+
+        status, headers, body = send_request('GET', '/files/ck-archive-missing?archive=tar&secretkey=%s' % cfg['secret_key'])
+        self.assertEqual(404, status)
@@ -0,0 +1,57 @@
+import base64
+import os
+import unittest
+
+# The following variables are initialized by test runner
+ck=None                 # CK kernel
+cfg=None                # test config
+access_test_repo=None   # convenience function to call the test repo without the need to specify its UOA and secretkey.
+                        # You just need to provide 'action' and the action's arguments
+send_request=None       # sends a raw HTTP request to the node: send_request(method, path, body, headers)
+send_command=None       # sends a JSON command straight to the node and returns the parsed result
+
+class TestBatch(unittest.TestCase):
+
+    def test_push_pull_batch(self):
+        contents = {'ck-batch-a.bin': os.urandom(1000), 'ck-batch-b.bin': b'', 'ck-batch-c.bin': os.urandom(100 * 1024)}
+        names = sorted(contents)
+        r = send_command({'action': 'push_batch', 'files': [
+            {'filename': name, 'file_content_base64': base64.b64encode(contents[name]).decode('ascii')} for name in names]})
+        self.assertEqual('0', r['return'])
+        self.assertEqual((3, 0), (r['count'], r['failed']))
+        self.assertEqual(names, [f['filename'] for f in r['files']])
+        for name in names:
+            with open(os.path.join(cfg['files_dir'], name), 'rb') as f:
+                self.assertEqual(contents[name], f.read())
+
+        r = send_command({'action': 'pull_batch', 'filenames': names})
+        self.assertEqual('0', r['return'])
+        self.assertEqual((3, 0), (r['count'], r['failed']))
+        for name, f in zip(names, r['files']):
+            self.assertEqual(name, f['filename'])
+            self.assertEqual('0', f['return'])
+            self.assertEqual(len(contents[name]), f['size'])
+            self.assertEqual(contents[name], base64.b64decode(f['file_content_base64']))
+
+    def test_batch_failures(self):
+        # a file which can not be moved does not stop the others
+        r = send_command({'action': 'push_batch', 'files': [
+            {'filename': '../ck-batch-escaped.bin', 'file_content_base64': 'YWJj'},
+            {'filename': 'ck-batch-no-content.bin'},
+            {'filename': 'ck-batch-ok.bin', 'file_content_base64': 'YWJj'}]})
+        self.assertEqual('0', r['return'])
+        self.assertEqual((3, 2), (r['count'], r['failed']))
+        self.assertEqual(['1', '1', '0'], [f['return'] for f in r['files']])
+        self.assertEqual('Invalid file name', r['files'][0]['error'])
+        self.assertEqual('No file content found', r['files'][1]['error'])
+
+        r = send_command({'action': 'pull_batch', 'filenames': ['ck-batch-missing.bin', '../ck-master.zip',
+                                                                'ck-batch-ok.bin']})
+        self.assertEqual((3, 2), (r['count'], r['failed']))
+        self.assertEqual('File not found', r['files'][0]['error'])
+        self.assertEqual('Invalid file name', r['files'][1]['error'])
+        self.assertEqual(b'abc', base64.b64decode(r['files'][2]['file_content_base64']))
+
+        for action in ('push_batch', 'pull_batch'):
+            r = send_command({'action': action})
+            self.assertEqual('1', r['return'])
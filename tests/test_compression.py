@@ -0,0 +1,118 @@
+import base64
+import gzip
+import io
+import json
+import os
+import unittest
+import zlib
+try:
+    from urllib.parse import urlencode
+except ImportError:
+    from urllib import urlencode
+
+# The following variables are initialized by test runner
+ck=None                 # CK kernel
+cfg=None                # test config
+access_test_repo=None   # convenience function to call the test repo without the need to specify its UOA and secretkey.
+                        # You just need to provide 'action' and the action's arguments
+send_request=None       # sends a raw HTTP request to the node: send_request(method, path, body, headers)
+send_command=None       # sends a JSON command straight to the node and returns the parsed result
+
+def gzipped(data):
+    out = io.BytesIO()
+    f = gzip.GzipFile(fileobj=out, mode='wb')
+    f.write(data)
+    f.close()
+    return out.getvalue()
+
+class TestCompression(unittest.TestCase):
+
+    def test_compressed_bomb(self):
+        # more than the max_upload_size of the test configuration once decompressed
+        bomb = base64.b64encode(gzipped(b'\0' * (65 * 1024 * 1024))).decode('ascii')
+        command = {'action': 'push', 'filename': 'ck-bomb.bin', 'compression': 'gzip', 'file_content_base64': bomb}
+        for path in ('/', '/?secretkey=' + cfg['secret_key']):
+            r = send_command(command, path=path)
+            self.assertEqual('1', r['return'])
+            self.assertIn('larger than the maximum upload size', r['error'])
+            self.assertFalse(os.path.exists(os.path.join(cfg['files_dir'], 'ck-bomb.bin')))
+        self.assertEqual([], [name for name in os.listdir(cfg['files_dir']) if name.endswith('.part')
+                              or name.endswith('.inflated')])
+
+        r = send_command({'action': 'push_batch', 'compression': 'gzip',
+                          'files': [{'filename': 'ck-bomb.bin', 'file_content_base64': bomb}]})
+        self.assertEqual(1, r['failed'])
+
+    def test_push_compressed(self):
+        path = os.path.join(cfg['files_dir'], 'ck-push-gzip.txt')
+        # buffered, and decoded while it is received
+        for content, query in ((b'compressible line\n' * 1000, ''), (os.urandom(200 * 1024), '?secretkey=' + cfg['secret_key'])):
+            r = send_command({'action': 'push', 'filename': 'ck-push-gzip.txt', 'compression': 'gzip',
+                              'file_content_base64': base64.b64encode(gzipped(content)).decode('ascii')}, path='/' + query)
+            self.assertEqual('0', r['return'])
+            with open(path, 'rb') as f:
+                self.assertEqual(content, f.read())
+        os.remove(path)
+
+    def test_push_compressed_chunks(self):
+        # offsets and the total size are those of the decompressed file
+        content = os.urandom(1000)
+        for offset in (500, 0):
+            r = send_command({'action': 'push', 'filename': 'ck-push-gzip-chunks.bin', 'upload_id': 'test-gzip-chunks',
+                              'total_size': len(content), 'offset': offset, 'compression': 'gzip',
+                              'file_content_base64': base64.b64encode(gzipped(content[offset:offset + 500])).decode('ascii')})
+            self.assertEqual('0', r['return'])
+        self.assertTrue(r['complete'])
+        path = os.path.join(cfg['files_dir'], 'ck-push-gzip-chunks.bin')
+        with open(path, 'rb') as f:
+            self.assertEqual(content, f.read())
+        os.remove(path)
+
+    def test_push_invalid_compressed_content(self):
+        # not gzip at all, and truncated
+        for content in (b'not gzip', gzipped(b'content')[:-8]):
+            r = send_command({'action': 'push', 'filename': 'ck-push-bad-gzip.txt', 'compression': 'gzip',
+                              'file_content_base64': base64.b64encode(content).decode('ascii')})
+            self.assertEqual('1', r['return'])
+            self.assertIn('Failed to decompress file', r['error'])
+        self.assertFalse(os.path.exists(os.path.join(cfg['files_dir'], 'ck-push-bad-gzip.txt')))
+
+    def test_unsupported_compression(self):
+        r = send_command({'action': 'push', 'filename': 'ck-push-lz4.txt', 'compression': 'lz4',
+                          'file_content_base64': base64.b64encode(b'content').decode('ascii')})
+        self.assertEqual('1', r['return'])
+        self.assertEqual('Unsupported compression: lz4', r['error'])
+
+    def test_pull_compressed(self):
+        content = b'compressible line\n' * 1000
+        with open(os.path.join(cfg['files_dir'], 'ck-pull-gzip.txt'), 'wb') as f:
+            f.write(content)
+        r = send_command({'action': 'pull', 'filename': 'ck-pull-gzip.txt', 'compression': 'gzip'})
+        self.assertEqual('0', r['return'])
+        self.assertEqual('gzip', r['compression'])
+        compressed = base64.b64decode(r['file_content_base64'])
+        self.assertLess(len(compressed), len(content))
+        self.assertEqual(content, zlib.decompress(compressed, 16 + zlib.MAX_WBITS))
+
+    def test_compressed_response(self):
+        content = b'compressible line\n' * 1000
+        with open(os.path.join(cfg['files_dir'], 'ck-response-gzip.txt'), 'wb') as f:
+            f.write(content)
+        def pull(filename, accept_encoding):
+            body = urlencode({'ck_json': json.dumps({'action': 'pull', 'filename': filename,
+                                                     'secretkey': cfg['secret_key']})})
+            return send_request('POST', '/', body, {'Accept-Encoding': accept_encoding,
+                                                    'Content-Type': 'application/x-www-form-urlencoded'})
+
+        status, headers, response = pull('ck-response-gzip.txt', 'br, gzip;q=0.5')
+        self.assertEqual(200, status)
+        self.assertEqual('gzip', headers.get('content-encoding'))
+        r = json.loads(zlib.decompress(response, 16 + zlib.MAX_WBITS).decode('utf-8'))
+        self.assertEqual(content, base64.b64decode(r['file_content_base64']))
+
+        # not accepted, or too small to be worth it
+        for filename, accept_encoding in (('ck-response-gzip.txt', 'gzip;q=0, identity'), ('ck-response-gzip.txt', ''),
+                                          ('ck-missing.txt', 'gzip')):
+            status, headers, response = pull(filename, accept_encoding)
+            self.assertNotIn('content-encoding', headers)
+            json.loads(response.decode('utf-8'))
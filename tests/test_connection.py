@@ -0,0 +1,157 @@
+import json
+import socket
+import time
+import unittest
+try:
+    from urllib.parse import urlencode
+except ImportError:
+    from urllib import urlencode
+
+# The following variables are initialized by test runner
+ck=None                 # CK kernel
+cfg=None                # test config
+access_test_repo=None   # convenience function to call the test repo without the need to specify its UOA and secretkey.
+                        # You just need to provide 'action' and the action's arguments
+send_request=None       # sends a raw HTTP request to the node: send_request(method, path, body, headers)
+send_command=None       # sends a JSON command straight to the node and returns the parsed result
+
+def command_request(param_dict, version='1.1', headers=''):
+    d = {'secretkey': cfg['secret_key']}
+    d.update(param_dict)
+    body = urlencode({'ck_json': json.dumps(d)}).encode('ascii')
+    return ('POST / HTTP/%s\r\nHost: localhost\r\nContent-Type: application/x-www-form-urlencoded\r\n'
+            'Content-Length: %d\r\n%s\r\n' % (version, len(body), headers)).encode('ascii') + body
+
+def push_request(version='1.1', headers=''):
+    return command_request({'action': 'push', 'filename': 'ck-connection.txt', 'file_content_base64': 'YWJj'}, version,
+                           headers)
+
+def read_response(f):
+    status_line = f.readline()
+    if not status_line:
+        return None
+    headers = {}
+    while True:
+        line = f.readline().rstrip(b'\r\n')
+        if not line:
+            break
+        name, value = line.decode('ascii').split(':', 1)
+        headers[name.strip().lower()] = value.strip()
+    body = f.read(int(headers.get('content-length', '0')))
+    return int(status_line.split()[1]), headers, body
+
+class TestConnection(unittest.TestCase):
+
+    def connect(self):
+        sock = socket.create_connection((cfg['host'], cfg['port']), timeout=30)
+        return sock, sock.makefile('rb')
+
+    def test_pipelined_requests(self):
+        sock, f = self.connect()
+        try:
+            sock.sendall(command_request({'action': 'push', 'filename': 'ck-pipelined.txt', 'file_content_base64': 'YWJj'})
+                         + command_request({'action': 'pull', 'filename': 'ck-pipelined.txt'})
+                         + command_request({'action': 'pull', 'filename': 'ck-pipelined-missing.txt'}))
+            responses = [read_response(f) for i in range(3)]
+            self.assertEqual([200, 200, 500], [status for status, headers, body in responses])
+            self.assertEqual(['keep-alive'] * 3, [headers['connection'] for status, headers, body in responses])
+            results = [json.loads(body.decode('utf-8')) for status, headers, body in responses]
+            self.assertEqual(['0', '0', '1'], [r['return'] for r in results])
+            self.assertEqual('YWJj', results[1]['file_content_base64'])
+
+            # the connection is still open for the next request
+            sock.sendall(command_request({'action': 'pull', 'filename': 'ck-pipelined.txt'}))
+            self.assertEqual(200, read_response(f)[0])
+        finally:
+            f.close()
+            sock.close()
+
+    def test_keep_alive_max_requests(self):
+        count = cfg['keep_alive_max_requests']
+        sock, f = self.connect()
+        try:
+            sock.sendall(push_request() * (count + 1))
+            responses = [read_response(f) for i in range(count)]
+            self.assertEqual([200] * count, [status for status, headers, body in responses])
+            self.assertEqual(['keep-alive'] * (count - 1) + ['close'],
+                             [headers['connection'] for status, headers, body in responses])
+            # the request beyond the limit is not answered
+            self.assertEqual(None, read_response(f))
+        finally:
+            f.close()
+            sock.close()
+
+    def test_connection_close(self):
+        sock, f = self.connect()
+        try:
+            sock.sendall(push_request(headers='Connection: close\r\n'))
+            status, headers, body = read_response(f)
+            self.assertEqual(200, status)
+            self.assertEqual('close', headers['connection'])
+            self.assertEqual(None, read_response(f))
+        finally:
+            f.close()
+            sock.close()
+
+    def test_http_1_0(self):
+        # closed after the response unless the client asks for keep-alive
+        sock, f = self.connect()
+        try:
+            sock.sendall(push_request('1.0'))
+            status, headers, body = read_response(f)
+            self.assertEqual(200, status)
+            self.assertEqual('close', headers['connection'])
+            self.assertEqual(None, read_response(f))
+        finally:
+            f.close()
+            sock.close()
+
+        sock, f = self.connect()
+        try:
+            request = push_request('1.0', 'Connection: keep-alive\r\n')
+            sock.sendall(request * 2)
+            for i in range(2):
+                status, headers, body = read_response(f)
+                self.assertEqual(200, status)
+                self.assertEqual('keep-alive', headers['connection'])
+        finally:
+            f.close()
+            sock.close()
+
+    def test_idle_timeout(self):
+        sock, f = self.connect()
+        try:
+            sock.sendall(push_request())
+            self.assertEqual('keep-alive', read_response(f)[1]['connection'])
+            start = time.time()
+            self.assertEqual(b'', sock.recv(1))
+            # the idle connections are looked at about once a second
+            self.assertGreaterEqual(time.time() - start, cfg['keep_alive_timeout'] - 1)
+        finally:
+            f.close()
+            sock.close()
+
+    def test_parser_errors(self):
+        for request, status, error in (
+                (b'G@T / HTTP/1.1\r\n\r\n', 400, 'Invalid request method'),
+                (b'GET  HTTP/1.1\r\n\r\n', 400, 'Empty request path'),
+                (b'GET /\r\n\r\n', 400, 'Missing HTTP version'),
+                (b'GET / HTTP/2.0\r\n\r\n', 505, 'Unsupported HTTP version'),
+                (b'GET / HTTP/1.1\r\nBad Header: 1\r\n\r\n', 400, 'Invalid header name'),
+                (b'POST / HTTP/1.1\r\nContent-Length: 12a\r\n\r\n', 400, 'Invalid Content-Length'),
+                (b'POST / HTTP/1.1\r\nContent-Length: 99999999999999999999\r\n\r\n', 413, 'Request body is too large'),
+                (b'GET / HTTP/1.1\r\nX-Large: ' + b'a' * 17000 + b'\r\n\r\n', 431, 'Request headers are too large'),
+                (b'GET / HTTP/1.1\r\n' + b'X-Header: 1\r\n' * 65 + b'\r\n', 431, 'Too many request headers'),
+                (b'POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n', 501,
+                 'Transfer-Encoding is not supported for requests')):
+            sock, f = self.connect()
+            try:
+                sock.sendall(request)
+                response_status, headers, body = read_response(f)
+                self.assertEqual(status, response_status, error)
+                self.assertEqual('close', headers['connection'])
+                self.assertEqual(error, json.loads(body.decode('utf-8'))['error'])
+                self.assertEqual(None, read_response(f))
+            finally:
+                f.close()
+                sock.close()
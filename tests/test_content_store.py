@@ -0,0 +1,64 @@
+import base64
+import hashlib
+import os
+import unittest
+
+# The following variables are initialized by test runner
+ck=None                 # CK kernel
+cfg=None                # test config
+access_test_repo=None   # convenience function to call the test repo without the need to specify its UOA and secretkey.
+                        # You just need to provide 'action' and the action's arguments
+send_request=None       # sends a raw HTTP request to the node: send_request(method, path, body, headers)
+send_command=None       # sends a JSON command straight to the node and returns the parsed result
+
+def push(filename, content):
+    return send_command({'action': 'push', 'filename': filename,
+                         'file_content_base64': base64.b64encode(content).decode('ascii')})
+
+class TestContentStore(unittest.TestCase):
+
+    def test_has(self):
+        content = b'content store test ' + os.urandom(16)
+        digest = hashlib.sha256(content).hexdigest()
+        r = send_command({'action': 'has', 'hashes': [digest, 'not a hash']})
+        self.assertEqual('0', r['return'])
+        self.assertEqual([digest, 'not a hash'], r['missing'])
+
+        r = push('ck-store-has.txt', content)
+        self.assertEqual('0', r['return'])
+        self.assertEqual(digest, r['hash'])
+
+        r = send_command({'action': 'has', 'hashes': [digest]})
+        self.assertEqual([], r['missing'])
+
+    def test_push_by_hash(self):
+        content = b'pushed by hash ' + os.urandom(16)
+        digest = hashlib.sha256(content).hexdigest()
+        r = send_command({'action': 'push', 'filename': 'ck-store-by-hash.txt', 'hash': digest})
+        self.assertEqual('1', r['return'])
+
+        push('ck-store-by-hash-1.txt', content)
+        r = send_command({'action': 'push', 'filename': 'ck-store-by-hash-2.txt', 'hash': digest})
+        self.assertEqual('0', r['return'])
+        with open(os.path.join(cfg['files_dir'], 'ck-store-by-hash-2.txt'), 'rb') as f:
+            self.assertEqual(content, f.read())
+
+        r = send_command({'action': 'push', 'filename': 'ck-store-by-hash-3.txt', 'hash': '0' * 64,
+                          'file_content_base64': base64.b64encode(content).decode('ascii')})
+        self.assertEqual('1', r['return'])
+
+    def test_files_do_not_share_content(self):
+        content = b'shared content ' + os.urandom(16)
+        digest = hashlib.sha256(content).hexdigest()
+        push('ck-store-one.txt', content)
+        push('ck-store-two.txt', content)
+        send_command({'action': 'push', 'filename': 'ck-store-three.txt', 'hash': digest})
+
+        with open(os.path.join(cfg['files_dir'], 'ck-store-one.txt'), 'ab') as f:
+            f.write(b'tampered\n')
+
+        for name in ('ck-store-two.txt', 'ck-store-three.txt'):
+            with open(os.path.join(cfg['files_dir'], name), 'rb') as f:
+                self.assertEqual(content, f.read())
+        r = send_command({'action': 'pull', 'filename': 'ck-store-two.txt'})
+        self.assertEqual(content, base64.b64decode(r['file_content_base64']))
@@ -2,13 +2,23 @@
 import shutil
 import os
 import filecmp
+import socket
+import base64
+import json
+import zlib
 import unittest
+try:
+    from urllib.parse import urlencode
+except ImportError:
+    from urllib import urlencode
 
 # The following variables are initialized by test runner
 ck=None                 # CK kernel
 cfg=None                # test config
 access_test_repo=None   # convenience function to call the test repo without the need to specify its UOA and secretkey.
                         # You just need to provide 'action' and the action's arguments
+send_request=None       # sends a raw HTTP request to the node: send_request(method, path, body, headers)
+send_command=None       # sends a JSON command straight to the node and returns the parsed result
 
 class TestPushPull(unittest.TestCase):
 
@@ -30,3 +40,108 @@ class TestPushPull(unittest.TestCase):
                 os.remove(tmp_file)
             except: pass
 
+
+    def push_command(self, filename, content):
+        return {'action': 'push', 'filename': filename, 'file_content_base64': base64.b64encode(content).decode('ascii')}
+
+    def temp_files(self):
+        return [name for name in os.listdir(cfg['files_dir']) if name.endswith('.part')]
+
+    def test_push_streamed(self):
+        content = os.urandom(300 * 1024)
+        # the key is in the JSON only, as stock CK clients send it, or in the request line or a header as well
+        for path, headers in (('/', {}), ('/?secretkey=' + cfg['secret_key'], {}),
+                              ('/', {'X-CK-Secret-Key': cfg['secret_key']})):
+            r = send_command(self.push_command('ck-push-streamed.bin', content), headers, path)
+            self.assertEqual('0', r['return'])
+            r = send_command({'action': 'pull', 'filename': 'ck-push-streamed.bin'})
+            self.assertEqual(content, base64.b64decode(r['file_content_base64']))
+
+    def test_push_streamed_wrong_key(self):
+        content = os.urandom(300 * 1024)
+        command = self.push_command('ck-push-wrong-key.bin', content)
+        for path, headers in (('/?secretkey=wrong', {}), ('/', {'X-CK-Secret-Key': 'wrong'})):
+            r = send_command(command, headers, path)
+            self.assertEqual(403, r['http_status'])
+            self.assertEqual([], self.temp_files())
+        command['secretkey'] = 'wrong'
+        r = send_command(command)
+        self.assertEqual('3', r['return'])
+        self.assertEqual([], self.temp_files())
+        self.assertFalse(os.path.exists(os.path.join(cfg['files_dir'], 'ck-push-wrong-key.bin')))
+
+    def test_request_body_too_large(self):
+        sock = socket.create_connection((cfg['host'], cfg['port']), timeout=30)
+        try:
+            sock.sendall(b'POST / HTTP/1.1\r\nHost: localhost\r\nContent-Length: 4294967296\r\n\r\nck_json=')
+            self.assertIn(b' 413 ', sock.recv(4096).split(b'\r\n')[0])
+        finally:
+            sock.close()
+
+    def test_unsafe_file_names(self):
+        for name in ('../ck-escaped.txt', '/tmp/ck-escaped.txt', 'a/../../ck-escaped.txt', '..\\ck-escaped.txt'):
+            r = send_command(self.push_command(name, b'content'))
+            self.assertEqual('1', r['return'])
+            self.assertEqual('Invalid file name', r['error'])
+            r = send_command({'action': 'pull', 'filename': name})
+            self.assertEqual('1', r['return'])
+            self.assertEqual('Invalid file name', r['error'])
+        self.assertFalse(os.path.exists(os.path.join(cfg['files_dir'], '..', 'ck-escaped.txt')))
+
+    def test_pull_large(self):
+        content = os.urandom(3 * 1024 * 1024 + 17)
+        with open(os.path.join(cfg['files_dir'], 'ck-pull-large.bin'), 'wb') as f:
+            f.write(content)
+        r = send_command({'action': 'pull', 'filename': 'ck-pull-large.bin'})
+        self.assertEqual('0', r['return'])
+        self.assertEqual(content, base64.b64decode(r['file_content_base64']))
+
+        r = send_command({'action': 'pull', 'filename': 'ck-pull-large.bin', 'offset': 1000, 'length': 2 * 1024 * 1024})
+        self.assertEqual(content[1000:1000 + 2 * 1024 * 1024], base64.b64decode(r['file_content_base64']))
+
+        r = send_command({'action': 'pull', 'filename': 'ck-pull-large.bin', 'compression': 'gzip'})
+        self.assertEqual('gzip', r['compression'])
+        self.assertEqual(content, zlib.decompress(base64.b64decode(r['file_content_base64']), 16 + zlib.MAX_WBITS))
+
+    def test_pull_range(self):
+        content = os.urandom(10000)
+        with open(os.path.join(cfg['files_dir'], 'ck-pull-range.bin'), 'wb') as f:
+            f.write(content)
+        r = send_command({'action': 'pull', 'filename': 'ck-pull-range.bin', 'offset': 100, 'length': 50})
+        self.assertEqual('0', r['return'])
+        self.assertEqual((100, 50, len(content)), (r['offset'], r['length'], r['size']))
+        self.assertEqual(content[100:150], base64.b64decode(r['file_content_base64']))
+
+        # the length is cut at the end of the file
+        r = send_command({'action': 'pull', 'filename': 'ck-pull-range.bin', 'offset': 9000, 'length': 5000})
+        self.assertEqual(1000, r['length'])
+        self.assertEqual(content[9000:], base64.b64decode(r['file_content_base64']))
+
+        for offset in (-1, len(content) + 1):
+            r = send_command({'action': 'pull', 'filename': 'ck-pull-range.bin', 'offset': offset})
+            self.assertEqual('1', r['return'])
+            self.assertEqual('Range not satisfiable', r['error'])
+
+    def test_pull_large_compressed_response(self):
+        content = b'compressible line\n' * (200 * 1024)
+        with open(os.path.join(cfg['files_dir'], 'ck-pull-large.txt'), 'wb') as f:
+            f.write(content)
+        body = urlencode({'ck_json': json.dumps({'action': 'pull', 'filename': 'ck-pull-large.txt',
+                                                 'secretkey': cfg['secret_key']})})
+        status, headers, response = send_request('POST', '/', body, {'Accept-Encoding': 'gzip',
+                                                                     'Content-Type': 'application/x-www-form-urlencoded'})
+        self.assertEqual(200, status)
+        self.assertEqual('gzip', headers.get('content-encoding'))
+        self.assertLess(len(response), len(content))
+        r = json.loads(zlib.decompress(response, 16 + zlib.MAX_WBITS).decode('utf-8'))
+        self.assertEqual(content, base64.b64decode(r['file_content_base64']))
+
+    def test_push_empty_file(self):
+        for encoded in ('', '===='):
+            r = send_command({'action': 'push', 'filename': 'ck-push-empty.txt', 'file_content_base64': encoded})
+            self.assertEqual('0', r['return'])
+            self.assertEqual(0, os.path.getsize(os.path.join(cfg['files_dir'], 'ck-push-empty.txt')))
+            r = send_command({'action': 'push_batch', 'files': [{'filename': 'ck-push-empty-batch.txt',
+                                                                 'file_content_base64': encoded}]})
+            self.assertEqual(0, r['failed'])
+            self.assertEqual(0, os.path.getsize(os.path.join(cfg['files_dir'], 'ck-push-empty-batch.txt')))
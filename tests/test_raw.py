@@ -0,0 +1,103 @@
+import json
+import os
+import unittest
+
+# The following variables are initialized by test runner
+ck=None                 # CK kernel
+cfg=None                # test config
+access_test_repo=None   # convenience function to call the test repo without the need to specify its UOA and secretkey.
+                        # You just need to provide 'action' and the action's arguments
+send_request=None       # sends a raw HTTP request to the node: send_request(method, path, body, headers)
+send_command=None       # sends a JSON command straight to the node and returns the parsed result
+
+class TestRaw(unittest.TestCase):
+
+    def put_file(self, name, body, secret_key=None):
+        status, headers, response = send_request('PUT', '/files/%s?secretkey=%s' % (name, secret_key or cfg['secret_key']),
+                                                  body)
+        return status, json.loads(response.decode('utf-8'))
+
+    def test_put(self):
+        content = os.urandom(300 * 1024)
+        path = os.path.join(cfg['files_dir'], 'ck-raw-put.bin')
+        try:
+            status, r = self.put_file('ck-raw-put.bin', content)
+            self.assertEqual(200, status)
+            self.assertEqual('0', r['return'])
+            self.assertEqual(len(content), r['size'])
+            with open(path, 'rb') as f:
+                self.assertEqual(content, f.read())
+
+            # an empty body makes an empty file
+            status, r = self.put_file('ck-raw-put.bin', b'')
+            self.assertEqual(200, status)
+            self.assertEqual(0, os.path.getsize(path))
+        finally:
+            if os.path.exists(path):
+                os.remove(path)
+
+    def test_put_wrong_key(self):
+        status, r = self.put_file('ck-raw-put-denied.bin', b'content', 'wrong-key')
+        self.assertEqual(403, status)
+        self.assertNotEqual('0', r['return'])
+        self.assertFalse(os.path.exists(os.path.join(cfg['files_dir'], 'ck-raw-put-denied.bin')))
+
+    def test_put_unsafe_name(self):
+        for name in ('..%2Fck-raw-escape.bin', '%2Ftmp%2Fck-raw-escape.bin'):
+            status, r = self.put_file(name, b'content')
+            self.assertEqual(400, status)
+            self.assertEqual('Invalid file name', r['error'])
+        self.assertFalse(os.path.exists(os.path.join(os.path.dirname(os.path.normpath(cfg['files_dir'])),
+                                                     'ck-raw-escape.bin')))
+
+    def get_file(self, name, query='', headers={}):
+        return send_request('GET', '/files/%s?secretkey=%s%s' % (name, cfg['secret_key'], query), headers=headers)
+
+    def test_get(self):
+        content = os.urandom(300 * 1024)
+        path = os.path.join(cfg['files_dir'], 'ck-raw-get.bin')
+        with open(path, 'wb') as f:
+            f.write(content)
+        try:
+            status, headers, body = self.get_file('ck-raw-get.bin')
+            self.assertEqual(200, status)
+            self.assertEqual(str(len(content)), headers['content-length'])
+            self.assertEqual('bytes', headers['accept-ranges'])
+            self.assertEqual(content, body)
+        finally:
+            os.remove(path)
+
+    def test_get_missing_file(self):
+        status, headers, body = self.get_file('ck-raw-missing.bin')
+        self.assertEqual(404, status)
+        self.assertEqual('1', json.loads(body.decode('utf-8'))['return'])
+
+    def test_get_wrong_key(self):
+        status, headers, body = send_request('GET', '/files/ck-master.zip?secretkey=wrong-key')
+        self.assertEqual(403, status)
+
+    def test_get_ranges(self):
+        content = os.urandom(100 * 1024)
+        size = len(content)
+        path = os.path.join(cfg['files_dir'], 'ck-raw-range.bin')
+        with open(path, 'wb') as f:
+            f.write(content)
+        try:
+            for header, first, last in (('bytes=0-99', 0, 99), ('bytes=1000-', 1000, size - 1),
+                                        ('bytes=-500', size - 500, size - 1), ('bytes=5000-999999', 5000, size - 1)):
+                status, headers, body = self.get_file('ck-raw-range.bin', headers={'Range': header})
+                self.assertEqual(206, status)
+                self.assertEqual('bytes %d-%d/%d' % (first, last, size), headers['content-range'])
+                self.assertEqual(content[first:last + 1], body)
+
+            status, headers, body = self.get_file('ck-raw-range.bin', '&offset=2000&length=300')
+            self.assertEqual(206, status)
+            self.assertEqual('bytes 2000-2299/%d' % size, headers['content-range'])
+            self.assertEqual(content[2000:2300], body)
+
+            for query, headers in (('', {'Range': 'bytes=%d-' % size}), ('&offset=%d' % size, {}), ('&length=0', {})):
+                status, response_headers, body = self.get_file('ck-raw-range.bin', query, headers)
+                self.assertEqual(416, status)
+                self.assertEqual('bytes */%d' % size, response_headers['content-range'])
+        finally:
+            os.remove(path)
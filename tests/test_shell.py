@@ -1,11 +1,21 @@
 
+import json
+import os
+import socket
+import time
 import unittest
+try:
+    from urllib.parse import urlencode
+except ImportError:
+    from urllib import urlencode
 
 # The following variables are initialized by test runner
 ck=None                 # CK kernel
 cfg=None                # test config
 access_test_repo=None   # convenience function to call the test repo without the need to specify its UOA and secretkey.
                         # You just need to provide 'action' and the action's arguments
+send_request=None       # sends a raw HTTP request to the node: send_request(method, path, body, headers)
+send_command=None       # sends a JSON command straight to the node and returns the parsed result
 
 class TestPushPull(unittest.TestCase):
 
@@ -15,3 +25,164 @@ class TestPushPull(unittest.TestCase):
         self.assertIn('stdout', r)
         self.assertIn('return_code', r)
         self.assertIn('stderr', r)
+
+    def test_shell_without_cmd(self):
+        r = send_command({'action': 'shell'})
+        self.assertEqual('1', r['return'])
+        self.assertEqual('Invalid action JSON format for message: no cmd found', r['error'])
+
+    def test_shell_benchmark(self):
+        if 'Windows' == cfg['platform']:
+            return
+        counter = '/tmp/ck-crowdnode-benchmark-%d' % os.getpid()
+        try:
+            # the warmup runs are run but not measured, the output is the one of the last run
+            r = send_command({'action': 'shell', 'cmd': 'echo run >> %s; wc -l < %s' % (counter, counter),
+                              'repeat': 5, 'warmup': 2})
+            self.assertEqual('0', r['return'])
+            self.assertEqual('7', r['stdout'].strip())
+            benchmark = r['benchmark']
+            self.assertEqual((2, 5, False), (benchmark['warmup'], benchmark['runs'], benchmark['converged']))
+            self.assertEqual(5, len(benchmark['times']))
+            for field in ('median', 'mean', 'stddev', 'min', 'max', 'outliers', 'rci'):
+                self.assertIn(field, benchmark)
+            self.assertLessEqual(benchmark['min'], benchmark['median'])
+            self.assertLessEqual(benchmark['median'], benchmark['max'])
+            self.assertEqual(min(benchmark['times']), benchmark['min'])
+            self.assertEqual(max(benchmark['times']), benchmark['max'])
+        finally:
+            if os.path.exists(counter):
+                os.remove(counter)
+
+        # a target every confidence interval meets stops the runs as soon as the statistics are applied
+        r = send_command({'action': 'shell', 'cmd': 'true', 'repeat': 50, 'min_repeat': 3, 'target_rci': 100})
+        self.assertEqual('0', r['return'])
+        benchmark = r['benchmark']
+        self.assertEqual((3, True), (benchmark['runs'], benchmark['converged']))
+        self.assertLessEqual(benchmark['rci'], 100)
+
+    def stream_shell(self, cmd, version):
+        body = urlencode({'ck_json': json.dumps({'secretkey': cfg['secret_key'], 'action': 'shell', 'cmd': cmd,
+                                                 'stream': True})}).encode('ascii')
+        sock = socket.create_connection((cfg['host'], cfg['port']), timeout=30)
+        try:
+            sock.sendall(('POST / HTTP/%s\r\nHost: localhost\r\nContent-Type: application/x-www-form-urlencoded\r\n'
+                          'Content-Length: %d\r\n\r\n' % (version, len(body))).encode('ascii') + body)
+            response = b''
+            while True:
+                data = sock.recv(65536)
+                if not data:
+                    break
+                response += data
+        finally:
+            sock.close()
+        head, body = response.split(b'\r\n\r\n', 1)
+        lines = head.decode('ascii').split('\r\n')
+        self.assertIn(' 200 ', lines[0])
+        headers = dict((name.strip().lower(), value.strip()) for name, value in (l.split(':', 1) for l in lines[1:]))
+        self.assertEqual('application/x-ndjson', headers['content-type'])
+        self.assertEqual('close', headers['connection'])
+        return headers, body
+
+    def check_shell_frames(self, frames):
+        self.assertEqual('out\n', ''.join(f['data'] for f in frames if 'stdout' == f['stream']))
+        self.assertEqual('err\n', ''.join(f['data'] for f in frames if 'stderr' == f['stream']))
+        self.assertEqual({'return': '0', 'stream': 'exit', 'return_code': 3, 'signal': 0}, frames[-1])
+        self.assertEqual(1, len([f for f in frames if 'exit' == f['stream']]))
+
+    def test_shell_stream(self):
+        if 'Windows' == cfg['platform']:
+            return
+        cmd = 'echo out; sleep 0.1; echo err 1>&2; exit 3'
+        headers, body = self.stream_shell(cmd, '1.1')
+        self.assertEqual('chunked', headers['transfer-encoding'])
+        # every frame is a chunk of its own, the response ends with the zero length chunk
+        frames = []
+        while True:
+            size_line, body = body.split(b'\r\n', 1)
+            size = int(size_line, 16)
+            self.assertEqual(b'\r\n', body[size:size + 2])
+            if 0 == size:
+                self.assertEqual(b'\r\n', body)
+                break
+            self.assertEqual(b'\n', body[size - 1:size])
+            frames.append(json.loads(body[:size].decode('utf-8')))
+            body = body[size + 2:]
+        self.check_shell_frames(frames)
+
+        # HTTP/1.0 clients get the frames until the connection is closed
+        headers, body = self.stream_shell(cmd, '1.0')
+        self.assertNotIn('transfer-encoding', headers)
+        self.assertTrue(body.endswith(b'\n'))
+        self.check_shell_frames([json.loads(line) for line in body.decode('utf-8').splitlines()])
+
+    def state(self, run_uuid):
+        return send_command({'action': 'state', 'parameters': {'runUUID': run_uuid}})
+
+    def test_shell_async(self):
+        if 'Windows' == cfg['platform']:
+            return
+        r = send_command({'action': 'shell', 'cmd': 'echo out; echo err 1>&2; exit 3', 'async': 'yes'})
+        self.assertEqual('0', r['return'])
+        self.assertIn(r['state'], ('queued', 'running'))
+        run_uuid = r['runUUID']
+
+        deadline = time.time() + 30
+        while r['state'] in ('queued', 'running') and time.time() < deadline:
+            time.sleep(0.05)
+            r = self.state(run_uuid)
+            self.assertEqual('0', r['return'])
+            self.assertEqual(run_uuid, r['runUUID'])
+        self.assertEqual('finished', r['state'])
+        self.assertEqual(3, r['return_code'])
+        self.assertEqual('out\n', r['stdout'])
+        self.assertEqual('err\n', r['stderr'])
+
+        # a finished job is kept for later state requests
+        self.assertEqual('finished', self.state(run_uuid)['state'])
+
+    def submit(self, cmd, exclusive=False):
+        r = send_command({'action': 'shell', 'cmd': cmd, 'async': 'yes', 'exclusive': 'yes' if exclusive else 'no'})
+        self.assertEqual('0', r['return'])
+        return r['runUUID']
+
+    def wait_for_states(self, run_uuids, states):
+        deadline = time.time() + 30
+        while True:
+            current = [self.state(run_uuid)['state'] for run_uuid in run_uuids]
+            if all(state in states for state in current) or time.time() > deadline:
+                return current
+            time.sleep(0.05)
+
+    def test_exclusive_job(self):
+        if 'Windows' == cfg['platform']:
+            return
+        slots = cfg['max_running_jobs']
+        running = [self.submit('sleep 2') for i in range(slots)]
+        self.assertEqual(['running'] * slots, self.wait_for_states(running, ('running',)))
+
+        # the exclusive job waits for all running ones, the job behind it waits for the exclusive one
+        exclusive = self.submit('echo exclusive', True)
+        behind = self.submit('echo behind')
+        time.sleep(0.2)
+        self.assertEqual(['queued', 'queued'], [self.state(exclusive)['state'], self.state(behind)['state']])
+        self.assertEqual(['running'] * slots, [self.state(run_uuid)['state'] for run_uuid in running])
+
+        self.assertEqual('finished', self.wait_for_states([exclusive], ('finished',))[0])
+        self.assertEqual(['finished'] * slots, [self.state(run_uuid)['state'] for run_uuid in running])
+        self.assertEqual('exclusive\n', self.state(exclusive)['stdout'])
+        self.assertEqual('finished', self.wait_for_states([behind], ('finished',))[0])
+
+        # every slot is free again
+        after = [self.submit('sleep 1') for i in range(slots)]
+        self.assertEqual(['running'] * slots, self.wait_for_states(after, ('running',)))
+        self.assertEqual(['finished'] * slots, self.wait_for_states(after, ('finished',)))
+
+    def test_state_unknown_run(self):
+        r = self.state('00000000-0000-0000-0000-000000000000')
+        self.assertEqual('1', r['return'])
+        self.assertEqual('Unknown runUUID', r['error'])
+
+        r = send_command({'action': 'state'})
+        self.assertEqual('1', r['return'])
+        self.assertEqual('Invalid action JSON format for message: no runUUID found', r['error'])
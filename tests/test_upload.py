@@ -0,0 +1,57 @@
+import base64
+import os
+import unittest
+
+# The following variables are initialized by test runner
+ck=None                 # CK kernel
+cfg=None                # test config
+access_test_repo=None   # convenience function to call the test repo without the need to specify its UOA and secretkey.
+                        # You just need to provide 'action' and the action's arguments
+send_request=None       # sends a raw HTTP request to the node: send_request(method, path, body, headers)
+send_command=None       # sends a JSON command straight to the node and returns the parsed result
+
+CHUNK_SIZE = 64 * 1024
+
+class TestUpload(unittest.TestCase):
+
+    def push_chunk(self, upload_id, filename, total, offset, data=None):
+        command = {'action': 'push', 'filename': filename, 'upload_id': upload_id, 'total_size': total,
+                   'offset': offset}
+        if data is not None:
+            command['file_content_base64'] = base64.b64encode(data).decode('ascii')
+        return send_command(command)
+
+    def test_chunked_push(self):
+        upload_id = 'test-' + base64.b16encode(os.urandom(8)).decode('ascii')
+        content = os.urandom(3 * CHUNK_SIZE + 100)
+        offsets = [3 * CHUNK_SIZE, CHUNK_SIZE, 0]
+
+        for offset in offsets:
+            r = self.push_chunk(upload_id, 'ck-upload.bin', len(content), offset, content[offset:offset + CHUNK_SIZE])
+            self.assertEqual('0', r['return'])
+            self.assertFalse(r['complete'])
+        self.assertEqual([[2 * CHUNK_SIZE, CHUNK_SIZE]], r['missing'])
+
+        # a dropped connection is resumed by asking for the missing ranges
+        r = self.push_chunk(upload_id, 'ck-upload.bin', len(content), 0)
+        self.assertEqual([[2 * CHUNK_SIZE, CHUNK_SIZE]], r['missing'])
+        self.assertEqual(len(content) - CHUNK_SIZE, r['received'])
+
+        offset = 2 * CHUNK_SIZE
+        r = self.push_chunk(upload_id, 'ck-upload.bin', len(content), offset, content[offset:offset + CHUNK_SIZE])
+        self.assertTrue(r['complete'])
+        with open(os.path.join(cfg['files_dir'], 'ck-upload.bin'), 'rb') as f:
+            self.assertEqual(content, f.read())
+
+        r = self.push_chunk(upload_id, 'ck-other.bin', len(content), 0)
+        self.assertEqual('1', r['return'])
+
+    def test_chunk_outside_file(self):
+        r = self.push_chunk('test-outside', 'ck-upload-outside.bin', 10, 8, b'0123')
+        self.assertEqual('1', r['return'])
+
+    def test_total_size_too_large(self):
+        r = self.push_chunk('test-too-large', 'ck-upload-large.bin', 1 << 50, 0)
+        self.assertEqual('1', r['return'])
+        self.assertIn('larger than the maximum upload size', r['error'])
+        self.assertFalse([name for name in os.listdir(cfg['files_dir']) if name.startswith('.upload-test-too-large')])